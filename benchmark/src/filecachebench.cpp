@@ -0,0 +1,473 @@
+/**
+ * Synthetic farm load for FileCache.
+ *
+ * Usage: filecachebench [-t tree] [-n files] [-d fixed|uniform|loguniform]
+ *                       [-s min,max] [-z zipf] [-m cache size in MB]
+ *                       [-p processes] [-j threads] [-r requests] [-R seed] [-w]
+ *                       [-L latency in ms] [-B bandwidth in MB/s]
+ *
+ * Builds a tree of files under <tree>/remote (reused if it is already there),
+ * which the cache treats as remote via FILECACHE_REMOTE, and a cache at
+ * <tree>/cache (emptied first unless -w is given for a warm start).
+ *
+ * Then forks the given number of processes, each running the given number of
+ * threads with their own FileCache instance. Every thread picks files with a
+ * Zipf distribution (exponent -z, 0 means uniform) and calls cacheFile() and
+ * releaseFile() on them. File sizes are given in KB.
+ *
+ * -L and -B make the tree behave like a file server (see ThrottledBackend),
+ * with every process getting its own link.
+ *
+ * Reports the hit ratio, throughput, p50/p99 latency of cacheFile() and the
+ * bytes copied and evicted, summed over all processes.
+ *
+ *   filecachebench -n 2000 -s 16,65536 -d loguniform -m 2000 -p 8 -j 4
+ *
+ */
+#include <filecache.hpp>
+#include <cachestats.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+using namespace std;
+
+
+struct Options {
+	string tree;
+	unsigned files;
+	string distribution;
+	uintmax_t minSize, maxSize;
+	double zipf;
+	uintmax_t cacheSize;
+	unsigned processes, threads, requests;
+	unsigned seed;
+	bool warm;
+	string latency, bandwidth;
+};
+
+
+// What a process reports to the parent, followed by its latency samples
+struct Report {
+	boost::uint64_t requests;
+	boost::uint64_t hits, misses, stalePinned;
+	boost::uint64_t bytesIn, evictions, evictedBytes;
+	double seconds;
+};
+
+
+static void usage( const char* name ) {
+	cerr << "Usage: " << name << " [-t tree] [-n files] [-d fixed|uniform|loguniform] [-s min,max KB]" << endl
+	     << "       [-z zipf] [-m cache size in MB] [-p processes] [-j threads] [-r requests] [-R seed] [-w]" << endl
+	     << "       [-L latency in ms] [-B bandwidth in MB/s]" << endl;
+}
+
+
+static string file_name( const Options& options, unsigned i ) {
+	ostringstream name;
+	name << options.tree << "/remote/" << setfill( '0' ) << setw( 3 ) << i % 100 << "/file" << setw( 6 ) << i << ".dat";
+
+	return name.str();
+}
+
+
+static uintmax_t file_size( const Options& options, unsigned i ) {
+	// Sizes only depend on the seed so a tree can be reused
+	unsigned state( options.seed + i * 2654435761u );
+	double u( rand_r( &state ) / ( RAND_MAX + 1.0 ) );
+
+	double kb;
+
+	if( "fixed" == options.distribution ) {
+		kb = options.minSize;
+	} else if( "uniform" == options.distribution ) {
+		kb = options.minSize + u * ( options.maxSize - options.minSize );
+	} else {
+		kb = exp( log( ( double )options.minSize ) + u * ( log( ( double )options.maxSize ) - log( ( double )options.minSize ) ) );
+	}
+
+	return ( uintmax_t )( kb * 1024 );
+}
+
+
+static bool write_file( const string& name, uintmax_t size ) {
+	struct stat stats;
+
+	if( !stat( name.c_str(), &stats ) && ( uintmax_t )stats.st_size == size ) {
+		return true;
+	}
+
+	int fd( open( name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 ) );
+
+	if( -1 == fd ) {
+		return false;
+	}
+
+	// Somewhat compressible, like most render inputs
+	vector< char > block( 65536 );
+	for( size_t i( 0 ); i < block.size(); ++i ) {
+		block[ i ] = ( char )( ( i * 7 ) ^ ( i >> 5 ) );
+	}
+
+	bool success( true );
+
+	for( uintmax_t written( 0 ); success && written < size; ) {
+		size_t n( min< uintmax_t >( block.size(), size - written ) );
+		success = n == ( size_t )write( fd, &block[ 0 ], n );
+		written += n;
+	}
+
+	return !close( fd ) && success;
+}
+
+
+static bool build_tree( const Options& options, uintmax_t& total ) {
+	total = 0;
+
+	try {
+		for( unsigned i( 0 ); i < options.files; ++i ) {
+			string name( file_name( options, i ) );
+			fs::create_directories( fs::path( name ).branch_path() );
+
+			uintmax_t size( file_size( options, i ) );
+
+			if( !write_file( name, size ) ) {
+				return false;
+			}
+
+			total += size;
+		}
+
+		fs::path cache( options.tree + "/cache" );
+
+		if( !options.warm ) {
+			fs::remove_all( cache );
+		}
+
+		fs::create_directories( cache );
+	} catch( fs::filesystem_error ) {
+		return false;
+	}
+
+	return true;
+}
+
+
+class Load {
+	public:
+		Load( const Options& options )
+			: options_( options ), cdf_( options.files )
+		{
+			double sum( 0 );
+
+			for( unsigned i( 0 ); i < options.files; ++i ) {
+				sum += 1.0 / pow( i + 1.0, options.zipf );
+				cdf_[ i ] = sum;
+			}
+
+			for( unsigned i( 0 ); i < options.files; ++i ) {
+				cdf_[ i ] /= sum;
+			}
+
+			// The most popular files shouldn't all live in the same directory
+			for( unsigned i( 0 ); i < options.files; ++i ) {
+				ranks_.push_back( ( unsigned )( ( i * 2654435761u ) % options.files ) );
+			}
+		}
+
+		void run( unsigned thread ) {
+			Jupiter::FileCache cache( fs::path( options_.tree + "/cache" ) );
+
+			unsigned state( options_.seed ^ ( getpid() << 8 ) ^ thread );
+			vector< float > samples;
+			samples.reserve( options_.requests );
+
+			for( unsigned i( 0 ); i < options_.requests; ++i ) {
+				double u( rand_r( &state ) / ( RAND_MAX + 1.0 ) );
+				unsigned rank( lower_bound( cdf_.begin(), cdf_.end(), u ) - cdf_.begin() );
+				string name( file_name( options_, ranks_[ min( rank, options_.files - 1 ) ] ) );
+
+				Jupiter::StopWatch watch;
+				string cached( cache.cacheFile( name ) );
+				samples.push_back( watch.seconds() );
+
+				cache.releaseFile( cached );
+			}
+
+			boost::mutex::scoped_lock lock( mutex_ );
+			samples_.insert( samples_.end(), samples.begin(), samples.end() );
+		}
+
+		const vector< float >& samples() const {
+			return samples_;
+		}
+
+	private:
+		const Options& options_;
+		vector< double > cdf_;
+		vector< unsigned > ranks_;
+
+		boost::mutex mutex_;
+		vector< float > samples_;
+};
+
+
+static bool write_all( int fd, const void* data, size_t size ) {
+	const char* p( ( const char* )data );
+
+	while( size ) {
+		ssize_t n( write( fd, p, size ) );
+
+		if( -1 == n && EINTR == errno ) {
+			continue;
+		}
+
+		if( n <= 0 ) {
+			return false;
+		}
+
+		p += n;
+		size -= n;
+	}
+
+	return true;
+}
+
+
+static bool read_all( int fd, void* data, size_t size ) {
+	char* p( ( char* )data );
+
+	while( size ) {
+		ssize_t n( read( fd, p, size ) );
+
+		if( -1 == n && EINTR == errno ) {
+			continue;
+		}
+
+		if( n <= 0 ) {
+			return false;
+		}
+
+		p += n;
+		size -= n;
+	}
+
+	return true;
+}
+
+
+static void run_process( const Options& options, int out ) {
+	Load load( options );
+	Jupiter::StopWatch watch;
+
+	boost::thread_group threads;
+
+	for( unsigned i( 0 ); i < options.threads; ++i ) {
+		threads.create_thread( boost::bind( &Load::run, &load, i ) );
+	}
+
+	threads.join_all();
+
+	Jupiter::CacheStats stats( Jupiter::FileCache::processStats() );
+
+	Report report;
+	report.requests = load.samples().size();
+	report.hits = stats.hits;
+	report.misses = stats.misses;
+	report.stalePinned = stats.stalePinned;
+	report.bytesIn = stats.bytesIn;
+	report.evictions = stats.evictions;
+	report.evictedBytes = stats.evictedBytes;
+	report.seconds = watch.seconds();
+
+	write_all( out, &report, sizeof( report ) );
+
+	if( !load.samples().empty() ) {
+		write_all( out, &load.samples()[ 0 ], load.samples().size() * sizeof( float ) );
+	}
+}
+
+
+static double percentile( const vector< float >& sorted, double p ) {
+	if( sorted.empty() ) {
+		return 0;
+	}
+
+	return sorted[ min< size_t >( sorted.size() - 1, ( size_t )( p * sorted.size() ) ) ];
+}
+
+
+int main( int argc, char* argv[] ) {
+
+	Options options;
+	options.tree = "/var/tmp/filecachebench";
+	options.files = 1000;
+	options.distribution = "loguniform";
+	options.minSize = 16;
+	options.maxSize = 16384;
+	options.zipf = 0.9;
+	options.cacheSize = 1000;
+	options.processes = 4;
+	options.threads = 4;
+	options.requests = 2000;
+	options.seed = 1;
+	options.warm = false;
+
+	int option;
+
+	try {
+		while( -1 != ( option = getopt( argc, argv, "t:n:d:s:z:m:p:j:r:R:wL:B:h" ) ) ) {
+			switch( option ) {
+				case 't': options.tree = optarg; break;
+				case 'n': options.files = boost::lexical_cast< unsigned >( optarg ); break;
+				case 'd': options.distribution = optarg; break;
+				case 's': {
+					string sizes( optarg );
+					string::size_type comma( sizes.find( ',' ) );
+					options.minSize = boost::lexical_cast< uintmax_t >( sizes.substr( 0, comma ) );
+					options.maxSize = string::npos == comma ? options.minSize : boost::lexical_cast< uintmax_t >( sizes.substr( comma + 1 ) );
+					break;
+				}
+				case 'z': options.zipf = boost::lexical_cast< double >( optarg ); break;
+				case 'm': options.cacheSize = boost::lexical_cast< uintmax_t >( optarg ); break;
+				case 'p': options.processes = boost::lexical_cast< unsigned >( optarg ); break;
+				case 'j': options.threads = boost::lexical_cast< unsigned >( optarg ); break;
+				case 'r': options.requests = boost::lexical_cast< unsigned >( optarg ); break;
+				case 'R': options.seed = boost::lexical_cast< unsigned >( optarg ); break;
+				case 'w': options.warm = true; break;
+				case 'L': options.latency = boost::lexical_cast< string >( boost::lexical_cast< double >( optarg ) ); break;
+				case 'B': options.bandwidth = boost::lexical_cast< string >( boost::lexical_cast< double >( optarg ) ); break;
+				default: usage( argv[ 0 ] ); return 1;
+			}
+		}
+	} catch( boost::bad_lexical_cast ) {
+		usage( argv[ 0 ] );
+		return 1;
+	}
+
+	if( !options.files || !options.minSize || options.maxSize < options.minSize ||
+	    ( "fixed" != options.distribution && "uniform" != options.distribution && "loguniform" != options.distribution ) ) {
+		usage( argv[ 0 ] );
+		return 1;
+	}
+
+	uintmax_t total;
+
+	if( !build_tree( options, total ) ) {
+		cerr << "Could not build the file tree in '" << options.tree << "'." << endl;
+		return 1;
+	}
+
+	setenv( "FILECACHE_REMOTE", ( options.tree + "/remote" ).c_str(), 1 );
+	setenv( "FILECACHE_SIZE", boost::lexical_cast< string >( options.cacheSize * 1000000 ).c_str(), 1 );
+
+	if( !options.latency.empty() ) {
+		setenv( "FILECACHE_REMOTE_LATENCY", options.latency.c_str(), 1 );
+	}
+
+	if( !options.bandwidth.empty() ) {
+		setenv( "FILECACHE_REMOTE_BANDWIDTH", options.bandwidth.c_str(), 1 );
+	}
+
+	cout << options.files << " files (" << total / 1000000.0 << " MB, " << options.distribution << "), cache "
+	     << options.cacheSize << " MB, " << options.processes << " processes x " << options.threads << " threads x "
+	     << options.requests << " requests, zipf " << options.zipf << endl;
+
+	vector< pid_t > children;
+	vector< int > pipes;
+
+	for( unsigned i( 0 ); i < options.processes; ++i ) {
+		int fds[ 2 ];
+
+		if( pipe( fds ) ) {
+			cerr << "Could not create a pipe." << endl;
+			return 1;
+		}
+
+		pid_t pid( fork() );
+
+		if( !pid ) {
+			close( fds[ 0 ] );
+			run_process( options, fds[ 1 ] );
+			close( fds[ 1 ] );
+			_exit( 0 );
+		}
+
+		close( fds[ 1 ] );
+
+		if( -1 == pid ) {
+			cerr << "Could not fork." << endl;
+			close( fds[ 0 ] );
+			break;
+		}
+
+		children.push_back( pid );
+		pipes.push_back( fds[ 0 ] );
+	}
+
+	Report sum;
+	memset( &sum, 0, sizeof( sum ) );
+	vector< float > samples;
+
+	for( size_t i( 0 ); i < pipes.size(); ++i ) {
+		Report report;
+
+		if( read_all( pipes[ i ], &report, sizeof( report ) ) ) {
+			size_t offset( samples.size() );
+			samples.resize( offset + report.requests );
+
+			if( !report.requests || read_all( pipes[ i ], &samples[ offset ], report.requests * sizeof( float ) ) ) {
+				sum.requests += report.requests;
+				sum.hits += report.hits;
+				sum.misses += report.misses;
+				sum.stalePinned += report.stalePinned;
+				sum.bytesIn += report.bytesIn;
+				sum.evictions += report.evictions;
+				sum.evictedBytes += report.evictedBytes;
+				sum.seconds = max( sum.seconds, report.seconds );
+			} else {
+				samples.resize( offset );
+			}
+		}
+
+		close( pipes[ i ] );
+	}
+
+	for( size_t i( 0 ); i < children.size(); ++i ) {
+		waitpid( children[ i ], NULL, 0 );
+	}
+
+	sort( samples.begin(), samples.end() );
+
+	boost::uint64_t lookups( sum.hits + sum.misses + sum.stalePinned );
+
+	cout << "requests      " << sum.requests << endl
+	     << "hit ratio     " << ( lookups ? ( double )sum.hits / lookups : 0.0 ) << endl
+	     << "stale pinned  " << sum.stalePinned << endl
+	     << "throughput    " << ( sum.seconds > 0 ? sum.requests / sum.seconds : 0.0 ) << " requests/s" << endl
+	     << "latency p50   " << percentile( samples, 0.5 ) * 1000 << " ms" << endl
+	     << "latency p99   " << percentile( samples, 0.99 ) * 1000 << " ms" << endl
+	     << "bytes in      " << sum.bytesIn << endl
+	     << "evictions     " << sum.evictions << " (" << sum.evictedBytes << " bytes)" << endl;
+
+	return sum.requests == ( boost::uint64_t )options.processes * options.threads * options.requests ? 0 : 1;
+}
@@ -0,0 +1,209 @@
+/**
+ * Heap allocations and time per cache hit.
+ *
+ * Usage: filecachehits [-t tree] [-n files] [-r rounds]
+ *
+ * Writes a number of small files under <tree>/remote, which the cache treats
+ * as remote via FILECACHE_REMOTE, and caches them at <tree>/cache. Then
+ * requests them the given number of rounds through each cacheFile()
+ * overload. Every request is a hit on a file the instance already uses.
+ *
+ * Allocations are counted by replacing the global operator new.
+ * cacheFile( const char*, std::string& ) and cacheFileInterned() are
+ * expected to report 0; the others allocate for the path they return.
+ *
+ *   filecachehits -n 1000 -r 100
+ *
+ */
+#include <filecache.hpp>
+#include <cachestats.hpp>
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+
+using namespace std;
+
+
+static volatile unsigned long allocations( 0 );
+
+
+void* operator new( size_t size ) {
+	__sync_fetch_and_add( &allocations, 1 );
+
+	void* memory( malloc( size ? size : 1 ) );
+
+	if( !memory ) {
+		throw bad_alloc();
+	}
+
+	return memory;
+}
+
+
+void* operator new[]( size_t size ) {
+	return operator new( size );
+}
+
+
+void operator delete( void* memory ) throw() {
+	free( memory );
+}
+
+
+void operator delete[]( void* memory ) throw() {
+	free( memory );
+}
+
+
+static void usage( const char* name ) {
+	cerr << "Usage: " << name << " [-t tree] [-n files] [-r rounds]" << endl;
+}
+
+
+static void report( const char* overload, unsigned long before, const Jupiter::StopWatch& watch, unsigned long requests ) {
+	cout << setw( 44 ) << left << overload << right
+	     << setw( 12 ) << ( double )( allocations - before ) / requests
+	     << setw( 12 ) << watch.seconds() * 1000000.0 / requests << endl;
+}
+
+
+int main( int argc, char* argv[] ) {
+
+	string tree( "/var/tmp/filecachehits" );
+	unsigned files( 1000 );
+	unsigned rounds( 100 );
+
+	int option;
+
+	try {
+		while( -1 != ( option = getopt( argc, argv, "t:n:r:h" ) ) ) {
+			switch( option ) {
+				case 't': tree = optarg; break;
+				case 'n': files = boost::lexical_cast< unsigned >( optarg ); break;
+				case 'r': rounds = boost::lexical_cast< unsigned >( optarg ); break;
+				default: usage( argv[ 0 ] ); return 1;
+			}
+		}
+	} catch( boost::bad_lexical_cast ) {
+		usage( argv[ 0 ] );
+		return 1;
+	}
+
+	if( !files || !rounds ) {
+		usage( argv[ 0 ] );
+		return 1;
+	}
+
+	vector< string > names;
+
+	try {
+		boost::filesystem::create_directories( tree + "/remote" );
+	} catch( boost::filesystem::filesystem_error ) {
+		cerr << "Could not create '" << tree << "/remote'." << endl;
+		return 1;
+	}
+
+	for( unsigned i( 0 ); i < files; ++i ) {
+		ostringstream name;
+		name << tree << "/remote/file" << setfill( '0' ) << setw( 6 ) << i << ".dat";
+
+		int fd( open( name.str().c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 ) );
+
+		if( -1 == fd || 4 != write( fd, "data", 4 ) || close( fd ) ) {
+			cerr << "Could not write '" << name.str() << "'." << endl;
+			return 1;
+		}
+
+		names.push_back( name.str() );
+	}
+
+	setenv( "FILECACHE_REMOTE", ( tree + "/remote" ).c_str(), 1 );
+
+	Jupiter::FileCache cache( tree + "/cache" );
+	string result;
+
+	// Misses, then a round that settles the inventory and scratch memory
+	for( int pass( 0 ); pass < 2; ++pass ) {
+		for( unsigned i( 0 ); i < files; ++i ) {
+			if( !cache.cacheFile( names[ i ].c_str(), result ) ) {
+				cerr << "Could not cache '" << names[ i ] << "'." << endl;
+				return 1;
+			}
+		}
+	}
+
+	vector< boost::filesystem::path > paths( names.begin(), names.end() );
+	unsigned long requests( ( unsigned long )files * rounds );
+
+	cout << files << " files, " << rounds << " rounds" << endl << endl
+	     << setw( 44 ) << left << "overload" << right << setw( 12 ) << "allocs/hit" << setw( 12 ) << "us/hit" << endl;
+
+	{
+		unsigned long before( allocations );
+		Jupiter::StopWatch watch;
+
+		for( unsigned r( 0 ); r < rounds; ++r ) {
+			for( unsigned i( 0 ); i < files; ++i ) {
+				cache.cacheFile( names[ i ].c_str(), result );
+			}
+		}
+
+		report( "cacheFile( const char*, std::string& )", before, watch, requests );
+	}
+
+	{
+		unsigned long before( allocations );
+		Jupiter::StopWatch watch;
+
+		for( unsigned r( 0 ); r < rounds; ++r ) {
+			for( unsigned i( 0 ); i < files; ++i ) {
+				cache.cacheFileInterned( names[ i ].c_str() );
+			}
+		}
+
+		report( "cacheFileInterned( const char* )", before, watch, requests );
+	}
+
+	{
+		unsigned long before( allocations );
+		Jupiter::StopWatch watch;
+
+		for( unsigned r( 0 ); r < rounds; ++r ) {
+			for( unsigned i( 0 ); i < files; ++i ) {
+				cache.cacheFile( names[ i ] );
+			}
+		}
+
+		report( "cacheFile( const std::string& )", before, watch, requests );
+	}
+
+	{
+		unsigned long before( allocations );
+		Jupiter::StopWatch watch;
+
+		for( unsigned r( 0 ); r < rounds; ++r ) {
+			for( unsigned i( 0 ); i < files; ++i ) {
+				cache.cacheFile( paths[ i ] );
+			}
+		}
+
+		report( "cacheFile( const fs::path& )", before, watch, requests );
+	}
+
+	Jupiter::CacheStats stats( cache.stats() );
+
+	cout << endl << stats.hits << " hits, " << stats.misses << " misses" << endl;
+
+	return 0;
+}
@@ -0,0 +1,133 @@
+/**
+ * Cache daemon -- owns a node's cache location.
+ *
+ * Usage: filecached [-l location] [-s size] [-u socket] [-p port] [-b address] [-w directory] [-d]
+ *
+ * Local processes use the cache through a CacheClient connected to the Unix
+ * domain socket (default: FILECACHE_SOCKET or /var/tmp/filecached.socket).
+ * Other nodes fetch from it via TCP on the given port; -p 0 switches that off.
+ * The port only listens on the loopback unless -b names another address (an
+ * empty one means all interfaces). It has no authentication, so only open it
+ * to a trusted network.
+ * On a file server, -w lets nodes write files below the given directory back
+ * through the same port, compressed (see FileCache::writeBack()).
+ *
+ * Several daemons on loopback, each serving its own cache directory, are
+ * enough to try peer fetching on a single machine:
+ *
+ *   filecached -l /var/tmp/cacheA -p 7001 &
+ *   filecached -l /var/tmp/cacheB -p 7002 &
+ *   FILECACHE_LOCATION=/var/tmp/cacheC FILECACHE_PEERS=localhost:7001,localhost:7002 render ...
+ *
+ */
+#include <filecache.hpp>
+#include <cacheserver.hpp>
+#include <peercache.hpp>
+
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+
+#include <signal.h>
+#include <unistd.h>
+
+#include <boost/lexical_cast.hpp>
+
+using namespace std;
+
+
+static volatile sig_atomic_t quit( 0 );
+
+
+static void on_signal( int ) {
+	quit = 1;
+}
+
+
+static void usage( const char* name ) {
+	cerr << "Usage: " << name << " [-l location] [-s size in MB] [-u socket] [-p port] [-b address] [-w writable directory] [-d]" << endl;
+}
+
+
+int main( int argc, char* argv[] ) {
+
+	string location, socket, address( "127.0.0.1" );
+	uintmax_t size( 0 );
+	unsigned short port( 7001 );
+	vector< string > writable;
+	bool detach( false );
+
+	int option;
+
+	try {
+		while( -1 != ( option = getopt( argc, argv, "l:s:u:p:b:w:dh" ) ) ) {
+			switch( option ) {
+				case 'l': location = optarg; break;
+				case 's': size = boost::lexical_cast< uintmax_t >( optarg ); break;
+				case 'u': socket = optarg; break;
+				case 'p': port = boost::lexical_cast< unsigned short >( optarg ); break;
+				case 'b': address = optarg; break;
+				case 'w': writable.push_back( optarg ); break;
+				case 'd': detach = true; break;
+				default: usage( argv[ 0 ] ); return 1;
+			}
+		}
+	} catch( boost::bad_lexical_cast ) {
+		usage( argv[ 0 ] );
+		return 1;
+	}
+
+	// Uses FILECACHE_LOCATION and FILECACHE_SIZE unless given on the command line
+	Jupiter::FileCache cache( location );
+
+	if( size ) {
+		cache.resize( size );
+	}
+
+	if( socket.empty() ) {
+		char* env( getenv( "FILECACHE_SOCKET" ) );
+		socket = env ? env : "/var/tmp/filecached.socket";
+	}
+
+	Jupiter::CacheServer server( cache, socket );
+	Jupiter::PeerServer peerServer( cache.location(), port, address );
+
+	// Only needed on file servers taking compressed write-backs
+	for( vector< string >::const_iterator it( writable.begin() ); it != writable.end(); ++it ) {
+		peerServer.writable( *it );
+	}
+
+	if( detach && daemon( 0, 0 ) ) {
+		cerr << "Could not detach from terminal." << endl;
+		return 1;
+	}
+
+	signal( SIGPIPE, SIG_IGN );
+	signal( SIGINT, on_signal );
+	signal( SIGTERM, on_signal );
+
+	if( !server.start() ) {
+		cerr << "Could not listen on '" << socket << "'." << endl;
+		return 1;
+	}
+
+	if( port && !peerServer.start() ) {
+		cerr << "Could not listen on port " << port << "." << endl;
+		return 1;
+	}
+
+	cerr << "Serving '" << cache.location() << "' on '" << socket << "'";
+	if( port ) {
+		cerr << " and port " << port;
+	}
+	cerr << "." << endl;
+
+	while( !quit ) {
+		sleep( 1 );
+	}
+
+	peerServer.stop();
+	server.stop();
+
+	return 0;
+}
@@ -0,0 +1,133 @@
+/**@file
+ *
+ * Deciding which files are worth a place in the cache.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010 Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+
+#ifndef JUPITER_ADMISSION_HPP
+#define JUPITER_ADMISSION_HPP
+
+#include <boost/cstdint.hpp>
+#include <string>
+#include <vector>
+
+namespace Jupiter {
+
+    /**
+     * Filters deciding whether a missing file is copied to the cache.
+     *
+     * @par
+     * ADMIT_ALL copies every file that fits. ADMIT_TINYLFU copies a file only
+     * if it was requested more often lately than each of the entries that
+     * would have to be evicted for it, so one-off requests can't flush what
+     * is used over and over.
+     *
+     */
+    enum AdmissionFilter {
+        ADMIT_ALL = 0,
+        ADMIT_TINYLFU = 1
+    };
+
+    /**
+     * Parse a filter name ("all" or "tinylfu").
+     *
+     * @param  name    the name
+     * @param  filter  receives the filter
+     *
+     * @return  true if the name is known, false otherwise
+     *
+     */
+    bool admission_filter_from_name( const std::string& name, AdmissionFilter& filter );
+
+    /**
+     * Query the name of a filter.
+     *
+     */
+    std::string admission_filter_name( AdmissionFilter filter );
+
+    /**
+     * Approximate request counts of recent keys in constant space.
+     *
+     * @par
+     * A count-min sketch: each key increments one small counter per row, the
+     * estimate is the smallest of them. Collisions can only make estimates
+     * too high. Counters saturate at MAX_COUNT, and all are halved once the
+     * sketch saw SAMPLE_FACTOR times as many requests as a row has counters,
+     * so old popularity fades.
+     *
+     */
+    class FrequencySketch {
+        public:
+            enum {
+                DEPTH = 4,          ///< Rows of counters
+                MAX_COUNT = 15,
+                SAMPLE_FACTOR = 10
+            };
+
+            /**
+             * @param  width  the counters per row, rounded up to a power of two
+             *
+             */
+            explicit      FrequencySketch( std::size_t width = 4096 );
+
+            void          record( boost::uint64_t key );
+            unsigned      estimate( boost::uint64_t key ) const;
+
+        private:
+            std::vector< boost::uint8_t > counters_;
+            std::size_t width_;
+            std::size_t additions_;
+
+            std::size_t   index( boost::uint64_t key, unsigned row ) const;
+    };
+
+    /**
+     * How a cache location admits files.
+     *
+     */
+    struct AdmissionPolicy {
+        AdmissionFilter filter;
+        unsigned maxPercent;        ///< Largest file admitted, in percent of the cache size, 0 for no limit
+        FrequencySketch sketch;     ///< Requests of the location's entries, for ADMIT_TINYLFU
+
+        AdmissionPolicy() : filter( ADMIT_ALL ), maxPercent( 0 ) {}
+    };
+
+    /**
+     * Decide whether a file evicting others is admitted, the TinyLFU way.
+     *
+     * @param  frequency  the estimated recent requests of the file
+     * @param  victims    the estimated recent requests of each entry it
+     *                    would evict
+     *
+     * @return  true if the file was requested more often than every victim,
+     *          false otherwise
+     *
+     */
+    bool admit_candidate( unsigned frequency, const std::vector< unsigned >& victims );
+
+} // namespace Jupiter
+
+#endif // JUPITER_ADMISSION_HPP
@@ -0,0 +1,124 @@
+/**@file
+ *
+ * Per-block checksums and delta copies of large cache entries.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010 Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+
+#ifndef JUPITER_BLOCKDELTA_HPP
+#define JUPITER_BLOCKDELTA_HPP
+
+#include <sourcebackend.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/cstdint.hpp>
+#include <vector>
+
+namespace fs = boost::filesystem;
+
+namespace Jupiter {
+
+    /**
+     * Checksums of the fixed size blocks of a file.
+     *
+     * @par
+     * The cache stores them next to large entries (see
+     * FileCache::deltaRefresh()) and asks the source backend for those of the
+     * original when the entry is outdated. Only the blocks whose checksums
+     * differ, and those appended, are fetched again.
+     * @par
+     * The checksum is a fast 64 bit hash, good for spotting changes but not
+     * against tampering. Files are stored in host byte order -- they never
+     * leave the machine that wrote them.
+     *
+     */
+    struct BlockSums {
+        enum {
+            BLOCK_SIZE = 1048576    ///< Default bytes per block
+        };
+
+        boost::uint32_t blockSize;
+        uintmax_t size;                         ///< Of the file the sums describe
+        std::vector< boost::uint64_t > sums;
+
+        BlockSums() : blockSize( BLOCK_SIZE ), size( 0 ) {}
+
+        /**
+         * Checksum a block.
+         *
+         */
+        static boost::uint64_t checksum( const char* data, std::size_t length );
+
+        /**
+         * Read a file and checksum its blocks.
+         *
+         * @param  file       the open file
+         * @param  size       the size of the file
+         * @param  blockSize  bytes per block
+         *
+         * @return  true if successful, false otherwise
+         *
+         */
+        bool compute( SourceFile& file, uintmax_t size, boost::uint32_t blockSize = BLOCK_SIZE );
+
+        /**
+         * Read checksums stored with save().
+         *
+         * @return  true if successful, false if the file is missing or invalid
+         *
+         */
+        bool load( const fs::path& path );
+
+        /**
+         * Store the checksums in a file.
+         *
+         * @return  true if successful, false otherwise
+         *
+         */
+        bool save( const fs::path& path ) const;
+    };
+
+    /**
+     * Build a file from an older local copy and the changed blocks of its original.
+     *
+     * @par
+     * A block is taken from @c base if its checksum in @c baseSums equals the
+     * one in @c sourceSums, and read from @c source otherwise. Both must use
+     * the same block size.
+     *
+     * @param  source       the open original
+     * @param  sourceSums   the original's checksums
+     * @param  base         the older copy, not altered
+     * @param  baseSums     the older copy's checksums
+     * @param  destination  the file to write, must not exist
+     * @param  fetched      receives the bytes read from @c source
+     *
+     * @return  true if successful, false otherwise
+     *
+     */
+    bool delta_copy( SourceFile& source, const BlockSums& sourceSums, const fs::path& base, const BlockSums& baseSums,
+                     const fs::path& destination, uintmax_t& fetched );
+
+} // namespace Jupiter
+
+#endif // JUPITER_BLOCKDELTA_HPP
@@ -0,0 +1,143 @@
+/**@file
+ *
+ * Deciding whether copying a missing file to the cache pays.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010 Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+
+#ifndef JUPITER_BYPASS_HPP
+#define JUPITER_BYPASS_HPP
+
+#include <boost/filesystem/path.hpp>
+#include <admission.hpp>
+#include <ctime>
+#include <map>
+
+namespace fs = boost::filesystem;
+
+namespace Jupiter {
+
+    class SourceBackend;
+
+    /**
+     * A moving average of how fast something transfers data, and of how
+     * long it takes to answer at all.
+     *
+     * @par
+     * Each sample moves the averages a WEIGHT-th of the way; the first one
+     * sets them.
+     *
+     */
+    class RateEstimate {
+        public:
+            enum {
+                WEIGHT = 4,
+                MIN_SAMPLES = 2     ///< Transfers needed before the estimate is used, by default
+            };
+
+            explicit      RateEstimate( unsigned minSamples = MIN_SAMPLES );
+
+            void          recordTransfer( uintmax_t bytes, double seconds );
+            void          recordLatency( double seconds );
+
+            /**
+             * Query whether enough transfers were seen to go by the estimate.
+             *
+             */
+            bool          known() const;
+
+            /**
+             * Estimate the seconds a transfer of @c bytes takes, latency
+             * included.
+             *
+             */
+            double        seconds( uintmax_t bytes ) const;
+
+        private:
+            double bytesPerSecond_;
+            double latency_;
+            unsigned transfers_, answers_;
+            unsigned minSamples_;
+    };
+
+    /**
+     * What happens to a missing file.
+     *
+     */
+    enum BypassDecision {
+        BYPASS_COPY = 0,        ///< Copy it to the cache and serve the copy
+        BYPASS_ORIGINAL = 1,    ///< Serve the original
+        BYPASS_BACKGROUND = 2   ///< Serve the original, copy it for the next request
+    };
+
+    /**
+     * Decide whether a missing file is copied to the cache.
+     *
+     * @par
+     * A copy pays if writing the file to the cache disk takes no longer than
+     * reading it from the source -- the request waits for both, but every
+     * later one reads at the cache disk's speed. Otherwise the disk is the
+     * bottleneck: a file requested before is copied in the background while
+     * the original is served, any other one just served from the original.
+     * Without estimates of both sides, files are copied.
+     *
+     * @param  size      the file's size
+     * @param  requests  the file's estimated recent requests, this one included
+     * @param  source    copies from the file's source
+     * @param  cache     writes to the cache disk
+     *
+     */
+    BypassDecision plan_bypass( uintmax_t size, unsigned requests, const RateEstimate& source, const RateEstimate& cache );
+
+    /**
+     * Time writing a file of @c size bytes through to the disk, then remove it.
+     *
+     * @param  seconds  receives the time taken
+     *
+     * @return  true if successful, false otherwise
+     *
+     */
+    bool probe_write( const fs::path& file, std::size_t size, double& seconds );
+
+    /**
+     * What a cache location knows to decide about copies, see plan_bypass().
+     *
+     */
+    struct BypassPolicy {
+        enum {
+            PROBE_SIZE = 1048576,   ///< Bytes written to measure the cache disk
+            PROBE_INTERVAL = 30     ///< Seconds between measurements
+        };
+
+        RateEstimate cache;                                         ///< Probes, one is enough to go by
+        std::map< const SourceBackend*, RateEstimate > sources;   ///< Copies and stats, by the backend they went through (all NFS mounts share one)
+        FrequencySketch requests;
+        time_t probed;
+
+        BypassPolicy() : cache( 1 ), probed( 0 ) {}
+    };
+
+} // namespace Jupiter
+
+#endif // JUPITER_BYPASS_HPP
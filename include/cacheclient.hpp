@@ -0,0 +1,150 @@
+/**@file
+ *
+ * Thin client for the per-node cache daemon.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010 Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+
+#ifndef JUPITER_CACHECLIENT_HPP
+#define JUPITER_CACHECLIENT_HPP
+
+#include <boost/thread/mutex.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/cstdint.hpp>
+#include <string>
+
+namespace fs = boost::filesystem;
+
+namespace Jupiter {
+
+    /**
+     * Talks to the node's cache daemon instead of running a cache engine.
+     *
+     * @par
+     * The interface mirrors FileCache, but all work is done by the CacheServer
+     * in the daemon: the client holds no inventory and copies nothing. Every
+     * call is a single round trip over a Unix domain socket.
+     * @par
+     * Files cached through a client stay pinned until they are released or the
+     * client is destroyed, just like with a FileCache instance.
+     * @par
+     * If the daemon can't be reached, every call returns the original path --
+     * the same worst case FileCache falls back to.
+     *
+     */
+    class CacheClient {
+        public:
+            /**
+             * Creates a client.
+             *
+             * @param  socket  The daemon's socket. If this is empty, the client
+             *                 looks for an environment variable called
+             *                 FILECACHE_SOCKET and uses its value, or
+             *                 "/var/tmp/filecached.socket" if it isn't set.
+             *
+             */
+                          CacheClient( const std::string& socket = std::string() );
+                         ~CacheClient();
+
+            /**
+             * Cache a file.
+             *
+             * @see  FileCache::cacheFile()
+             *
+             * @return  the cached path if sucessful, the unaltered original path otherwise
+             *
+             */
+            fs::path      cacheFile( const fs::path& toCache );
+            std::string   cacheFile( const std::string& toCache );
+
+            /**
+             * Cache a file and open it for reading.
+             *
+             * @par
+             * The daemon opens the file and passes the descriptor to this process,
+             * saving the caller another path lookup on the cache disk. If the file
+             * couldn't be cached, the descriptor refers to the original.
+             * @par
+             * The file stays pinned until releaseFile() is called on the path
+             * returned in @c cached. Closing the descriptor is up to the caller.
+             *
+             * @param  toCache  the file to cache
+             * @param  cached   if not null, receives the path the descriptor refers to
+             *
+             * @return  the open descriptor if successful, -1 otherwise
+             *
+             */
+            int           openFile( const fs::path& toCache, fs::path* cached = 0 );
+
+            /**
+             * Copy a file back from the cache.
+             *
+             * @see  FileCache::uncacheFile()
+             *
+             */
+            fs::path      uncacheFile( const fs::path& fromCache, bool overwrite = true, bool ifNewer = true );
+            std::string   uncacheFile( const std::string& fromCache, bool overwrite = true, bool ifNewer = true );
+
+            /**
+             * Construct a cache path for writing.
+             *
+             * @see  FileCache::cacheFileForWriting()
+             *
+             */
+            fs::path      cacheFileForWriting( const fs::path& toCache );
+            std::string   cacheFileForWriting( const std::string& toCache );
+
+            /**
+             * Releases a file from the cache for this client.
+             *
+             * @see  FileCache::releaseFile()
+             *
+             */
+            void          releaseFile( const fs::path& path );
+            void          releaseFile( const std::string& path );
+
+            /**
+             * Query whether the daemon is reachable.
+             *
+             * @return  true if the client is connected, false otherwise
+             *
+             */
+            bool          connected() const;
+
+        private:
+                          CacheClient( const CacheClient& );
+            CacheClient&  operator=( const CacheClient& );
+
+            std::string path_;
+            int socket_;
+
+            mutable boost::mutex mutex_;
+
+            bool connect_daemon();
+            bool round_trip( boost::uint8_t opcode, boost::uint8_t flags, const std::string& request, std::string& reply, int* fd = 0 );
+    };
+
+} // namespace Jupiter
+
+#endif // JUPITER_CACHECLIENT_HPP
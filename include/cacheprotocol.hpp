@@ -0,0 +1,115 @@
+/**@file
+ *
+ * Binary protocol spoken between CacheClient and CacheServer.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010 Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+
+#ifndef JUPITER_CACHEPROTOCOL_HPP
+#define JUPITER_CACHEPROTOCOL_HPP
+
+#include <boost/cstdint.hpp>
+#include <string>
+
+namespace Jupiter {
+
+    /**
+     * Framing of requests and replies on the daemon's Unix domain socket.
+     *
+     * @par
+     * Every message is a fixed eight byte header followed by @c size bytes of
+     * payload, which is a path without a terminating zero. Each client call
+     * is exactly one request and one reply. A reply may carry a file
+     * descriptor as SCM_RIGHTS ancillary data; the @c fd field of the header
+     * tells whether it does.
+     * @par
+     * Both ends run on the same machine, so the header is sent in host byte
+     * order.
+     *
+     */
+    namespace Protocol {
+
+        enum Opcode {
+            CACHE = 1,              ///< FileCache::cacheFile()
+            CACHE_FOR_WRITING = 2,  ///< FileCache::cacheFileForWriting()
+            UNCACHE = 3,            ///< FileCache::uncacheFile()
+            RELEASE = 4,            ///< FileCache::releaseFile()
+            OPEN = 5                ///< cacheFile() and pass an open descriptor of the result
+        };
+
+        enum Flags {
+            OVERWRITE = 1,          ///< UNCACHE: overwrite an existing destination
+            IF_NEWER = 2            ///< UNCACHE: only if the cached file is newer
+        };
+
+        enum Status {
+            OK = 0,
+            FAILED = 1
+        };
+
+        struct Header {
+            boost::uint32_t size;   ///< Payload size in bytes
+            boost::uint8_t code;    ///< Opcode in requests, Status in replies
+            boost::uint8_t flags;   ///< Flags in requests
+            boost::uint8_t fd;      ///< Non-zero if a descriptor is attached (replies only)
+            boost::uint8_t reserved;
+        };
+
+        /**
+         * Refuse payloads larger than this -- no path is this long.
+         */
+        const boost::uint32_t MAX_PAYLOAD = 65536;
+
+        /**
+         * Send a message, optionally attaching a file descriptor.
+         *
+         * @param  socket   the connected socket
+         * @param  code     the opcode or status
+         * @param  flags    request flags
+         * @param  payload  the path to send
+         * @param  fd       a descriptor to pass to the other process, -1 for none
+         *
+         * @return  true if the whole message was sent, false otherwise
+         *
+         */
+        bool send( int socket, boost::uint8_t code, boost::uint8_t flags, const std::string& payload, int fd = -1 );
+
+        /**
+         * Receive a message.
+         *
+         * @param  socket   the connected socket
+         * @param  header   receives the message header
+         * @param  payload  receives the path
+         * @param  fd       receives a passed descriptor, -1 if there was none
+         *
+         * @return  true if a whole message was received, false otherwise
+         *
+         */
+        bool receive( int socket, Header& header, std::string& payload, int& fd );
+
+    } // namespace Protocol
+
+} // namespace Jupiter
+
+#endif // JUPITER_CACHEPROTOCOL_HPP
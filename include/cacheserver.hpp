@@ -0,0 +1,136 @@
+/**@file
+ *
+ * Per-node cache engine serving local processes over a Unix domain socket.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010 Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+
+#ifndef JUPITER_CACHESERVER_HPP
+#define JUPITER_CACHESERVER_HPP
+
+#include <filecache.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <set>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+namespace Jupiter {
+
+    /**
+     * Owns a node's cache location on behalf of all local processes.
+     *
+     * @par
+     * Renderers and plugins talk to the server through CacheClient instead of
+     * running a FileCache of their own. All inventory, copying and eviction
+     * thus happens in one process, and a file requested by many processes at
+     * once is copied only once: a second request for a file that is being
+     * copied waits for the copy and then finds it in the cache, while
+     * requests for other files go on meanwhile.
+     * @par
+     * Only root, the daemon's user and members of its group may connect.
+     * Paths must be absolute. OPEN only hands out descriptors of cached
+     * files; for anything else the client opens the original itself.
+     * @par
+     * A path is only served if the client could read it, or write it for
+     * CACHE_FOR_WRITING and UNCACHE, with its own credentials. Serving other
+     * users than the daemon's own thus needs a daemon running as root, which
+     * takes on a client's credentials for the check; otherwise their
+     * requests fail.
+     * @par
+     * Every connection is served by its own copy of the engine's FileCache
+     * instance. Files a client caches stay pinned until it releases them or
+     * disconnects -- exactly as if the client's process had used a FileCache
+     * instance of its own.
+     *
+     * @see  Protocol, CacheClient
+     *
+     */
+    class CacheServer {
+        public:
+            /**
+             * Creates a server for the given cache.
+             *
+             * @param  cache   The engine -- all connections share its location and size.
+             * @param  socket  The path of the Unix domain socket to listen on.
+             *
+             */
+                          CacheServer( const FileCache& cache, const std::string& socket );
+                         ~CacheServer();
+
+            /**
+             * Start accepting connections.
+             *
+             * @par
+             * A stale socket file left behind by a previous daemon is removed.
+             * The socket is accessible to the daemon's group only.
+             *
+             * @return  true if the server is listening, false otherwise
+             *
+             */
+            bool          start();
+            /**
+             * Stop accepting connections, disconnect all clients and wait for
+             * their requests to finish.
+             *
+             */
+            void          stop();
+
+        private:
+            /**
+             * Who is on the other end of a connection.
+             *
+             */
+            struct Credentials {
+                uid_t uid;
+                gid_t gid;
+                std::vector< gid_t > groups;    ///< Including @c gid
+            };
+
+                          CacheServer( const CacheServer& );
+            CacheServer&  operator=( const CacheServer& );
+
+            FileCache engine_;
+            std::string path_;
+            int socket_;
+            volatile bool running_;
+
+            boost::thread* thread_;
+
+            std::set< int > connections_;
+            boost::mutex connectionMutex_;
+            boost::condition idle_;
+
+            void run();
+            bool get_credentials( int connection, Credentials& peer ) const;
+            bool is_authorized( const Credentials& peer ) const;
+            bool may_access( const Credentials& peer, const std::string& path, bool writing ) const;
+            void serve_connection( int connection, const Credentials& peer );
+    };
+
+} // namespace Jupiter
+
+#endif // JUPITER_CACHESERVER_HPP
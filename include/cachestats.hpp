@@ -0,0 +1,178 @@
+/**@file
+ *
+ * Counters and latency histograms describing what a cache location does.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010 Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+
+#ifndef JUPITER_CACHESTATS_HPP
+#define JUPITER_CACHESTATS_HPP
+
+#include <boost/cstdint.hpp>
+#include <map>
+#include <ostream>
+#include <string>
+
+namespace Jupiter {
+
+    /**
+     * A histogram of latencies in seconds.
+     *
+     * @par
+     * The buckets have fixed upper bounds from 100 microseconds to one minute,
+     * the last bucket takes everything slower. Recording is thus a handful of
+     * comparisons and never allocates.
+     *
+     */
+    struct LatencyHistogram {
+        enum {
+            BUCKETS = 14
+        };
+
+        static const double bounds[ BUCKETS - 1 ];  ///< Upper bounds of all but the last bucket
+
+        boost::uint64_t counts[ BUCKETS ];
+        boost::uint64_t count;
+        double sum;
+
+                          LatencyHistogram();
+
+        void              record( double seconds );
+
+        /**
+         * Estimate a quantile.
+         *
+         * @param  q  the quantile, e.g. 0.99
+         *
+         * @return  the upper bound of the bucket holding the quantile, the
+         *          largest bound for the last bucket, 0 if nothing was recorded
+         *
+         */
+        double            quantile( double q ) const;
+
+        LatencyHistogram& operator+=( const LatencyHistogram& other );
+    };
+
+    /**
+     * A snapshot of what a cache location did in this process.
+     *
+     * @par
+     * A hit is a request served from an existing cache entry, a miss one that
+     * copied the file to the cache. A request for a file whose cache entry is
+     * outdated but still pinned by another instance counts as stale pinned --
+     * the caller got the original, unless a newer version of the file could
+     * be cached next to it (a version). Bytes in are bytes copied to the cache,
+     * bytes out bytes copied back by uncacheFile(). Prefetches are files
+     * copied ahead of time by the read-ahead; a prefetch hit is the first
+     * request for one of them, a wasted prefetch one evicted unused. Delta
+     * refreshes update outdated entries by their changed blocks; only the
+     * blocks fetched count as bytes in. Progressive fills are misses copied
+     * in the background while they were already being read. Revalidations
+     * are originals checked in the background, refreshes updated originals
+     * copied there (see FileCache::revalidate()). Admitted and rejected
+     * misses are the ones an admission filter let in or kept out (see
+     * FileCache::admission()). Bypassed misses were served from the
+     * original because copying them wouldn't have paid, background copies
+     * also copied for later (see FileCache::bypass()).
+     *
+     */
+    struct CacheStats {
+        boost::uint64_t hits;
+        boost::uint64_t misses;
+        boost::uint64_t stalePinned;
+        boost::uint64_t versions;
+        boost::uint64_t deltaRefreshes;
+        boost::uint64_t deltaSavedBytes;
+        boost::uint64_t progressiveFills;
+        boost::uint64_t revalidations;
+        boost::uint64_t refreshes;
+        boost::uint64_t admitted;
+        boost::uint64_t rejected;
+        boost::uint64_t bypassed;
+        boost::uint64_t backgroundCopies;
+        boost::uint64_t peerFetches;
+        boost::uint64_t bytesIn;
+        boost::uint64_t bytesOut;
+        boost::uint64_t evictions;
+        boost::uint64_t evictedBytes;
+        boost::uint64_t prefetches;
+        boost::uint64_t prefetchHits;
+        boost::uint64_t prefetchWasted;
+
+        LatencyHistogram cacheFileLatency;  ///< Whole cacheFile() calls that got to the cache
+        LatencyHistogram copyLatency;       ///< Copies (or peer fetches, or compression) into the cache
+        LatencyHistogram tidyLatency;       ///< Making room in the cache
+
+                          CacheStats();
+
+        /**
+         * Query the average copy throughput.
+         *
+         * @return  bytes per second copied into the cache, 0 if nothing was copied
+         *
+         */
+        double            copyThroughput() const;
+
+        CacheStats&       operator+=( const CacheStats& other );
+
+        /**
+         * Snapshots keyed by the Prometheus labels of their samples, e.g.
+         * <tt>location="/var/tmp/_cache"</tt>.
+         *
+         */
+        typedef std::map< std::string, CacheStats > LabeledStats;
+
+        /**
+         * Write snapshots in Prometheus text exposition format.
+         *
+         * @param  out    the stream to write to
+         * @param  stats  the snapshots to write
+         *
+         */
+        static void       writePrometheus( std::ostream& out, const LabeledStats& stats );
+    };
+
+    /**
+     * Measures elapsed wall clock time on a monotonic clock.
+     *
+     */
+    class StopWatch {
+        public:
+                          StopWatch();
+
+            /**
+             * Query the seconds since construction.
+             *
+             */
+            double        seconds() const;
+
+        private:
+            double start_;
+
+            static double now();
+    };
+
+} // namespace Jupiter
+
+#endif // JUPITER_CACHESTATS_HPP
@@ -0,0 +1,179 @@
+/**@file
+ *
+ * Compact binary traces of cache requests.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010 Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+
+#ifndef JUPITER_CACHETRACE_HPP
+#define JUPITER_CACHETRACE_HPP
+
+#include <boost/thread/mutex.hpp>
+#include <boost/cstdint.hpp>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace Jupiter {
+
+    /**
+     * One traced cache request.
+     *
+     * @par
+     * Files are identified by hash_path() of their name in the cache, which is
+     * their full original path with the slashes replaced. Pins belong to a
+     * cache instance, so every record names the process and the instance; a
+     * FINISH record says the instance went away and released all its files.
+     *
+     */
+    struct TraceRecord {
+        enum Operation {
+            CACHE = 1,          ///< cacheFile()
+            RELEASE = 2,        ///< releaseFile()
+            FINISH = 3          ///< The instance was destroyed
+        };
+
+        enum Outcome {
+            LOCAL = 0,          ///< Not a remote file, never cached
+            HIT = 1,
+            MISS = 2,           ///< Copied to the cache
+            STALE_PINNED = 3,   ///< Outdated entry pinned elsewhere, the caller got the original
+            FAILED = 4          ///< Couldn't be cached, e.g. the cache was full
+        };
+
+        boost::uint64_t time;       ///< Microseconds since the epoch
+        boost::uint64_t path;       ///< hash_path() of the file's cache name
+        boost::uint64_t size;       ///< Size of the original in bytes
+        boost::uint32_t latency;    ///< Microseconds the request took
+        boost::uint32_t pid;
+        boost::uint32_t instance;
+        boost::uint8_t operation;
+        boost::uint8_t outcome;
+        boost::uint16_t reserved;
+
+                          TraceRecord();
+    };
+
+    /**
+     * Hash a path for a trace (64 bit FNV-1a).
+     *
+     */
+    boost::uint64_t hash_path( const std::string& path );
+
+    /**
+     * Query the current time in microseconds since the epoch.
+     *
+     */
+    boost::uint64_t trace_time();
+
+    /**
+     * Appends trace records to a file.
+     *
+     * @par
+     * A trace file is a short header followed by fixed size records in host
+     * byte order. Records are buffered and written in batches; every write
+     * appends whole records, so forked children (which drop the records they
+     * inherited) can share their parent's file.
+     * @par
+     * The writer is thread safe.
+     *
+     */
+    class TraceWriter {
+        public:
+            enum {
+                BUFFER_RECORDS = 256    ///< Records collected before they are written
+            };
+
+                          TraceWriter();
+                         ~TraceWriter();
+
+            /**
+             * Start tracing to a file, closing the current one.
+             *
+             * @param  file  The file to append to. It is created if it doesn't
+             *               exist. An empty name stops tracing.
+             *
+             * @return  true if the file is open, false otherwise
+             *
+             */
+            bool          open( const std::string& file );
+
+            /**
+             * Query whether records are written anywhere.
+             *
+             */
+            bool          enabled() const;
+
+            void          record( const TraceRecord& record );
+
+            /**
+             * Write all buffered records.
+             *
+             */
+            void          flush();
+
+        private:
+                          TraceWriter( const TraceWriter& );
+            TraceWriter&  operator=( const TraceWriter& );
+
+            int fd_;
+            boost::uint32_t pid_;
+            std::vector< TraceRecord > buffer_;
+
+            mutable boost::mutex mutex_;
+
+            void          drop_inherited();
+            void          write_buffer();
+    };
+
+    /**
+     * Reads the records of a trace file.
+     *
+     */
+    class TraceReader {
+        public:
+                          TraceReader( const std::string& file );
+
+            /**
+             * Query whether the file was opened and has a valid header.
+             *
+             */
+            bool          valid() const;
+
+            /**
+             * Read the next record.
+             *
+             * @return  true if a record was read, false at the end of the trace
+             *
+             */
+            bool          next( TraceRecord& record );
+
+        private:
+            std::ifstream in_;
+            bool valid_;
+    };
+
+} // namespace Jupiter
+
+#endif // JUPITER_CACHETRACE_HPP
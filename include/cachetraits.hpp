@@ -0,0 +1,177 @@
+/**@file
+ *
+ * Compile time policies of the cache engine.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010 Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+
+#ifndef JUPITER_CACHETRAITS_HPP
+#define JUPITER_CACHETRAITS_HPP
+
+#include <admission.hpp>
+#include <bypass.hpp>
+#include <eviction.hpp>
+#include <sourcebackend.hpp>
+#include <cstddef>
+#include <ctime>
+#include <string>
+#include <vector>
+
+namespace Jupiter {
+
+    /**
+     * The policies of the stock cache engine, see BasicFileCache.
+     *
+     * @par
+     * A variant derives from this and hides what it wants to change. All
+     * members are static and inline, so the engine calls them without any
+     * dispatch, e.g. a cache that takes links as they are:
+     * @code
+     * struct LinkKeepingTraits : DefaultCacheTraits {
+     *     enum { RESOLVE_SYMLINKS = false };
+     * };
+     *
+     * template class BasicFileCache< LinkKeepingTraits >; // in filecache.cpp
+     * @endcode
+     *
+     */
+    struct DefaultCacheTraits {
+        enum {
+            RESOLVE_SYMLINKS = true    ///< Cache the target of a link, so files linked many times are cached once
+        };
+
+        /**
+         * The most characters entry_name() writes for a source of @c length
+         * characters.
+         *
+         */
+        static std::size_t entry_length( std::size_t length )
+        {
+            return length;
+        }
+
+        /**
+         * Write the name of the cache entry of an absolute path.
+         *
+         * @par
+         * The entry is the source with all '/' replaced by '%'. This works
+         * on any platform since string() returns the internal representation
+         * of a path which always uses '/' as the separator char.
+         *
+         * @param  entry  receives the name, not terminated; must have room
+         *                for entry_length( length ) characters
+         *
+         * @return  the length of the name
+         *
+         */
+        static std::size_t entry_name( const char* source, std::size_t length, char* entry )
+        {
+            for ( std::size_t i( 0 ); i < length; ++i ) {
+                entry[ i ] = '/' == source[ i ] ? '%' : source[ i ];
+            }
+
+            return length;
+        }
+
+        /**
+         * The source of a cache entry -- the inverse of entry_name(), used
+         * to copy write cached files back.
+         *
+         */
+        static std::string source_name( std::string entry )
+        {
+            for ( std::string::iterator it( entry.begin() ); it != entry.end(); ++it ) {
+                if ( '%' == *it ) {
+                    *it = '/';
+                }
+            }
+
+            return entry;
+        }
+
+        /**
+         * Decide whether a file is cached.
+         *
+         * @param  source   the absolute, link resolved path
+         * @param  claimed  whether a source backend handles the file; files
+         *                  cached without one are read through LocalBackend
+         *
+         */
+        static bool is_remote( const char* source, bool claimed )
+        {
+            return claimed;
+        }
+
+        /**
+         * Decide whether a cache entry is outdated.
+         *
+         * @param  size      the size of the entry's data
+         * @param  mtime     the entry's modification time
+         * @param  original  the original's size and modification time
+         *
+         */
+        static bool is_different( uintmax_t size, std::time_t mtime, const SourceStats& original )
+        {
+            // Newer on the source, or a different size
+            return mtime < original.mtime || size != original.size;
+        }
+
+        /**
+         * Choose the entries to evict, see Jupiter::plan_eviction().
+         *
+         * @param  policy  the location's policy, see FileCache::eviction()
+         *
+         */
+        static bool plan_eviction( const std::vector< EvictionCandidate >& candidates, uintmax_t total, uintmax_t capacity,
+                                   EvictionPolicy policy, std::vector< std::size_t >& victims )
+        {
+            return Jupiter::plan_eviction( candidates, total, capacity, policy, victims );
+        }
+
+        /**
+         * Decide whether a file evicting others is cached, see
+         * Jupiter::admit_candidate(). Only asked if the location filters
+         * with ADMIT_TINYLFU, see FileCache::admission().
+         *
+         */
+        static bool admit( unsigned frequency, const std::vector< unsigned >& victims )
+        {
+            return Jupiter::admit_candidate( frequency, victims );
+        }
+
+        /**
+         * Decide whether a missing file is copied, see Jupiter::plan_bypass().
+         * Only asked if the location bypasses adaptively, see
+         * FileCache::bypass().
+         *
+         */
+        static BypassDecision plan_bypass( uintmax_t size, unsigned requests, const RateEstimate& source, const RateEstimate& cache )
+        {
+            return Jupiter::plan_bypass( size, requests, source, cache );
+        }
+    };
+
+} // namespace Jupiter
+
+#endif // JUPITER_CACHETRAITS_HPP
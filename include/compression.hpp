@@ -0,0 +1,228 @@
+/**@file
+ *
+ * Chunked, randomly accessible compressed files for the cache store.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010 Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+
+#ifndef JUPITER_COMPRESSION_HPP
+#define JUPITER_COMPRESSION_HPP
+
+#include <sourcebackend.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/cstdint.hpp>
+#include <set>
+#include <string>
+
+namespace fs = boost::filesystem;
+
+namespace Jupiter {
+
+    /**
+     * Compression codecs.
+     *
+     * @par
+     * LZ4 and zstd are only available if the library was built with
+     * FILECACHE_LZ4 resp. FILECACHE_ZSTD defined.
+     *
+     */
+    enum Codec {
+        CODEC_NONE = 0,
+        CODEC_LZ4 = 1,
+        CODEC_ZSTD = 2
+    };
+
+    /**
+     * Compress a block of data.
+     *
+     * @param  codec   the codec to use
+     * @param  data    the data to compress
+     * @param  length  the size of the data
+     * @param  result  receives the compressed data
+     *
+     * @return  true if successful, false if the codec failed or isn't available
+     *
+     */
+    bool compress_block( Codec codec, const char* data, size_t length, std::string& result );
+
+    /**
+     * Decompress a block of data.
+     *
+     * @param  codec         the codec the data was compressed with
+     * @param  data          the compressed data
+     * @param  length        the size of the compressed data
+     * @param  result        receives the uncompressed data
+     * @param  resultLength  the exact size of the uncompressed data
+     *
+     * @return  true if successful, false otherwise
+     *
+     */
+    bool decompress_block( Codec codec, const char* data, size_t length, char* result, size_t resultLength );
+
+    /**
+     * Which files a cache location stores compressed, and how.
+     *
+     * @par
+     * A file is compressed if its extension is listed in @c extensions or it
+     * is at least @c threshold bytes big. If neither is given, all files are
+     * compressed.
+     *
+     */
+    struct CompressionPolicy {
+        Codec codec;
+        uintmax_t threshold;
+        std::set< std::string > extensions;
+
+        CompressionPolicy() : codec( CODEC_NONE ), threshold( 0 ) {}
+
+        /**
+         * Parse a codec name ("lz4", "zstd" or "none").
+         *
+         * @return  the codec if it is known and compiled in, CODEC_NONE otherwise
+         */
+        static Codec codec_from_name( const std::string& name );
+
+        /**
+         * Set the extensions from a whitespace or comma separated list.
+         *
+         * Leading dots are optional, matching is case insensitive.
+         */
+        void extensions_from_list( const std::string& list );
+
+        bool applies( const fs::path& file, uintmax_t size ) const;
+    };
+
+    /**
+     * A file stored compressed in independently decompressible chunks.
+     *
+     * @par
+     * The layout is a fixed header, an index holding the offset of every
+     * chunk, and the chunks themselves. Reading a range thus only touches the
+     * chunks covering it. A chunk that doesn't shrink is stored as is.
+     * @par
+     * All values are stored in host byte order -- the files never leave the
+     * machine that wrote them.
+     *
+     */
+    class CompressedFile : public SourceFile {
+        public:
+            enum {
+                CHUNK_SIZE = 1048576    ///< Uncompressed bytes per chunk
+            };
+
+            /**
+             * Opens a compressed file for reading.
+             *
+             * @param  path  the compressed file
+             *
+             */
+                          CompressedFile( const fs::path& path );
+            virtual      ~CompressedFile();
+
+            /**
+             * Query whether the file was opened and has a valid header.
+             *
+             */
+            bool          valid() const;
+
+            /**
+             * Query the size of the uncompressed data.
+             *
+             */
+            uintmax_t     size() const;
+
+            /**
+             * Read a range of the uncompressed data.
+             *
+             * @param  offset  where to start reading in the uncompressed data
+             * @param  buffer  receives the data
+             * @param  size    the number of bytes to read
+             *
+             * @return  the number of bytes read, -1 on error
+             *
+             */
+            virtual std::streamsize read( uintmax_t offset, char* buffer, std::size_t size );
+
+            /**
+             * Write the uncompressed data to a file.
+             *
+             * @return  true if successful, false otherwise
+             *
+             */
+            bool          decompress( const fs::path& destination ) const;
+
+            /**
+             * Compress a file.
+             *
+             * @param  source       the file to compress
+             * @param  destination  the compressed file to write, must not exist
+             * @param  codec        the codec to use for the chunks
+             *
+             * @return  true if successful, false otherwise
+             *
+             */
+            static bool   compress( const fs::path& source, const fs::path& destination, Codec codec );
+
+            /**
+             * Compress a file read from a backend.
+             *
+             * @param  source       the open file to compress
+             * @param  size         the size of the file
+             * @param  destination  the compressed file to write, must not exist
+             * @param  codec        the codec to use for the chunks
+             *
+             * @return  true if successful, false otherwise
+             *
+             */
+            static bool   compress( SourceFile& source, uintmax_t size, const fs::path& destination, Codec codec );
+
+            /**
+             * Check if a file is a compressed file.
+             *
+             */
+            static bool   is_compressed( const fs::path& path );
+
+        private:
+                          CompressedFile( const CompressedFile& );
+            CompressedFile& operator=( const CompressedFile& );
+
+            struct Header {
+                char magic[ 4 ];
+                boost::uint8_t version;
+                boost::uint8_t codec;
+                boost::uint16_t reserved;
+                boost::uint32_t chunkSize;
+                boost::uint32_t chunks;
+                boost::uint64_t size;
+            };
+
+            int fd_;
+            Header header_;
+
+            bool read_chunk( boost::uint32_t chunk, char* buffer, uintmax_t& length ) const;
+    };
+
+} // namespace Jupiter
+
+#endif // JUPITER_COMPRESSION_HPP
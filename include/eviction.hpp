@@ -0,0 +1,108 @@
+/**@file
+ *
+ * Choosing which cache entries to evict.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010 Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+
+#ifndef JUPITER_EVICTION_HPP
+#define JUPITER_EVICTION_HPP
+
+#include <boost/cstdint.hpp>
+#include <ctime>
+#include <string>
+#include <vector>
+
+namespace Jupiter {
+
+    /**
+     * Orders in which cache entries are evicted.
+     *
+     * @par
+     * EVICT_LRU removes the least recently accessed entries first. EVICT_LARGEST
+     * removes the biggest entries first, which keeps more small files cached
+     * and favours the hit ratio over the bytes fetched from the origin.
+     *
+     */
+    enum EvictionPolicy {
+        EVICT_LRU = 0,
+        EVICT_LARGEST = 1
+    };
+
+    /**
+     * What the eviction planner needs to know about a cache entry.
+     *
+     */
+    struct EvictionCandidate {
+        uintmax_t size;
+        time_t lastAccess;
+        bool pinned;        ///< Used by a cache instance, must not be evicted
+        bool preferred;     ///< Can be recreated locally, e.g. a decompressed copy
+
+        EvictionCandidate() : size( 0 ), lastAccess( 0 ), pinned( false ), preferred( false ) {}
+    };
+
+    /**
+     * Parse a policy name ("lru" or "largest").
+     *
+     * @param  name    the name
+     * @param  policy  receives the policy
+     *
+     * @return  true if the name is known, false otherwise
+     *
+     */
+    bool eviction_policy_from_name( const std::string& name, EvictionPolicy& policy );
+
+    /**
+     * Query the name of a policy.
+     *
+     */
+    std::string eviction_policy_name( EvictionPolicy policy );
+
+    /**
+     * Choose the entries to evict so the cache drops below its capacity.
+     *
+     * @par
+     * Preferred entries go before all others, each group in the order of the
+     * policy. Pinned entries are never chosen. Nothing is chosen if the total
+     * doesn't exceed the capacity.
+     * @par
+     * This is the one place that decides evictions: FileCache runs it on the
+     * cache directory, the trace replay on its model of the cache.
+     *
+     * @param  candidates  the entries in the cache
+     * @param  total       the bytes in the cache plus the bytes about to come in
+     * @param  capacity    the cache size in bytes
+     * @param  policy      the order to evict in
+     * @param  victims     receives the indices of the entries to evict, in order
+     *
+     * @return  true if evicting the victims makes enough room, false otherwise
+     *
+     */
+    bool plan_eviction( const std::vector< EvictionCandidate >& candidates, uintmax_t total, uintmax_t capacity,
+                        EvictionPolicy policy, std::vector< std::size_t >& victims );
+
+} // namespace Jupiter
+
+#endif // JUPITER_EVICTION_HPP
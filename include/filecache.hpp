@@ -38,18 +38,220 @@
  *
  */
 
+#ifndef JUPITER_FILECACHE_HPP
+#define JUPITER_FILECACHE_HPP
+
+#include <boost/thread/condition_variable.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/shared_mutex.hpp>
 #include <boost/thread/thread.hpp>
 #include <boost/interprocess/detail/os_thread_functions.hpp>
 #include <boost/filesystem/path.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <admission.hpp>
+#include <bypass.hpp>
+#include <cachestats.hpp>
+#include <cachetraits.hpp>
+#include <cachetrace.hpp>
+#include <compression.hpp>
+#include <eviction.hpp>
+#include <pathtable.hpp>
+#include <sourcebackend.hpp>
+#include <ctime>
+#include <ios>
 #include <map>
 #include <set>
+#include <vector>
 
 namespace fs = boost::filesystem;
 namespace ipd = boost::interprocess::detail;
 
 namespace Jupiter {
 
+    class FilePattern;
+    class PeerClient;
+    class Prefetcher;
+    class ProgressiveFill;
+    class Revalidator;
+    class SequencePredictor;
+    class WriteBackClient;
+
+    /**
+     * The state all cache instances of a process share, whatever their traits.
+     *
+     * @par
+     * Inventories, sizes and the other per-location settings are kept per
+     * location, so that instances of different BasicFileCache variants using
+     * the same location still see each other's files.
+     *
+     */
+    class FileCacheBase {
+        protected:
+            typedef std::map< ipd::OS_process_id_t, std::set< unsigned > > ProcessCounterInventory;
+
+            /**
+             * Orders cache locations by their string. Comparing paths element
+             * by element builds a string per element -- the per-location maps
+             * are looked up on every request.
+             */
+            struct LocationLess {
+                bool operator()( const fs::path& a, const fs::path& b ) const {
+                    return a.string() < b.string();
+                }
+            };
+
+            typedef std::map< unsigned, PathIdSet > ReferenceInventory;
+            typedef std::map< ipd::OS_process_id_t, ReferenceInventory > ProcessInventory;
+            typedef std::map< fs::path, ProcessInventory, LocationLess > Inventory;
+
+            /**
+             * The class keeps a map of cache locations
+             * Each entry points to a map of process IDs
+             * Each process ID points to a class instance reference number
+             * Each class instance reference number points to a set of paths,
+             * interned in paths_
+             * These paths are the files cached by the resp. instance of the class
+             * Once cached, they are guaranteed to not be altered by the cache as
+             * long as the process is alive and/or hasn't released the files.
+             * This covers the case where e.g.:
+             * - A render (A) uses a shadow map that got cached.
+             * - Another render (B) is launched on the machine later, demanding the
+             *   same map.
+             * - The map was updated on the server in the meantime.
+             * - The filecache lib will give render A the cached loaction and
+             *   render B the original one
+             * - If render B requests the file again via the filecache lib after
+             *   the process of render A has terminated, the file will get updated
+             *   in the cache.
+             */
+            typedef std::map< fs::path, uintmax_t, LocationLess > PathSizeMap;
+            typedef std::map< fs::path, boost::shared_ptr< PeerClient >, LocationLess > PathPeerMap;
+            typedef std::map< fs::path, CompressionPolicy, LocationLess > PathCompressionMap;
+            typedef std::map< fs::path, boost::shared_ptr< WriteBackClient >, LocationLess > PathWriteBackMap;
+            typedef std::map< fs::path, CacheStats, LocationLess > PathStatsMap;
+            typedef std::map< fs::path, std::vector< boost::shared_ptr< SourceBackend > >, LocationLess > PathSourceMap;
+            typedef std::map< fs::path, EvictionPolicy, LocationLess > PathEvictionMap;
+            typedef std::map< fs::path, AdmissionPolicy, LocationLess > PathAdmissionMap;
+            typedef std::map< fs::path, BypassPolicy, LocationLess > PathBypassMap;
+            typedef std::map< std::string, boost::shared_ptr< ProgressiveFill > > FillMap;
+            typedef std::map< fs::path, boost::shared_ptr< Revalidator >, LocationLess > PathRevalidatorMap;
+
+            /**
+             * What a revalidator found out about an entry's original
+             */
+            struct Validation {
+                SourceStats stats;
+                time_t checked;
+            };
+
+            typedef std::map< PathId, Validation > ValidationMap;
+
+            /**
+             * How much of its filesystem a location leaves free, see keepFree()
+             */
+            struct FreeSpace {
+                uintmax_t keep;         ///< Bytes to leave free
+                unsigned keepPercent;   ///< Percent of the filesystem to leave free
+                uintmax_t budget;       ///< Bytes the cache may use, as of the last check
+                time_t checked;
+
+                FreeSpace() : keep( 0 ), keepPercent( 0 ), budget( 0 ), checked( 0 ) {}
+            };
+
+            typedef std::map< fs::path, FreeSpace, LocationLess > PathFreeSpaceMap;
+
+            enum {
+                COPY_THREADS = 8,           ///< Parallel copies when caching a set of files
+                FREE_SPACE_INTERVAL = 10,   ///< Seconds a look at the free space of a location's filesystem is trusted
+                PARTIAL_TIMEOUT = 300,      ///< Seconds after their last write partial files are taken for abandoned
+                RECLAIM_PATHS = 65536       ///< Interned paths before unused ones are dropped, see reclaim_paths()
+            };
+
+            enum EntryState {
+                ENTRY_CURRENT,      ///< Usable as is
+                ENTRY_STALE_PINNED, ///< Outdated but used by another instance
+                ENTRY_OUTDATED      ///< Missing or outdated, needs copying
+            };
+
+            /**
+             * A copy planned when caching a set of files
+             */
+            struct PendingCopy {
+                fs::path source, entry, destination;
+                boost::shared_ptr< SourceBackend > backend;
+                SourceStats stats;
+                Codec codec;
+                bool done;
+                double seconds;     ///< The transfer's, once done
+            };
+
+            /**
+             * Guards the inventory, the per-location settings and every
+             * instance's own state. Process wide: instances on different
+             * threads share the inventory and settings of their location.
+             */
+            static boost::shared_mutex mutex_;
+
+            static ProcessCounterInventory instanceCounter_;
+            static Inventory cacheInventory_;
+            static PathSizeMap cacheSize_;
+            static PathFreeSpaceMap cacheFreeSpace_;
+            static PathPeerMap cachePeers_;
+            static PathCompressionMap cacheCompression_;
+            static PathWriteBackMap cacheWriteBack_;
+            static PathStatsMap cacheStats_;
+            static PathSourceMap cacheSources_;
+            static PathEvictionMap cacheEviction_;
+            static PathAdmissionMap cacheAdmission_;  ///< Guarded by statsMutex_, the sketches are updated on every request
+            static PathBypassMap cacheBypass_;        ///< Guarded by statsMutex_, like cacheAdmission_
+            static PathSizeMap cacheDelta_;           ///< Minimum size of files refreshed by blocks
+            static PathSizeMap cacheProgressive_;     ///< Minimum size of files readable while they are copied
+
+            static FillMap fills_;                    ///< Entries being filled, by entry path
+            static boost::mutex fillsMutex_;
+
+            static boost::mutex statsMutex_;
+            static std::string statsFile_;
+            static unsigned statsInterval_;
+            static time_t lastStatsDump_;
+
+            static TraceWriter tracer_;
+
+            static PathTable paths_;                  ///< The cache entries the inventory refers to
+            static std::size_t pathsKept_;            ///< Paths left by the last reclaim_paths()
+            static PathIdSet prefetched_;             ///< Prefetched entries not requested yet, guarded by statsMutex_
+
+            static PathSizeMap cacheRevalidate_;      ///< Seconds between background revalidations
+            static PathSizeMap cacheRevalidateRate_;  ///< Most originals revalidated per second, 0 for no limit
+            static ValidationMap validated_;          ///< Originals of entries checked in the background, guarded by statsMutex_
+            static PathRevalidatorMap cacheRevalidators_;   ///< Not registered as instances, see BasicFileCache::WORKER
+
+            static std::multiset< PathId > copying_;  ///< Entries being copied (or read by a copy) with mutex_ released, never evicted; guarded by it
+            static boost::condition_variable_any copied_;  ///< Signalled whenever a copy ends
+
+            /**
+             * Releases mutex_ for a scope, e.g. a transfer, and takes it again
+             * at its end. The caller holds mutex_ exclusively.
+             */
+            struct Unlocked {
+                Unlocked() { mutex_.unlock(); }
+                ~Unlocked() { mutex_.lock(); }
+            };
+
+            /**
+             * Marks an entry as being copied for a scope, see copying_.
+             * Created and destroyed with mutex_ held.
+             */
+            struct Copying {
+                PathId id;
+
+                explicit Copying( PathId entry ) : id( entry ) { copying_.insert( id ); }
+                ~Copying() { copying_.erase( copying_.find( id ) ); copied_.notify_all(); }
+            };
+    };
+
+
     /**
      * Multi location, multi process, thread safe file cache class.
      *
@@ -63,7 +265,9 @@ namespace Jupiter {
      * -# The cache is kept synchronized with the files it mirrors: if an original
      *    file is newer than the cached one (or has a different size), the cache is
      *    updated; unless the file is being used by another cache instance on the
-     *    same machine.
+     *    same machine. Then the new version is cached next to the old one: new
+     *    requests get the new version, the instances using the old one keep it
+     *    until they release it. See cacheFile().
      * -# A file is identified by its full path: files that have the same name in
      *    different directories do not collide.
      * -# Symbolic links are resolved prior to caching, this ensures that a given
@@ -84,7 +288,10 @@ namespace Jupiter {
      *
      * @par Thread safety
      * The cache always does obtain a mutex lock before accessing or modifying any
-     * data.
+     * data. All instances in a process share that lock, as they share the
+     * inventory and settings of their locations. It is released while a file
+     * is transferred; a request for a file that is being copied waits for the
+     * copy and uses it.
      * @par
      * Cache locations are referenced per class instance. This ensures that there
      * can be more that one cache instance per location per process.
@@ -93,8 +300,16 @@ namespace Jupiter {
      * this instance only. Other instances of the cache with this location under
      * the same process will keep shared files locked throughout their lifetime.
      *
+     * @par Traits
+     * Path mapping, which files are cached, when an entry is outdated and what
+     * gets evicted are decided by @c Traits at compile time, see
+     * DefaultCacheTraits. FileCache is the stock engine. The member
+     * definitions live in filecache.cpp; a variant is compiled by explicitly
+     * instantiating it there.
+     *
      */
-    class FileCache {
+    template< typename Traits = DefaultCacheTraits >
+    class BasicFileCache : protected FileCacheBase {
         public:
 
             /**
@@ -109,7 +324,40 @@ namespace Jupiter {
              * The cache looks for two environment variables, FILECACHE_LOCATION and
              * FILECACHE_SIZE which have the obvious meanings.  The size is specified in
              * in Megabytes (multiples of 1,000,000), not Mebibytes (multiples of
-             * 1,048,576).
+             * 1,048,576). FILECACHE_KEEP_FREE and FILECACHE_KEEP_FREE_PERCENT
+             * limit the size by the space left on the disk, see keepFree().
+             * @par
+             * If FILECACHE_PEERS is set, files missing from the cache are first
+             * fetched from the caches of the listed nodes. See peers().
+             * @par
+             * FILECACHE_COMPRESSION, FILECACHE_COMPRESSION_SIZE and
+             * FILECACHE_COMPRESSION_EXTENSIONS set up compressed storage. See
+             * compression().
+             * @par
+             * FILECACHE_WRITEBACK and FILECACHE_WRITEBACK_CODEC set up compressed
+             * write-back. See writeBack().
+             * @par
+             * FILECACHE_STATS and FILECACHE_STATS_INTERVAL set up the statistics
+             * dump. See statsFile().
+             * @par
+             * FILECACHE_TRACE sets up request tracing, see traceFile();
+             * FILECACHE_EVICTION the eviction policy, see eviction();
+             * FILECACHE_ADMISSION and FILECACHE_ADMISSION_LIMIT the admission
+             * filter, see admission(); FILECACHE_BYPASS adaptive bypassing,
+             * see bypass();
+             * FILECACHE_READAHEAD the number of files to read ahead, see
+             * readAhead().
+             * @par
+             * If the library was built with FILECACHE_SPANS defined,
+             * FILECACHE_TRACE_SPANS names a file ("%p" is replaced by the process
+             * ID) the internal steps of recent calls are written to, in Chrome's
+             * trace event format, when the last instance in the process goes
+             * away. See SpanTracer.
+             * @par
+             * Files on NFS mounts are always cached. FILECACHE_REMOTE lists further
+             * directories (colon separated) to cache as if they were remote;
+             * FILECACHE_REMOTE_LATENCY (milliseconds) and FILECACHE_REMOTE_BANDWIDTH
+             * (Megabytes per second) slow them down. See addSource().
              *
              * @param  where  The location for the cache. If this is empty, the cache will
              *                look for an environment variable called FILECACHE_LOCATION
@@ -121,24 +369,27 @@ namespace Jupiter {
              *                   will always return the original filename.
              *
              */
-                          FileCache( bool activate = true );
-                          FileCache( const fs::path& where, bool activate = true );
-                          FileCache( const std::string& where, bool activate = true );
+                          BasicFileCache( bool activate = true );
+                          BasicFileCache( const fs::path& where, bool activate = true );
+                          BasicFileCache( const std::string& where, bool activate = true );
             /**
              * Copy constructor.
              *
              * <a href="http://en.wikipedia.org/wiki/Rule_of_three_(C++_programming)">Rule of three</a>. :)
+             * @par
+             * The copy shares location and size with the original but is a cache
+             * instance of its own: it starts out owning no files.
              *
              */
-                          FileCache( const FileCache& fc );
+                          BasicFileCache( const BasicFileCache& fc );
             /**
              * Assignment operator.
              *
              * <a href="http://en.wikipedia.org/wiki/Rule_of_three_(C++_programming)">Rule of three</a>. :)
              *
              */
-            FileCache&    operator=( const FileCache& fc );
-            bool          operator==( const FileCache& fc ) const;
+            BasicFileCache& operator=( const BasicFileCache& fc );
+            bool          operator==( const BasicFileCache& fc ) const;
             /**
              * Destructor.
              *
@@ -150,7 +401,7 @@ namespace Jupiter {
              * on a machine that always runs at least one process using it.
              *
              */
-                         ~FileCache();
+                         ~BasicFileCache();
 
             /**
              * Cache a file.
@@ -164,6 +415,12 @@ namespace Jupiter {
              * This only matters in multi-threaded programs where a file is opened for
              * reading multiple times. If you need to ensure that each thread uses the
              * latest file and caches that, use multiple caches.
+             * @par
+             * If the original was altered and another instance uses the cached
+             * file, the new version is cached under a name of its own (the
+             * entry's name with the original's modification time and size
+             * appended) and returned instead. Once the old version isn't used
+             * anymore, the new one takes the entry's name again.
              *
              * @param  toCache  the file to cache
              *
@@ -173,6 +430,128 @@ namespace Jupiter {
             fs::path      cacheFile( const fs::path& );
             std::string   cacheFile( const std::string& toCache );
 
+            /**
+             * Cache a file, without allocating on hits.
+             *
+             * @par
+             * Like cacheFile( const std::string& ), but the path to use is
+             * assigned to @c result. A hit on an absolute path whose entry is
+             * current and already in this instance's inventory then costs no
+             * heap allocations, provided @c result is reused across calls.
+             * Symlinks, relative paths, compressed locations and an instance
+             * with read-ahead or tracing on take the general path.
+             *
+             * @param  toCache  the file to cache
+             * @param  result   receives the cached path if successful, the
+             *                  unaltered original path otherwise
+             *
+             * @return  true if @c result is a cached file, false otherwise
+             *
+             */
+            bool          cacheFile( const char* toCache, std::string& result );
+
+            /**
+             * Cache a file, returning a path that never goes away.
+             *
+             * @par
+             * Cached paths are interned (see PathTable): the result stays valid
+             * for the lifetime of the process and needn't be copied by the
+             * caller. Hits cost no heap allocations, as with
+             * cacheFile( const char*, std::string& ).
+             *
+             * @param  toCache  the file to cache
+             *
+             * @return  the cached path if successful, @c toCache itself otherwise
+             *
+             */
+            const char*   cacheFileInterned( const char* toCache );
+
+            /**
+             * Cache all files in a directory.
+             *
+             * @par
+             * The directory is listed once on the source. Files that are missing
+             * from the cache or outdated are then copied in parallel, after room
+             * was made for all of them at once.
+             * @par
+             * The files are owned by this cache instance as if cacheFile() had
+             * been called on each of them; cacheFile() on any of them is a hit.
+             *
+             * @param  directory  the directory to cache
+             * @param  recursive  whether to cache subdirectories too
+             *
+             * @return  the number of files that are in the cache
+             *
+             */
+            std::size_t   cacheDirectory( const fs::path& directory, bool recursive = false );
+            std::size_t   cacheDirectory( const std::string& directory, bool recursive = false );
+
+            /**
+             * Cache a set of files given by a pattern.
+             *
+             * @par
+             * The pattern's file name may hold UDIM tiles (<tt>\<UDIM\></tt>),
+             * frame numbers (<tt>####</tt>, <tt>%04d</tt>) and globs; see
+             * FilePattern. The directory must be literal. Matching files are
+             * found with a single listing and cached like with cacheDirectory().
+             * @par
+             * Since cached files keep their names, the returned pattern matches
+             * the cached copies of the files just like the original pattern
+             * matches the originals, e.g. for a renderer that resolves UDIMs
+             * itself. If files changed while another instance still uses
+             * their old copies, the new versions and the rest of the set are
+             * linked under names with a common tag, and the returned pattern
+             * matches those.
+             *
+             * @param  pattern  the pattern
+             *
+             * @return  the pattern inside the cache if all matching files were
+             *          cached, the unaltered pattern otherwise
+             *
+             */
+            fs::path      cachePattern( const fs::path& pattern );
+            std::string   cachePattern( const std::string& pattern );
+
+            /**
+             * Read a range of a file through the cache.
+             *
+             * @par
+             * The file is cached as by cacheFile() and the range is read from the
+             * cached copy. Compressed entries are decompressed on the fly, chunk by
+             * chunk, without creating a decompressed copy. This is how callers
+             * benefit fully from compressed storage.
+             * @par
+             * Unlike cacheFile(), this doesn't keep the file pinned for this cache
+             * instance.
+             *
+             * @param  file    the file to read from
+             * @param  offset  where to start reading
+             * @param  buffer  receives the data
+             * @param  size    the number of bytes to read
+             *
+             * @return  the number of bytes read, -1 on error
+             *
+             */
+            std::streamsize readFile( const fs::path& file, uintmax_t offset, char* buffer, std::size_t size );
+
+            /**
+             * Open a file for reading ranges through the cache.
+             *
+             * @par
+             * Like readFile(), for callers reading many ranges of a file. If
+             * the file is missing from the cache and large enough (see
+             * progressive()), it is filled in the background and the reader
+             * returns each range as soon as it has arrived instead of waiting
+             * for the whole copy.
+             *
+             * @param  file  the file to read from
+             *
+             * @return  the reader, to be deleted by the caller, or 0 if neither
+             *          the cache nor the original could be opened
+             *
+             */
+            SourceFile*   openFile( const fs::path& file );
+
             /**
              * Copy a file back from the cache.
              *
@@ -233,6 +612,25 @@ namespace Jupiter {
              */
             void          babble( bool logging );
 
+            /**
+             * Prefetch the next files of sequences this instance reads.
+             *
+             * @par
+             * When cacheFile() requests look like a numbered sequence (e.g.
+             * foo.0101.vdb, foo.0102.vdb), the next @c files files of the sequence
+             * are copied to the cache in the background, so they are hits by the
+             * time they are requested. Prefetches make room in the cache like
+             * any other copy but don't pin the files. See SequencePredictor.
+             * @par
+             * The prefetches, prefetch hits and wasted prefetches in stats() tell
+             * whether @c files is set right.
+             *
+             * @param  files  The number of files to read ahead, 0 switches read-ahead
+             *                off.
+             *
+             */
+            void          readAhead( unsigned files );
+
             void          relocate( const fs::path& where );
             void          relocate( const std::string& where );
             /**
@@ -249,6 +647,320 @@ namespace Jupiter {
              */
             void          resize( uintmax_t size );
 
+            /**
+             * Keep space free on the filesystem of this cache's location.
+             *
+             * @par
+             * The cache then never grows beyond what leaves at least
+             * @c megaBytes Megabytes, and at least @c percent percent of the
+             * filesystem, free. As other jobs fill the disk, the cache
+             * shrinks, evicting files when the next one comes in; as they
+             * free it, the cache grows again. The free space is looked at
+             * every FREE_SPACE_INTERVAL seconds. A size set with resize()
+             * still caps the cache.
+             * @par
+             * Note that this will override the setting for all cache
+             * instances sharing this cache's location.
+             *
+             * @param megaBytes  The space to keep free in Megabytes.
+             * @param percent    The share of the filesystem to keep free.
+             *                   Both 0 switch keeping space free off.
+             *
+             */
+            void          keepFree( uintmax_t megaBytes, unsigned percent = 0 );
+
+            /**
+             * Set the nodes to fetch missing files from for this cache's location.
+             *
+             * @par
+             * On a miss, the file is first requested from any of these nodes that
+             * advertises a current copy in its cache (see PeerServer). Only if no
+             * peer can deliver it, the original is copied.
+             * @par
+             * Note that this will override the peers for all cache instances sharing
+             * this cache's location.
+             *
+             * @param peers  A whitespace or comma separated list of host:port pairs.
+             *               An empty string switches peer fetching off.
+             *
+             */
+            void          peers( const std::string& peers );
+
+            /**
+             * Store files compressed at this cache's location.
+             *
+             * @par
+             * A file is compressed if its extension is in @c extensions or it is at
+             * least @c threshold Megabytes big. If neither is given, all files are
+             * compressed.
+             * @par
+             * Compressed entries count towards the cache size with their compressed
+             * size. cacheFile() still returns a plain file, decompressed next to the
+             * entry from the local copy; these decompressed copies are the first to
+             * go when the cache is tidied up. Use readFile() to read from the
+             * compressed entry directly.
+             * @par
+             * Note that this will override the compression for all cache instances
+             * sharing this cache's location.
+             *
+             * @param codec       "lz4", "zstd" or "none". Unavailable codecs switch
+             *                    compression off.
+             * @param threshold   The minimum size in Megabytes of files to compress.
+             * @param extensions  A whitespace or comma separated list of extensions
+             *                    of files to compress, e.g. "exr ptc abc".
+             *
+             */
+            void          compression( const std::string& codec, uintmax_t threshold = 0, const std::string& extensions = std::string() );
+
+            /**
+             * Set the order in which files are evicted at this cache's location.
+             *
+             * @par
+             * "lru" (the default) evicts the least recently accessed files first,
+             * "largest" the biggest ones. Decompressed copies of compressed entries
+             * always go first. Use filecachereplay on a trace (see traceFile())
+             * to find out which suits a workload.
+             * @par
+             * Note that this will override the policy for all cache instances
+             * sharing this cache's location.
+             *
+             * @param policy  "lru" or "largest". Unknown policies are ignored.
+             *
+             */
+            void          eviction( const std::string& policy );
+
+            /**
+             * Set which missing files are copied to this cache's location.
+             *
+             * @par
+             * "all" (the default) copies every file that fits. "tinylfu" keeps
+             * an estimate of how often each entry was requested lately (see
+             * FrequencySketch) and copies a file that needs others evicted
+             * only if it was requested more often than each of them. A scan
+             * over many files requested once thus can't flush the files
+             * requested over and over. Files that fit without evicting
+             * anything are always copied.
+             * @par
+             * Independently, files bigger than @c maxPercent percent of the
+             * cache size are never copied. Rejected files are read from the
+             * original; stats() counts admitted and rejected misses.
+             * @par
+             * FILECACHE_ADMISSION and FILECACHE_ADMISSION_LIMIT set the filter
+             * and the limit at construction. Note that this will override the
+             * setting for all cache instances sharing this cache's location.
+             *
+             * @param filter      "all" or "tinylfu". Unknown filters are ignored.
+             * @param maxPercent  The largest file to copy, in percent of the
+             *                    cache size. 0 means no limit.
+             *
+             */
+            void          admission( const std::string& filter, unsigned maxPercent = 0 );
+
+            /**
+             * Copy missing files to this cache's location only where it pays.
+             *
+             * @par
+             * The cache measures how fast copies from each source backend
+             * are, how long the backend takes to answer, and, every
+             * BypassPolicy::PROBE_INTERVAL seconds, how fast the cache disk
+             * writes. A missing file is copied if the cache disk keeps up
+             * with the source. If it doesn't, e.g. because other jobs keep it
+             * busy, the original is served instead; files requested before
+             * are also copied in the background, for the next request. See
+             * plan_bypass().
+             * @par
+             * stats() counts the misses bypassed and copied in the
+             * background. Instances created before the call serve the
+             * original instead of copying in the background.
+             * @par
+             * FILECACHE_BYPASS (1 or 0) switches adaptive bypassing on or off
+             * at construction. Note that this will override the setting for
+             * all cache instances sharing this cache's location.
+             *
+             * @param adaptive  Whether to bypass adaptively; false copies
+             *                  every missing file again.
+             *
+             */
+            void          bypass( bool adaptive );
+
+            /**
+             * Refresh large outdated files by their changed blocks only.
+             *
+             * @par
+             * Files of at least @c threshold Megabytes get their block
+             * checksums (see BlockSums) stored next to their entry when they
+             * are copied. When such an entry is outdated, or a new version is
+             * cached next to it, the checksums of the original are asked from
+             * the source backend and only the blocks that changed or were
+             * appended are fetched. The rest is copied from the old entry.
+             * @par
+             * Backends that can't checksum where the file is stored (NFS)
+             * always copy the whole file, and their entries get no checksums
+             * (see SourceBackend::checksummed()). stats() counts delta
+             * refreshes and the bytes they didn't fetch.
+             * @par
+             * FILECACHE_DELTA sets the threshold at construction. Note that
+             * this will override the setting for all cache instances sharing
+             * this cache's location.
+             *
+             * @param threshold  The minimum size in Megabytes, 0 switches delta
+             *                   refreshes off.
+             *
+             */
+            void          deltaRefresh( uintmax_t threshold );
+
+            /**
+             * Make large files readable while they are being copied.
+             *
+             * @par
+             * A file of at least @c threshold Megabytes that openFile() or
+             * readFile() finds missing from the cache is copied block by block
+             * on a background thread (see ProgressiveFill). Reads wait only
+             * for the blocks of their range, which are copied ahead of the
+             * rest. cacheFile() on a file being filled waits for the fill
+             * instead of copying the file again.
+             * @par
+             * Progressive fills bypass compression and peers. stats() counts
+             * them.
+             * @par
+             * FILECACHE_PROGRESSIVE sets the threshold at construction. Note
+             * that this will override the setting for all cache instances
+             * sharing this cache's location.
+             *
+             * @param threshold  The minimum size in Megabytes, 0 switches
+             *                   progressive fills off.
+             *
+             */
+            void          progressive( uintmax_t threshold );
+
+            /**
+             * Check the entries in use in the background.
+             *
+             * @par
+             * Every @c interval seconds, a thread asks the sources about the
+             * originals of all entries the instances of this process use at
+             * the cache's location, batched like cacheDirectory() does.
+             * Updated originals are copied right away: over the entry if
+             * nobody uses it, as a version next to it otherwise (see
+             * cacheFile()). The next request finds them cached.
+             * @par
+             * While an entry's last check is at most two intervals old,
+             * cacheFile() trusts it instead of asking the source itself. A
+             * file changed on the source may thus be served from the cache
+             * for up to an interval longer.
+             * @par
+             * stats() counts the checks and the entries refreshed. The checks
+             * pause while a process has no cache instances left and resume
+             * with its next one.
+             * @par
+             * FILECACHE_REVALIDATE and FILECACHE_REVALIDATE_RATE set the
+             * interval and rate at construction. Note that this will override
+             * the setting for all cache instances sharing this cache's
+             * location.
+             *
+             * @param interval  Seconds between checks, 0 switches background
+             *                  revalidation off.
+             * @param rate      The most originals to ask about per second,
+             *                  spread over each interval. 0 means no limit.
+             *
+             */
+            void          revalidate( unsigned interval, unsigned rate = 0 );
+
+            /**
+             * Copy files back through a server at the origin for this cache's location.
+             *
+             * @par
+             * uncacheFile() then sends files to a PeerServer running on the file
+             * server, compressing them on the fly; the server decompresses them and
+             * writes them in place (see WriteBackClient). This cuts the bytes on the
+             * wire for large, compressible outputs. The destination path must be
+             * the same on both ends and lie below one of the server's writable
+             * directories. If the server can't take a file, it is copied as usual.
+             * @par
+             * Note that this will override the write-back for all cache instances
+             * sharing this cache's location.
+             *
+             * @param server  The server as a host:port pair. An empty string switches
+             *                compressed write-back off.
+             * @param codec   "lz4" or "zstd".
+             *
+             */
+            void          writeBack( const std::string& server, const std::string& codec = "lz4" );
+
+            /**
+             * Add a source of original files for this cache's location.
+             *
+             * @par
+             * Files the backend handles() are cached and read through the backend.
+             * Backends are asked in the order they were added; files on NFS mounts
+             * are always handled by an NfsBackend if no other backend claims them.
+             * @par
+             * Note that this will add the source for all cache instances sharing
+             * this cache's location.
+             *
+             * @param backend  The backend.
+             *
+             */
+            void          addSource( const boost::shared_ptr< SourceBackend >& backend );
+
+            /**
+             * Query what this cache's location did in this process so far.
+             *
+             * @return  a snapshot of the location's statistics
+             *
+             */
+            CacheStats    stats() const;
+
+            /**
+             * Query what all cache locations did in this process so far.
+             *
+             * @return  the sum of the statistics of all locations
+             *
+             */
+            static CacheStats processStats();
+
+            /**
+             * Dump the statistics of this process to a file, periodically.
+             *
+             * @par
+             * The file is written in Prometheus text format (e.g. for the node
+             * exporter's textfile collector), with one set of samples per cache
+             * location, labeled with the location, process name and process ID.
+             * Statistics only change when the cache is used, so the file is
+             * rewritten by a cache call at most every @c interval seconds after
+             * the previous dump, and once more when the last instance in the
+             * process goes away. The file is replaced atomically.
+             * @par
+             * This setting is process wide.
+             *
+             * @param file      The file to write. A "%p" in the name is replaced by
+             *                  the process ID. An empty path switches dumping off.
+             * @param interval  The minimum number of seconds between two dumps.
+             *
+             */
+            static void   statsFile( const fs::path& file, unsigned interval = 60 );
+
+            /**
+             * Trace every cacheFile() and releaseFile() call to a file.
+             *
+             * @par
+             * Each request is stored as a fixed size binary TraceRecord: when it
+             * happened, the process and instance, a hash of the file's path, its
+             * size, whether it was a hit or a miss and how long it took. The
+             * filecachereplay tool feeds traces through the eviction engine to
+             * compare cache sizes and policies without touching any files.
+             * @par
+             * Records are buffered and appended in batches; the buffer is flushed
+             * when the last instance in the process goes away.
+             * @par
+             * This setting is process wide.
+             *
+             * @param file  The file to append to. A "%p" in the name is replaced by
+             *              the process ID. An empty path switches tracing off.
+             *
+             */
+            static void   traceFile( const fs::path& file );
+
             /**
              * Query the cache's size.
              *
@@ -294,70 +1006,121 @@ namespace Jupiter {
             typedef boost::unique_lock< boost::shared_mutex > WriteGuard;
             typedef boost::shared_lock< boost::shared_mutex > ReadGuard;
 
-            typedef std::map< ipd::OS_process_id_t, std::set< unsigned > > ProcessCounterInventory;
-
-            typedef std::map< unsigned, std::set< fs::path > > ReferenceInventory;
-            typedef std::map< ipd::OS_process_id_t, ReferenceInventory > ProcessInventory;
-            typedef std::map< fs::path, ProcessInventory > Inventory;
-
             /**
-             * The class keeps a map of cache locations
-             * Each entry points to a map of process IDs
-             * Each process ID points to a class instance reference number
-             * Each class instance reference number points to a set of paths
-             * These paths are the files cached by the resp. instance of the class
-             * Once cached, they are guaranteed to not be altered by the cache as
-             * long as the process is alive and/or hasn't released the files.
-             * This covers the case where e.g.:
-             * - A render (A) uses a shadow map that got cached.
-             * - Another render (B) is launched on the machine later, demanding the
-             *   same map.
-             * - The map was updated on the server in the meantime.
-             * - The filecache lib will give render A the cached loaction and
-             *   render B the original one
-             * - If render B requests the file again via the filecache lib after
-             *   the process of render A has terminated, the file will get updated
-             *   in the cache.
+             * Tags the constructor of an instance working for another one on
+             * a background thread. Such an instance isn't registered: it owns
+             * no files and doesn't count as an instance of the process.
              */
-            typedef std::map< fs::path, uintmax_t > PathSizeMap;
+            enum WorkerTag { WORKER };
 
-            static ProcessCounterInventory instanceCounter_;
-            static Inventory cacheInventory_;
-            static PathSizeMap cacheSize_;
+                          BasicFileCache( const BasicFileCache& owner, WorkerTag );
 
-            bool cache_, log_;
+            bool cache_, log_, worker_;
             fs::path cacheLocation_, cwd_;
+            std::string cachePrefix_;       ///< cacheLocation_ ending in a '/', cached entries start with it
 
             std::string processName_;
 
             unsigned reference_;
 
-            mutable boost::shared_mutex mutex_;
+            TraceRecord::Outcome outcome_;  ///< What the last cache_entry() call did
+
+            boost::scoped_ptr< SequencePredictor > predictor_;
+            boost::scoped_ptr< Prefetcher > prefetcher_;
+            boost::scoped_ptr< Prefetcher > copier_;     ///< Copies bypassed files in the background
+
             mutable boost::shared_mutex messageMutex_;
 
             void init_cache( const fs::path&, bool );
+            void register_instance();
             void relocate_cache( const fs::path& where );
-            // TODO: move all this stuff to a traits class and convert filecache into a template
+            void update_prefix();
+            fs::path cache_file( const fs::path& );
+            const char* cached_hit( const char* source, std::size_t length, PathId& id );
+            std::size_t entry_name( const char* source, std::size_t length, char* entry ) const;
             fs::path cached_file_path( const fs::path& ) const;
             fs::path original_file_path( const fs::path& ) const;
             fs::path cached_file_name( const fs::path& ) const;
             bool is_remote( const fs::path& ) const;
-            bool is_different( const fs::path&, const fs::path& ) const;
+            boost::shared_ptr< SourceBackend > source_for( const fs::path& ) const;
+            boost::shared_ptr< SourceBackend > source_for( const char* ) const;
+            bool source_stats( const fs::path&, SourceStats& ) const;
+            bool is_different( const fs::path&, const fs::path&, const SourceStats* known = 0 ) const;
+            bool uses_compression( const fs::path& ) const;
+            fs::path compressed_file_path( const fs::path& ) const;
+            bool is_compressed_file( const fs::path& ) const;
             bool is_used( const fs::path& ) const;
             bool is_used_by_this_cache( const fs::path& ) const;
+            bool is_used_by_this_cache( PathId ) const;
             void register_file( const fs::path& );
-            fs::path copy_to_cache( const fs::path&, const fs::path& );
+            void register_file( PathId );
+            void register_hit( const fs::path& );
+            void register_hit( PathId );
+            EntryState entry_state( const fs::path&, const fs::path&, const SourceStats* original = 0 ) const;
+            fs::path cache_entry( const fs::path&, const fs::path& );
+            fs::path cache_version( const fs::path&, const fs::path&, EntryState );
+            fs::path version_path( const fs::path&, const SourceStats& ) const;
+            fs::path materialize_file( const fs::path&, const fs::path& );
+            fs::path copy_to_cache( const fs::path&, const fs::path&, const fs::path& base = fs::path() );
+            bool delta_transfer( const SourceBackend&, const fs::path&, const SourceStats&, const fs::path& base, const fs::path& );
+            bool uses_delta( uintmax_t size ) const;
+            fs::path checksum_file_path( const fs::path& ) const;
+            bool is_checksum_file( const fs::path& ) const;
+            SourceFile* fill_progressively( const SourceBackend&, const fs::path&, const fs::path& );
+            bool join_fill( const fs::path& );
+            bool uses_progressive( uintmax_t size ) const;
+            fs::path partial_file_path( const fs::path&, const char* kind ) const;
+            bool is_partial_file( const fs::path& ) const;
+            bool is_abandoned( const fs::path& partial ) const;
+            bool is_copying( const fs::path& ) const;
+            bool wait_for_copy( const fs::path& );
+            void start_revalidator( unsigned interval, unsigned rate, boost::shared_ptr< Revalidator >& previous );
+            void revalidate_entries( unsigned rate );
+            void refresh_entry( const PendingCopy& );
+            bool revalidated( PathId, SourceStats& ) const;
+            bool transfer( const SourceBackend&, const fs::path&, const SourceStats&, const fs::path&, Codec ) const;
+            bool fetch_from_peers( const fs::path&, const SourceStats&, const fs::path& ) const;
+            bool collect_files( const fs::path& directory, const FilePattern* pattern, bool recursive, std::vector< fs::path >& files ) const;
+            std::size_t cache_set( const std::vector< fs::path >& files, std::vector< fs::path >* used = 0 );
+            fs::path name_set( const fs::path& pattern, const std::vector< fs::path >& used );
+            void stat_sources( std::vector< PendingCopy >& copies ) const;
+            void transfer_sources( std::vector< PendingCopy >& copies ) const;
+            void run_copies( std::vector< PendingCopy >& copies, bool planning ) const;
+            void copy_worker( std::vector< PendingCopy >* copies, std::size_t* next, boost::mutex* nextMutex, bool planning ) const;
             void copy_overwrite_file( const fs::path&, const fs::path& ) const;
+            void copy_back( const fs::path&, const fs::path&, bool overwrite ) const;
+            void read_ahead( const fs::path& source );
+            void prefetch_file( const fs::path& source, bool prefetch );
             void erase_this_reference();
             void tidy_up_inventory();
-            bool tidy_up_cache( const fs::path& path );
+            void reclaim_paths( const fs::path& admitting );
+            bool tidy_up_cache( uintmax_t incoming, const fs::path& admitting = fs::path() );
+            bool make_room( uintmax_t incoming, const fs::path& admitting );
+            void check_free_space( uintmax_t used );
+            bool effective_size( uintmax_t& size ) const;
+            bool admits( const fs::path& candidate, const std::vector< fs::path >& files, const std::vector< std::size_t >& victims ) const;
+            void record_request( PathId ) const;
+            BypassDecision bypass_decision( const SourceBackend&, const fs::path& entry, uintmax_t size ) const;
+            void record_source( const SourceBackend&, double statSeconds, uintmax_t bytes, double copySeconds ) const;
             fs::path read_link( const fs::path& link ) const;
+            fs::path resolve_link( const fs::path& ) const;
             time_t last_access_time( const fs::path& ) const;
             bool create_full_path( const fs::path& ) const;
 
+            void count( boost::uint64_t CacheStats::* counter, boost::uint64_t amount = 1 ) const;
+            void record_latency( LatencyHistogram CacheStats::* histogram, const StopWatch& watch ) const;
+            void record_latency( LatencyHistogram CacheStats::* histogram, double seconds ) const;
+            void dump_stats( bool force ) const;
+            void trace( TraceRecord::Operation operation, TraceRecord::Outcome outcome, const fs::path& entry, uintmax_t size, double seconds ) const;
+
             inline void message( const std::string& message ) const;
             std::string get_process_name() const;
     };
 
 
+    typedef BasicFileCache<> FileCache;
+
+
 } // namespace Jupiter
+
+#endif // JUPITER_FILECACHE_HPP
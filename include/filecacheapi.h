@@ -0,0 +1,192 @@
+/**@file
+ *
+ * C interface to FileCache, for renderer plugins and foreign function interfaces.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010 Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+
+#ifndef JUPITER_FILECACHEAPI_H
+#define JUPITER_FILECACHEAPI_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A cache instance, see Jupiter::FileCache.
+ *
+ * @par
+ * A handle from filecache_open() is thread safe and an instance of its own: it owns the files cached through it until they are released or
+ * the handle is closed. A handle from filecache_attach() shares the process's
+ * engine for the location with all other attached handles, see
+ * Jupiter::SharedCache, and pins the files cached through it the same way.
+ * @par
+ * No function throws. All return a status; paths come back either in a
+ * buffer the caller provides or as an interned string that stays valid for
+ * the lifetime of the process. Neither allocates on a cache hit, so the
+ * functions can be called per shading point, e.g. from Python through
+ * ctypes:
+ * @code
+ * lib = ctypes.CDLL( "libFileCache.so" )
+ * lib.filecache_open.restype = ctypes.c_void_p
+ * cache = ctypes.c_void_p( lib.filecache_open( None, None ) )
+ * result = ctypes.c_char_p()
+ * lib.filecache_cache_file_interned( cache, b"/net/tex/foo.tx", ctypes.byref( result ) )
+ * @endcode
+ *
+ */
+typedef struct FileCacheHandle FileCacheHandle;
+
+/**
+ * Status codes.
+ *
+ * Negative values are errors.
+ *
+ */
+enum FileCacheStatus {
+    FILECACHE_OK = 0,               /**< The result is a cached file */
+    FILECACHE_NOT_CACHED = 1,       /**< The result is the original file, e.g. because it is local */
+    FILECACHE_ERROR_ARGUMENT = -1,  /**< A required argument was null */
+    FILECACHE_ERROR_BUFFER = -2,    /**< The buffer is too small, the length needed was stored */
+    FILECACHE_ERROR_MEMORY = -3,    /**< Out of memory */
+    FILECACHE_ERROR_INTERNAL = -4   /**< Anything else went wrong */
+};
+
+/**
+ * Open a cache.
+ *
+ * @param  location  the cache's directory; null uses FILECACHE_LOCATION or
+ *                   the default, see Jupiter::FileCache
+ * @param  status    receives the status if not null
+ *
+ * @return  the handle, to be closed with filecache_close(), or null on error
+ *
+ */
+FileCacheHandle* filecache_open( const char* location, int* status );
+
+/**
+ * Attach to the process's shared cache for a location.
+ *
+ * @par
+ * The first handle attached to a location creates its engine, the last one
+ * closed destroys it. Attaching to an existing engine is cheap, so plugins
+ * can attach per thread or shading context. An attached handle should only
+ * be used by one thread at a time.
+ * @par
+ * filecache_relocate() moves the handle to the other location's engine,
+ * releasing its files; filecache_resize() resizes the shared engine.
+ *
+ * @param  location  as for filecache_open()
+ * @param  status    receives the status if not null
+ *
+ * @return  the handle, to be closed with filecache_close(), or null on error
+ *
+ */
+FileCacheHandle* filecache_attach( const char* location, int* status );
+
+/**
+ * Close a cache, releasing all files cached through it.
+ *
+ */
+void filecache_close( FileCacheHandle* cache );
+
+/**
+ * Cache a file, copying the path to use into a buffer.
+ *
+ * @param  cache   the cache
+ * @param  path    the file to cache
+ * @param  buffer  receives the cached path, or the original one, terminated
+ * @param  size    the size of the buffer
+ * @param  length  receives the length of the path without the terminator if
+ *                 not null, also if the buffer is too small
+ *
+ * @return  FILECACHE_OK, FILECACHE_NOT_CACHED or an error
+ *
+ */
+int filecache_cache_file( FileCacheHandle* cache, const char* path, char* buffer, size_t size, size_t* length );
+
+/**
+ * Cache a file, returning an interned path.
+ *
+ * @param  cache   the cache
+ * @param  path    the file to cache
+ * @param  result  receives the cached path, valid for the lifetime of the
+ *                 process, or @c path itself if the file isn't cached
+ *
+ * @return  FILECACHE_OK, FILECACHE_NOT_CACHED or an error
+ *
+ */
+int filecache_cache_file_interned( FileCacheHandle* cache, const char* path, const char** result );
+
+/**
+ * Release a file cached through this cache.
+ *
+ */
+int filecache_release_file( FileCacheHandle* cache, const char* path );
+
+/**
+ * Get a location to write a file to, see Jupiter::FileCache::cacheFileForWriting().
+ *
+ * Buffer, size and length are as for filecache_cache_file().
+ *
+ */
+int filecache_cache_file_for_writing( FileCacheHandle* cache, const char* path, char* buffer, size_t size, size_t* length );
+
+/**
+ * Move a file written to the cache to its destination, see
+ * Jupiter::FileCache::uncacheFile().
+ *
+ * Buffer, size and length are as for filecache_cache_file() and receive the
+ * destination.
+ *
+ */
+int filecache_uncache_file( FileCacheHandle* cache, const char* path, int overwrite, int ifNewer, char* buffer, size_t size, size_t* length );
+
+/**
+ * Move the cache to another directory.
+ *
+ */
+int filecache_relocate( FileCacheHandle* cache, const char* location );
+
+/**
+ * Set the size of the cache in megabytes, 0 is unlimited.
+ *
+ */
+int filecache_resize( FileCacheHandle* cache, unsigned long megabytes );
+
+/**
+ * Describe a status code.
+ *
+ * @return  a static string
+ *
+ */
+const char* filecache_status_string( int status );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* JUPITER_FILECACHEAPI_H */
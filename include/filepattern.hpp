@@ -0,0 +1,78 @@
+/**@file
+ *
+ * File name patterns for texture sets and frame sequences.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010 Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+
+#ifndef JUPITER_FILEPATTERN_HPP
+#define JUPITER_FILEPATTERN_HPP
+
+#include <string>
+
+namespace Jupiter {
+
+    /**
+     * A pattern matching the names of a set of files in one directory.
+     *
+     * @par
+     * Besides literal characters, a pattern may contain:
+     * - <tt>\<UDIM\></tt> (in any case): a four digit UDIM tile number, 1001 and up.
+     * - <tt>#</tt>: a frame number of at least as many digits as there are
+     *   hashes, i.e. <tt>####</tt> matches 0001 and 10000. Negative frames
+     *   have a leading minus.
+     * - <tt>%d</tt>, <tt>%04d</tt>: the printf notation for the same.
+     * - <tt>*</tt>, <tt>?</tt> and <tt>[...]</tt>: shell globs, where
+     *   <tt>[!...]</tt> or <tt>[^...]</tt> negates a class.
+     *
+     */
+    class FilePattern {
+        public:
+            /**
+             * Creates a pattern.
+             *
+             * @param  pattern  the pattern for file names, without a directory
+             *
+             */
+            explicit      FilePattern( const std::string& pattern );
+
+            /**
+             * Query whether the pattern contains no wildcards.
+             *
+             */
+            bool          literal() const;
+
+            bool          matches( const std::string& name ) const;
+
+        private:
+            std::string pattern_;
+
+            bool match( std::string::size_type p, const std::string& name, std::string::size_type n ) const;
+            bool number( std::string::size_type p, std::string::size_type& length, std::string::size_type& digits, bool& udim ) const;
+            bool character_class( std::string::size_type p, char c, std::string::size_type& length, bool& matched ) const;
+    };
+
+} // namespace Jupiter
+
+#endif // JUPITER_FILEPATTERN_HPP
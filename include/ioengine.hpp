@@ -0,0 +1,119 @@
+/**@file
+ *
+ * Batched stats and copies of local files, on io_uring or threads.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010 Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+
+#ifndef JUPITER_IOENGINE_HPP
+#define JUPITER_IOENGINE_HPP
+
+#include <sourcebackend.hpp>
+#include <string>
+#include <vector>
+
+namespace Jupiter {
+
+    /**
+     * A file to stat in a batch.
+     *
+     */
+    struct StatRequest {
+        std::string path;
+        SourceStats stats;      ///< Receives the file's stats
+        bool done;              ///< Receives whether the file exists
+
+        StatRequest() : done( false ) {}
+    };
+
+    /**
+     * A file to copy in a batch.
+     *
+     */
+    struct CopyRequest {
+        std::string source, destination;
+        double seconds;         ///< Receives the time the copy took
+        bool done;              ///< Receives whether the copy succeeded
+
+        CopyRequest() : seconds( 0.0 ), done( false ) {}
+    };
+
+    /**
+     * Runs many independent stats and copies of local files at once.
+     *
+     * @par
+     * The cache hands it the files of a batch (see FileCache::cacheDirectory())
+     * whose backend is direct(), i.e. reachable with plain system calls. With
+     * io_uring, all of a batch's operations are queued on one ring and
+     * completed by the calling thread, keeping up to QUEUE_DEPTH of them in
+     * flight. Without it, a pool of threads works through the batch, one
+     * blocking call at a time each.
+     * @par
+     * Copies create the destination, they fail if it exists rather than
+     * replace or overwrite it.
+     *
+     */
+    class IoEngine {
+        public:
+            enum {
+                QUEUE_DEPTH = 64,           ///< Operations in flight on a ring
+                THREADS = 8,                ///< Threads of the fallback pool
+                COPY_BLOCK_SIZE = 262144    ///< Bytes a copy reads and writes at a time
+            };
+
+            virtual               ~IoEngine();
+
+            /**
+             * The engine's name, "io_uring" or "threads".
+             *
+             */
+            virtual const char*   name() const = 0;
+
+            /**
+             * Stat a batch of files, following symlinks.
+             *
+             */
+            virtual void          stat( std::vector< StatRequest >& requests ) = 0;
+
+            /**
+             * Copy a batch of files.
+             *
+             */
+            virtual void          copy( std::vector< CopyRequest >& requests ) = 0;
+
+            /**
+             * Create an engine, on io_uring if the library was built with
+             * FILECACHE_URING and the kernel supports it, on threads otherwise.
+             *
+             * @param  uring  false to always use the thread pool
+             *
+             * @return  the engine, to be deleted by the caller
+             *
+             */
+            static IoEngine*      create( bool uring = true );
+    };
+
+} // namespace Jupiter
+
+#endif // JUPITER_IOENGINE_HPP
@@ -0,0 +1,180 @@
+/**@file
+ *
+ * Interned paths and sets of them, for the cache inventory.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010 Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+
+#ifndef JUPITER_PATHTABLE_HPP
+#define JUPITER_PATHTABLE_HPP
+
+#include <boost/cstdint.hpp>
+#include <boost/thread/mutex.hpp>
+#include <string>
+#include <vector>
+
+namespace Jupiter {
+
+    typedef boost::uint32_t PathId;
+
+    /**
+     * Stores each distinct path once and names it by a 32 bit id.
+     *
+     * @par
+     * The strings live in large arena blocks, the lookup is an open addressing
+     * hash table of ids. A long running process can drop the paths it doesn't
+     * refer to any more with retain(); their ids are then reused, and an arena
+     * block is freed once none of its strings is left. Strings handed out by
+     * c_str() are never removed.
+     * @par
+     * The table is thread safe.
+     *
+     */
+    class PathTable {
+        public:
+            enum {
+                BLOCK_SIZE = 65536  ///< Bytes per arena block
+            };
+
+                          PathTable();
+                         ~PathTable();
+
+            /**
+             * Query the id of a path, adding the path if it is new.
+             *
+             */
+            PathId        intern( const std::string& path );
+            PathId        intern( const char* path, std::size_t length );
+
+            /**
+             * Query the id of a path without adding it.
+             *
+             * @return  true if the path is in the table, false otherwise
+             *
+             */
+            bool          find( const std::string& path, PathId& id ) const;
+            bool          find( const char* path, std::size_t length, PathId& id ) const;
+
+            /**
+             * Query the path of an id.
+             *
+             */
+            std::string   path( PathId id ) const;
+
+            /**
+             * Query the path of an id as a C string.
+             *
+             * The string stays valid for the lifetime of the table: retain()
+             * keeps the path from now on.
+             *
+             */
+            const char*   c_str( PathId id );
+
+            /**
+             * Remove all paths but the given ones and those handed out by
+             * c_str().
+             *
+             * @param  live  the ids to keep, sorted
+             *
+             * @return  the number of paths removed
+             *
+             */
+            std::size_t   retain( const std::vector< PathId >& live );
+
+            /**
+             * Query the number of paths in the table.
+             *
+             */
+            std::size_t   size() const;
+
+        private:
+                          PathTable( const PathTable& );
+            PathTable&    operator=( const PathTable& );
+
+            enum {
+                EMPTY = 0xffffffff  ///< Unused hash table slot
+            };
+
+            struct Entry {
+                const char* data;           ///< 0 if the id is free
+                boost::uint32_t length;
+                boost::uint32_t hash;
+                boost::uint32_t block;
+                bool exposed;               ///< Handed out by c_str()
+            };
+
+            std::vector< char* > blocks_;   ///< 0 once freed
+            std::vector< std::size_t > blockLive_;   ///< Bytes of each block still in use
+            std::size_t blockUsed_;
+
+            std::vector< Entry > entries_;
+            std::vector< PathId > free_;    ///< Ids removed by retain(), for reuse
+            std::vector< PathId > slots_;   ///< Size is a power of two
+
+            mutable boost::mutex mutex_;
+
+            std::size_t   slot( const char* data, std::size_t length, boost::uint32_t hash ) const;
+            void          store( Entry& entry, const char* data, std::size_t length );
+            void          rehash( std::size_t slots );
+    };
+
+    /**
+     * A set of path ids, kept as a sorted vector.
+     *
+     */
+    class PathIdSet {
+        public:
+            /**
+             * Add an id.
+             *
+             * @return  true if it wasn't in the set yet, false otherwise
+             *
+             */
+            bool          insert( PathId id );
+
+            /**
+             * Remove an id.
+             *
+             * @return  true if it was in the set, false otherwise
+             *
+             */
+            bool          erase( PathId id );
+
+            bool          count( PathId id ) const;
+            bool          empty() const;
+            std::size_t   size() const;
+
+            /**
+             * Query the ids, in ascending order.
+             *
+             */
+            const std::vector< PathId >& ids() const;
+
+        private:
+            std::vector< PathId > ids_;
+    };
+
+} // namespace Jupiter
+
+#endif // JUPITER_PATHTABLE_HPP
@@ -0,0 +1,258 @@
+/**@file
+ *
+ * Peer-to-peer fetching of cached files between render nodes.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010 Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+
+#ifndef JUPITER_PEERCACHE_HPP
+#define JUPITER_PEERCACHE_HPP
+
+#include <compression.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/filesystem/path.hpp>
+#include <ctime>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace fs = boost::filesystem;
+
+namespace Jupiter {
+
+    /**
+     * Serves the contents of a cache location to other nodes.
+     *
+     * @par
+     * The server speaks a small line based protocol over TCP:
+     * - <tt>LIST</tt> is answered with one line per cached file
+     *   (<tt>size mtime name</tt>), terminated by a line containing a single
+     *   dot. This is how a node advertises what it holds.
+     * - <tt>FETCH size mtime name</tt> is answered with <tt>OK size</tt>
+     *   followed by the file's contents if the cached copy is at least as new
+     *   as @c mtime and has the given @c size, or with <tt>NO</tt> otherwise.
+     * - <tt>STORE codec size overwrite path</tt> writes a file below one of
+     *   the writable() roots. The server answers <tt>GO</tt> or <tt>NO</tt>,
+     *   then receives the file's contents as a stream of compressed blocks
+     *   (see WriteBackClient) and answers <tt>OK</tt> once the file is in
+     *   place or <tt>NO</tt> if anything went wrong.
+     * @par
+     * Names are the leaf names of files inside the cache location, i.e. the
+     * original path with all separators replaced, as created by FileCache.
+     * @par
+     * Files are opened before they are checked and streamed from the open
+     * descriptor. A concurrent update or eviction of the cached copy thus
+     * never corrupts a transfer that is already under way.
+     *
+     */
+    class PeerServer {
+        public:
+            /**
+             * Creates a server for the given cache location.
+             *
+             * @param  location  The cache location to serve.
+             * @param  port      The TCP port to listen on.
+             * @param  address   The address to listen on. Anything but the
+             *                   loopback lets other nodes fetch from and write
+             *                   to this node without authentication, so only
+             *                   bind to interfaces on a trusted network. An
+             *                   empty address listens on all interfaces.
+             *
+             */
+                          PeerServer( const fs::path& location, unsigned short port, const std::string& address = "127.0.0.1" );
+                         ~PeerServer();
+
+            /**
+             * Start accepting connections.
+             *
+             * @return  true if the server is listening, false otherwise
+             *
+             */
+            bool          start();
+            /**
+             * Stop accepting connections and wait for all transfers to finish.
+             *
+             */
+            void          stop();
+            /**
+             * Serve connections on the calling thread until stop() is called.
+             *
+             */
+            void          run();
+
+            /**
+             * Accept STORE requests for files below the given directory.
+             *
+             * @par
+             * Without any writable roots, the server refuses all STORE requests.
+             * Files are written with the permissions of the server's process.
+             * Links are resolved before a destination is checked against the
+             * roots, so a link below a root can't lead a STORE out of it.
+             *
+             */
+            void          writable( const fs::path& root );
+
+        private:
+                          PeerServer( const PeerServer& );
+            PeerServer&   operator=( const PeerServer& );
+
+            fs::path location_;
+            unsigned short port_;
+            std::string address_;
+            int socket_;
+            volatile bool running_;
+
+            std::vector< std::string > writable_;
+
+            boost::thread* thread_;
+
+            unsigned connections_;
+            mutable boost::mutex connectionMutex_;
+            boost::condition idle_;
+
+            void serve_connection( int connection );
+            void serve_list( int connection ) const;
+            void serve_fetch( int connection, const std::string& request ) const;
+            void serve_store( int connection, const std::string& request ) const;
+            std::string store_path( const std::string& path ) const;
+            bool is_writable( const std::string& path ) const;
+    };
+
+
+    /**
+     * Fetches files from the caches of other nodes.
+     *
+     * @par
+     * Peers are given as a whitespace or comma separated list of
+     * <tt>host:port</tt> pairs. What a peer holds is learned from its
+     * advertisement, which is refreshed at most every refresh() seconds.
+     * A peer that can't be reached is skipped until the next refresh.
+     *
+     */
+    class PeerClient {
+        public:
+                          PeerClient( const std::string& peers );
+
+            /**
+             * Try to fetch a file from any peer that holds a current copy.
+             *
+             * @param  name         the leaf name of the file in the cache
+             * @param  size         the size of the original
+             * @param  mtime        the modification time of the original
+             * @param  destination  where to write the file to, must not exist
+             *
+             * @return  true if the file was fetched, false otherwise
+             *
+             */
+            bool          fetch( const std::string& name, uintmax_t size, time_t mtime, const fs::path& destination );
+
+            /**
+             * Set the minimum number of seconds between two advertisement queries.
+             *
+             */
+            void          refresh( unsigned seconds );
+
+            bool          empty() const;
+
+        private:
+            struct Peer {
+                std::string host;
+                std::string port;
+                std::set< std::string > holds;
+                bool reachable;
+            };
+
+            std::vector< Peer > peers_;
+            time_t lastRefresh_;
+            unsigned refresh_;
+
+            mutable boost::mutex mutex_;
+
+            static void query_advertisements( std::vector< Peer >& );
+            bool fetch_from( const Peer&, const std::string&, uintmax_t, time_t, const fs::path& ) const;
+    };
+
+
+    /**
+     * Writes files back to their origin through a PeerServer running there.
+     *
+     * @par
+     * Instead of copying a file byte for byte over the network file system,
+     * the file is compressed on the fly in blocks of at most BLOCK_SIZE bytes
+     * and decompressed by the server on the receiving end. Each block is
+     * preceded by its uncompressed and its stored size (both 32 bit, network
+     * byte order); a block that doesn't shrink is sent as is. A block with an
+     * uncompressed size of zero ends the stream.
+     * @par
+     * The server writes to a temporary file next to the destination and only
+     * renames it into place once the whole file arrived, so readers never see
+     * a partial file.
+     *
+     */
+    class WriteBackClient {
+        public:
+            enum {
+                BLOCK_SIZE = 1048576    ///< Maximum uncompressed bytes per block
+            };
+
+            /**
+             * Creates a client.
+             *
+             * @param  server  The server as a <tt>host:port</tt> pair.
+             * @param  codec   "lz4" or "zstd".
+             *
+             */
+                          WriteBackClient( const std::string& server, const std::string& codec );
+
+            /**
+             * Write a file to the server.
+             *
+             * @param  source       the local file
+             * @param  destination  the absolute path of the file on the server
+             * @param  overwrite    whether to replace an existing destination
+             *
+             * @return  true if the file was written, false otherwise
+             *
+             */
+            bool          store( const fs::path& source, const fs::path& destination, bool overwrite ) const;
+
+            /**
+             * Query whether the server address and codec are usable.
+             *
+             */
+            bool          valid() const;
+
+        private:
+            std::string host_;
+            std::string port_;
+            std::string codecName_;
+            Codec codec_;
+    };
+
+
+} // namespace Jupiter
+
+#endif // JUPITER_PEERCACHE_HPP
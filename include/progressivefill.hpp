@@ -0,0 +1,136 @@
+/**@file
+ *
+ * Cache entries readable while they are being filled.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010 Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+
+#ifndef JUPITER_PROGRESSIVEFILL_HPP
+#define JUPITER_PROGRESSIVEFILL_HPP
+
+#include <sourcebackend.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/cstdint.hpp>
+#include <deque>
+#include <vector>
+
+namespace fs = boost::filesystem;
+
+namespace Jupiter {
+
+    /**
+     * Copies a file to the cache on a background thread while it is read.
+     *
+     * @par
+     * The file is copied block by block to a temporary name and renamed to
+     * the entry when it is complete. Readers wait only for the blocks of the
+     * range they read; those blocks are copied next, and the copy carries on
+     * from there, so a file read front to back is copied just ahead of the
+     * reader.
+     * @par
+     * Destroying an unfinished fill stops the copy and removes the
+     * temporary file.
+     *
+     */
+    class ProgressiveFill {
+        public:
+            enum {
+                BLOCK_SIZE = 1048576    ///< Bytes copied at a time
+            };
+
+            /**
+             * Starts filling an entry.
+             *
+             * @param  source       the open original, owned by the fill
+             * @param  size         the size of the original
+             * @param  partial      the temporary file, must not exist
+             * @param  destination  the entry
+             *
+             */
+                          ProgressiveFill( SourceFile* source, uintmax_t size, const fs::path& partial, const fs::path& destination );
+                         ~ProgressiveFill();
+
+            /**
+             * Read a range, waiting until it has been copied.
+             *
+             * @return  the number of bytes read (less than @c size only at the
+             *          end of the file), -1 if the copy failed before the range
+             *          arrived
+             *
+             */
+            std::streamsize read( uintmax_t offset, char* buffer, std::size_t size );
+
+            /**
+             * Wait until the entry is complete.
+             *
+             * @return  true if the entry was filled, false if the copy failed
+             *
+             */
+            bool          wait();
+
+            /**
+             * Query whether the copy is over, successful or not.
+             *
+             */
+            bool          finished() const;
+
+            /**
+             * Open a reader of the fill's ranges, see read().
+             *
+             * @return  the reader, to be deleted by the caller
+             *
+             */
+            static SourceFile* reader( const boost::shared_ptr< ProgressiveFill >& fill );
+
+        private:
+                          ProgressiveFill( const ProgressiveFill& );
+            ProgressiveFill& operator=( const ProgressiveFill& );
+
+            boost::scoped_ptr< SourceFile > source_;
+            uintmax_t size_;
+            fs::path partial_, destination_;
+            int fd_;
+
+            std::vector< bool > present_;
+            std::deque< boost::uint32_t > wanted_;  ///< Blocks readers wait for, in order
+            boost::uint32_t missing_, next_;
+            bool finished_, complete_, stop_;
+
+            mutable boost::mutex mutex_;
+            boost::condition_variable filled_;
+            boost::thread thread_;
+
+            bool          next_block( boost::uint32_t& block );
+            bool          is_present( boost::uint32_t first, boost::uint32_t last ) const;
+            void          run();
+    };
+
+} // namespace Jupiter
+
+#endif // JUPITER_PROGRESSIVEFILL_HPP
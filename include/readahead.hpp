@@ -0,0 +1,140 @@
+/**@file
+ *
+ * Predicting and prefetching the next files of a sequence.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010 Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+
+#ifndef JUPITER_READAHEAD_HPP
+#define JUPITER_READAHEAD_HPP
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/function.hpp>
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace fs = boost::filesystem;
+
+namespace Jupiter {
+
+    /**
+     * Spots files requested as a numbered sequence and predicts the next ones.
+     *
+     * @par
+     * A file's frame number is the last run of digits in its name, e.g. 0101
+     * in foo.0101.vdb; the rest of the path names the sequence. Once two
+     * requests of a sequence are a frame apart, or two steps had the same
+     * stride, the next frames along the stride are predicted, keeping the
+     * number's zero padding.
+     * @par
+     * The predictor isn't thread safe.
+     *
+     */
+    class SequencePredictor {
+        public:
+            enum {
+                MAX_SEQUENCES = 256     ///< Sequences tracked at once, older ones are forgotten
+            };
+
+            /**
+             * Creates a predictor.
+             *
+             * @param  depth  the number of files to predict
+             *
+             */
+            explicit      SequencePredictor( unsigned depth );
+
+            /**
+             * Note a requested file.
+             *
+             * @param  file       the file
+             * @param  predicted  receives the files predicted to be requested next
+             *
+             */
+            void          observe( const fs::path& file, std::vector< fs::path >& predicted );
+
+        private:
+            struct Sequence {
+                long frame;
+                long stride;
+                unsigned long age;
+            };
+
+            typedef std::map< std::string, Sequence > Sequences;
+
+            Sequences sequences_;
+            unsigned depth_;
+            unsigned long requests_;
+
+            void forget_oldest();
+    };
+
+    /**
+     * Runs jobs for files on a background thread, one at a time.
+     *
+     * @par
+     * A file that is already waiting isn't queued again. Jobs still waiting
+     * when the prefetcher is destroyed are dropped; a running job is waited
+     * for.
+     *
+     */
+    class Prefetcher {
+        public:
+            typedef boost::function< void( const fs::path& ) > Job;
+
+            enum {
+                MAX_QUEUED = 64         ///< Files waiting at most, further ones are dropped
+            };
+
+            explicit      Prefetcher( const Job& job );
+                         ~Prefetcher();
+
+            void          enqueue( const fs::path& file );
+
+        private:
+                          Prefetcher( const Prefetcher& );
+            Prefetcher&   operator=( const Prefetcher& );
+
+            Job job_;
+
+            std::deque< fs::path > queue_;
+            std::set< fs::path > queued_;
+            bool stop_;
+
+            boost::mutex mutex_;
+            boost::condition_variable wakeUp_;
+            boost::thread thread_;
+
+            void          run();
+    };
+
+} // namespace Jupiter
+
+#endif // JUPITER_READAHEAD_HPP
@@ -0,0 +1,79 @@
+/**@file
+ *
+ * Periodic background checks of cache entries against their originals.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010 Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+
+#ifndef JUPITER_REVALIDATOR_HPP
+#define JUPITER_REVALIDATOR_HPP
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/function.hpp>
+
+namespace Jupiter {
+
+    /**
+     * Runs a job periodically on a background thread.
+     *
+     * @par
+     * FileCache::revalidate() runs a pass over a location's entries in use
+     * with it. The first run is one interval after construction. Destroying
+     * the revalidator waits for a running job and stops.
+     *
+     */
+    class Revalidator {
+        public:
+            typedef boost::function< void() > Job;
+
+            /**
+             * Starts the thread.
+             *
+             * @param  job       what to run
+             * @param  interval  seconds from the end of one run to the start of the next
+             *
+             */
+                          Revalidator( const Job& job, unsigned interval );
+                         ~Revalidator();
+
+        private:
+                          Revalidator( const Revalidator& );
+            Revalidator&  operator=( const Revalidator& );
+
+            Job job_;
+            unsigned interval_;
+            bool stop_;
+
+            boost::mutex mutex_;
+            boost::condition_variable wakeUp_;
+            boost::thread thread_;
+
+            void          run();
+    };
+
+} // namespace Jupiter
+
+#endif // JUPITER_REVALIDATOR_HPP
@@ -0,0 +1,107 @@
+/**@file
+ *
+ * Per-thread scratch memory for the temporaries of a request.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010 Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+
+#ifndef JUPITER_SCRATCHARENA_HPP
+#define JUPITER_SCRATCHARENA_HPP
+
+#include <cstddef>
+#include <vector>
+
+namespace Jupiter {
+
+    /**
+     * A bump allocator for the temporaries of a request, one per thread.
+     *
+     * @par
+     * Memory is handed out from blocks the arena keeps for the lifetime of
+     * its thread, and given back in one go when the enclosing Scope ends. Once
+     * a thread's arena has grown to what its requests need, building
+     * temporaries costs no heap allocations.
+     * @par
+     * @code
+     * ScratchArena::Scope scope;
+     * char* name( ScratchArena::local().allocate( length + 1 ) );
+     * @endcode
+     *
+     */
+    class ScratchArena {
+        public:
+            enum {
+                BLOCK_SIZE = 16384  ///< Bytes per block, bigger requests get a block of their own
+            };
+
+            /**
+             * Releases everything allocated from this thread's arena while it
+             * existed.
+             *
+             */
+            class Scope {
+                public:
+                                  Scope();
+                                 ~Scope();
+
+                private:
+                                  Scope( const Scope& );
+                    Scope&        operator=( const Scope& );
+
+                    ScratchArena& arena_;
+                    std::size_t block_, used_;
+            };
+
+            /**
+             * Query the calling thread's arena.
+             *
+             */
+            static ScratchArena& local();
+
+            /**
+             * Allocate memory, valid until the innermost Scope ends.
+             *
+             */
+            char*         allocate( std::size_t size );
+
+                         ~ScratchArena();
+
+        private:
+                          ScratchArena();
+                          ScratchArena( const ScratchArena& );
+            ScratchArena& operator=( const ScratchArena& );
+
+            struct Block {
+                char* data;
+                std::size_t size;
+            };
+
+            std::vector< Block > blocks_;
+            std::size_t block_;     ///< The block allocated from
+            std::size_t used_;      ///< Bytes used of it
+    };
+
+} // namespace Jupiter
+
+#endif // JUPITER_SCRATCHARENA_HPP
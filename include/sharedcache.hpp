@@ -0,0 +1,135 @@
+/**@file
+ *
+ * A process-wide cache engine per location that plugins attach to.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010 Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+
+#ifndef JUPITER_SHAREDCACHE_HPP
+#define JUPITER_SHAREDCACHE_HPP
+
+#include <filecache.hpp>
+#include <boost/shared_ptr.hpp>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace Jupiter {
+
+    /**
+     * A light handle on the process's cache engine for a location.
+     *
+     * @par
+     * Every FileCache instance has its own reference and inventory set, so a
+     * plugin creating one per thread or shading context multiplies both. A
+     * SharedCache instead attaches to one FileCache per location and process,
+     * created by the first attachment and destroyed with the last one.
+     * Attaching to an existing engine is a map lookup.
+     * @par
+     * Each attachment keeps its own small, sorted pin set of the cached paths
+     * it returned. The engine keeps a reference count per path over all its
+     * attachments and holds a file in its inventory while any attachment has
+     * it pinned. Releasing a file, or destroying the attachment, drops its
+     * pins; a file nobody pins anymore is released at once. A cacheFile()
+     * call that overlapped the release of the file it returns caches it
+     * again before pinning it.
+     * @par
+     * An attachment is meant to be used by one thread at a time, e.g. kept in
+     * thread or context local storage. The engine is thread safe.
+     *
+     */
+    class SharedCache {
+        public:
+            /**
+             * Attaches to the engine for a location, creating it if needed.
+             *
+             * @param  location  The cache's directory. If this is empty, the
+             *                   engine uses FILECACHE_LOCATION or the default,
+             *                   see FileCache. Engines are keyed by the string
+             *                   given, not the directory it resolves to.
+             *
+             */
+                          SharedCache( const std::string& location = std::string() );
+                         ~SharedCache();
+
+            /**
+             * Cache a file and pin it for this attachment.
+             *
+             * @see  FileCache::cacheFileInterned()
+             *
+             * @return  the interned cached path if successful, @c toCache itself otherwise
+             *
+             */
+            const char*   cacheFile( const char* toCache );
+
+            /**
+             * Drop this attachment's pin on a file.
+             *
+             * @par
+             * The engine releases the file when no attachment has it pinned
+             * anymore.
+             *
+             * @param  path  a path returned by cacheFile()
+             *
+             */
+            void          releaseFile( const char* path );
+
+            /**
+             * Query the number of files this attachment has pinned.
+             *
+             */
+            std::size_t   pinned() const;
+
+            /**
+             * The shared engine, for everything but caching and releasing.
+             *
+             * @par
+             * Files cached on the engine directly are pinned until the engine
+             * goes away, i.e. until the last attachment is destroyed.
+             *
+             */
+            FileCache&    engine() const;
+
+            /**
+             * Query the number of engines in this process.
+             *
+             */
+            static std::size_t engines();
+
+            struct Engine; ///< A location's FileCache and pin counts
+
+        private:
+                          SharedCache( const SharedCache& );
+            SharedCache&  operator=( const SharedCache& );
+
+            boost::shared_ptr< Engine > engine_;
+            std::vector< const char* > pins_; // Interned, sorted by address
+
+            void          unpin( const char* path );
+            void          finish( std::multiset< unsigned long >::iterator call );
+    };
+
+} // namespace Jupiter
+
+#endif // JUPITER_SHAREDCACHE_HPP
@@ -0,0 +1,293 @@
+/**@file
+ *
+ * Where the cache gets the originals of cached files from.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010 Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+
+#ifndef JUPITER_SOURCEBACKEND_HPP
+#define JUPITER_SOURCEBACKEND_HPP
+
+#include <cachestats.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/cstdint.hpp>
+#include <ctime>
+#include <ios>
+#include <string>
+#include <vector>
+
+namespace fs = boost::filesystem;
+
+namespace Jupiter {
+
+    struct BlockSums;
+
+    /**
+     * What a backend knows about a file.
+     *
+     */
+    struct SourceStats {
+        uintmax_t size;
+        time_t mtime;
+        bool directory;
+
+        SourceStats() : size( 0 ), mtime( 0 ), directory( false ) {}
+    };
+
+    /**
+     * A file opened for reading ranges.
+     *
+     */
+    class SourceFile {
+        public:
+            virtual                 ~SourceFile();
+
+            /**
+             * Read a range of the file.
+             *
+             * @param  offset  where to start reading
+             * @param  buffer  receives the data
+             * @param  size    the number of bytes to read
+             *
+             * @return  the number of bytes read (less than @c size only at the
+             *          end of the file), -1 on error
+             *
+             */
+            virtual std::streamsize read( uintmax_t offset, char* buffer, std::size_t size ) = 0;
+    };
+
+    /**
+     * A source of original files.
+     *
+     * @par
+     * FileCache caches a file if one of the backends of its location
+     * handles() it, and then reads it only through that backend. Paths are
+     * always the absolute paths the cache's users ask for.
+     *
+     */
+    class SourceBackend {
+        public:
+            virtual             ~SourceBackend();
+
+            /**
+             * Query whether files at the given path come from this backend and
+             * are worth caching.
+             *
+             */
+            virtual bool        handles( const fs::path& path ) const = 0;
+
+            /**
+             * Query a file's size and modification time.
+             *
+             * @return  true if the file exists, false otherwise
+             *
+             */
+            virtual bool        stat( const fs::path& path, SourceStats& stats ) const = 0;
+
+            /**
+             * handles() for a path given as a string.
+             *
+             * @par
+             * The cache's hit path uses this and stat( const char* ) so it
+             * needn't build a path. The defaults build one and call the
+             * fs::path versions; a backend that overrides either version should
+             * override both.
+             *
+             */
+            virtual bool        handles( const char* path ) const;
+
+            /**
+             * stat() for a path given as a string, see handles( const char* ).
+             *
+             */
+            virtual bool        stat( const char* path, SourceStats& stats ) const;
+
+            /**
+             * Open a file for reading.
+             *
+             * @return  the open file, to be deleted by the caller, or 0 on failure
+             *
+             */
+            virtual SourceFile* open( const fs::path& path ) const = 0;
+
+            /**
+             * List the names of the entries of a directory.
+             *
+             * @return  true if the directory could be read, false otherwise
+             *
+             */
+            virtual bool        list( const fs::path& directory, std::vector< std::string >& names ) const = 0;
+
+            /**
+             * Copy a file to a new local destination.
+             *
+             * Fails if the destination exists, it is never replaced.
+             *
+             * The default implementation reads the file through open().
+             *
+             * @return  true if successful, false otherwise
+             *
+             */
+            virtual bool        copy( const fs::path& path, const fs::path& destination ) const;
+
+            /**
+             * Checksum the blocks of a file where it is stored.
+             *
+             * @par
+             * Only worth it if the checksums cost less than the file to
+             * fetch, i.e. if the server computes them. The default
+             * implementation doesn't support this and returns false.
+             *
+             * @param  path       the file
+             * @param  blockSize  bytes per block
+             * @param  sums       receives the checksums
+             *
+             * @return  true if successful, false otherwise
+             *
+             */
+            virtual bool        checksums( const fs::path& path, boost::uint32_t blockSize, BlockSums& sums ) const;
+
+            /**
+             * Query whether checksums() is supported.
+             *
+             * The cache only keeps checksums of entries it can refresh by
+             * blocks. The default implementation returns false.
+             *
+             */
+            virtual bool        checksummed() const;
+
+            /**
+             * Query whether the backend's files can be stat()ed and read by
+             * their path with plain system calls.
+             *
+             * @par
+             * The cache then stats and copies batches of them on its
+             * IoEngine instead of through the backend. The default
+             * implementation returns false.
+             *
+             */
+            virtual bool        direct() const;
+    };
+
+    /**
+     * Files reachable through the local file system.
+     *
+     * @par
+     * Only files below one of the given directories are handled, even though
+     * they are local. This lets the cache front any slow local mount, and lets
+     * it be exercised on a machine without remote file systems.
+     *
+     */
+    class LocalBackend : public SourceBackend {
+        public:
+            /**
+             * Creates a backend.
+             *
+             * @param  directories  A colon separated list of directories to handle.
+             *
+             */
+                                LocalBackend( const std::string& directories = std::string() );
+
+            virtual bool        handles( const fs::path& path ) const;
+            virtual bool        handles( const char* path ) const;
+            virtual bool        stat( const fs::path& path, SourceStats& stats ) const;
+            virtual bool        stat( const char* path, SourceStats& stats ) const;
+            virtual SourceFile* open( const fs::path& path ) const;
+            virtual bool        list( const fs::path& directory, std::vector< std::string >& names ) const;
+            virtual bool        copy( const fs::path& path, const fs::path& destination ) const;
+            virtual bool        checksums( const fs::path& path, boost::uint32_t blockSize, BlockSums& sums ) const;
+            virtual bool        checksummed() const;
+            virtual bool        direct() const;
+
+        private:
+            std::vector< std::string > directories_;
+    };
+
+    /**
+     * Files on NFS mounts.
+     *
+     * This is what the cache always fronts. Checksums aren't supported:
+     * reading a file over the mount to checksum it costs as much as copying it.
+     *
+     */
+    class NfsBackend : public LocalBackend {
+        public:
+            virtual bool        handles( const fs::path& path ) const;
+            virtual bool        handles( const char* path ) const;
+            virtual bool        checksums( const fs::path& path, boost::uint32_t blockSize, BlockSums& sums ) const;
+            virtual bool        checksummed() const;
+    };
+
+    /**
+     * Makes another backend slow, predictably.
+     *
+     * @par
+     * Every call waits for the given latency first. Reads additionally share
+     * the given bandwidth: each read reserves the time its bytes take on one
+     * link, so concurrent reads queue up behind each other like on a real
+     * network connection.
+     *
+     */
+    class ThrottledBackend : public SourceBackend {
+        public:
+            /**
+             * Creates a backend.
+             *
+             * @param  backend    The backend to slow down.
+             * @param  latency    Seconds every call takes at least.
+             * @param  bandwidth  Bytes per second shared by all reads. 0 means
+             *                    unlimited.
+             *
+             */
+                                ThrottledBackend( const boost::shared_ptr< SourceBackend >& backend, double latency, double bandwidth );
+
+            virtual bool        handles( const fs::path& path ) const;
+            virtual bool        handles( const char* path ) const;
+            virtual bool        stat( const fs::path& path, SourceStats& stats ) const;
+            virtual bool        stat( const char* path, SourceStats& stats ) const;
+            virtual SourceFile* open( const fs::path& path ) const;
+            virtual bool        list( const fs::path& directory, std::vector< std::string >& names ) const;
+            virtual bool        checksums( const fs::path& path, boost::uint32_t blockSize, BlockSums& sums ) const;
+            virtual bool        checksummed() const;
+
+        private:
+            class File;
+            friend class File;
+
+            boost::shared_ptr< SourceBackend > backend_;
+            double latency_, bandwidth_;
+
+            StopWatch clock_;
+            mutable double linkBusyUntil_;
+            mutable boost::mutex mutex_;
+
+            void wait() const;
+            void transfer( uintmax_t bytes ) const;
+    };
+
+} // namespace Jupiter
+
+#endif // JUPITER_SOURCEBACKEND_HPP
@@ -0,0 +1,149 @@
+/**@file
+ *
+ * Low overhead tracing spans for the cache's internal steps.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010 Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+
+#ifndef JUPITER_TRACING_HPP
+#define JUPITER_TRACING_HPP
+
+#include <boost/cstdint.hpp>
+#include <ostream>
+#include <string>
+
+/**
+ * Trace the enclosing scope as a span called @c name (a string literal).
+ *
+ * Spans are only compiled in if FILECACHE_SPANS is defined; otherwise the
+ * macro expands to nothing.
+ */
+#if defined( FILECACHE_SPANS )
+# define FILECACHE_SPAN( name ) Jupiter::Span filecacheSpan_( name )
+#else
+# define FILECACHE_SPAN( name )
+#endif
+
+namespace Jupiter {
+
+    /**
+     * Collects spans in per-thread ring buffers.
+     *
+     * @par
+     * Every thread writes to a ring of its own, so recording a span takes no
+     * lock: it is a clock read when the span starts and a few stores when it
+     * ends. A ring holds the last RING_SIZE spans of its thread; older spans
+     * are overwritten. Rings of finished threads are reused by new ones.
+     * @par
+     * Recording is off until enable() is called. While it is off, a span
+     * costs a single test of a flag.
+     *
+     */
+    class SpanTracer {
+        public:
+            enum {
+                RING_SIZE = 4096    ///< Spans kept per thread
+            };
+
+            /**
+             * Start recording spans.
+             *
+             * @param  file  Where dump() writes the spans to. A "%p" in the name
+             *               is replaced by the process ID. An empty name stops
+             *               recording.
+             *
+             */
+            static void   enable( const std::string& file );
+
+            static bool   enabled() {
+                return enabled_;
+            }
+
+            /**
+             * Record a finished span.
+             *
+             * @param  name      the span's name, which must outlive the tracer
+             * @param  start     when it started, in microseconds (see now())
+             * @param  duration  how long it took in microseconds
+             *
+             */
+            static void   record( const char* name, boost::uint64_t start, boost::uint64_t duration );
+
+            /**
+             * Write the spans of all threads in Chrome's trace event format.
+             *
+             * @par
+             * The result loads in chrome://tracing or Perfetto. Spans are
+             * complete ("X") events; threads are identified by their kernel
+             * thread ID.
+             *
+             */
+            static void   write( std::ostream& out );
+
+            /**
+             * Write the spans to the file given to enable().
+             *
+             * @return  true if successful or not enabled, false otherwise
+             *
+             */
+            static bool   dump();
+
+            /**
+             * Query a monotonic clock in microseconds.
+             *
+             */
+            static boost::uint64_t now();
+
+        private:
+            static volatile bool enabled_;
+    };
+
+    /**
+     * A span covering the lifetime of the object.
+     *
+     * Use FILECACHE_SPAN() rather than this class, so the span can be
+     * compiled out.
+     */
+    class Span {
+        public:
+            explicit      Span( const char* name )
+                : name_( SpanTracer::enabled() ? name : 0 ), start_( name_ ? SpanTracer::now() : 0 ) {}
+
+                         ~Span() {
+                if ( name_ ) {
+                    SpanTracer::record( name_, start_, SpanTracer::now() - start_ );
+                }
+            }
+
+        private:
+                          Span( const Span& );
+            Span&         operator=( const Span& );
+
+            const char* name_;
+            boost::uint64_t start_;
+    };
+
+} // namespace Jupiter
+
+#endif // JUPITER_TRACING_HPP
@@ -0,0 +1,495 @@
+/**
+ * LD_PRELOAD shim caching the files unmodified programs read.
+ *
+ * Usage: LD_PRELOAD=libfilecachepreload.so program...
+ *
+ * Intercepts open(), openat(), fopen() and their 64 bit variants. A file
+ * opened read-only by its absolute path is cached (see FileCache::cacheFile())
+ * and the cached copy is opened instead; it stays pinned until the last
+ * descriptor opened on it is closed. stat() of a file opened this way is
+ * answered from the cached copy, without asking the server. Everything else
+ * goes straight to the C library.
+ *
+ * So do all calls of the cache's own threads: pthread_create() is
+ * intercepted too, and threads started by the cache (revalidation,
+ * background copies, read-ahead, ...) never come through the shim again.
+ * Otherwise they would be sent to the very cached copies they check or
+ * refresh.
+ *
+ * The cache is set up from the usual environment (FILECACHE_LOCATION,
+ * FILECACHE_SIZE, FILECACHE_REMOTE, ...). Two more variables narrow down
+ * what is cached, both colon separated lists of directories:
+ *
+ *   FILECACHE_PRELOAD_ALLOW   only files below these are cached
+ *   FILECACHE_PRELOAD_DENY    files below these are never cached
+ *
+ * /dev, /proc, /sys and the cache location itself are always denied.
+ *
+ *   FILECACHE_REMOTE=/mnt/assets FILECACHE_REMOTE_BANDWIDTH=20 \
+ *   LD_PRELOAD=libfilecachepreload.so maketx /mnt/assets/tex.exr -o /tmp/tex.tx
+ *
+ */
+#include <filecache.hpp>
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/tokenizer.hpp>
+
+using namespace std;
+using Jupiter::FileCache;
+
+
+namespace {
+
+	// Set while the shim itself is at work on this thread -- the cache's own calls go straight through
+	__thread int busy( 0 );
+
+	struct Busy {
+		Busy() { ++busy; }
+		~Busy() { --busy; }
+	};
+
+
+	template< typename Function >
+	Function next( Function& function, const char* name ) {
+		if( !function ) {
+			function = ( Function )dlsym( RTLD_NEXT, name );
+		}
+
+		return function;
+	}
+
+
+	// A cached file open through the shim
+	struct Pin {
+		string original;
+		unsigned descriptors;
+	};
+
+
+	struct Shim {
+		FileCache cache;
+		vector< string > allow, deny;
+
+		boost::mutex mutex;
+		map< int, const char* > descriptors;  // Descriptor to interned cached path
+		map< const char*, Pin > pins;
+		map< string, const char* > originals;
+
+		Shim() {
+			const char* allowed( getenv( "FILECACHE_PRELOAD_ALLOW" ) );
+			const char* denied( getenv( "FILECACHE_PRELOAD_DENY" ) );
+
+			split( allowed ? allowed : "", allow );
+			split( denied ? denied : "", deny );
+
+			deny.push_back( "/dev" );
+			deny.push_back( "/proc" );
+			deny.push_back( "/sys" );
+			deny.push_back( cache.location() );
+		}
+
+		static void split( const string& list, vector< string >& directories ) {
+			typedef boost::tokenizer< boost::char_separator< char > > Tokenizer;
+
+			boost::char_separator< char > colon( ":" );
+			Tokenizer tokens( list, colon );
+
+			for( Tokenizer::iterator it( tokens.begin() ); it != tokens.end(); ++it ) {
+				string directory( *it );
+
+				while( 1 < directory.size() && '/' == directory[ directory.size() - 1 ] ) {
+					directory.erase( directory.size() - 1 );
+				}
+
+				directories.push_back( directory );
+			}
+		}
+
+		static bool below( const char* path, const vector< string >& directories ) {
+			for( vector< string >::const_iterator it( directories.begin() ); it != directories.end(); ++it ) {
+				if( !strncmp( path, it->c_str(), it->size() ) &&
+				    ( '/' == path[ it->size() ] || !path[ it->size() ] || "/" == *it ) ) {
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		bool wanted( const char* path ) const {
+			return '/' == path[ 0 ] && ( allow.empty() || below( path, allow ) ) && !below( path, deny );
+		}
+
+		// The cached copy to open instead of path, pinned, or 0
+		const char* pin( const char* path ) {
+			const char* cached( cache.cacheFileInterned( path ) );
+
+			if( cached == path ) {
+				return 0;
+			}
+
+			boost::mutex::scoped_lock lock( mutex );
+
+			Pin& pin( pins[ cached ] );
+
+			if( !pin.descriptors++ ) {
+				pin.original = path;
+				originals[ pin.original ] = cached;
+			}
+
+			return cached;
+		}
+
+		void opened( int fd, const char* cached ) {
+			boost::mutex::scoped_lock lock( mutex );
+
+			descriptors[ fd ] = cached;
+		}
+
+		void unpin( const char* cached ) {
+			bool release( false );
+
+			{
+				boost::mutex::scoped_lock lock( mutex );
+
+				map< const char*, Pin >::iterator it( pins.find( cached ) );
+
+				if( pins.end() != it && !--it->second.descriptors ) {
+					originals.erase( it->second.original );
+					pins.erase( it );
+					release = true;
+				}
+			}
+
+			if( release ) {
+				cache.releaseFile( string( cached ) );
+			}
+		}
+
+		void closed( int fd ) {
+			const char* cached( 0 );
+
+			{
+				boost::mutex::scoped_lock lock( mutex );
+
+				map< int, const char* >::iterator it( descriptors.find( fd ) );
+
+				if( descriptors.end() == it ) {
+					return;
+				}
+
+				cached = it->second;
+				descriptors.erase( it );
+			}
+
+			unpin( cached );
+		}
+
+		// The cached copy of a file open through the shim, or 0
+		const char* open_copy( const char* path ) {
+			boost::mutex::scoped_lock lock( mutex );
+
+			map< string, const char* >::const_iterator it( originals.find( path ) );
+
+			return originals.end() == it ? 0 : it->second;
+		}
+	};
+
+
+	// Never destroyed: descriptors may be closed by other static destructors
+	Shim* create_shim() {
+		Busy guard;
+
+		return new Shim;
+	}
+
+
+	Shim* created( 0 );  // Set once a file was opened through the shim
+
+
+	Shim& shim() {
+		static Shim* shim( create_shim() );
+
+		created = shim;
+		return *shim;
+	}
+
+
+	bool read_only( int flags ) {
+		return O_RDONLY == ( flags & O_ACCMODE ) && !( flags & ( O_CREAT | O_TRUNC | O_DIRECTORY ) );
+	}
+
+
+	bool read_only( const char* mode ) {
+		return 'r' == mode[ 0 ] && !strchr( mode, '+' );
+	}
+
+
+	// Open path, or its cached copy if it should be cached
+	template< typename Open >
+	int open_cached( Open open, const char* path, int flags, mode_t mode ) {
+		if( busy || !path || !read_only( flags ) ) {
+			return open( path, flags, mode );
+		}
+
+		Busy guard;
+		Shim& cache( shim() );
+
+		if( !cache.wanted( path ) ) {
+			return open( path, flags, mode );
+		}
+
+		const char* cached( cache.pin( path ) );
+
+		if( cached ) {
+			int fd( open( cached, flags, mode ) );
+
+			if( -1 != fd ) {
+				cache.opened( fd, cached );
+				return fd;
+			}
+
+			cache.unpin( cached );
+		}
+
+		return open( path, flags, mode );
+	}
+
+
+	template< typename Open >
+	FILE* fopen_cached( Open open, const char* path, const char* mode ) {
+		if( busy || !path || !mode || !read_only( mode ) ) {
+			return open( path, mode );
+		}
+
+		Busy guard;
+		Shim& cache( shim() );
+
+		if( !cache.wanted( path ) ) {
+			return open( path, mode );
+		}
+
+		const char* cached( cache.pin( path ) );
+
+		if( cached ) {
+			FILE* file( open( cached, mode ) );
+
+			if( file ) {
+				cache.opened( fileno( file ), cached );
+				return file;
+			}
+
+			cache.unpin( cached );
+		}
+
+		return open( path, mode );
+	}
+
+
+	// The path to stat() instead of path
+	const char* stat_path( const char* path ) {
+		if( busy || !path || !created ) {
+			return path;
+		}
+
+		Busy guard;
+		const char* cached( created->open_copy( path ) );
+
+		return cached ? cached : path;
+	}
+
+
+	// A thread the cache starts, busy for good
+	struct Start {
+		void* ( *routine )( void* );
+		void* argument;
+	};
+
+
+	void* start_busy( void* argument ) {
+		Start start( *( Start* )argument );
+		delete ( Start* )argument;
+
+		++busy;
+		return start.routine( start.argument );
+	}
+
+
+	mode_t open_mode( int flags, va_list arguments ) {
+		return ( flags & O_CREAT ) ? ( mode_t )va_arg( arguments, int ) : 0;
+	}
+
+
+	typedef int ( *OpenFunction )( const char*, int, ... );
+	typedef int ( *OpenAtFunction )( int, const char*, int, ... );
+	typedef FILE* ( *FopenFunction )( const char*, const char* );
+	typedef int ( *CloseFunction )( int );
+	typedef int ( *FcloseFunction )( FILE* );
+	typedef int ( *StatFunction )( const char*, struct stat* );
+	typedef int ( *Stat64Function )( const char*, struct stat64* );
+	typedef int ( *XstatFunction )( int, const char*, struct stat* );
+	typedef int ( *Xstat64Function )( int, const char*, struct stat64* );
+	typedef int ( *PthreadCreateFunction )( pthread_t*, const pthread_attr_t*, void* ( * )( void* ), void* );
+
+	OpenFunction real_open, real_open64;
+	OpenAtFunction real_openat, real_openat64;
+	FopenFunction real_fopen, real_fopen64;
+	CloseFunction real_close;
+	FcloseFunction real_fclose;
+	StatFunction real_stat;
+	Stat64Function real_stat64;
+	XstatFunction real_xstat;
+	Xstat64Function real_xstat64;
+	PthreadCreateFunction real_pthread_create;
+
+
+	// openat() relative to the working directory, as open()
+	struct OpenAt {
+		OpenAtFunction function;
+		int directory;
+
+		OpenAt( OpenAtFunction function, int directory ) : function( function ), directory( directory ) {}
+
+		int operator()( const char* path, int flags, mode_t mode ) const {
+			return function( directory, path, flags, mode );
+		}
+	};
+
+} // anonymous namespace
+
+
+extern "C" {
+
+	int open( const char* path, int flags, ... ) {
+		va_list arguments;
+		va_start( arguments, flags );
+		mode_t mode( open_mode( flags, arguments ) );
+		va_end( arguments );
+
+		return open_cached( next( real_open, "open" ), path, flags, mode );
+	}
+
+
+	int open64( const char* path, int flags, ... ) {
+		va_list arguments;
+		va_start( arguments, flags );
+		mode_t mode( open_mode( flags, arguments ) );
+		va_end( arguments );
+
+		return open_cached( next( real_open64, "open64" ), path, flags, mode );
+	}
+
+
+	int openat( int directory, const char* path, int flags, ... ) {
+		va_list arguments;
+		va_start( arguments, flags );
+		mode_t mode( open_mode( flags, arguments ) );
+		va_end( arguments );
+
+		// Absolute paths ignore the directory, others are left alone
+		if( path && '/' != path[ 0 ] ) {
+			return next( real_openat, "openat" )( directory, path, flags, mode );
+		}
+
+		return open_cached( OpenAt( next( real_openat, "openat" ), directory ), path, flags, mode );
+	}
+
+
+	int openat64( int directory, const char* path, int flags, ... ) {
+		va_list arguments;
+		va_start( arguments, flags );
+		mode_t mode( open_mode( flags, arguments ) );
+		va_end( arguments );
+
+		if( path && '/' != path[ 0 ] ) {
+			return next( real_openat64, "openat64" )( directory, path, flags, mode );
+		}
+
+		return open_cached( OpenAt( next( real_openat64, "openat64" ), directory ), path, flags, mode );
+	}
+
+
+	FILE* fopen( const char* path, const char* mode ) {
+		return fopen_cached( next( real_fopen, "fopen" ), path, mode );
+	}
+
+
+	FILE* fopen64( const char* path, const char* mode ) {
+		return fopen_cached( next( real_fopen64, "fopen64" ), path, mode );
+	}
+
+
+	int close( int fd ) {
+		if( !busy && created ) {
+			Busy guard;
+			created->closed( fd );
+		}
+
+		return next( real_close, "close" )( fd );
+	}
+
+
+	int fclose( FILE* file ) {
+		if( !busy && created && file ) {
+			Busy guard;
+			created->closed( fileno( file ) );
+		}
+
+		return next( real_fclose, "fclose" )( file );
+	}
+
+
+	int stat( const char* path, struct stat* buffer ) throw() {
+		return next( real_stat, "stat" )( stat_path( path ), buffer );
+	}
+
+
+	int stat64( const char* path, struct stat64* buffer ) throw() {
+		return next( real_stat64, "stat64" )( stat_path( path ), buffer );
+	}
+
+
+	// Before glibc 2.33, stat() is an inline wrapper of these
+	int __xstat( int version, const char* path, struct stat* buffer ) throw() {
+		return next( real_xstat, "__xstat" )( version, stat_path( path ), buffer );
+	}
+
+
+	int __xstat64( int version, const char* path, struct stat64* buffer ) throw() {
+		return next( real_xstat64, "__xstat64" )( version, stat_path( path ), buffer );
+	}
+
+
+	// Only the cache starts threads while the shim is busy
+	int pthread_create( pthread_t* thread, const pthread_attr_t* attributes, void* ( *routine )( void* ), void* argument ) throw() {
+		if( !busy ) {
+			return next( real_pthread_create, "pthread_create" )( thread, attributes, routine, argument );
+		}
+
+		Start* start( new Start );
+		start->routine = routine;
+		start->argument = argument;
+
+		int result( next( real_pthread_create, "pthread_create" )( thread, attributes, start_busy, start ) );
+
+		if( result ) {
+			delete start;
+		}
+
+		return result;
+	}
+
+}
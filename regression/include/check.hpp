@@ -0,0 +1,24 @@
+/**@file
+ *
+ * Minimal checks for the regression tests.
+ *
+ * Each test is a program of its own: it runs its checks, reports the failed
+ * ones and returns the number of failures, so ctest sees 0 as a pass.
+ *
+ */
+#ifndef JUPITER_REGRESSION_CHECK_HPP
+#define JUPITER_REGRESSION_CHECK_HPP
+
+#include <iostream>
+
+static int failures( 0 );
+
+#define CHECK( condition ) \
+	do { \
+		if( !( condition ) ) { \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK( " #condition " ) failed" << std::endl; \
+			++failures; \
+		} \
+	} while( 0 )
+
+#endif // JUPITER_REGRESSION_CHECK_HPP
@@ -0,0 +1,116 @@
+/**
+ * FrequencySketch and the TinyLFU admission decision.
+ *
+ */
+#include <admission.hpp>
+#include <check.hpp>
+
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace Jupiter;
+
+
+static void names() {
+	AdmissionFilter filter( ADMIT_ALL );
+
+	CHECK( admission_filter_from_name( "tinylfu", filter ) && ADMIT_TINYLFU == filter );
+	CHECK( admission_filter_from_name( "all", filter ) && ADMIT_ALL == filter );
+
+	// Unknown names leave the filter alone
+	CHECK( !admission_filter_from_name( "lru", filter ) );
+	CHECK( ADMIT_ALL == filter );
+
+	CHECK( admission_filter_name( ADMIT_ALL ) == "all" );
+	CHECK( admission_filter_name( ADMIT_TINYLFU ) == "tinylfu" );
+}
+
+
+static void counting() {
+	FrequencySketch sketch;
+
+	CHECK( 0 == sketch.estimate( 1 ) );
+
+	for( int i( 0 ); i < 3; ++i ) {
+		sketch.record( 1 );
+	}
+	sketch.record( 2 );
+
+	CHECK( 3 == sketch.estimate( 1 ) );
+	CHECK( 1 == sketch.estimate( 2 ) );
+
+	// Counters saturate
+	for( int i( 0 ); i < 100; ++i ) {
+		sketch.record( 1 );
+	}
+
+	CHECK( FrequencySketch::MAX_COUNT == sketch.estimate( 1 ) );
+}
+
+
+static void overestimating() {
+	// Crowded on purpose: collisions may only ever raise an estimate
+	FrequencySketch sketch( 64 );
+	vector< unsigned > counts( 200 );
+
+	for( int round( 0 ); round < 6; ++round ) {
+		for( unsigned key( 0 ); key < counts.size(); ++key ) {
+			if( key % 7 > ( unsigned )round ) {
+				sketch.record( key );
+				++counts[ key ];
+			}
+		}
+	}
+
+	for( unsigned key( 0 ); key < counts.size(); ++key ) {
+		CHECK( sketch.estimate( key ) >= counts[ key ] );
+	}
+}
+
+
+static void aging() {
+	const unsigned width( 1024 ), sample( width * FrequencySketch::SAMPLE_FACTOR );
+	FrequencySketch sketch( width );
+
+	for( int i( 0 ); i < FrequencySketch::MAX_COUNT; ++i ) {
+		sketch.record( 0 );
+	}
+
+	// Other keys until the counters are halved
+	unsigned key( 1 );
+	while( FrequencySketch::MAX_COUNT == sketch.estimate( 0 ) && key < 2 * sample ) {
+		sketch.record( key++ );
+	}
+
+	CHECK( FrequencySketch::MAX_COUNT / 2 == sketch.estimate( 0 ) );
+	CHECK( key + FrequencySketch::MAX_COUNT >= sample );
+}
+
+
+static void admitting() {
+	vector< unsigned > victims;
+
+	// Nothing to evict
+	CHECK( admit_candidate( 0, victims ) );
+
+	victims.push_back( 2 );
+	victims.push_back( 5 );
+
+	CHECK( admit_candidate( 6, victims ) );
+	CHECK( !admit_candidate( 4, victims ) );
+
+	// Ties keep what is cached
+	CHECK( !admit_candidate( 5, victims ) );
+}
+
+
+int main() {
+	names();
+	counting();
+	overestimating();
+	aging();
+	admitting();
+
+	return failures;
+}
@@ -0,0 +1,177 @@
+/**
+ * Block checksums and building a file from changed blocks, BlockSums and
+ * delta_copy().
+ *
+ */
+#include <blockdelta.hpp>
+#include <check.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include <unistd.h>
+
+using namespace std;
+using namespace Jupiter;
+
+
+static const boost::uint32_t BLOCK( 4096 );
+
+
+// An original in memory that counts what is read of it
+class MemoryFile : public SourceFile {
+	public:
+		MemoryFile( const string& data ) : data_( data ), read_( 0 ) {}
+
+		virtual streamsize read( uintmax_t offset, char* buffer, size_t size ) {
+			if( offset >= data_.size() ) {
+				return 0;
+			}
+
+			size = min< uintmax_t >( size, data_.size() - offset );
+			data_.copy( buffer, size, offset );
+			read_ += size;
+
+			return size;
+		}
+
+		uintmax_t bytes_read() const {
+			return read_;
+		}
+
+	private:
+		string data_;
+		uintmax_t read_;
+};
+
+
+static string noise( size_t size, unsigned seed ) {
+	string data;
+
+	for( size_t i( 0 ); i < size; ++i ) {
+		seed = seed * 1103515245 + 12345;
+		data += ( char )( seed >> 16 );
+	}
+
+	return data;
+}
+
+
+static string contents( const string& path ) {
+	ifstream in( path.c_str() );
+
+	return string( ( istreambuf_iterator< char >( in ) ), istreambuf_iterator< char >() );
+}
+
+
+static void checksums() {
+	string block( noise( BLOCK, 1 ) );
+
+	CHECK( BlockSums::checksum( block.data(), block.size() ) == BlockSums::checksum( block.data(), block.size() ) );
+	CHECK( BlockSums::checksum( block.data(), block.size() ) != BlockSums::checksum( block.data(), block.size() - 1 ) );
+
+	string changed( block );
+	changed[ 1000 ] ^= 1;
+
+	CHECK( BlockSums::checksum( block.data(), block.size() ) != BlockSums::checksum( changed.data(), changed.size() ) );
+
+	// The length counts, not only the bytes
+	string zeros( 16, '\0' );
+	CHECK( BlockSums::checksum( zeros.data(), 8 ) != BlockSums::checksum( zeros.data(), 16 ) );
+}
+
+
+static void computing( const string& directory ) {
+	string data( noise( 2 * BLOCK + 100, 2 ) );
+	MemoryFile file( data );
+	BlockSums sums;
+
+	CHECK( sums.compute( file, data.size(), BLOCK ) );
+	CHECK( 3 == sums.sums.size() );
+	CHECK( BLOCK == sums.blockSize );
+	CHECK( data.size() == sums.size );
+	CHECK( 3 == sums.sums.size() && BlockSums::checksum( data.data() + 2 * BLOCK, 100 ) == sums.sums[ 2 ] );
+
+	// A file shorter than claimed
+	BlockSums truncated;
+	CHECK( !truncated.compute( file, data.size() + 1, BLOCK ) );
+
+	fs::path path( directory + "/sums.jfcs" );
+	BlockSums loaded;
+
+	CHECK( sums.save( path ) );
+	CHECK( loaded.load( path ) );
+	CHECK( loaded.blockSize == sums.blockSize && loaded.size == sums.size && loaded.sums == sums.sums );
+
+	{
+		ofstream garbage( path.string().c_str() );
+		garbage << "not checksums";
+	}
+
+	CHECK( !loaded.load( path ) );
+	CHECK( !loaded.load( fs::path( directory + "/missing.jfcs" ) ) );
+
+	unlink( path.string().c_str() );
+}
+
+
+static void copying( const string& directory ) {
+	string old( noise( 3 * BLOCK + 10, 3 ) );
+	string path( directory + "/base" );
+
+	{
+		ofstream base( path.c_str() );
+		base << old;
+	}
+
+	// One block changed, the short last one grown
+	string data( old );
+	data[ BLOCK + 5 ] ^= 1;
+	data += noise( 50, 4 );
+
+	MemoryFile original( data ), base( old );
+	BlockSums sourceSums, baseSums;
+
+	CHECK( sourceSums.compute( original, data.size(), BLOCK ) );
+	CHECK( baseSums.compute( base, old.size(), BLOCK ) );
+
+	fs::path destination( directory + "/copy" );
+	uintmax_t fetched;
+
+	CHECK( delta_copy( original, sourceSums, fs::path( path ), baseSums, destination, fetched ) );
+	CHECK( BLOCK + 60 == fetched );
+	CHECK( contents( destination.string() ) == data );
+
+	// Never replaces a file
+	CHECK( !delta_copy( original, sourceSums, fs::path( path ), baseSums, destination, fetched ) );
+	unlink( destination.string().c_str() );
+
+	// Sums of different block sizes don't compare
+	BlockSums coarse;
+	CHECK( coarse.compute( base, old.size(), 2 * BLOCK ) );
+	CHECK( !delta_copy( original, sourceSums, fs::path( path ), coarse, destination, fetched ) );
+	CHECK( access( destination.string().c_str(), F_OK ) );
+
+	unlink( path.c_str() );
+}
+
+
+int main() {
+	char directory[] = "/tmp/filecachetest.XXXXXX";
+
+	if( !mkdtemp( directory ) ) {
+		cerr << "Could not create a scratch directory." << endl;
+		return 1;
+	}
+
+	checksums();
+	computing( directory );
+	copying( directory );
+
+	rmdir( directory );
+
+	return failures;
+}
@@ -0,0 +1,99 @@
+/**
+ * RateEstimate, plan_bypass() and probe_write().
+ *
+ */
+#include <bypass.hpp>
+#include <check.hpp>
+
+#include <cstdlib>
+#include <string>
+
+#include <unistd.h>
+
+using namespace std;
+using namespace Jupiter;
+
+
+static const double MEGABYTE( 1000000 );
+
+
+static void estimating() {
+	RateEstimate estimate;
+
+	CHECK( !estimate.known() );
+
+	estimate.recordTransfer( 100, 1 );
+	CHECK( !estimate.known() );
+
+	// Moves a WEIGHT-th of the way: 100 + ( 500 - 100 ) / 4
+	estimate.recordTransfer( 1000, 2 );
+	CHECK( estimate.known() );
+	CHECK( 2 == estimate.seconds( 400 ) );
+
+	// Instant transfers tell nothing
+	estimate.recordTransfer( 1000, 0 );
+	CHECK( 2 == estimate.seconds( 400 ) );
+
+	estimate.recordLatency( 1 );
+	CHECK( 3 == estimate.seconds( 400 ) );
+
+	RateEstimate once( 1 );
+	once.recordTransfer( 100, 1 );
+	CHECK( once.known() );
+}
+
+
+static void planning() {
+	RateEstimate source, fastCache( 1 ), slowCache( 1 );
+
+	fastCache.recordTransfer( 100 * MEGABYTE, 1 );
+	slowCache.recordTransfer( MEGABYTE, 1 );
+
+	// Without an estimate of the source everything is copied
+	CHECK( BYPASS_COPY == plan_bypass( 10 * MEGABYTE, 1, source, slowCache ) );
+
+	source.recordTransfer( 10 * MEGABYTE, 1 );
+	source.recordTransfer( 10 * MEGABYTE, 1 );
+
+	CHECK( BYPASS_COPY == plan_bypass( 10 * MEGABYTE, 1, source, RateEstimate( 1 ) ) );
+	CHECK( BYPASS_COPY == plan_bypass( 10 * MEGABYTE, 1, source, fastCache ) );
+
+	// The disk is the bottleneck: files asked for again are copied in the background
+	CHECK( BYPASS_ORIGINAL == plan_bypass( 10 * MEGABYTE, 1, source, slowCache ) );
+	CHECK( BYPASS_BACKGROUND == plan_bypass( 10 * MEGABYTE, 2, source, slowCache ) );
+
+	// A slow source to answer makes small files worth copying anyway
+	source.recordLatency( 1 );
+	CHECK( BYPASS_COPY == plan_bypass( 1000, 1, source, slowCache ) );
+	CHECK( BYPASS_ORIGINAL == plan_bypass( 100 * MEGABYTE, 1, source, slowCache ) );
+}
+
+
+static void probing() {
+	char directory[] = "/tmp/filecachetest.XXXXXX";
+
+	if( !mkdtemp( directory ) ) {
+		CHECK( !"Could not create a scratch directory." );
+		return;
+	}
+
+	string probe( string( directory ) + "/probe" );
+	double seconds( -1 );
+
+	CHECK( probe_write( probe, BypassPolicy::PROBE_SIZE, seconds ) );
+	CHECK( 0 <= seconds );
+	CHECK( access( probe.c_str(), F_OK ) );
+
+	CHECK( !probe_write( string( directory ) + "/missing/probe", 1000, seconds ) );
+
+	rmdir( directory );
+}
+
+
+int main() {
+	estimating();
+	planning();
+	probing();
+
+	return failures;
+}
@@ -0,0 +1,190 @@
+/**
+ * The C interface, filecacheapi.h.
+ *
+ */
+#include <filecacheapi.h>
+#include <check.hpp>
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+
+static string root;
+
+
+static bool exists( const string& path ) {
+	return !access( path.c_str(), F_OK );
+}
+
+
+static void write_file( const string& path, const char* contents ) {
+	ofstream file( path.c_str() );
+	file << contents;
+}
+
+
+static void arguments() {
+	FileCacheHandle* cache( filecache_open( ( root + "/cache" ).c_str(), NULL ) );
+	char buffer[ 1024 ];
+
+	CHECK( FILECACHE_ERROR_ARGUMENT == filecache_cache_file( NULL, "/a", buffer, sizeof( buffer ), NULL ) );
+	CHECK( FILECACHE_ERROR_ARGUMENT == filecache_cache_file( cache, NULL, buffer, sizeof( buffer ), NULL ) );
+	CHECK( FILECACHE_ERROR_ARGUMENT == filecache_cache_file_interned( cache, "/a", NULL ) );
+	CHECK( FILECACHE_ERROR_ARGUMENT == filecache_release_file( cache, NULL ) );
+	CHECK( FILECACHE_ERROR_ARGUMENT == filecache_cache_file_for_writing( NULL, "/a", buffer, sizeof( buffer ), NULL ) );
+	CHECK( FILECACHE_ERROR_ARGUMENT == filecache_uncache_file( cache, NULL, 1, 1, buffer, sizeof( buffer ), NULL ) );
+	CHECK( FILECACHE_ERROR_ARGUMENT == filecache_relocate( NULL, "/a" ) );
+	CHECK( FILECACHE_ERROR_ARGUMENT == filecache_resize( NULL, 1 ) );
+
+	// Closing nothing is fine
+	filecache_close( NULL );
+	filecache_close( cache );
+}
+
+
+static void caching() {
+	int status( FILECACHE_ERROR_INTERNAL );
+	FileCacheHandle* cache( filecache_open( ( root + "/cache" ).c_str(), &status ) );
+
+	CHECK( cache );
+	CHECK( FILECACHE_OK == status );
+
+	string remote( root + "/remote/a.tx" ), local( root + "/local.tx" );
+	char buffer[ 1024 ];
+	size_t length( 0 );
+
+	CHECK( FILECACHE_OK == filecache_cache_file( cache, remote.c_str(), buffer, sizeof( buffer ), &length ) );
+	CHECK( remote != buffer );
+	CHECK( strlen( buffer ) == length );
+	CHECK( exists( buffer ) );
+
+	string cached( buffer );
+
+	// Too small: nothing copied, but the length needed is known
+	char small[ 4 ] = "abc";
+	length = 0;
+
+	CHECK( FILECACHE_ERROR_BUFFER == filecache_cache_file( cache, remote.c_str(), small, sizeof( small ), &length ) );
+	CHECK( cached.size() == length );
+	CHECK( !strcmp( small, "abc" ) );
+	CHECK( FILECACHE_ERROR_BUFFER == filecache_cache_file( cache, remote.c_str(), NULL, 0, &length ) );
+
+	// Local files are used where they are
+	CHECK( FILECACHE_NOT_CACHED == filecache_cache_file( cache, local.c_str(), buffer, sizeof( buffer ), NULL ) );
+	CHECK( local == buffer );
+
+	const char* result( NULL );
+
+	CHECK( FILECACHE_OK == filecache_cache_file_interned( cache, remote.c_str(), &result ) );
+	CHECK( result && cached == result );
+
+	const char* again( NULL );
+	CHECK( FILECACHE_OK == filecache_cache_file_interned( cache, remote.c_str(), &again ) );
+	CHECK( again == result );
+
+	CHECK( FILECACHE_NOT_CACHED == filecache_cache_file_interned( cache, local.c_str(), &result ) );
+	CHECK( result == local.c_str() );
+
+	CHECK( FILECACHE_OK == filecache_release_file( cache, cached.c_str() ) );
+	CHECK( FILECACHE_OK == filecache_resize( cache, 100 ) );
+
+	filecache_close( cache );
+}
+
+
+static void writing() {
+	FileCacheHandle* cache( filecache_open( ( root + "/cache" ).c_str(), NULL ) );
+
+	string output( root + "/remote/out.tx" );
+	char buffer[ 1024 ], destination[ 1024 ];
+	size_t length;
+
+	CHECK( FILECACHE_OK == filecache_cache_file_for_writing( cache, output.c_str(), buffer, sizeof( buffer ), &length ) );
+	CHECK( output != buffer );
+
+	write_file( buffer, "written" );
+
+	// Only a file already in the cache is registered for uncaching
+	CHECK( FILECACHE_OK == filecache_cache_file_for_writing( cache, output.c_str(), buffer, sizeof( buffer ), &length ) );
+
+	CHECK( FILECACHE_OK == filecache_uncache_file( cache, buffer, 1, 0, destination, sizeof( destination ), &length ) );
+	CHECK( exists( output ) );
+
+	// Same status logic as filecache_cache_file(): a failed copy into the buffer is an error, not NOT_CACHED
+	string local( root + "/local.tx" );
+	char small[ 4 ];
+
+	CHECK( FILECACHE_NOT_CACHED == filecache_cache_file_for_writing( cache, local.c_str(), buffer, sizeof( buffer ), NULL ) );
+	CHECK( FILECACHE_ERROR_BUFFER == filecache_cache_file_for_writing( cache, local.c_str(), small, sizeof( small ), NULL ) );
+	CHECK( FILECACHE_ERROR_BUFFER == filecache_uncache_file( cache, local.c_str(), 1, 0, small, sizeof( small ), NULL ) );
+
+	filecache_close( cache );
+}
+
+
+static void attaching() {
+	int status;
+	FileCacheHandle* first( filecache_attach( ( root + "/shared" ).c_str(), &status ) );
+	FileCacheHandle* second( filecache_attach( ( root + "/shared" ).c_str(), &status ) );
+
+	CHECK( first && second );
+
+	string remote( root + "/remote/a.tx" );
+	const char* a( NULL );
+	const char* b( NULL );
+
+	CHECK( FILECACHE_OK == filecache_cache_file_interned( first, remote.c_str(), &a ) );
+	CHECK( FILECACHE_OK == filecache_cache_file_interned( second, remote.c_str(), &b ) );
+	CHECK( a == b );
+
+	CHECK( FILECACHE_OK == filecache_release_file( first, a ) );
+	filecache_close( first );
+
+	// Still pinned by the second handle
+	CHECK( exists( b ) );
+
+	filecache_close( second );
+}
+
+
+static void statuses() {
+	CHECK( filecache_status_string( FILECACHE_OK ) );
+	CHECK( filecache_status_string( FILECACHE_ERROR_BUFFER ) );
+	CHECK( strcmp( filecache_status_string( FILECACHE_OK ), filecache_status_string( FILECACHE_ERROR_BUFFER ) ) );
+	CHECK( filecache_status_string( 12345 ) );
+}
+
+
+int main() {
+	char directory[] = "/tmp/filecachetest.XXXXXX";
+
+	if( !mkdtemp( directory ) ) {
+		cerr << "Could not create a scratch directory." << endl;
+		return 1;
+	}
+
+	root = directory;
+	mkdir( ( root + "/remote" ).c_str(), 0755 );
+	write_file( root + "/remote/a.tx", "remote" );
+	write_file( root + "/local.tx", "local" );
+
+	// Read when a cache is created
+	setenv( "FILECACHE_REMOTE", ( root + "/remote" ).c_str(), 1 );
+
+	arguments();
+	caching();
+	writing();
+	attaching();
+	statuses();
+
+	system( ( "rm -rf '" + root + "'" ).c_str() );
+
+	return failures;
+}
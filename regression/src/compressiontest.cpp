@@ -0,0 +1,168 @@
+/**
+ * Compressing blocks and files, CompressedFile and CompressionPolicy.
+ *
+ */
+#include <compression.hpp>
+#include <check.hpp>
+
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace std;
+using namespace Jupiter;
+
+
+static vector< Codec > codecs() {
+	vector< Codec > available;
+
+	// Chunks are stored as they are without a codec
+	available.push_back( CODEC_NONE );
+#if defined( FILECACHE_LZ4 )
+	available.push_back( CODEC_LZ4 );
+#endif
+#if defined( FILECACHE_ZSTD )
+	available.push_back( CODEC_ZSTD );
+#endif
+
+	return available;
+}
+
+
+// Compressible, then noise, then compressible again, ending within a chunk
+static string contents() {
+	string data;
+	unsigned seed( 42 );
+
+	for( size_t i( 0 ); i < CompressedFile::CHUNK_SIZE; ++i ) {
+		data += "frame"[ i % 5 ];
+	}
+
+	for( size_t i( 0 ); i < CompressedFile::CHUNK_SIZE; ++i ) {
+		seed = seed * 1103515245 + 12345;
+		data += ( char )( seed >> 16 );
+	}
+
+	data += string( CompressedFile::CHUNK_SIZE / 2 + 17, 'x' );
+
+	return data;
+}
+
+
+static void blocks() {
+	string data( 10000, 'a' ), compressed;
+
+	CHECK( !compress_block( CODEC_NONE, data.data(), data.size(), compressed ) );
+
+	for( size_t c( 1 ); c < codecs().size(); ++c ) {
+		CHECK( compress_block( codecs()[ c ], data.data(), data.size(), compressed ) );
+		CHECK( compressed.size() < data.size() );
+
+		vector< char > result( data.size() );
+
+		CHECK( decompress_block( codecs()[ c ], compressed.data(), compressed.size(), &result[ 0 ], result.size() ) );
+		CHECK( string( result.begin(), result.end() ) == data );
+
+		// The exact size has to be known
+		CHECK( !decompress_block( codecs()[ c ], compressed.data(), compressed.size(), &result[ 0 ], result.size() - 1 ) );
+	}
+}
+
+
+static void policies() {
+	CHECK( CODEC_NONE == CompressionPolicy::codec_from_name( "none" ) );
+	CHECK( CODEC_NONE == CompressionPolicy::codec_from_name( "gzip" ) );
+
+	CompressionPolicy policy;
+	policy.codec = CODEC_LZ4;
+
+	// Neither extensions nor a threshold: everything
+	CHECK( policy.applies( fs::path( "/a/b.exr" ), 1 ) );
+
+	policy.extensions_from_list( ".EXR, vdb" );
+	CHECK( policy.applies( fs::path( "/a/b.exr" ), 1 ) );
+	CHECK( policy.applies( fs::path( "/a/b.vdb" ), 1 ) );
+	CHECK( !policy.applies( fs::path( "/a/b.tif" ), 1 ) );
+
+	policy.threshold = 1000;
+	CHECK( policy.applies( fs::path( "/a/b.tif" ), 1000 ) );
+	CHECK( !policy.applies( fs::path( "/a/b.tif" ), 999 ) );
+}
+
+
+static void files( const string& directory ) {
+	string data( contents() );
+	string original( directory + "/original" );
+
+	{
+		ofstream file( original.c_str() );
+		file << data;
+	}
+
+	CHECK( !CompressedFile::is_compressed( fs::path( original ) ) );
+
+	vector< Codec > available( codecs() );
+
+	for( size_t c( 0 ); c < available.size(); ++c ) {
+		fs::path compressed( directory + "/compressed" );
+		fs::path restored( directory + "/restored" );
+
+		CHECK( CompressedFile::compress( fs::path( original ), compressed, available[ c ] ) );
+		CHECK( CompressedFile::is_compressed( compressed ) );
+
+		// Never replaces a file
+		CHECK( !CompressedFile::compress( fs::path( original ), compressed, available[ c ] ) );
+
+		CompressedFile file( compressed );
+
+		CHECK( file.valid() );
+		CHECK( data.size() == file.size() );
+
+		// Ranges within a chunk, across chunks and past the end
+		vector< char > buffer( CompressedFile::CHUNK_SIZE + 2 );
+		uintmax_t offsets[] = { 0, 100, CompressedFile::CHUNK_SIZE - 1, CompressedFile::CHUNK_SIZE * 3 / 2 };
+
+		for( size_t i( 0 ); i < sizeof( offsets ) / sizeof( *offsets ); ++i ) {
+			CHECK( ( streamsize )buffer.size() == file.read( offsets[ i ], &buffer[ 0 ], buffer.size() ) );
+			CHECK( data.compare( offsets[ i ], buffer.size(), &buffer[ 0 ], buffer.size() ) == 0 );
+		}
+
+		CHECK( 17 == file.read( data.size() - 17, &buffer[ 0 ], buffer.size() ) );
+		CHECK( data.compare( data.size() - 17, 17, &buffer[ 0 ], 17 ) == 0 );
+		CHECK( 0 == file.read( data.size(), &buffer[ 0 ], buffer.size() ) );
+
+		CHECK( file.decompress( restored ) );
+
+		ifstream in( restored.string().c_str() );
+		string result( ( istreambuf_iterator< char >( in ) ), istreambuf_iterator< char >() );
+
+		CHECK( result == data );
+
+		unlink( compressed.string().c_str() );
+		unlink( restored.string().c_str() );
+	}
+
+	unlink( original.c_str() );
+}
+
+
+int main() {
+	char directory[] = "/tmp/filecachetest.XXXXXX";
+
+	if( !mkdtemp( directory ) ) {
+		cerr << "Could not create a scratch directory." << endl;
+		return 1;
+	}
+
+	blocks();
+	policies();
+	files( directory );
+
+	rmdir( directory );
+
+	return failures;
+}
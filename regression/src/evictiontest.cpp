@@ -0,0 +1,95 @@
+/**
+ * Choosing the entries to evict, plan_eviction().
+ *
+ */
+#include <eviction.hpp>
+#include <check.hpp>
+
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace Jupiter;
+
+
+static EvictionCandidate candidate( uintmax_t size, time_t lastAccess, bool pinned = false, bool preferred = false ) {
+	EvictionCandidate entry;
+
+	entry.size = size;
+	entry.lastAccess = lastAccess;
+	entry.pinned = pinned;
+	entry.preferred = preferred;
+
+	return entry;
+}
+
+
+static void names() {
+	EvictionPolicy policy( EVICT_LRU );
+
+	CHECK( eviction_policy_from_name( "largest", policy ) && EVICT_LARGEST == policy );
+	CHECK( eviction_policy_from_name( "lru", policy ) && EVICT_LRU == policy );
+
+	// Unknown names leave the policy alone
+	CHECK( !eviction_policy_from_name( "lfu", policy ) );
+	CHECK( EVICT_LRU == policy );
+
+	CHECK( eviction_policy_name( EVICT_LRU ) == "lru" );
+	CHECK( eviction_policy_name( EVICT_LARGEST ) == "largest" );
+}
+
+
+static void ordering() {
+	vector< EvictionCandidate > candidates;
+	vector< size_t > victims;
+
+	candidates.push_back( candidate( 100, 30 ) );
+	candidates.push_back( candidate( 300, 20 ) );
+	candidates.push_back( candidate( 200, 10 ) );
+
+	// Room enough: nothing to do
+	CHECK( plan_eviction( candidates, 600, 600, EVICT_LRU, victims ) );
+	CHECK( victims.empty() );
+
+	// Oldest first, until below the capacity
+	CHECK( plan_eviction( candidates, 600, 500, EVICT_LRU, victims ) );
+	CHECK( 1 == victims.size() && 2 == victims[ 0 ] );
+
+	CHECK( plan_eviction( candidates, 600, 400, EVICT_LRU, victims ) );
+	CHECK( 2 == victims.size() && 2 == victims[ 0 ] && 1 == victims[ 1 ] );
+
+	// Largest first
+	CHECK( plan_eviction( candidates, 600, 500, EVICT_LARGEST, victims ) );
+	CHECK( 1 == victims.size() && 1 == victims[ 0 ] );
+
+	// Equal sizes go oldest first
+	candidates[ 0 ].size = 300;
+	CHECK( plan_eviction( candidates, 800, 600, EVICT_LARGEST, victims ) );
+	CHECK( 1 == victims.size() && 1 == victims[ 0 ] );
+}
+
+
+static void pinning() {
+	vector< EvictionCandidate > candidates;
+	vector< size_t > victims;
+
+	candidates.push_back( candidate( 100, 10, true ) );
+	candidates.push_back( candidate( 100, 20 ) );
+	candidates.push_back( candidate( 100, 30, false, true ) );
+
+	// Preferred entries go first, pinned ones never
+	CHECK( plan_eviction( candidates, 300, 250, EVICT_LRU, victims ) );
+	CHECK( 1 == victims.size() && 2 == victims[ 0 ] );
+
+	CHECK( !plan_eviction( candidates, 300, 100, EVICT_LRU, victims ) );
+	CHECK( 2 == victims.size() && 2 == victims[ 0 ] && 1 == victims[ 1 ] );
+}
+
+
+int main() {
+	names();
+	ordering();
+	pinning();
+
+	return failures;
+}
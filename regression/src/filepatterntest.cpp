@@ -0,0 +1,92 @@
+/**
+ * Matching file names against FilePattern.
+ *
+ */
+#include <filepattern.hpp>
+#include <check.hpp>
+
+#include <string>
+
+using namespace std;
+using namespace Jupiter;
+
+
+static void plain() {
+	CHECK( FilePattern( "plate.exr" ).literal() );
+	CHECK( FilePattern( "plate.exr" ).matches( "plate.exr" ) );
+	CHECK( !FilePattern( "plate.exr" ).matches( "plate.exr.bak" ) );
+
+	// Not complete tokens
+	CHECK( FilePattern( "100%.tif" ).literal() );
+	CHECK( FilePattern( "a[b.tif" ).literal() );
+	CHECK( FilePattern( "a[b.tif" ).matches( "a[b.tif" ) );
+	CHECK( FilePattern( "<udi>.tif" ).literal() );
+
+	CHECK( !FilePattern( "*.tif" ).literal() );
+	CHECK( !FilePattern( "plate.####.exr" ).literal() );
+	CHECK( !FilePattern( "diffuse.<UDIM>.tx" ).literal() );
+}
+
+
+static void udims() {
+	FilePattern pattern( "diffuse.<UDIM>.tx" );
+
+	CHECK( pattern.matches( "diffuse.1001.tx" ) );
+	CHECK( pattern.matches( "diffuse.1042.tx" ) );
+	CHECK( FilePattern( "diffuse.<udim>.tx" ).matches( "diffuse.1001.tx" ) );
+
+	CHECK( !pattern.matches( "diffuse.0999.tx" ) );
+	CHECK( !pattern.matches( "diffuse.101.tx" ) );
+	CHECK( !pattern.matches( "diffuse.10011.tx" ) );
+	CHECK( !pattern.matches( "diffuse.10a1.tx" ) );
+}
+
+
+static void frames() {
+	FilePattern hashes( "plate.####.exr" );
+
+	CHECK( hashes.matches( "plate.0001.exr" ) );
+	CHECK( hashes.matches( "plate.10000.exr" ) );
+	CHECK( hashes.matches( "plate.-0001.exr" ) );
+	CHECK( !hashes.matches( "plate.001.exr" ) );
+	CHECK( !hashes.matches( "plate..exr" ) );
+
+	CHECK( FilePattern( "plate.%04d.exr" ).matches( "plate.0042.exr" ) );
+	CHECK( !FilePattern( "plate.%04d.exr" ).matches( "plate.42.exr" ) );
+	CHECK( FilePattern( "plate.%d.exr" ).matches( "plate.42.exr" ) );
+
+	// Digits the rest of the pattern needs are given back
+	CHECK( FilePattern( "shot#_v1.exr" ).matches( "shot12_v1.exr" ) );
+	CHECK( FilePattern( "f##1.exr" ).matches( "f0101.exr" ) );
+}
+
+
+static void globs() {
+	CHECK( FilePattern( "*.tif" ).matches( "a.tif" ) );
+	CHECK( FilePattern( "*.tif" ).matches( ".tif" ) );
+	CHECK( !FilePattern( "*.tif" ).matches( "a.tiff" ) );
+	CHECK( FilePattern( "a*b*c" ).matches( "abbbc" ) );
+
+	CHECK( FilePattern( "?.tif" ).matches( "a.tif" ) );
+	CHECK( !FilePattern( "?.tif" ).matches( ".tif" ) );
+
+	CHECK( FilePattern( "[abc].tif" ).matches( "b.tif" ) );
+	CHECK( !FilePattern( "[abc].tif" ).matches( "d.tif" ) );
+	CHECK( FilePattern( "[a-c].tif" ).matches( "b.tif" ) );
+	CHECK( FilePattern( "[!a-c].tif" ).matches( "d.tif" ) );
+	CHECK( !FilePattern( "[^a-c].tif" ).matches( "a.tif" ) );
+
+	// A ']' right at the start is part of the class, a trailing '-' too
+	CHECK( FilePattern( "[]a].tif" ).matches( "].tif" ) );
+	CHECK( FilePattern( "[a-].tif" ).matches( "-.tif" ) );
+}
+
+
+int main() {
+	plain();
+	udims();
+	frames();
+	globs();
+
+	return failures;
+}
@@ -0,0 +1,88 @@
+/**
+ * Keeping space free on the cache's filesystem, FileCache::keepFree().
+ *
+ */
+#include <filecache.hpp>
+#include <check.hpp>
+
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+
+using namespace std;
+using namespace Jupiter;
+
+
+static string root;
+
+
+static void write_file( const string& path, size_t size ) {
+	ofstream file( path.c_str() );
+	file << string( size, 'x' );
+}
+
+
+static bool cached( FileCache& cache, const string& name ) {
+	string original( root + "/remote/" + name );
+
+	return cache.cacheFile( original ) != original;
+}
+
+
+int main() {
+	char directory[] = "/tmp/filecachetest.XXXXXX";
+
+	if( !mkdtemp( directory ) ) {
+		cerr << "Could not create a scratch directory." << endl;
+		return 1;
+	}
+
+	root = directory;
+	mkdir( ( root + "/remote" ).c_str(), 0755 );
+	mkdir( ( root + "/cache" ).c_str(), 0755 );
+
+	const char* names[] = { "a.tx", "b.tx", "c.tx", "d.tx", "e.tx", "big.tx" };
+	for( size_t i( 0 ); i < sizeof( names ) / sizeof( *names ); ++i ) {
+		write_file( root + "/remote/" + names[ i ], 1000 );
+	}
+	write_file( root + "/remote/big.tx", 2000000 );
+
+	struct statvfs disk;
+	CHECK( !statvfs( directory, &disk ) );
+	uintmax_t megabytes( ( uintmax_t )disk.f_blocks * disk.f_frsize / 1000000 );
+
+	// Read when a cache is created
+	setenv( "FILECACHE_REMOTE", ( root + "/remote" ).c_str(), 1 );
+
+	{
+		FileCache cache( root + "/cache" );
+
+		// More than the whole disk to keep free leaves nothing for the cache
+		cache.keepFree( megabytes + 1 );
+		CHECK( !cached( cache, "a.tx" ) );
+
+		// So does all of it, in percent
+		cache.keepFree( 0, 100 );
+		CHECK( !cached( cache, "b.tx" ) );
+
+		// Off again
+		cache.keepFree( 0, 0 );
+		CHECK( cached( cache, "c.tx" ) );
+
+		// Plenty of room
+		cache.keepFree( 1 );
+		CHECK( cached( cache, "d.tx" ) );
+
+		// The configured size still caps the cache
+		cache.resize( 1 );
+		CHECK( cached( cache, "e.tx" ) );
+		CHECK( !cached( cache, "big.tx" ) );
+	}
+
+	system( ( "rm -rf '" + root + "'" ).c_str() );
+
+	return failures;
+}
@@ -0,0 +1,148 @@
+/**
+ * PathTable and PathIdSet.
+ *
+ */
+#include <pathtable.hpp>
+#include <check.hpp>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace Jupiter;
+
+
+static string numbered( const char* prefix, int number ) {
+	char name[ 256 ];
+	snprintf( name, sizeof( name ), "%s/%08d.tx", prefix, number );
+	return name;
+}
+
+
+static void interning() {
+	PathTable table;
+
+	PathId a( table.intern( "/net/tex/a.tx" ) );
+	PathId b( table.intern( string( "/net/tex/b.tx" ) ) );
+
+	CHECK( a != b );
+	CHECK( table.intern( "/net/tex/a.tx" ) == a );
+	CHECK( table.size() == 2 );
+
+	PathId found;
+	CHECK( table.find( "/net/tex/b.tx", found ) && found == b );
+	CHECK( !table.find( "/net/tex/c.tx", found ) );
+	CHECK( table.size() == 2 );
+
+	CHECK( table.path( a ) == "/net/tex/a.tx" );
+	CHECK( string( table.c_str( b ) ) == "/net/tex/b.tx" );
+
+	// Not a prefix match
+	CHECK( !table.find( "/net/tex/a", found ) );
+	CHECK( table.intern( "/net/tex/a", 9 ) != a );
+}
+
+
+static void growing() {
+	PathTable table;
+	vector< PathId > ids;
+
+	// Many slot resizes and arena blocks
+	for( int i( 0 ); i < 50000; ++i ) {
+		ids.push_back( table.intern( numbered( "/net/sim", i ) ) );
+	}
+
+	CHECK( table.size() == 50000 );
+
+	bool all( true );
+
+	for( int i( 0 ); i < 50000; ++i ) {
+		PathId found;
+		all = all && table.find( numbered( "/net/sim", i ), found ) && found == ids[ i ] && table.path( found ) == numbered( "/net/sim", i );
+	}
+
+	CHECK( all );
+
+	// Longer than an arena block
+	string huge( PathTable::BLOCK_SIZE + 10, 'x' );
+	PathId id( table.intern( huge ) );
+	CHECK( table.path( id ) == huge );
+}
+
+
+static void retaining() {
+	PathTable table;
+	vector< PathId > ids;
+
+	for( int i( 0 ); i < 20000; ++i ) {
+		ids.push_back( table.intern( numbered( "/net/old", i ) ) );
+	}
+
+	const char* handedOut( table.c_str( ids[ 3 ] ) );
+
+	vector< PathId > live;
+	live.push_back( ids[ 1 ] );
+	live.push_back( ids[ 19999 ] );
+
+	CHECK( table.retain( live ) == 19997 );
+	CHECK( table.size() == 3 );
+
+	PathId found;
+	CHECK( table.find( numbered( "/net/old", 1 ), found ) && found == ids[ 1 ] );
+	CHECK( table.find( numbered( "/net/old", 19999 ), found ) && found == ids[ 19999 ] );
+	CHECK( !table.find( numbered( "/net/old", 2 ), found ) );
+	CHECK( table.path( ids[ 2 ] ).empty() );
+
+	// Strings handed out stay, and so does their path
+	CHECK( string( handedOut ) == numbered( "/net/old", 3 ) );
+	CHECK( table.find( numbered( "/net/old", 3 ), found ) && found == ids[ 3 ] );
+
+	// Removed ids are reused, the kept ones keep their paths
+	for( int i( 0 ); i < 20000; ++i ) {
+		table.intern( numbered( "/net/new", i ) );
+	}
+
+	CHECK( table.size() == 20003 );
+	CHECK( table.path( ids[ 1 ] ) == numbered( "/net/old", 1 ) );
+	CHECK( table.find( numbered( "/net/new", 12345 ), found ) && table.path( found ) == numbered( "/net/new", 12345 ) );
+
+	// Nothing to remove
+	live.clear();
+	CHECK( table.retain( live ) == 20002 );
+	CHECK( table.retain( live ) == 0 );
+	CHECK( table.size() == 1 );
+}
+
+
+static void sets() {
+	PathIdSet set;
+
+	CHECK( set.empty() );
+	CHECK( set.insert( 7 ) );
+	CHECK( set.insert( 3 ) );
+	CHECK( set.insert( 11 ) );
+	CHECK( !set.insert( 7 ) );
+	CHECK( set.size() == 3 );
+
+	CHECK( set.count( 3 ) && set.count( 7 ) && set.count( 11 ) );
+	CHECK( !set.count( 5 ) );
+
+	// Ascending
+	CHECK( set.ids()[ 0 ] == 3 && set.ids()[ 1 ] == 7 && set.ids()[ 2 ] == 11 );
+
+	CHECK( set.erase( 7 ) );
+	CHECK( !set.erase( 7 ) );
+	CHECK( !set.count( 7 ) );
+	CHECK( set.size() == 2 );
+}
+
+
+int main() {
+	interning();
+	growing();
+	retaining();
+	sets();
+
+	return failures;
+}
@@ -0,0 +1,148 @@
+/**
+ * Reading an entry while it is copied, ProgressiveFill.
+ *
+ */
+#include <progressivefill.hpp>
+#include <check.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include <unistd.h>
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+
+using namespace std;
+using namespace Jupiter;
+
+
+// An original in memory, failing from a given offset on
+class MemoryFile : public SourceFile {
+	public:
+		MemoryFile( const string& data, uintmax_t broken = ( uintmax_t )-1 ) : data_( data ), broken_( broken ) {}
+
+		virtual streamsize read( uintmax_t offset, char* buffer, size_t size ) {
+			if( offset >= broken_ ) {
+				return -1;
+			}
+
+			if( offset >= data_.size() ) {
+				return 0;
+			}
+
+			size = min< uintmax_t >( size, data_.size() - offset );
+			data_.copy( buffer, size, offset );
+
+			return size;
+		}
+
+	private:
+		string data_;
+		uintmax_t broken_;
+};
+
+
+static string noise( size_t size ) {
+	string data;
+	unsigned seed( 7 );
+
+	for( size_t i( 0 ); i < size; ++i ) {
+		seed = seed * 1103515245 + 12345;
+		data += ( char )( seed >> 16 );
+	}
+
+	return data;
+}
+
+
+static string contents( const string& path ) {
+	ifstream in( path.c_str() );
+
+	return string( ( istreambuf_iterator< char >( in ) ), istreambuf_iterator< char >() );
+}
+
+
+static void filling( const string& directory ) {
+	const size_t BLOCK( ProgressiveFill::BLOCK_SIZE );
+	string data( noise( 2 * BLOCK + BLOCK / 2 ) );
+	string partial( directory + "/entry.filling" ), destination( directory + "/entry" );
+
+	boost::shared_ptr< ProgressiveFill > fill( new ProgressiveFill( new MemoryFile( data ), data.size(), fs::path( partial ), fs::path( destination ) ) );
+	boost::scoped_ptr< SourceFile > reader( ProgressiveFill::reader( fill ) );
+
+	// The end first, then across a block boundary
+	string buffer( BLOCK, '\0' );
+
+	CHECK( ( streamsize )( BLOCK / 2 ) == reader->read( 2 * BLOCK, &buffer[ 0 ], BLOCK ) );
+	CHECK( 0 == data.compare( 2 * BLOCK, BLOCK / 2, buffer, 0, BLOCK / 2 ) );
+
+	CHECK( ( streamsize )BLOCK == reader->read( BLOCK / 2, &buffer[ 0 ], BLOCK ) );
+	CHECK( 0 == data.compare( BLOCK / 2, BLOCK, buffer ) );
+
+	CHECK( 0 == reader->read( data.size(), &buffer[ 0 ], BLOCK ) );
+
+	CHECK( fill->wait() );
+	CHECK( fill->finished() );
+	CHECK( contents( destination ) == data );
+	CHECK( access( partial.c_str(), F_OK ) );
+
+	// Readers keep working once the entry is in place
+	CHECK( 10 == reader->read( 0, &buffer[ 0 ], 10 ) );
+	CHECK( 0 == data.compare( 0, 10, buffer, 0, 10 ) );
+
+	unlink( destination.c_str() );
+}
+
+
+static void failing( const string& directory ) {
+	const size_t BLOCK( ProgressiveFill::BLOCK_SIZE );
+	string data( noise( 3 * BLOCK ) );
+	string partial( directory + "/entry.filling" ), destination( directory + "/entry" );
+
+	{
+		ProgressiveFill fill( new MemoryFile( data, BLOCK ), data.size(), fs::path( partial ), fs::path( destination ) );
+		string buffer( 10, '\0' );
+
+		CHECK( -1 == fill.read( 2 * BLOCK, &buffer[ 0 ], buffer.size() ) );
+		CHECK( !fill.wait() );
+		CHECK( access( destination.c_str(), F_OK ) );
+		CHECK( access( partial.c_str(), F_OK ) );
+	}
+
+	// Somebody else's partial file is left alone
+	{
+		ofstream other( partial.c_str() );
+		other << "theirs";
+	}
+
+	{
+		ProgressiveFill fill( new MemoryFile( data ), data.size(), fs::path( partial ), fs::path( destination ) );
+
+		CHECK( !fill.wait() );
+		CHECK( access( destination.c_str(), F_OK ) );
+		CHECK( "theirs" == contents( partial ) );
+	}
+
+	unlink( partial.c_str() );
+}
+
+
+int main() {
+	char directory[] = "/tmp/filecachetest.XXXXXX";
+
+	if( !mkdtemp( directory ) ) {
+		cerr << "Could not create a scratch directory." << endl;
+		return 1;
+	}
+
+	filling( directory );
+	failing( directory );
+
+	rmdir( directory );
+
+	return failures;
+}
@@ -0,0 +1,108 @@
+/**
+ * Predicting the next files of a sequence, SequencePredictor.
+ *
+ */
+#include <readahead.hpp>
+#include <check.hpp>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace Jupiter;
+
+
+static vector< fs::path > observe( SequencePredictor& predictor, const string& file ) {
+	vector< fs::path > predicted;
+
+	predictor.observe( fs::path( file ), predicted );
+
+	return predicted;
+}
+
+
+static void frames() {
+	SequencePredictor predictor( 2 );
+
+	CHECK( observe( predictor, "/shots/a/foo.0100.vdb" ).empty() );
+
+	// A frame apart is a sequence at once, the padding is kept
+	vector< fs::path > predicted( observe( predictor, "/shots/a/foo.0101.vdb" ) );
+
+	CHECK( 2 == predicted.size() );
+	CHECK( 2 == predicted.size() && "/shots/a/foo.0102.vdb" == predicted[ 0 ].string() );
+	CHECK( 2 == predicted.size() && "/shots/a/foo.0103.vdb" == predicted[ 1 ].string() );
+
+	// Backwards, without padding
+	CHECK( observe( predictor, "/shots/a/bar9.exr" ).empty() );
+	predicted = observe( predictor, "/shots/a/bar8.exr" );
+
+	CHECK( 2 == predicted.size() && "/shots/a/bar7.exr" == predicted[ 0 ].string() );
+
+	// Nothing before frame 0
+	observe( predictor, "/shots/a/baz.1.exr" );
+	predicted = observe( predictor, "/shots/a/baz.0.exr" );
+
+	CHECK( predicted.empty() );
+}
+
+
+static void strides() {
+	SequencePredictor predictor( 1 );
+
+	CHECK( observe( predictor, "/s/f.0010.exr" ).empty() );
+	CHECK( observe( predictor, "/s/f.0012.exr" ).empty() );
+
+	// Two steps of the same stride
+	vector< fs::path > predicted( observe( predictor, "/s/f.0014.exr" ) );
+
+	CHECK( 1 == predicted.size() && "/s/f.0016.exr" == predicted[ 0 ].string() );
+
+	// A jump has to be confirmed again
+	CHECK( observe( predictor, "/s/f.0100.exr" ).empty() );
+	CHECK( observe( predictor, "/s/f.0100.exr" ).empty() );
+}
+
+
+static void sequences() {
+	SequencePredictor predictor( 1 );
+
+	// The last number names the frame, the rest of the path the sequence
+	observe( predictor, "/s/v2/f.0001.exr" );
+	CHECK( observe( predictor, "/s/v3/f.0002.exr" ).empty() );
+	CHECK( observe( predictor, "/s/v2/f.0002.tif" ).empty() );
+	CHECK( 1 == observe( predictor, "/s/v2/f.0002.exr" ).size() );
+
+	// No number, or too long for a frame
+	CHECK( observe( predictor, "/s/plate.exr" ).empty() );
+	observe( predictor, "/s/id1234567890.exr" );
+	CHECK( observe( predictor, "/s/id1234567891.exr" ).empty() );
+}
+
+
+static void forgetting() {
+	SequencePredictor predictor( 1 );
+
+	observe( predictor, "/s/first.1.exr" );
+
+	for( int i( 0 ); i < SequencePredictor::MAX_SEQUENCES; ++i ) {
+		char name[ 32 ];
+		snprintf( name, sizeof( name ), "/s/other%d_.1.exr", i );
+		observe( predictor, name );
+	}
+
+	// The oldest sequence made room
+	CHECK( observe( predictor, "/s/first.2.exr" ).empty() );
+	CHECK( 1 == observe( predictor, "/s/other255_.2.exr" ).size() );
+}
+
+
+int main() {
+	frames();
+	strides();
+	sequences();
+	forgetting();
+
+	return failures;
+}
@@ -0,0 +1,368 @@
+/**
+ * Replays FileCache traces against simulated caches.
+ *
+ * Usage: filecachereplay [-s sizes in MB] [-P policies] trace...
+ *
+ * Reads traces written with FILECACHE_TRACE (see FileCache::traceFile()),
+ * merges them by time and feeds the requests through the cache's eviction
+ * engine (plan_eviction()) for every combination of cache size and policy.
+ * No files are touched: the simulated cache only keeps sizes, access times
+ * and which cache instances have a file pinned.
+ *
+ * -s and -P take comma separated lists. Sizes default to 10%, 25%, 50% and
+ * 100% of the bytes of all distinct files in the traces, 0 is unlimited.
+ * Policies default to all of them.
+ *
+ * A file whose size changed since it was cached is outdated: it is copied
+ * again unless another instance has it pinned, in which case the request goes
+ * to the origin. Requests for local files are ignored.
+ *
+ * Reports the hit ratio, the bytes fetched from the origin and the evictions
+ * for each combination, next to the hit ratio recorded in the traces.
+ *
+ *   FILECACHE_TRACE=/var/tmp/trace.%p filecachebench -m 500
+ *   filecachereplay -s 100,250,500,1000 -P lru,largest /var/tmp/trace.*
+ *
+ */
+#include <cachetrace.hpp>
+#include <eviction.hpp>
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include <boost/lexical_cast.hpp>
+#include <boost/tokenizer.hpp>
+
+using namespace std;
+using Jupiter::TraceRecord;
+
+
+typedef pair< boost::uint32_t, boost::uint32_t > Instance; // pid, instance
+
+
+static bool earlier( const TraceRecord& a, const TraceRecord& b ) {
+	return a.time < b.time;
+}
+
+
+static void usage( const char* name ) {
+	cerr << "Usage: " << name << " [-s sizes in MB] [-P policies] trace..." << endl;
+}
+
+
+// What a simulated cache did
+struct Result {
+	boost::uint64_t requests, hits, misses, stalePinned, failed;
+	boost::uint64_t originBytes, evictions, evictedBytes;
+
+	Result() : requests( 0 ), hits( 0 ), misses( 0 ), stalePinned( 0 ), failed( 0 ),
+	           originBytes( 0 ), evictions( 0 ), evictedBytes( 0 ) {}
+};
+
+
+class Simulation {
+	public:
+		Simulation( uintmax_t capacity, Jupiter::EvictionPolicy policy )
+			: capacity_( capacity ), policy_( policy ), used_( 0 ) {}
+
+		void replay( const TraceRecord& record ) {
+			switch( record.operation ) {
+				case TraceRecord::CACHE:
+					if( TraceRecord::LOCAL != record.outcome ) {
+						request( record );
+					}
+					break;
+				case TraceRecord::RELEASE:
+					release( record.path, Instance( record.pid, record.instance ) );
+					break;
+				case TraceRecord::FINISH:
+					finish( Instance( record.pid, record.instance ) );
+					break;
+			}
+		}
+
+		const Result& result() const {
+			return result_;
+		}
+
+	private:
+		struct Entry {
+			uintmax_t size;
+			boost::uint64_t lastAccess;
+			set< Instance > pins;
+		};
+
+		typedef map< boost::uint64_t, Entry > Entries;
+
+		uintmax_t capacity_;
+		Jupiter::EvictionPolicy policy_;
+		uintmax_t used_;
+
+		Entries entries_;
+		map< Instance, set< boost::uint64_t > > pinned_;
+
+		Result result_;
+
+		void request( const TraceRecord& record ) {
+			Instance instance( record.pid, record.instance );
+			Entries::iterator it( entries_.find( record.path ) );
+
+			++result_.requests;
+
+			if( entries_.end() != it ) {
+				if( it->second.size == record.size || it->second.pins.count( instance ) ) {
+					// Current, or outdated but already used by this instance
+					++result_.hits;
+					pin( it, instance, record.time );
+					return;
+				}
+
+				if( !it->second.pins.empty() ) {
+					// Outdated but pinned elsewhere -- the caller reads the original
+					++result_.stalePinned;
+					result_.originBytes += record.size;
+					return;
+				}
+
+				used_ -= it->second.size;
+				entries_.erase( it );
+			}
+
+			++result_.misses;
+			result_.originBytes += record.size;
+
+			if( !make_room( record.size ) ) {
+				++result_.failed;
+				return;
+			}
+
+			Entry entry;
+			entry.size = record.size;
+			entry.lastAccess = record.time;
+
+			it = entries_.insert( Entries::value_type( record.path, entry ) ).first;
+			used_ += record.size;
+
+			pin( it, instance, record.time );
+		}
+
+		// The same decision FileCache::make_room() takes on the cache directory
+		bool make_room( uintmax_t incoming ) {
+			if( !capacity_ || used_ + incoming <= capacity_ ) {
+				return true;
+			}
+
+			vector< Entries::iterator > files;
+			vector< Jupiter::EvictionCandidate > candidates;
+
+			files.reserve( entries_.size() );
+			candidates.reserve( entries_.size() );
+
+			for( Entries::iterator it( entries_.begin() ); it != entries_.end(); ++it ) {
+				Jupiter::EvictionCandidate candidate;
+				candidate.size = it->second.size;
+				candidate.lastAccess = it->second.lastAccess;
+				candidate.pinned = !it->second.pins.empty();
+
+				files.push_back( it );
+				candidates.push_back( candidate );
+			}
+
+			vector< size_t > victims;
+			bool room( Jupiter::plan_eviction( candidates, used_ + incoming, capacity_, policy_, victims ) );
+
+			for( size_t i( 0 ); i < victims.size(); ++i ) {
+				++result_.evictions;
+				result_.evictedBytes += candidates[ victims[ i ] ].size;
+
+				used_ -= candidates[ victims[ i ] ].size;
+				entries_.erase( files[ victims[ i ] ] );
+			}
+
+			return room;
+		}
+
+		void pin( Entries::iterator it, const Instance& instance, boost::uint64_t time ) {
+			it->second.lastAccess = time;
+			it->second.pins.insert( instance );
+			pinned_[ instance ].insert( it->first );
+		}
+
+		void release( boost::uint64_t path, const Instance& instance ) {
+			Entries::iterator it( entries_.find( path ) );
+
+			if( entries_.end() != it ) {
+				it->second.pins.erase( instance );
+			}
+
+			pinned_[ instance ].erase( path );
+		}
+
+		void finish( const Instance& instance ) {
+			map< Instance, set< boost::uint64_t > >::iterator it( pinned_.find( instance ) );
+
+			if( pinned_.end() == it ) {
+				return;
+			}
+
+			for( set< boost::uint64_t >::const_iterator p( it->second.begin() ); p != it->second.end(); ++p ) {
+				Entries::iterator entry( entries_.find( *p ) );
+
+				if( entries_.end() != entry ) {
+					entry->second.pins.erase( instance );
+				}
+			}
+
+			pinned_.erase( it );
+		}
+};
+
+
+int main( int argc, char* argv[] ) {
+
+	typedef boost::tokenizer< boost::char_separator< char > > Tokenizer;
+	boost::char_separator< char > comma( "," );
+
+	vector< uintmax_t > sizes;
+	vector< Jupiter::EvictionPolicy > policies;
+
+	int option;
+
+	try {
+		while( -1 != ( option = getopt( argc, argv, "s:P:h" ) ) ) {
+			switch( option ) {
+				case 's': {
+					string list( optarg );
+					Tokenizer tokens( list, comma );
+
+					for( Tokenizer::iterator it( tokens.begin() ); it != tokens.end(); ++it ) {
+						// Megabytes, like resize()
+						sizes.push_back( boost::lexical_cast< uintmax_t >( *it ) * 1000000 );
+					}
+					break;
+				}
+				case 'P': {
+					string list( optarg );
+					Tokenizer tokens( list, comma );
+
+					for( Tokenizer::iterator it( tokens.begin() ); it != tokens.end(); ++it ) {
+						Jupiter::EvictionPolicy policy;
+
+						if( !Jupiter::eviction_policy_from_name( *it, policy ) ) {
+							cerr << "Unknown policy '" << *it << "'." << endl;
+							return 1;
+						}
+
+						policies.push_back( policy );
+					}
+					break;
+				}
+				default: usage( argv[ 0 ] ); return 1;
+			}
+		}
+	} catch( boost::bad_lexical_cast ) {
+		usage( argv[ 0 ] );
+		return 1;
+	}
+
+	if( optind >= argc ) {
+		usage( argv[ 0 ] );
+		return 1;
+	}
+
+	vector< TraceRecord > records;
+
+	for( int i( optind ); i < argc; ++i ) {
+		Jupiter::TraceReader reader( argv[ i ] );
+
+		if( !reader.valid() ) {
+			cerr << "'" << argv[ i ] << "' is not a trace." << endl;
+			return 1;
+		}
+
+		TraceRecord record;
+
+		while( reader.next( record ) ) {
+			records.push_back( record );
+		}
+	}
+
+	stable_sort( records.begin(), records.end(), earlier );
+
+	// What the traced caches did
+	Result recorded;
+	map< boost::uint64_t, uintmax_t > files;
+	set< boost::uint32_t > processes;
+
+	for( vector< TraceRecord >::const_iterator it( records.begin() ); it != records.end(); ++it ) {
+		if( TraceRecord::CACHE != it->operation || TraceRecord::LOCAL == it->outcome ) {
+			continue;
+		}
+
+		++recorded.requests;
+		processes.insert( it->pid );
+		files[ it->path ] = max( files[ it->path ], ( uintmax_t )it->size );
+
+		switch( it->outcome ) {
+			case TraceRecord::HIT: ++recorded.hits; break;
+			case TraceRecord::MISS: ++recorded.misses; recorded.originBytes += it->size; break;
+			case TraceRecord::STALE_PINNED: ++recorded.stalePinned; recorded.originBytes += it->size; break;
+			default: ++recorded.failed; recorded.originBytes += it->size; break;
+		}
+	}
+
+	uintmax_t workingSet( 0 );
+
+	for( map< boost::uint64_t, uintmax_t >::const_iterator it( files.begin() ); it != files.end(); ++it ) {
+		workingSet += it->second;
+	}
+
+	if( sizes.empty() ) {
+		sizes.push_back( workingSet / 10 );
+		sizes.push_back( workingSet / 4 );
+		sizes.push_back( workingSet / 2 );
+		sizes.push_back( workingSet );
+	}
+
+	if( policies.empty() ) {
+		policies.push_back( Jupiter::EVICT_LRU );
+		policies.push_back( Jupiter::EVICT_LARGEST );
+	}
+
+	cout << recorded.requests << " requests from " << processes.size() << " processes, "
+	     << files.size() << " files (" << workingSet / 1000000.0 << " MB)" << endl
+	     << "recorded hit ratio " << ( recorded.requests ? ( double )recorded.hits / recorded.requests : 0.0 )
+	     << ", " << recorded.originBytes / 1000000.0 << " MB from origin" << endl << endl;
+
+	cout << setw( 12 ) << "size MB" << setw( 10 ) << "policy" << setw( 12 ) << "hit ratio"
+	     << setw( 14 ) << "origin MB" << setw( 12 ) << "evictions" << setw( 14 ) << "evicted MB"
+	     << setw( 10 ) << "stale" << setw( 10 ) << "failed" << endl;
+
+	for( size_t s( 0 ); s < sizes.size(); ++s ) {
+		for( size_t p( 0 ); p < policies.size(); ++p ) {
+			Simulation simulation( sizes[ s ], policies[ p ] );
+
+			for( vector< TraceRecord >::const_iterator it( records.begin() ); it != records.end(); ++it ) {
+				simulation.replay( *it );
+			}
+
+			const Result& result( simulation.result() );
+
+			cout << setw( 12 ) << sizes[ s ] / 1000000.0 << setw( 10 ) << Jupiter::eviction_policy_name( policies[ p ] )
+			     << setw( 12 ) << ( result.requests ? ( double )result.hits / result.requests : 0.0 )
+			     << setw( 14 ) << result.originBytes / 1000000.0 << setw( 12 ) << result.evictions
+			     << setw( 14 ) << result.evictedBytes / 1000000.0 << setw( 10 ) << result.stalePinned
+			     << setw( 10 ) << result.failed << endl;
+		}
+	}
+
+	return 0;
+}
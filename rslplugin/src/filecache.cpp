@@ -1,48 +1,87 @@
 #include <RslPlugin.h>
 #include <rx.h>
-#include <filecache.hpp>
-#include <iostream>
+#include <filecacheapi.h>
+#include <pthread.h>
+#include <string>
+#include <vector>
 
 
 typedef struct {
-	filecache::filecache cache;
-	string name;
+	FileCacheHandle* cache;
+	std::vector< char > name; // Results of the write calls, grown as needed
 } cacheData;
 
 
 
 void destructor( RixContext* ctx, void* data ) {
-	// This will release all files cached by this instance
+	// This will drop this context's pins on the shared cache
+	filecache_close( ( ( cacheData* )data )->cache );
 	delete ( cacheData* )data;
 }
 
 
+static pthread_once_t settingsOnce = PTHREAD_ONCE_INIT;
+static std::string location;
+static bool located( false );
+static FileCacheHandle* settings( NULL ); // Keeps the engine, and so its size, for the whole render
+
+
+// The attributes configure the process's cache once, from the first context that caches
+static void read_settings() {
+	RxInfoType_t type;
+	int count;
+	char* name( NULL );
+	char** namePtr( &name );
+
+	if( !RxAttribute( "user:filecachelocation", ( void* )namePtr, sizeof( char* ), &type, &count ) && ( type == RxInfoStringV ) && name ) {
+		location = name;
+		located = true;
+	}
+
+	settings = filecache_attach( located ? location.c_str() : NULL, NULL );
+
+	RtInt size;
+	if( !RxAttribute( "user:filecachesize", &size, sizeof( RtInt ), &type, &count ) ) {
+		if( ( type == RxInfoInteger ) && ( 1 == count ) ) {
+			filecache_resize( settings, size );
+		}
+	}
+}
+
+
+// All contexts attach to the process's cache for their location, so a
+// threaded render runs one cache instead of one per thread
 inline cacheData* constructor( RslContext* rslContext  ) {
 	cacheData * tempData( ( cacheData* )rslContext->GetLocalData() );
 	if( !tempData ) {
+		pthread_once( &settingsOnce, read_settings );
+
 		tempData = new cacheData;
+		tempData->cache = filecache_attach( located ? location.c_str() : NULL, NULL );
+		tempData->name.resize( 1024 );
 		rslContext->SetLocalData( ( void* )tempData, destructor );
+	}
+	return tempData;
+}
 
-		RxInfoType_t type;
-		int count;
-		char* location;
-		char** locationPtr( &location );
 
-		if( !RxAttribute( "user:filecachelocation", ( void* )locationPtr, sizeof( char* ), &type, &count ) ) {
-			if( type == RxInfoStringV ) {
-				tempData->cache.relocate( location );
-			}
-		}
-		
-		RtInt size;
-		if( !RxAttribute( "user:filecachesize", &size, sizeof( RtInt ), &type, &count ) ) {
-			if( ( type == RxInfoInteger ) && ( 1 == count ) ) {
-				tempData->cache.resize( size );
-			}
-		}
+// Calls one of the buffer taking functions, growing the context's buffer if it is too small
+template< typename Call >
+static const char* call_with_buffer( cacheData* tempData, const char* toCache, Call call ) {
+	size_t length;
+	int status( call( tempData->cache, toCache, &tempData->name[ 0 ], tempData->name.size(), &length ) );
 
+	if( FILECACHE_ERROR_BUFFER == status ) {
+		tempData->name.resize( length + 1 );
+		status = call( tempData->cache, toCache, &tempData->name[ 0 ], tempData->name.size(), &length );
 	}
-	return tempData;
+
+	return 0 > status ? toCache : &tempData->name[ 0 ];
+}
+
+
+static int uncache_file( FileCacheHandle* cache, const char* path, char* buffer, size_t size, size_t* length ) {
+	return filecache_uncache_file( cache, path, 1, 1, buffer, size, length );
 }
 
 
@@ -52,9 +91,14 @@ RSLEXPORT int rslCacheFile( RslContext* rslContext, int argc, const RslArg* argv
 
 	cacheData* tempData( constructor( rslContext ) );
 
-	tempData->name = tempData->cache.cacheFile( *toCache );
+	// Interned -- stays valid without a copy per call
+	const char* name;
+
+	if( 0 > filecache_cache_file_interned( tempData->cache, *toCache, &name ) ) {
+		name = *toCache;
+	}
 
-	*result = const_cast< char* >( tempData->name.c_str() );
+	*result = const_cast< char* >( name );
 
 	return 0;
 }
@@ -66,9 +110,7 @@ RSLEXPORT int rslCacheFileForWriting( RslContext* rslContext, int argc, const Rs
 
 	cacheData* tempData( constructor( rslContext ) );
 
-	tempData->name = tempData->cache.cacheFileForWriting( *toCache );
-
-	*result = const_cast< char* >( tempData->name.c_str() );
+	*result = const_cast< char* >( call_with_buffer( tempData, *toCache, filecache_cache_file_for_writing ) );
 
 	return 0;
 }
@@ -80,9 +122,7 @@ RSLEXPORT int rslUnCacheFile( RslContext* rslContext, int argc, const RslArg* ar
 
 	cacheData* tempData( constructor( rslContext ) );
 
-	tempData->name = tempData->cache.uncacheFile( *toCache );
-
-	*result = const_cast< char* >( tempData->name.c_str() );
+	*result = const_cast< char* >( call_with_buffer( tempData, *toCache, uncache_file ) );
 
 	return 0;
 }
@@ -0,0 +1,148 @@
+/**@file
+ *
+ * Deciding which files are worth a place in the cache.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010  Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+// Own headers
+#include <admission.hpp>
+
+// Standard headers
+#include <algorithm> // min()
+
+
+namespace Jupiter {
+
+
+    namespace {
+
+        /**
+         * Spread the bits of a key, so neighbouring ids use unrelated counters
+         */
+        boost::uint64_t mix( boost::uint64_t key )
+        {
+            key ^= key >> 33;
+            key *= 0xff51afd7ed558ccdULL;
+            key ^= key >> 33;
+            key *= 0xc4ceb9fe1a85ec53ULL;
+            key ^= key >> 33;
+
+            return key;
+        }
+
+    } // anonymous namespace
+
+
+    bool admission_filter_from_name( const std::string& name, AdmissionFilter& filter )
+    {
+        if ( "all" == name ) {
+            filter = ADMIT_ALL;
+        } else if ( "tinylfu" == name ) {
+            filter = ADMIT_TINYLFU;
+        } else {
+            return false;
+        }
+
+        return true;
+    }
+
+
+    std::string admission_filter_name( AdmissionFilter filter )
+    {
+        return ADMIT_TINYLFU == filter ? "tinylfu" : "all";
+    }
+
+
+    FrequencySketch::FrequencySketch( std::size_t width )
+        : width_( 1 ), additions_( 0 )
+    {
+        while ( width_ < width ) {
+            width_ <<= 1;
+        }
+
+        counters_.resize( width_ * DEPTH, 0 );
+    }
+
+
+    void FrequencySketch::record( boost::uint64_t key )
+    {
+        unsigned current( estimate( key ) );
+
+        if ( MAX_COUNT == current ) {
+            return;
+        }
+
+        // Only the smallest counters go up -- the others already count more than this key
+        for ( unsigned row( 0 ); row < DEPTH; ++row ) {
+            boost::uint8_t& counter( counters_[ index( key, row ) ] );
+
+            if ( current == counter ) {
+                ++counter;
+            }
+        }
+
+        if ( ++additions_ >= width_ * SAMPLE_FACTOR ) {
+            for ( std::vector< boost::uint8_t >::iterator it( counters_.begin() ); it != counters_.end(); ++it ) {
+                *it >>= 1;
+            }
+
+            additions_ /= 2;
+        }
+    }
+
+
+    unsigned FrequencySketch::estimate( boost::uint64_t key ) const
+    {
+        unsigned result( MAX_COUNT );
+
+        for ( unsigned row( 0 ); row < DEPTH; ++row ) {
+            result = std::min< unsigned >( result, counters_[ index( key, row ) ] );
+        }
+
+        return result;
+    }
+
+
+    std::size_t FrequencySketch::index( boost::uint64_t key, unsigned row ) const
+    {
+        boost::uint64_t hash( mix( key ) );
+
+        // Double hashing: the high half steps through the rows
+        return row * width_ + ( ( hash + row * ( ( hash >> 32 ) | 1 ) ) & ( width_ - 1 ) );
+    }
+
+
+    bool admit_candidate( unsigned frequency, const std::vector< unsigned >& victims )
+    {
+        for ( std::vector< unsigned >::const_iterator it( victims.begin() ); it != victims.end(); ++it ) {
+            if ( frequency <= *it ) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+
+} // namespace Jupiter
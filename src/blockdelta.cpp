@@ -0,0 +1,257 @@
+/**@file
+ *
+ * Per-block checksums and delta copies of large cache entries.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010  Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+// Own headers
+#include <blockdelta.hpp>
+
+// Standard headers
+#include <algorithm> // min()
+#include <cstring> // memcmp(), memcpy()
+
+// System headers
+#include <errno.h> // errno
+#include <fcntl.h> // open()
+#include <unistd.h> // pread(), pwrite(), close()
+
+
+namespace Jupiter {
+
+
+    namespace {
+
+        const char MAGIC[ 4 ] = { 'J', 'F', 'C', 'S' };
+        const boost::uint8_t VERSION = 1;
+
+        struct Header {
+            char magic[ 4 ];
+            boost::uint8_t version;
+            boost::uint8_t reserved[ 3 ];
+            boost::uint32_t blockSize;
+            boost::uint32_t blocks;
+            boost::uint64_t size;
+        };
+
+        bool pread_all( int fd, char* buffer, size_t size, off_t offset )
+        {
+            while ( size ) {
+                ssize_t n( pread( fd, buffer, size, offset ) );
+
+                if ( -1 == n && EINTR == errno ) {
+                    continue;
+                }
+
+                if ( n <= 0 ) {
+                    return false;
+                }
+
+                buffer += n;
+                size -= n;
+                offset += n;
+            }
+
+            return true;
+        }
+
+
+        bool pwrite_all( int fd, const char* buffer, size_t size, off_t offset )
+        {
+            while ( size ) {
+                ssize_t n( pwrite( fd, buffer, size, offset ) );
+
+                if ( -1 == n && EINTR == errno ) {
+                    continue;
+                }
+
+                if ( n <= 0 ) {
+                    return false;
+                }
+
+                buffer += n;
+                size -= n;
+                offset += n;
+            }
+
+            return true;
+        }
+
+    } // anonymous namespace
+
+
+    boost::uint64_t BlockSums::checksum( const char* data, std::size_t length )
+    {
+        const boost::uint64_t MULTIPLIER( 0x9e3779b97f4a7c15ULL );
+
+        boost::uint64_t hash( 0xcbf29ce484222325ULL ^ length );
+        boost::uint64_t word;
+        std::size_t i( 0 );
+
+        // Eight bytes at a time, the tail byte by byte
+        for ( ; i + sizeof( word ) <= length; i += sizeof( word ) ) {
+            memcpy( &word, data + i, sizeof( word ) );
+            hash = ( hash ^ word ) * MULTIPLIER;
+            hash ^= hash >> 29;
+        }
+
+        for ( ; i < length; ++i ) {
+            hash = ( hash ^ ( unsigned char )data[ i ] ) * MULTIPLIER;
+        }
+
+        return hash ^ ( hash >> 32 );
+    }
+
+
+    bool BlockSums::compute( SourceFile& file, uintmax_t fileSize, boost::uint32_t fileBlockSize )
+    {
+        blockSize = fileBlockSize;
+        size = fileSize;
+        sums.clear();
+
+        std::vector< char > block( blockSize );
+
+        for ( uintmax_t offset( 0 ); offset < size; offset += blockSize ) {
+            std::size_t length( std::min< uintmax_t >( blockSize, size - offset ) );
+
+            if ( ( std::streamsize )length != file.read( offset, &block[ 0 ], length ) ) {
+                return false;
+            }
+
+            sums.push_back( checksum( &block[ 0 ], length ) );
+        }
+
+        return true;
+    }
+
+
+    bool BlockSums::load( const fs::path& path )
+    {
+        int fd( open( path.string().c_str(), O_RDONLY ) );
+
+        if ( -1 == fd ) {
+            return false;
+        }
+
+        Header header;
+        bool success( pread_all( fd, ( char* )&header, sizeof( header ), 0 ) &&
+                      !memcmp( header.magic, MAGIC, sizeof( MAGIC ) ) && VERSION == header.version && header.blockSize );
+
+        if ( success ) {
+            blockSize = header.blockSize;
+            size = header.size;
+            sums.resize( header.blocks );
+
+            success = sums.empty() || pread_all( fd, ( char* )&sums[ 0 ], sums.size() * sizeof( boost::uint64_t ), sizeof( header ) );
+        }
+
+        close( fd );
+
+        return success;
+    }
+
+
+    bool BlockSums::save( const fs::path& path ) const
+    {
+        int fd( open( path.string().c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 ) );
+
+        if ( -1 == fd ) {
+            return false;
+        }
+
+        Header header;
+        memcpy( header.magic, MAGIC, sizeof( MAGIC ) );
+        header.version = VERSION;
+        memset( header.reserved, 0, sizeof( header.reserved ) );
+        header.blockSize = blockSize;
+        header.blocks = sums.size();
+        header.size = size;
+
+        bool success( pwrite_all( fd, ( const char* )&header, sizeof( header ), 0 ) &&
+                      ( sums.empty() || pwrite_all( fd, ( const char* )&sums[ 0 ], sums.size() * sizeof( boost::uint64_t ), sizeof( header ) ) ) );
+
+        if ( close( fd ) || !success ) {
+            unlink( path.string().c_str() );
+            return false;
+        }
+
+        return true;
+    }
+
+
+    bool delta_copy( SourceFile& source, const BlockSums& sourceSums, const fs::path& base, const BlockSums& baseSums,
+                     const fs::path& destination, uintmax_t& fetched )
+    {
+        fetched = 0;
+
+        if ( sourceSums.blockSize != baseSums.blockSize ) {
+            return false;
+        }
+
+        int in( open( base.string().c_str(), O_RDONLY ) );
+
+        if ( -1 == in ) {
+            return false;
+        }
+
+        int out( open( destination.string().c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644 ) );
+
+        if ( -1 == out ) {
+            close( in );
+            return false;
+        }
+
+        std::vector< char > block( sourceSums.blockSize );
+        bool success( true );
+
+        for ( std::size_t i( 0 ); success && i < sourceSums.sums.size(); ++i ) {
+            uintmax_t offset( ( uintmax_t )i * sourceSums.blockSize );
+            std::size_t length( std::min< uintmax_t >( sourceSums.blockSize, sourceSums.size - offset ) );
+
+            // A block of the old copy is only reused if it had the same length there
+            bool unchanged( i < baseSums.sums.size() && sourceSums.sums[ i ] == baseSums.sums[ i ] &&
+                            offset + length <= baseSums.size );
+
+            if ( unchanged ) {
+                success = pread_all( in, &block[ 0 ], length, offset );
+            } else {
+                success = ( std::streamsize )length == source.read( offset, &block[ 0 ], length );
+                fetched += length;
+            }
+
+            success = success && pwrite_all( out, &block[ 0 ], length, offset );
+        }
+
+        close( in );
+
+        if ( close( out ) || !success ) {
+            unlink( destination.string().c_str() );
+            return false;
+        }
+
+        return true;
+    }
+
+
+} // namespace Jupiter
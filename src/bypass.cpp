@@ -0,0 +1,128 @@
+/**@file
+ *
+ * Deciding whether copying a missing file to the cache pays.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010  Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+// Own headers
+#include <bypass.hpp>
+#include <cachestats.hpp>
+
+// Standard headers
+#include <vector> // vector
+
+// System headers
+#include <errno.h> // errno
+#include <fcntl.h> // open()
+#include <unistd.h> // write(), fdatasync(), close(), unlink()
+
+
+namespace Jupiter {
+
+
+    RateEstimate::RateEstimate( unsigned minSamples )
+        : bytesPerSecond_( 0 ), latency_( 0 ), transfers_( 0 ), answers_( 0 ), minSamples_( minSamples )
+    {
+    }
+
+
+    void RateEstimate::recordTransfer( uintmax_t bytes, double seconds )
+    {
+        if ( 0 >= seconds ) {
+            return;
+        }
+
+        double rate( bytes / seconds );
+
+        bytesPerSecond_ = transfers_++ ? bytesPerSecond_ + ( rate - bytesPerSecond_ ) / WEIGHT : rate;
+    }
+
+
+    void RateEstimate::recordLatency( double seconds )
+    {
+        latency_ = answers_++ ? latency_ + ( seconds - latency_ ) / WEIGHT : seconds;
+    }
+
+
+    bool RateEstimate::known() const
+    {
+        return minSamples_ <= transfers_ && 0 < bytesPerSecond_;
+    }
+
+
+    double RateEstimate::seconds( uintmax_t bytes ) const
+    {
+        return latency_ + bytes / bytesPerSecond_;
+    }
+
+
+    BypassDecision plan_bypass( uintmax_t size, unsigned requests, const RateEstimate& source, const RateEstimate& cache )
+    {
+        if ( !source.known() || !cache.known() || cache.seconds( size ) <= source.seconds( size ) ) {
+            return BYPASS_COPY;
+        }
+
+        return 1 < requests ? BYPASS_BACKGROUND : BYPASS_ORIGINAL;
+    }
+
+
+    bool probe_write( const fs::path& file, std::size_t size, double& seconds )
+    {
+        int fd( open( file.string().c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 ) );
+
+        if ( -1 == fd ) {
+            return false;
+        }
+
+        std::vector< char > data( size, 0 );
+        StopWatch watch;
+        bool success( true );
+
+        for ( std::size_t written( 0 ); written < size; ) {
+            ssize_t n( write( fd, &data[ written ], size - written ) );
+
+            if ( -1 == n && EINTR == errno ) {
+                continue;
+            }
+
+            if ( 0 >= n ) {
+                success = false;
+                break;
+            }
+
+            written += n;
+        }
+
+        // Only what reached the disk tells how busy it is
+        success = success && !fdatasync( fd );
+        seconds = watch.seconds();
+
+        close( fd );
+        unlink( file.string().c_str() );
+
+        return success;
+    }
+
+
+} // namespace Jupiter
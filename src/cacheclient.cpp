@@ -0,0 +1,242 @@
+/**@file
+ *
+ * Thin client for the per-node cache daemon.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010  Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+// Own headers
+#include <cacheclient.hpp>
+#include <cacheprotocol.hpp>
+
+// Standard headers
+#include <climits> // PATH_MAX
+#include <cstdlib> // getenv()
+#include <cstring> // memset(), strncpy()
+
+// System headers
+#include <fcntl.h> // open()
+#include <sys/socket.h> // socket()
+#include <sys/un.h> // sockaddr_un
+#include <unistd.h> // close(), getcwd()
+
+
+namespace Jupiter {
+
+
+    CacheClient::CacheClient( const std::string& socket )
+        : path_( socket ), socket_( -1 )
+    {
+        if ( path_.empty() ) {
+            char* env( std::getenv( "FILECACHE_SOCKET" ) );
+
+            path_ = env ? env : "/var/tmp/filecached.socket";
+        }
+
+        connect_daemon();
+    }
+
+
+    CacheClient::~CacheClient()
+    {
+        // The daemon releases all our files when we hang up
+        if ( -1 != socket_ ) {
+            close( socket_ );
+        }
+    }
+
+
+    bool CacheClient::connected() const
+    {
+        boost::mutex::scoped_lock lock( mutex_ );
+
+        return -1 != socket_;
+    }
+
+
+    fs::path CacheClient::cacheFile( const fs::path& toCache )
+    {
+        std::string reply;
+
+        if ( round_trip( Protocol::CACHE, 0, toCache.string(), reply ) ) {
+            return fs::path( reply, fs::no_check );
+        }
+
+        return toCache;
+    }
+
+
+    std::string CacheClient::cacheFile( const std::string& toCache )
+    {
+        std::string reply;
+
+        if ( round_trip( Protocol::CACHE, 0, toCache, reply ) ) {
+            return reply;
+        }
+
+        return toCache;
+    }
+
+
+    int CacheClient::openFile( const fs::path& toCache, fs::path* cached )
+    {
+        std::string reply;
+        int fd( -1 );
+
+        if ( round_trip( Protocol::OPEN, 0, toCache.string(), reply, &fd ) && -1 != fd ) {
+            if ( cached ) {
+                *cached = fs::path( reply, fs::no_check );
+            }
+
+            return fd;
+        }
+
+        // No daemon -- open the original ourselves
+        if ( cached ) {
+            *cached = toCache;
+        }
+
+        return open( toCache.string().c_str(), O_RDONLY );
+    }
+
+
+    fs::path CacheClient::uncacheFile( const fs::path& fromCache, bool overwrite, bool ifNewer )
+    {
+        std::string reply;
+
+        if ( round_trip( Protocol::UNCACHE,
+                         ( overwrite ? Protocol::OVERWRITE : 0 ) | ( ifNewer ? Protocol::IF_NEWER : 0 ),
+                         fromCache.string(), reply ) ) {
+            return fs::path( reply, fs::no_check );
+        }
+
+        return fromCache;
+    }
+
+
+    std::string CacheClient::uncacheFile( const std::string& fromCache, bool overwrite, bool ifNewer )
+    {
+        return uncacheFile( fs::path( fromCache, fs::no_check ), overwrite, ifNewer ).string();
+    }
+
+
+    fs::path CacheClient::cacheFileForWriting( const fs::path& toCache )
+    {
+        std::string reply;
+
+        if ( round_trip( Protocol::CACHE_FOR_WRITING, 0, toCache.string(), reply ) ) {
+            return fs::path( reply, fs::no_check );
+        }
+
+        return toCache;
+    }
+
+
+    std::string CacheClient::cacheFileForWriting( const std::string& toCache )
+    {
+        return cacheFileForWriting( fs::path( toCache, fs::no_check ) ).string();
+    }
+
+
+    void CacheClient::releaseFile( const fs::path& path )
+    {
+        std::string reply;
+
+        round_trip( Protocol::RELEASE, 0, path.string(), reply );
+    }
+
+
+    void CacheClient::releaseFile( const std::string& path )
+    {
+        std::string reply;
+
+        round_trip( Protocol::RELEASE, 0, path, reply );
+    }
+
+
+    bool CacheClient::connect_daemon()
+    {
+        struct sockaddr_un address;
+        memset( &address, 0, sizeof( address ) );
+        address.sun_family = AF_UNIX;
+
+        if ( path_.size() >= sizeof( address.sun_path ) ) {
+            return false;
+        }
+
+        strncpy( address.sun_path, path_.c_str(), sizeof( address.sun_path ) - 1 );
+
+        socket_ = socket( AF_UNIX, SOCK_STREAM, 0 );
+
+        if ( -1 != socket_ && connect( socket_, ( struct sockaddr* )&address, sizeof( address ) ) ) {
+            close( socket_ );
+            socket_ = -1;
+        }
+
+        return -1 != socket_;
+    }
+
+
+    bool CacheClient::round_trip( boost::uint8_t opcode, boost::uint8_t flags, const std::string& request, std::string& reply, int* fd )
+    {
+        boost::mutex::scoped_lock lock( mutex_ );
+
+        // Never reconnect silently: a new connection would have lost our pins
+        if ( -1 == socket_ ) {
+            return false;
+        }
+
+        Protocol::Header header;
+        int passed;
+
+        // The daemon has its own working directory
+        std::string path( request );
+
+        if ( path.empty() || '/' != path[ 0 ] ) {
+            char cwd[ PATH_MAX ];
+
+            if ( !getcwd( cwd, sizeof( cwd ) ) ) {
+                return false;
+            }
+
+            path = std::string( cwd ) + "/" + path;
+        }
+
+        if ( !Protocol::send( socket_, opcode, flags, path ) ||
+             !Protocol::receive( socket_, header, reply, passed ) ) {
+            close( socket_ );
+            socket_ = -1;
+            return false;
+        }
+
+        if ( fd ) {
+            *fd = passed;
+        } else if ( -1 != passed ) {
+            close( passed );
+        }
+
+        return Protocol::OK == header.code;
+    }
+
+
+} // namespace Jupiter
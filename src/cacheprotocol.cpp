@@ -0,0 +1,204 @@
+/**@file
+ *
+ * Binary protocol spoken between CacheClient and CacheServer.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010  Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+// Own headers
+#include <cacheprotocol.hpp>
+
+// Standard headers
+#include <algorithm> // min()
+#include <cstring> // memset(), memcpy()
+
+// System headers
+#include <errno.h> // errno
+#include <sys/socket.h> // sendmsg(), recvmsg()
+#include <sys/uio.h> // iovec
+#include <unistd.h> // read(), close()
+#ifndef MSG_NOSIGNAL
+# define MSG_NOSIGNAL 0
+#endif
+
+
+namespace Jupiter {
+
+    namespace Protocol {
+
+
+        bool send( int socket, boost::uint8_t code, boost::uint8_t flags, const std::string& payload, int fd )
+        {
+            Header header;
+            header.size = payload.size();
+            header.code = code;
+            header.flags = flags;
+            header.fd = -1 != fd;
+            header.reserved = 0;
+
+            struct iovec parts[ 2 ];
+            parts[ 0 ].iov_base = &header;
+            parts[ 0 ].iov_len = sizeof( header );
+            parts[ 1 ].iov_base = const_cast< char* >( payload.data() );
+            parts[ 1 ].iov_len = payload.size();
+
+            struct msghdr message;
+            memset( &message, 0, sizeof( message ) );
+            message.msg_iov = parts;
+            message.msg_iovlen = payload.empty() ? 1 : 2;
+
+            char control[ CMSG_SPACE( sizeof( int ) ) ];
+
+            if ( -1 != fd ) {
+                message.msg_control = control;
+                message.msg_controllen = sizeof( control );
+
+                struct cmsghdr* cmsg( CMSG_FIRSTHDR( &message ) );
+                cmsg->cmsg_level = SOL_SOCKET;
+                cmsg->cmsg_type = SCM_RIGHTS;
+                cmsg->cmsg_len = CMSG_LEN( sizeof( int ) );
+                memcpy( CMSG_DATA( cmsg ), &fd, sizeof( int ) );
+            }
+
+            size_t remaining( sizeof( header ) + payload.size() );
+
+            // The descriptor travels with the first chunk -- only resend plain bytes
+            while ( remaining ) {
+                ssize_t n( sendmsg( socket, &message, MSG_NOSIGNAL ) );
+
+                if ( -1 == n ) {
+                    if ( EINTR == errno ) {
+                        continue;
+                    }
+
+                    return false;
+                }
+
+                remaining -= n;
+                message.msg_control = NULL;
+                message.msg_controllen = 0;
+
+                while ( n && message.msg_iovlen ) {
+                    size_t consumed( std::min< size_t >( n, message.msg_iov->iov_len ) );
+
+                    message.msg_iov->iov_base = ( char* )message.msg_iov->iov_base + consumed;
+                    message.msg_iov->iov_len -= consumed;
+                    n -= consumed;
+
+                    if ( !message.msg_iov->iov_len ) {
+                        ++message.msg_iov;
+                        --message.msg_iovlen;
+                    }
+                }
+            }
+
+            return true;
+        }
+
+
+        bool receive( int socket, Header& header, std::string& payload, int& fd )
+        {
+            fd = -1;
+
+            struct iovec part;
+            part.iov_base = &header;
+            part.iov_len = sizeof( header );
+
+            char control[ CMSG_SPACE( sizeof( int ) ) ];
+
+            struct msghdr message;
+            memset( &message, 0, sizeof( message ) );
+            message.msg_iov = &part;
+            message.msg_iovlen = 1;
+            message.msg_control = control;
+            message.msg_controllen = sizeof( control );
+
+            size_t received( 0 );
+
+            while ( received < sizeof( header ) ) {
+                ssize_t n( recvmsg( socket, &message, 0 ) );
+
+                if ( -1 == n && EINTR == errno ) {
+                    continue;
+                }
+
+                if ( n <= 0 ) {
+                    if ( -1 != fd ) {
+                        close( fd );
+                        fd = -1;
+                    }
+
+                    return false;
+                }
+
+                for ( struct cmsghdr* cmsg( CMSG_FIRSTHDR( &message ) ); cmsg; cmsg = CMSG_NXTHDR( &message, cmsg ) ) {
+                    if ( SOL_SOCKET == cmsg->cmsg_level && SCM_RIGHTS == cmsg->cmsg_type ) {
+                        memcpy( &fd, CMSG_DATA( cmsg ), sizeof( int ) );
+                    }
+                }
+
+                received += n;
+                part.iov_base = ( char* )&header + received;
+                part.iov_len = sizeof( header ) - received;
+                message.msg_control = NULL;
+                message.msg_controllen = 0;
+            }
+
+            if ( header.size > MAX_PAYLOAD ) {
+                if ( -1 != fd ) {
+                    close( fd );
+                    fd = -1;
+                }
+
+                return false;
+            }
+
+            payload.resize( header.size );
+            received = 0;
+
+            while ( received < header.size ) {
+                ssize_t n( read( socket, &payload[ received ], header.size - received ) );
+
+                if ( -1 == n && EINTR == errno ) {
+                    continue;
+                }
+
+                if ( n <= 0 ) {
+                    if ( -1 != fd ) {
+                        close( fd );
+                        fd = -1;
+                    }
+
+                    return false;
+                }
+
+                received += n;
+            }
+
+            return true;
+        }
+
+
+    } // namespace Protocol
+
+} // namespace Jupiter
@@ -0,0 +1,377 @@
+/**@file
+ *
+ * Per-node cache engine serving local processes over a Unix domain socket.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010  Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+// Own headers
+#include <cacheserver.hpp>
+#include <cacheprotocol.hpp>
+
+// Standard headers
+#include <algorithm> // find()
+#include <cstring> // memset(), strncpy()
+
+// System headers
+#include <fcntl.h> // open(), faccessat()
+#include <grp.h> // getgrouplist()
+#include <pwd.h> // getpwuid_r()
+#include <sys/select.h> // select()
+#include <sys/socket.h> // socket()
+#include <sys/stat.h> // chmod()
+#ifdef LINUX
+# include <sys/syscall.h> // SYS_setfsuid, SYS_setfsgid, SYS_setgroups
+#endif
+#include <sys/un.h> // sockaddr_un
+#include <unistd.h> // close(), unlink(), syscall()
+
+// Boost headers
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+
+
+namespace Jupiter {
+
+
+#ifdef LINUX
+    namespace {
+
+        // The 32 bit ids' calls, where the plain ones take 16 bit ids
+#ifdef SYS_setfsuid32
+        const long SETFSUID( SYS_setfsuid32 ), SETFSGID( SYS_setfsgid32 ), SETGROUPS( SYS_setgroups32 );
+#else
+        const long SETFSUID( SYS_setfsuid ), SETFSGID( SYS_setfsgid ), SETGROUPS( SYS_setgroups );
+#endif
+
+    } // anonymous namespace
+#endif
+
+
+    CacheServer::CacheServer( const FileCache& cache, const std::string& socket )
+        : engine_( cache ), path_( socket ), socket_( -1 ), running_( false ), thread_( 0 )
+    {
+    }
+
+
+    CacheServer::~CacheServer()
+    {
+        stop();
+    }
+
+
+    bool CacheServer::start()
+    {
+        if ( running_ ) {
+            return true;
+        }
+
+        struct sockaddr_un address;
+        memset( &address, 0, sizeof( address ) );
+        address.sun_family = AF_UNIX;
+
+        if ( path_.size() >= sizeof( address.sun_path ) ) {
+            return false;
+        }
+
+        strncpy( address.sun_path, path_.c_str(), sizeof( address.sun_path ) - 1 );
+
+        socket_ = socket( AF_UNIX, SOCK_STREAM, 0 );
+
+        if ( -1 == socket_ ) {
+            return false;
+        }
+
+        unlink( path_.c_str() );
+
+        if ( bind( socket_, ( struct sockaddr* )&address, sizeof( address ) ) || listen( socket_, SOMAXCONN ) ) {
+            close( socket_ );
+            socket_ = -1;
+            return false;
+        }
+
+        // Renders on a node usually run as different users -- of our group
+        chmod( path_.c_str(), 0660 );
+
+        running_ = true;
+        thread_ = new boost::thread( boost::bind( &CacheServer::run, this ) );
+
+        return true;
+    }
+
+
+    void CacheServer::stop()
+    {
+        running_ = false;
+
+        if ( thread_ ) {
+            thread_->join();
+            delete thread_;
+            thread_ = 0;
+        }
+
+        if ( -1 != socket_ ) {
+            close( socket_ );
+            socket_ = -1;
+            unlink( path_.c_str() );
+        }
+
+        boost::mutex::scoped_lock lock( connectionMutex_ );
+
+        // Clients may stay connected for a whole render -- wake them up
+        for ( std::set< int >::const_iterator it( connections_.begin() ); it != connections_.end(); ++it ) {
+            shutdown( *it, SHUT_RDWR );
+        }
+
+        while ( !connections_.empty() ) {
+            idle_.wait( lock );
+        }
+    }
+
+
+    void CacheServer::run()
+    {
+        while ( running_ ) {
+            // Wake up regularly to notice stop()
+            fd_set readable;
+            FD_ZERO( &readable );
+            FD_SET( socket_, &readable );
+
+            struct timeval timeout;
+            timeout.tv_sec = 1;
+            timeout.tv_usec = 0;
+
+            if ( 0 < select( socket_ + 1, &readable, NULL, NULL, &timeout ) ) {
+                int connection( accept( socket_, NULL, NULL ) );
+                Credentials peer;
+
+                if ( -1 != connection && ( !get_credentials( connection, peer ) || !is_authorized( peer ) ) ) {
+                    close( connection );
+                } else if ( -1 != connection ) {
+                    boost::mutex::scoped_lock lock( connectionMutex_ );
+                    connections_.insert( connection );
+
+                    boost::thread( boost::bind( &CacheServer::serve_connection, this, connection, peer ) );
+                }
+            }
+        }
+    }
+
+
+    /**
+     * Find out who is on the other end of a connection.
+     *
+     * The groups are those of the user's entry, a client's own supplementary
+     * groups can't be asked for.
+     *
+     */
+    bool CacheServer::get_credentials( int connection, Credentials& peer ) const
+    {
+#ifdef LINUX
+        struct ucred credentials;
+        socklen_t length( sizeof( credentials ) );
+
+        if ( getsockopt( connection, SOL_SOCKET, SO_PEERCRED, &credentials, &length ) ) {
+            return false;
+        }
+
+        peer.uid = credentials.uid;
+        peer.gid = credentials.gid;
+#else
+        if ( getpeereid( connection, &peer.uid, &peer.gid ) ) {
+            return false;
+        }
+#endif
+
+        peer.groups.assign( 1, peer.gid );
+
+        std::vector< char > buffer( 16384 );
+        struct passwd user, *found( NULL );
+
+        if ( getpwuid_r( peer.uid, &user, &buffer[ 0 ], buffer.size(), &found ) || !found ) {
+            // Unknown users only have their primary group
+            return true;
+        }
+
+        int count( 64 );
+        peer.groups.resize( count );
+
+        if ( -1 == getgrouplist( user.pw_name, peer.gid, &peer.groups[ 0 ], &count ) ) {
+            // Tells the size needed
+            peer.groups.resize( count );
+            getgrouplist( user.pw_name, peer.gid, &peer.groups[ 0 ], &count );
+        }
+
+        peer.groups.resize( count );
+
+        return true;
+    }
+
+
+    /**
+     * Check whether a client may use the cache.
+     *
+     * Root, our own user and members of our group may; the socket's mode
+     * already keeps out everybody else, unless the socket's directory lets
+     * them replace it.
+     *
+     */
+    bool CacheServer::is_authorized( const Credentials& peer ) const
+    {
+        return 0 == peer.uid || geteuid() == peer.uid ||
+               peer.groups.end() != std::find( peer.groups.begin(), peer.groups.end(), getegid() );
+    }
+
+
+    /**
+     * Check whether a client could read or write a path itself.
+     *
+     * Writing a file that doesn't exist yet takes a writable directory.
+     * Other users' credentials are taken on by the serving thread only, for
+     * the check: the raw system calls, unlike their C library wrappers,
+     * leave the process's other threads alone.
+     *
+     */
+    bool CacheServer::may_access( const Credentials& peer, const std::string& path, bool writing ) const
+    {
+        std::string checked( path );
+        int mode( writing ? W_OK : R_OK );
+
+        if ( writing && -1 == access( path.c_str(), F_OK ) ) {
+            checked.erase( checked.rfind( '/' ) + 1 );
+            mode = W_OK | X_OK;
+        }
+
+        // We may do it anyway, and so may root
+        if ( geteuid() == peer.uid || 0 == peer.uid ) {
+            return true;
+        }
+
+#ifdef LINUX
+        std::vector< gid_t > ours( getgroups( 0, NULL ) + 1 );
+        ours.resize( getgroups( ours.size(), &ours[ 0 ] ) );
+
+        if ( syscall( SETGROUPS, peer.groups.size(), &peer.groups[ 0 ] ) ) {
+            // Not privileged enough to take on other users' credentials
+            return false;
+        }
+
+        syscall( SETFSGID, peer.gid );
+        syscall( SETFSUID, peer.uid );
+
+        // Set calls report the previous value, even if they failed
+        bool allowed( ( uid_t )syscall( SETFSUID, -1 ) == peer.uid && ( gid_t )syscall( SETFSGID, -1 ) == peer.gid &&
+                      !faccessat( AT_FDCWD, checked.c_str(), mode, AT_EACCESS ) );
+
+        syscall( SETFSUID, geteuid() );
+        syscall( SETFSGID, getegid() );
+        syscall( SETGROUPS, ours.size(), ours.empty() ? NULL : &ours[ 0 ] );
+
+        return allowed;
+#else
+        return false;
+#endif
+    }
+
+
+    void CacheServer::serve_connection( int connection, const Credentials& peer )
+    {
+        // The engine's lock covers its instances -- and is released while files are copied
+        boost::scoped_ptr< FileCache > cache( new FileCache( engine_ ) );
+        std::string location( cache->location() );
+
+        Protocol::Header request;
+        std::string path;
+        int unused;
+
+        while ( Protocol::receive( connection, request, path, unused ) ) {
+            if ( -1 != unused ) {
+                close( unused );
+            }
+
+            std::string result;
+            boost::uint8_t status( Protocol::OK );
+            int fd( -1 );
+
+            bool absolute( !path.empty() && '/' == path[ 0 ] );
+            bool writing( Protocol::CACHE_FOR_WRITING == request.code || Protocol::UNCACHE == request.code );
+
+            // Our working directory means nothing to the client, and nobody gets our rights
+            switch ( absolute && ( Protocol::RELEASE == request.code || may_access( peer, path, writing ) ) ? request.code : 0 ) {
+                case Protocol::CACHE:
+                case Protocol::OPEN:
+                    result = cache->cacheFile( fs::path( path ) ).string();
+                    break;
+                case Protocol::CACHE_FOR_WRITING:
+                    result = cache->cacheFileForWriting( fs::path( path ) ).string();
+                    break;
+                case Protocol::UNCACHE:
+                    result = cache->uncacheFile( fs::path( path ),
+                                                 request.flags & Protocol::OVERWRITE,
+                                                 request.flags & Protocol::IF_NEWER ).string();
+                    break;
+                case Protocol::RELEASE:
+                    cache->releaseFile( fs::path( path ) );
+                    break;
+                default:
+                    status = Protocol::FAILED;
+            }
+
+            // Only cached files are opened for the client -- it opens originals itself, with its own rights
+            if ( Protocol::OPEN == request.code && Protocol::OK == status ) {
+                bool cached( result != path && 0 == result.compare( 0, location.size(), location ) );
+
+                fd = cached ? open( result.c_str(), O_RDONLY ) : -1;
+
+                if ( -1 == fd ) {
+                    status = Protocol::FAILED;
+                }
+            }
+
+            bool sent( Protocol::send( connection, status, 0, result, fd ) );
+
+            if ( -1 != fd ) {
+                close( fd );
+            }
+
+            if ( !sent ) {
+                break;
+            }
+        }
+
+        // Releases all files of this client
+        cache.reset();
+
+        boost::mutex::scoped_lock lock( connectionMutex_ );
+
+        // Close under the lock so stop() never shuts down a recycled descriptor
+        connections_.erase( connection );
+        close( connection );
+
+        if ( connections_.empty() ) {
+            idle_.notify_all();
+        }
+    }
+
+
+} // namespace Jupiter
@@ -0,0 +1,264 @@
+/**@file
+ *
+ * Counters and latency histograms describing what a cache location does.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010  Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+// Own headers
+#include <cachestats.hpp>
+
+// System headers
+#include <sys/time.h> // gettimeofday()
+#include <time.h> // clock_gettime()
+
+
+namespace Jupiter {
+
+
+    namespace {
+
+        struct Counter {
+            const char* name;
+            const char* help;
+            boost::uint64_t CacheStats::* value;
+        };
+
+        const Counter counters[] = {
+            { "hits_total", "Requests served from an existing cache entry.", &CacheStats::hits },
+            { "misses_total", "Requests that copied the file to the cache.", &CacheStats::misses },
+            { "stale_pinned_total", "Requests served from the original because the outdated entry was in use.", &CacheStats::stalePinned },
+            { "versions_total", "Newer versions cached next to an outdated entry still in use.", &CacheStats::versions },
+            { "delta_refreshes_total", "Outdated files refreshed by their changed blocks.", &CacheStats::deltaRefreshes },
+            { "delta_saved_bytes_total", "Bytes delta refreshes didn't fetch from the original.", &CacheStats::deltaSavedBytes },
+            { "progressive_fills_total", "Misses read while they were being copied to the cache.", &CacheStats::progressiveFills },
+            { "revalidations_total", "Originals of entries checked in the background.", &CacheStats::revalidations },
+            { "refreshes_total", "Updated originals copied to the cache in the background.", &CacheStats::refreshes },
+            { "admitted_total", "Misses the admission filter let into the cache.", &CacheStats::admitted },
+            { "rejected_total", "Misses the admission filter served from the original.", &CacheStats::rejected },
+            { "bypassed_total", "Misses served from the original because copying wouldn't pay.", &CacheStats::bypassed },
+            { "background_copies_total", "Misses served from the original and copied in the background.", &CacheStats::backgroundCopies },
+            { "peer_fetches_total", "Misses served from another node's cache.", &CacheStats::peerFetches },
+            { "bytes_in_total", "Bytes copied to the cache.", &CacheStats::bytesIn },
+            { "bytes_out_total", "Bytes copied back from the cache.", &CacheStats::bytesOut },
+            { "evictions_total", "Files removed to make room.", &CacheStats::evictions },
+            { "evicted_bytes_total", "Bytes removed to make room.", &CacheStats::evictedBytes },
+            { "prefetches_total", "Files copied ahead of time by the read-ahead.", &CacheStats::prefetches },
+            { "prefetch_hits_total", "Prefetched files that were requested.", &CacheStats::prefetchHits },
+            { "prefetch_wasted_total", "Prefetched files evicted before they were requested.", &CacheStats::prefetchWasted }
+        };
+
+        struct Histogram {
+            const char* name;
+            const char* help;
+            LatencyHistogram CacheStats::* value;
+        };
+
+        const Histogram histograms[] = {
+            { "cachefile_seconds", "Latency of cacheFile().", &CacheStats::cacheFileLatency },
+            { "copy_seconds", "Latency of copies to the cache.", &CacheStats::copyLatency },
+            { "tidy_seconds", "Latency of making room in the cache.", &CacheStats::tidyLatency }
+        };
+
+    } // anonymous namespace
+
+
+    const double LatencyHistogram::bounds[ LatencyHistogram::BUCKETS - 1 ] = {
+        0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.05, 0.1, 0.5, 1.0, 10.0, 60.0
+    };
+
+
+    LatencyHistogram::LatencyHistogram()
+        : count( 0 ), sum( 0 )
+    {
+        for ( int i( 0 ); i < BUCKETS; ++i ) {
+            counts[ i ] = 0;
+        }
+    }
+
+
+    void LatencyHistogram::record( double seconds )
+    {
+        int i( 0 );
+
+        while ( i < BUCKETS - 1 && seconds > bounds[ i ] ) {
+            ++i;
+        }
+
+        ++counts[ i ];
+        ++count;
+        sum += seconds;
+    }
+
+
+    double LatencyHistogram::quantile( double q ) const
+    {
+        if ( !count ) {
+            return 0;
+        }
+
+        boost::uint64_t rank( ( boost::uint64_t )( q * count + 0.5 ) );
+        boost::uint64_t cumulative( 0 );
+
+        for ( int i( 0 ); i < BUCKETS - 1; ++i ) {
+            cumulative += counts[ i ];
+
+            if ( cumulative >= rank ) {
+                return bounds[ i ];
+            }
+        }
+
+        return bounds[ BUCKETS - 2 ];
+    }
+
+
+    LatencyHistogram& LatencyHistogram::operator+=( const LatencyHistogram& other )
+    {
+        for ( int i( 0 ); i < BUCKETS; ++i ) {
+            counts[ i ] += other.counts[ i ];
+        }
+
+        count += other.count;
+        sum += other.sum;
+
+        return *this;
+    }
+
+
+    CacheStats::CacheStats()
+        : hits( 0 ), misses( 0 ), stalePinned( 0 ), versions( 0 ), deltaRefreshes( 0 ), deltaSavedBytes( 0 ), progressiveFills( 0 ),
+          revalidations( 0 ), refreshes( 0 ), admitted( 0 ), rejected( 0 ), bypassed( 0 ), backgroundCopies( 0 ),
+          peerFetches( 0 ), bytesIn( 0 ), bytesOut( 0 ), evictions( 0 ), evictedBytes( 0 ), prefetches( 0 ), prefetchHits( 0 ),
+          prefetchWasted( 0 )
+    {
+    }
+
+
+    double CacheStats::copyThroughput() const
+    {
+        return copyLatency.sum > 0 ? bytesIn / copyLatency.sum : 0;
+    }
+
+
+    CacheStats& CacheStats::operator+=( const CacheStats& other )
+    {
+        hits += other.hits;
+        misses += other.misses;
+        stalePinned += other.stalePinned;
+        versions += other.versions;
+        deltaRefreshes += other.deltaRefreshes;
+        deltaSavedBytes += other.deltaSavedBytes;
+        progressiveFills += other.progressiveFills;
+        revalidations += other.revalidations;
+        refreshes += other.refreshes;
+        admitted += other.admitted;
+        rejected += other.rejected;
+        bypassed += other.bypassed;
+        backgroundCopies += other.backgroundCopies;
+        peerFetches += other.peerFetches;
+        bytesIn += other.bytesIn;
+        bytesOut += other.bytesOut;
+        evictions += other.evictions;
+        evictedBytes += other.evictedBytes;
+        prefetches += other.prefetches;
+        prefetchHits += other.prefetchHits;
+        prefetchWasted += other.prefetchWasted;
+
+        cacheFileLatency += other.cacheFileLatency;
+        copyLatency += other.copyLatency;
+        tidyLatency += other.tidyLatency;
+
+        return *this;
+    }
+
+
+    void CacheStats::writePrometheus( std::ostream& out, const LabeledStats& stats )
+    {
+        typedef LabeledStats::const_iterator Iterator;
+
+        // All samples of a metric have to follow its TYPE line in one group
+        for ( size_t i( 0 ); i < sizeof( counters ) / sizeof( Counter ); ++i ) {
+            out << "# HELP filecache_" << counters[ i ].name << ' ' << counters[ i ].help << '\n'
+                << "# TYPE filecache_" << counters[ i ].name << " counter\n";
+
+            for ( Iterator it( stats.begin() ); it != stats.end(); ++it ) {
+                out << "filecache_" << counters[ i ].name << '{' << it->first << "} " << it->second.*counters[ i ].value << '\n';
+            }
+        }
+
+        for ( size_t i( 0 ); i < sizeof( histograms ) / sizeof( Histogram ); ++i ) {
+            const char* name( histograms[ i ].name );
+
+            out << "# HELP filecache_" << name << ' ' << histograms[ i ].help << '\n'
+                << "# TYPE filecache_" << name << " histogram\n";
+
+            for ( Iterator it( stats.begin() ); it != stats.end(); ++it ) {
+                const LatencyHistogram& histogram( it->second.*histograms[ i ].value );
+                const std::string& labels( it->first );
+
+                // Prometheus buckets are cumulative
+                boost::uint64_t cumulative( 0 );
+
+                for ( int b( 0 ); b < LatencyHistogram::BUCKETS - 1; ++b ) {
+                    cumulative += histogram.counts[ b ];
+                    out << "filecache_" << name << "_bucket{" << labels << ",le=\"" << LatencyHistogram::bounds[ b ] << "\"} " << cumulative << '\n';
+                }
+
+                out << "filecache_" << name << "_bucket{" << labels << ",le=\"+Inf\"} " << histogram.count << '\n'
+                    << "filecache_" << name << "_sum{" << labels << "} " << histogram.sum << '\n'
+                    << "filecache_" << name << "_count{" << labels << "} " << histogram.count << '\n';
+            }
+        }
+    }
+
+
+    StopWatch::StopWatch()
+        : start_( now() )
+    {
+    }
+
+
+    double StopWatch::seconds() const
+    {
+        return now() - start_;
+    }
+
+
+    double StopWatch::now()
+    {
+#if defined( CLOCK_MONOTONIC )
+        struct timespec monotonic;
+
+        if ( !clock_gettime( CLOCK_MONOTONIC, &monotonic ) ) {
+            return monotonic.tv_sec + monotonic.tv_nsec * 1e-9;
+        }
+#endif
+        // Good enough where there is no monotonic clock
+        struct timeval wall;
+        gettimeofday( &wall, NULL );
+
+        return wall.tv_sec + wall.tv_usec * 1e-6;
+    }
+
+
+} // namespace Jupiter
@@ -0,0 +1,260 @@
+/**@file
+ *
+ * Compact binary traces of cache requests.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010  Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+// Own headers
+#include <cachetrace.hpp>
+
+// Standard headers
+#include <cstring> // memcmp(), memcpy()
+
+// System headers
+#include <errno.h> // errno
+#include <fcntl.h> // open()
+#include <sys/stat.h> // fstat()
+#include <sys/time.h> // gettimeofday()
+#include <unistd.h> // write(), close(), getpid()
+
+
+namespace Jupiter {
+
+
+    namespace {
+
+        const char MAGIC[ 4 ] = { 'J', 'F', 'C', 'T' };
+        const boost::uint8_t VERSION = 1;
+
+        struct Header {
+            char magic[ 4 ];
+            boost::uint8_t version;
+            boost::uint8_t reserved;
+            boost::uint16_t recordSize;
+        };
+
+        bool write_all( int fd, const char* buffer, size_t size )
+        {
+            while ( size ) {
+                ssize_t n( ::write( fd, buffer, size ) );
+
+                if ( -1 == n && EINTR == errno ) {
+                    continue;
+                }
+
+                if ( n <= 0 ) {
+                    return false;
+                }
+
+                buffer += n;
+                size -= n;
+            }
+
+            return true;
+        }
+
+    } // anonymous namespace
+
+
+    TraceRecord::TraceRecord()
+        : time( 0 ), path( 0 ), size( 0 ), latency( 0 ), pid( 0 ), instance( 0 ),
+          operation( CACHE ), outcome( LOCAL ), reserved( 0 )
+    {
+    }
+
+
+    boost::uint64_t hash_path( const std::string& path )
+    {
+        boost::uint64_t hash( 14695981039346656037ULL );
+
+        for ( std::string::const_iterator it( path.begin() ); it != path.end(); ++it ) {
+            hash ^= ( unsigned char )*it;
+            hash *= 1099511628211ULL;
+        }
+
+        return hash;
+    }
+
+
+    boost::uint64_t trace_time()
+    {
+        struct timeval now;
+        gettimeofday( &now, 0 );
+
+        return ( boost::uint64_t )now.tv_sec * 1000000 + now.tv_usec;
+    }
+
+
+    TraceWriter::TraceWriter()
+        : fd_( -1 ), pid_( 0 )
+    {
+    }
+
+
+    TraceWriter::~TraceWriter()
+    {
+        open( std::string() );
+    }
+
+
+    bool TraceWriter::open( const std::string& file )
+    {
+        boost::mutex::scoped_lock lock( mutex_ );
+
+        if ( -1 != fd_ ) {
+            write_buffer();
+            close( fd_ );
+            fd_ = -1;
+        }
+
+        buffer_.clear();
+
+        if ( file.empty() ) {
+            return false;
+        }
+
+        fd_ = ::open( file.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644 );
+
+        if ( -1 == fd_ ) {
+            return false;
+        }
+
+        struct stat fstats;
+
+        if ( fstat( fd_, &fstats ) ) {
+            close( fd_ );
+            fd_ = -1;
+            return false;
+        }
+
+        if ( !fstats.st_size ) {
+            Header header;
+            memcpy( header.magic, MAGIC, sizeof( MAGIC ) );
+            header.version = VERSION;
+            header.reserved = 0;
+            header.recordSize = sizeof( TraceRecord );
+
+            if ( !write_all( fd_, ( const char* )&header, sizeof( header ) ) ) {
+                close( fd_ );
+                fd_ = -1;
+                return false;
+            }
+        } else if ( TraceReader( file ).valid() ) {
+            // Appending to an earlier trace
+        } else {
+            // Never scribble over something that isn't a trace
+            close( fd_ );
+            fd_ = -1;
+            return false;
+        }
+
+        pid_ = getpid();
+        buffer_.reserve( BUFFER_RECORDS );
+
+        return true;
+    }
+
+
+    bool TraceWriter::enabled() const
+    {
+        boost::mutex::scoped_lock lock( mutex_ );
+
+        return -1 != fd_;
+    }
+
+
+    void TraceWriter::record( const TraceRecord& record )
+    {
+        boost::mutex::scoped_lock lock( mutex_ );
+
+        if ( -1 == fd_ ) {
+            return;
+        }
+
+        drop_inherited();
+
+        buffer_.push_back( record );
+
+        if ( buffer_.size() >= BUFFER_RECORDS ) {
+            write_buffer();
+        }
+    }
+
+
+    void TraceWriter::flush()
+    {
+        boost::mutex::scoped_lock lock( mutex_ );
+
+        if ( -1 != fd_ ) {
+            write_buffer();
+        }
+    }
+
+
+    void TraceWriter::drop_inherited()
+    {
+        if ( ( boost::uint32_t )getpid() != pid_ ) {
+            // We're a forked child -- the parent writes what it buffered
+            buffer_.clear();
+            pid_ = getpid();
+        }
+    }
+
+
+    void TraceWriter::write_buffer()
+    {
+        drop_inherited();
+
+        if ( !buffer_.empty() ) {
+            // One write per batch keeps batches of different processes from interleaving
+            write_all( fd_, ( const char* )&buffer_[ 0 ], buffer_.size() * sizeof( TraceRecord ) );
+            buffer_.clear();
+        }
+    }
+
+
+    TraceReader::TraceReader( const std::string& file )
+        : in_( file.c_str(), std::ios::in | std::ios::binary ), valid_( false )
+    {
+        Header header;
+
+        valid_ = in_.read( ( char* )&header, sizeof( header ) ) &&
+                 !memcmp( header.magic, MAGIC, sizeof( MAGIC ) ) &&
+                 VERSION == header.version && sizeof( TraceRecord ) == header.recordSize;
+    }
+
+
+    bool TraceReader::valid() const
+    {
+        return valid_;
+    }
+
+
+    bool TraceReader::next( TraceRecord& record )
+    {
+        return valid_ && in_.read( ( char* )&record, sizeof( record ) );
+    }
+
+
+} // namespace Jupiter
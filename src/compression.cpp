@@ -0,0 +1,432 @@
+/**@file
+ *
+ * Chunked, randomly accessible compressed files for the cache store.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010  Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+// Own headers
+#include <compression.hpp>
+
+// Standard headers
+#include <algorithm> // min(), transform()
+#include <cstring> // memcmp(), memcpy()
+#include <vector>
+
+// System headers
+#include <errno.h> // errno
+#include <fcntl.h> // open()
+#include <unistd.h> // pread(), pwrite(), close()
+#if defined( FILECACHE_LZ4 )
+# include <lz4.h>
+#endif
+#if defined( FILECACHE_ZSTD )
+# include <zstd.h>
+#endif
+
+// Boost headers
+#include <boost/filesystem/convenience.hpp> // extension()
+#include <boost/scoped_ptr.hpp>
+#include <boost/tokenizer.hpp>
+
+
+namespace Jupiter {
+
+
+    namespace {
+
+        const char MAGIC[ 4 ] = { 'J', 'F', 'C', 'Z' };
+        const boost::uint8_t VERSION = 1;
+
+        bool pread_all( int fd, char* buffer, size_t size, off_t offset )
+        {
+            while ( size ) {
+                ssize_t n( pread( fd, buffer, size, offset ) );
+
+                if ( -1 == n && EINTR == errno ) {
+                    continue;
+                }
+
+                if ( n <= 0 ) {
+                    return false;
+                }
+
+                buffer += n;
+                size -= n;
+                offset += n;
+            }
+
+            return true;
+        }
+
+
+        bool pwrite_all( int fd, const char* buffer, size_t size, off_t offset )
+        {
+            while ( size ) {
+                ssize_t n( pwrite( fd, buffer, size, offset ) );
+
+                if ( -1 == n && EINTR == errno ) {
+                    continue;
+                }
+
+                if ( n <= 0 ) {
+                    return false;
+                }
+
+                buffer += n;
+                size -= n;
+                offset += n;
+            }
+
+            return true;
+        }
+
+    } // anonymous namespace
+
+
+    bool compress_block( Codec codec, const char* data, size_t length, std::string& result )
+    {
+        switch ( codec ) {
+#if defined( FILECACHE_LZ4 )
+            case CODEC_LZ4: {
+                result.resize( LZ4_compressBound( length ) );
+
+                int n( LZ4_compress_default( data, &result[ 0 ], length, result.size() ) );
+
+                if ( n <= 0 ) {
+                    return false;
+                }
+
+                result.resize( n );
+                return true;
+            }
+#endif
+#if defined( FILECACHE_ZSTD )
+            case CODEC_ZSTD: {
+                result.resize( ZSTD_compressBound( length ) );
+
+                // Level 1 -- compression happens on the render's critical path
+                size_t n( ZSTD_compress( &result[ 0 ], result.size(), data, length, 1 ) );
+
+                if ( ZSTD_isError( n ) ) {
+                    return false;
+                }
+
+                result.resize( n );
+                return true;
+            }
+#endif
+            default:
+                return false;
+        }
+    }
+
+
+    bool decompress_block( Codec codec, const char* data, size_t length, char* result, size_t resultLength )
+    {
+        switch ( codec ) {
+#if defined( FILECACHE_LZ4 )
+            case CODEC_LZ4:
+                return ( int )resultLength == LZ4_decompress_safe( data, result, length, resultLength );
+#endif
+#if defined( FILECACHE_ZSTD )
+            case CODEC_ZSTD:
+                return resultLength == ZSTD_decompress( result, resultLength, data, length );
+#endif
+            default:
+                return false;
+        }
+    }
+
+
+    Codec CompressionPolicy::codec_from_name( const std::string& name )
+    {
+#if defined( FILECACHE_LZ4 )
+        if ( "lz4" == name ) {
+            return CODEC_LZ4;
+        }
+#endif
+#if defined( FILECACHE_ZSTD )
+        if ( "zstd" == name ) {
+            return CODEC_ZSTD;
+        }
+#endif
+
+        return CODEC_NONE;
+    }
+
+
+    void CompressionPolicy::extensions_from_list( const std::string& list )
+    {
+        typedef boost::tokenizer< boost::char_separator< char > > Tokenizer;
+
+        boost::char_separator< char > separators( " ,\t" );
+        Tokenizer tokens( list, separators );
+
+        extensions.clear();
+
+        for ( Tokenizer::iterator it( tokens.begin() ); it != tokens.end(); ++it ) {
+            std::string extension( '.' == ( *it )[ 0 ] ? *it : "." + *it );
+            std::transform( extension.begin(), extension.end(), extension.begin(), ::tolower );
+
+            extensions.insert( extension );
+        }
+    }
+
+
+    bool CompressionPolicy::applies( const fs::path& file, uintmax_t size ) const
+    {
+        if ( CODEC_NONE == codec ) {
+            return false;
+        }
+
+        if ( extensions.empty() && !threshold ) {
+            return true;
+        }
+
+        if ( threshold && size >= threshold ) {
+            return true;
+        }
+
+        std::string extension( fs::extension( file ) );
+        std::transform( extension.begin(), extension.end(), extension.begin(), ::tolower );
+
+        return extensions.count( extension );
+    }
+
+
+    CompressedFile::CompressedFile( const fs::path& path )
+        : fd_( open( path.string().c_str(), O_RDONLY ) )
+    {
+        if ( -1 != fd_ &&
+             ( !pread_all( fd_, ( char* )&header_, sizeof( header_ ), 0 ) ||
+               memcmp( header_.magic, MAGIC, sizeof( MAGIC ) ) || VERSION != header_.version ) ) {
+            close( fd_ );
+            fd_ = -1;
+        }
+    }
+
+
+    CompressedFile::~CompressedFile()
+    {
+        if ( -1 != fd_ ) {
+            close( fd_ );
+        }
+    }
+
+
+    bool CompressedFile::valid() const
+    {
+        return -1 != fd_;
+    }
+
+
+    uintmax_t CompressedFile::size() const
+    {
+        return valid() ? header_.size : 0;
+    }
+
+
+    std::streamsize CompressedFile::read( uintmax_t offset, char* buffer, std::size_t size )
+    {
+        if ( !valid() ) {
+            return -1;
+        }
+
+        if ( offset >= header_.size ) {
+            return 0;
+        }
+
+        uintmax_t length( std::min< uintmax_t >( size, header_.size - offset ) );
+
+        std::vector< char > chunk;
+        uintmax_t done( 0 );
+
+        while ( done < length ) {
+            boost::uint32_t index( ( offset + done ) / header_.chunkSize );
+            uintmax_t start( ( offset + done ) % header_.chunkSize );
+            uintmax_t chunkLength;
+
+            if ( !start && length - done >= header_.chunkSize ) {
+                // The whole chunk is wanted -- decompress straight into the caller's buffer
+                if ( !read_chunk( index, buffer + done, chunkLength ) ) {
+                    return -1;
+                }
+
+                done += chunkLength;
+            } else {
+                chunk.resize( header_.chunkSize );
+
+                if ( !read_chunk( index, &chunk[ 0 ], chunkLength ) ) {
+                    return -1;
+                }
+
+                uintmax_t n( std::min( chunkLength - start, length - done ) );
+                memcpy( buffer + done, &chunk[ start ], n );
+                done += n;
+            }
+        }
+
+        return done;
+    }
+
+
+    bool CompressedFile::decompress( const fs::path& destination ) const
+    {
+        if ( !valid() ) {
+            return false;
+        }
+
+        int out( open( destination.string().c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 ) );
+
+        if ( -1 == out ) {
+            return false;
+        }
+
+        std::vector< char > chunk( header_.chunkSize );
+        bool success( true );
+
+        for ( boost::uint32_t i( 0 ); success && i < header_.chunks; ++i ) {
+            uintmax_t length;
+
+            success = read_chunk( i, &chunk[ 0 ], length ) &&
+                      pwrite_all( out, &chunk[ 0 ], length, ( off_t )i * header_.chunkSize );
+        }
+
+        if ( close( out ) || !success ) {
+            unlink( destination.string().c_str() );
+            return false;
+        }
+
+        return true;
+    }
+
+
+    bool CompressedFile::read_chunk( boost::uint32_t chunk, char* buffer, uintmax_t& length ) const
+    {
+        if ( chunk >= header_.chunks ) {
+            return false;
+        }
+
+        boost::uint64_t span[ 2 ];
+
+        if ( !pread_all( fd_, ( char* )span, sizeof( span ), sizeof( header_ ) + chunk * sizeof( boost::uint64_t ) ) ) {
+            return false;
+        }
+
+        length = std::min< uintmax_t >( header_.chunkSize, header_.size - ( uintmax_t )chunk * header_.chunkSize );
+
+        boost::uint64_t stored( span[ 1 ] - span[ 0 ] );
+
+        if ( stored == length ) {
+            // Stored as is
+            return pread_all( fd_, buffer, length, span[ 0 ] );
+        }
+
+        std::vector< char > compressed( stored );
+
+        return pread_all( fd_, &compressed[ 0 ], stored, span[ 0 ] ) &&
+               decompress_block( ( Codec )header_.codec, &compressed[ 0 ], stored, buffer, length );
+    }
+
+
+    bool CompressedFile::compress( const fs::path& source, const fs::path& destination, Codec codec )
+    {
+        LocalBackend local;
+        SourceStats stats;
+
+        if ( !local.stat( source, stats ) ) {
+            return false;
+        }
+
+        boost::scoped_ptr< SourceFile > in( local.open( source ) );
+
+        return in && compress( *in, stats.size, destination, codec );
+    }
+
+
+    bool CompressedFile::compress( SourceFile& source, uintmax_t size, const fs::path& destination, Codec codec )
+    {
+        int out( open( destination.string().c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644 ) );
+
+        if ( -1 == out ) {
+            return false;
+        }
+
+        Header header;
+        memcpy( header.magic, MAGIC, sizeof( MAGIC ) );
+        header.version = VERSION;
+        header.codec = codec;
+        header.reserved = 0;
+        header.chunkSize = CHUNK_SIZE;
+        header.chunks = ( size + CHUNK_SIZE - 1 ) / CHUNK_SIZE;
+        header.size = size;
+
+        std::vector< boost::uint64_t > index( header.chunks + 1 );
+        std::vector< char > chunk( CHUNK_SIZE );
+        std::string compressed;
+
+        off_t offset( sizeof( header ) + index.size() * sizeof( boost::uint64_t ) );
+        bool success( true );
+
+        for ( boost::uint32_t i( 0 ); success && i < header.chunks; ++i ) {
+            size_t length( std::min< uintmax_t >( CHUNK_SIZE, header.size - ( uintmax_t )i * CHUNK_SIZE ) );
+
+            success = ( std::streamsize )length == source.read( ( uintmax_t )i * CHUNK_SIZE, &chunk[ 0 ], length );
+
+            if ( success ) {
+                index[ i ] = offset;
+
+                // Incompressible chunks (e.g. already compressed EXR tiles) are kept as they are
+                if ( compress_block( codec, &chunk[ 0 ], length, compressed ) && compressed.size() < length ) {
+                    success = pwrite_all( out, compressed.data(), compressed.size(), offset );
+                    offset += compressed.size();
+                } else {
+                    success = pwrite_all( out, &chunk[ 0 ], length, offset );
+                    offset += length;
+                }
+            }
+        }
+
+        index[ header.chunks ] = offset;
+
+        success = success &&
+                  pwrite_all( out, ( const char* )&header, sizeof( header ), 0 ) &&
+                  pwrite_all( out, ( const char* )&index[ 0 ], index.size() * sizeof( boost::uint64_t ), sizeof( header ) );
+
+        if ( close( out ) || !success ) {
+            unlink( destination.string().c_str() );
+            return false;
+        }
+
+        return true;
+    }
+
+
+    bool CompressedFile::is_compressed( const fs::path& path )
+    {
+        return CompressedFile( path ).valid();
+    }
+
+
+} // namespace Jupiter
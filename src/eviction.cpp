@@ -0,0 +1,131 @@
+/**@file
+ *
+ * Choosing which cache entries to evict.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010  Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+// Own headers
+#include <eviction.hpp>
+
+// Standard headers
+#include <algorithm> // sort()
+
+
+namespace Jupiter {
+
+
+    namespace {
+
+        /**
+         * Orders candidate indices by the policy, preferred entries first
+         */
+        class EvictionOrder {
+            public:
+                EvictionOrder( const std::vector< EvictionCandidate >& candidates, EvictionPolicy policy )
+                    : candidates_( candidates ), policy_( policy ) {}
+
+                bool operator()( std::size_t a, std::size_t b ) const
+                {
+                    const EvictionCandidate& x( candidates_[ a ] );
+                    const EvictionCandidate& y( candidates_[ b ] );
+
+                    if ( x.preferred != y.preferred ) {
+                        return x.preferred;
+                    }
+
+                    if ( EVICT_LARGEST == policy_ && x.size != y.size ) {
+                        return x.size > y.size;
+                    }
+
+                    if ( x.lastAccess != y.lastAccess ) {
+                        return x.lastAccess < y.lastAccess;
+                    }
+
+                    // Keep the order stable for equal entries
+                    return a < b;
+                }
+
+            private:
+                const std::vector< EvictionCandidate >& candidates_;
+                EvictionPolicy policy_;
+        };
+
+    } // anonymous namespace
+
+
+    bool eviction_policy_from_name( const std::string& name, EvictionPolicy& policy )
+    {
+        if ( "lru" == name ) {
+            policy = EVICT_LRU;
+        } else if ( "largest" == name ) {
+            policy = EVICT_LARGEST;
+        } else {
+            return false;
+        }
+
+        return true;
+    }
+
+
+    std::string eviction_policy_name( EvictionPolicy policy )
+    {
+        return EVICT_LARGEST == policy ? "largest" : "lru";
+    }
+
+
+    bool plan_eviction( const std::vector< EvictionCandidate >& candidates, uintmax_t total, uintmax_t capacity,
+                        EvictionPolicy policy, std::vector< std::size_t >& victims )
+    {
+        victims.clear();
+
+        if ( total <= capacity ) {
+            return true;
+        }
+
+        std::vector< std::size_t > order;
+        order.reserve( candidates.size() );
+
+        for ( std::size_t i( 0 ); i < candidates.size(); ++i ) {
+            if ( !candidates[ i ].pinned ) {
+                order.push_back( i );
+            }
+        }
+
+        std::sort( order.begin(), order.end(), EvictionOrder( candidates, policy ) );
+
+        for ( std::vector< std::size_t >::const_iterator it( order.begin() ); it != order.end(); ++it ) {
+            victims.push_back( *it );
+            total -= candidates[ *it ].size;
+
+            if ( total < capacity ) {
+                // Enough room
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+
+} // namespace Jupiter
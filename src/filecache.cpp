@@ -39,29 +39,35 @@
  */
 // Own headers
 #include <filecache.hpp>
+#include <blockdelta.hpp>
+#include <cachetrace.hpp>
+#include <compression.hpp>
+#include <eviction.hpp>
+#include <filepattern.hpp>
+#include <ioengine.hpp>
+#include <peercache.hpp>
+#include <progressivefill.hpp>
+#include <readahead.hpp>
+#include <revalidator.hpp>
+#include <scratcharena.hpp>
+#include <sourcebackend.hpp>
+#include <tracing.hpp>
 
 // Standard headers
+#include <algorithm> // sort()
+#include <cstring> // strlen()
+#include <fstream> // ofstream
 #include <iostream> // cerr
-#include <sstream> // istringstream
+#include <sstream> // istringstream, ostringstream
 
 // System headers
 #include <errno.h> // errno
-// superblock magic number for NFS -- this should better come from
-// linux/nfs_fs.h!!!
-// Need to investigate why we have missing include dependecies with
-// linux/nfs_fs.h on Fedora Bore.
-// Works fine on Gentoo. :)
-
-
-//#include <linux/nfs_fs.h> // NFS_SUPER_MAGIC
-#ifndef NFS_SUPER_MAGIC
-#define NFS_SUPER_MAGIC       0x00006969
-#endif
-
-
+#include <fcntl.h> // open()
 #include <signal.h> // kill()
 #include <sys/stat.h> // stat()
 #include <sys/statvfs.h> // statvfs()
+#include <stdio.h> // rename()
+#include <unistd.h> // pread(), close(), getpid(), link()
 #if defined( LINUX ) && defined( USEPROC )
 // proc/readproc.h is yet another header missing from Fedora Bore, it seems. :(
 # include <proc/readproc.h>
@@ -70,9 +76,12 @@
 
 // Boost headers
 #include <boost/algorithm/string/replace.hpp> // replace_all()
+#include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/functional/hash.hpp> // hash_range()
 #include <boost/lexical_cast.hpp>
 #include <boost/scoped_array.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/shared_array.hpp>
 
 
@@ -86,9 +95,96 @@
 namespace Jupiter {
 
 
-    FileCache::Inventory FileCache::cacheInventory_;
-    FileCache::PathSizeMap FileCache::cacheSize_;
-    FileCache::ProcessCounterInventory FileCache::instanceCounter_;
+    boost::shared_mutex FileCacheBase::mutex_;
+    FileCacheBase::Inventory FileCacheBase::cacheInventory_;
+    FileCacheBase::PathSizeMap FileCacheBase::cacheSize_;
+    FileCacheBase::PathFreeSpaceMap FileCacheBase::cacheFreeSpace_;
+    FileCacheBase::PathPeerMap FileCacheBase::cachePeers_;
+    FileCacheBase::PathCompressionMap FileCacheBase::cacheCompression_;
+    FileCacheBase::PathWriteBackMap FileCacheBase::cacheWriteBack_;
+    FileCacheBase::PathStatsMap FileCacheBase::cacheStats_;
+    FileCacheBase::PathSourceMap FileCacheBase::cacheSources_;
+    FileCacheBase::PathEvictionMap FileCacheBase::cacheEviction_;
+    FileCacheBase::PathAdmissionMap FileCacheBase::cacheAdmission_;
+    FileCacheBase::PathBypassMap FileCacheBase::cacheBypass_;
+    FileCacheBase::PathSizeMap FileCacheBase::cacheDelta_;
+    FileCacheBase::PathSizeMap FileCacheBase::cacheProgressive_;
+    FileCacheBase::FillMap FileCacheBase::fills_;
+    boost::mutex FileCacheBase::fillsMutex_;
+    boost::mutex FileCacheBase::statsMutex_;
+    std::string FileCacheBase::statsFile_;
+    unsigned FileCacheBase::statsInterval_( 60 );
+    time_t FileCacheBase::lastStatsDump_( 0 );
+    TraceWriter FileCacheBase::tracer_;
+    PathTable FileCacheBase::paths_;
+    std::size_t FileCacheBase::pathsKept_( 0 );
+    PathIdSet FileCacheBase::prefetched_;
+    FileCacheBase::ProcessCounterInventory FileCacheBase::instanceCounter_;
+    FileCacheBase::PathSizeMap FileCacheBase::cacheRevalidate_;
+    FileCacheBase::PathSizeMap FileCacheBase::cacheRevalidateRate_;
+    FileCacheBase::ValidationMap FileCacheBase::validated_;
+    std::multiset< PathId > FileCacheBase::copying_;
+    boost::condition_variable_any FileCacheBase::copied_;
+    // Last, so leftover revalidators stop before the state they use goes
+    FileCacheBase::PathRevalidatorMap FileCacheBase::cacheRevalidators_;
+
+
+    namespace {
+
+        /**
+         * The backend for NFS mounts, which are always cached
+         */
+        const boost::shared_ptr< SourceBackend >& nfs_backend()
+        {
+            static boost::shared_ptr< SourceBackend > backend( new NfsBackend );
+
+            return backend;
+        }
+
+
+        /**
+         * The backend for files nobody claims -- they are read but never cached
+         */
+        const boost::shared_ptr< SourceBackend >& local_backend()
+        {
+            static boost::shared_ptr< SourceBackend > backend( new LocalBackend );
+
+            return backend;
+        }
+
+
+        /**
+         * Query the space left on a filesystem, and its size, in bytes
+         */
+        bool filesystem_space( const fs::path& path, uintmax_t& available, uintmax_t& size )
+        {
+            struct statvfs stats;
+
+            if ( statvfs( path.string().c_str(), &stats ) ) {
+                return false;
+            }
+
+            // What unprivileged users may still fill
+            available = ( uintmax_t )stats.f_bavail * stats.f_frsize;
+            size = ( uintmax_t )stats.f_blocks * stats.f_frsize;
+
+            return true;
+        }
+
+
+        /**
+         * Escape a Prometheus label value
+         */
+        std::string label_value( std::string value )
+        {
+            boost::algorithm::replace_all( value, "\\", "\\\\" );
+            boost::algorithm::replace_all( value, "\"", "\\\"" );
+            boost::algorithm::replace_all( value, "\n", "\\n" );
+
+            return value;
+        }
+
+    } // anonymous namespace
 
     /**
      * Creates a new cache instance.
@@ -106,21 +202,27 @@ namespace Jupiter {
      *                path the default location "/var/tmp/_cache" ist used.
      *
      */
-    FileCache::FileCache( bool activate )
+    template< typename Traits >
+    BasicFileCache< Traits >::BasicFileCache( bool activate )
+        : worker_( false )
     {
         WriteGuard guard( mutex_ );
 
         init_cache( fs::path(), activate );
     }
 
-    FileCache::FileCache( const fs::path& where, bool activate )
+    template< typename Traits >
+    BasicFileCache< Traits >::BasicFileCache( const fs::path& where, bool activate )
+        : worker_( false )
     {
         WriteGuard guard( mutex_ );
 
         init_cache( where, activate );
     }
 
-    FileCache::FileCache( const std::string& where, bool activate )
+    template< typename Traits >
+    BasicFileCache< Traits >::BasicFileCache( const std::string& where, bool activate )
+        : worker_( false )
     {
         WriteGuard guard( mutex_ );
 
@@ -138,15 +240,37 @@ namespace Jupiter {
      * Rule of three. :)
      *
      */
-    FileCache::FileCache( const FileCache& fc )
+    template< typename Traits >
+    BasicFileCache< Traits >::BasicFileCache( const BasicFileCache& fc )
+        : worker_( false )
     {
         WriteGuard guard( mutex_ );
 
         cwd_ = fc.cwd_;
         cacheLocation_ = fc.cacheLocation_;
+        cachePrefix_ = fc.cachePrefix_;
         cacheSize_[ cacheLocation_ ] = fc.cacheSize_[ fc.cacheLocation_ ];
         cache_ = fc.cache_;
         log_ = fc.log_;
+        processName_ = fc.processName_;
+
+        // A copy is a new instance -- it gets its own reference and owns no files
+        register_instance();
+    }
+
+
+    /**
+     * Worker constructor.
+     *
+     * Shares the owner's location and settings; the caller holds our lock.
+     *
+     */
+    template< typename Traits >
+    BasicFileCache< Traits >::BasicFileCache( const BasicFileCache& owner, WorkerTag )
+        : cache_( owner.cache_ ), log_( owner.log_ ), worker_( true ),
+          cacheLocation_( owner.cacheLocation_ ), cwd_( owner.cwd_ ), cachePrefix_( owner.cachePrefix_ ),
+          processName_( owner.processName_ ), reference_( 0 ), outcome_( TraceRecord::LOCAL )
+    {
     }
 
 
@@ -156,15 +280,15 @@ namespace Jupiter {
      * Rule of three. :)
      *
      */
-    FileCache& FileCache::operator=( const FileCache& fc )
+    template< typename Traits >
+    BasicFileCache< Traits >& BasicFileCache< Traits >::operator=( const BasicFileCache& fc )
     {
-        ReadGuard guard( mutex_ );
+        WriteGuard guard( mutex_ );
 
         if ( this != &fc ) {
-            WriteGuard guard( mutex_, boost::adopt_lock );
-
             cwd_ = fc.cwd_;
             cacheLocation_ = fc.cacheLocation_;
+            cachePrefix_ = fc.cachePrefix_;
             cacheSize_[ cacheLocation_ ] = fc.cacheSize_[ fc.cacheLocation_ ];
             cache_ = fc.cache_;
             log_ = fc.log_;
@@ -174,7 +298,8 @@ namespace Jupiter {
     }
 
 
-    bool FileCache::operator==( const FileCache& fc ) const
+    template< typename Traits >
+    bool BasicFileCache< Traits >::operator==( const BasicFileCache& fc ) const
     {
         ReadGuard guard( mutex_ );
         return cacheLocation_ == fc.cacheLocation_;
@@ -187,15 +312,35 @@ namespace Jupiter {
      * Releases all files used by the current process.
      *
      */
-    FileCache::~FileCache()
+    template< typename Traits >
+    BasicFileCache< Traits >::~BasicFileCache()
     {
+        // The prefetcher's threads take our lock -- stop them first
+        prefetcher_.reset();
+        copier_.reset();
+
+        if ( worker_ ) {
+            // Never registered
+            return;
+        }
+
+        // Declared first so it's stopped after our lock is released -- its thread takes it
+        boost::shared_ptr< Revalidator > revalidator;
+
         WriteGuard guard( mutex_ );
 
         ipd::OS_process_id_t id( ipd::get_current_process_id() );
 
         erase_this_reference();
 
+        if ( tracer_.enabled() ) {
+            trace( TraceRecord::FINISH, TraceRecord::LOCAL, fs::path(), 0, 0 );
+        }
+
         if ( instanceCounter_[ id ].empty() ) { // No more instances in the process
+            dump_stats( true );
+            tracer_.flush();
+            SpanTracer::dump();
 
             if ( cacheInventory_[ cacheLocation_ ][ id ].empty() ) {
                 // In theory this can never return cacheInventory_[ cacheLocation_ ].end(), but maybe we should check???
@@ -208,24 +353,55 @@ namespace Jupiter {
                 cacheInventory_.erase( cacheInventory_.find( cacheLocation_ ) );
             }
         }
+
+        // The last instance at the location in the process -- its entries in
+        // use are gone, pause revalidating them until the next instance
+        Inventory::const_iterator location( cacheInventory_.find( cacheLocation_ ) );
+
+        if ( cacheInventory_.end() == location || !location->second.count( id ) || location->second.find( id )->second.empty() ) {
+            PathRevalidatorMap::iterator it( cacheRevalidators_.find( cacheLocation_ ) );
+
+            if ( cacheRevalidators_.end() != it ) {
+                revalidator = it->second;
+                cacheRevalidators_.erase( it );
+            }
+        }
     }
 
 
-    void FileCache::releaseFile( const fs::path& path )
+    template< typename Traits >
+    void BasicFileCache< Traits >::releaseFile( const fs::path& path )
     {
         WriteGuard guard( mutex_ );
 
         // Release a file from this process's cache inventory
-        std::set< fs::path >& thisFileInventory( cacheInventory_[ cacheLocation_ ][ ipd::get_current_process_id() ][ reference_ ] );
-        std::set< fs::path >::const_iterator it( thisFileInventory.find( path ) );
+        PathIdSet& thisFileInventory( cacheInventory_[ cacheLocation_ ][ ipd::get_current_process_id() ][ reference_ ] );
+        PathId id;
+
+        if ( paths_.find( path.string(), id ) ) {
+            thisFileInventory.erase( id );
+        }
+
+        // A decompressed file keeps its compressed entry pinned
+        if ( paths_.find( compressed_file_path( path ).string(), id ) ) {
+            thisFileInventory.erase( id );
+        }
 
-        if ( thisFileInventory.end() != it ) {
-            thisFileInventory.erase( it );
+        if ( tracer_.enabled() ) {
+            trace( TraceRecord::RELEASE, TraceRecord::LOCAL, path, 0, 0 );
         }
     }
 
 
-    void FileCache::babble( bool logging )
+    template< typename Traits >
+    void BasicFileCache< Traits >::releaseFile( const std::string& path )
+    {
+        releaseFile( fs::path( path ) );
+    }
+
+
+    template< typename Traits >
+    void BasicFileCache< Traits >::babble( bool logging )
     {
         WriteGuard guard( mutex_ );
 
@@ -233,7 +409,29 @@ namespace Jupiter {
     }
 
 
-    void FileCache::relocate( const fs::path& where )
+    template< typename Traits >
+    void BasicFileCache< Traits >::readAhead( unsigned files )
+    {
+        boost::scoped_ptr< Prefetcher > previous;
+
+        {
+            WriteGuard guard( mutex_ );
+
+            prefetcher_.swap( previous );
+            predictor_.reset();
+
+            if ( files ) {
+                predictor_.reset( new SequencePredictor( files ) );
+                prefetcher_.reset( new Prefetcher( boost::bind( &BasicFileCache::prefetch_file, this, _1, true ) ) );
+            }
+        }
+
+        // The previous prefetcher is stopped here, without our lock
+    }
+
+
+    template< typename Traits >
+    void BasicFileCache< Traits >::relocate( const fs::path& where )
     {
         WriteGuard guard( mutex_ );
 
@@ -241,7 +439,15 @@ namespace Jupiter {
     }
 
 
-    void FileCache::resize( uintmax_t megaByteSize )
+    template< typename Traits >
+    void BasicFileCache< Traits >::relocate( const std::string& where )
+    {
+        relocate( fs::path( where ) );
+    }
+
+
+    template< typename Traits >
+    void BasicFileCache< Traits >::resize( uintmax_t megaByteSize )
     {
         WriteGuard guard( mutex_ );
 
@@ -250,262 +456,984 @@ namespace Jupiter {
     }
 
 
-    fs::path FileCache::cacheFile( const fs::path& toCache )
+    template< typename Traits >
+    void BasicFileCache< Traits >::keepFree( uintmax_t megaBytes, unsigned percent )
     {
+        WriteGuard guard( mutex_ );
 
-        ReadGuard guard( mutex_ );
+        if ( !megaBytes && !percent ) {
+            cacheFreeSpace_.erase( cacheLocation_ );
+            return;
+        }
 
-        try {
-            if ( cache_ ) {
-                WriteGuard guard( mutex_, boost::adopt_lock );
+        // Looked at again on the next tidy up
+        FreeSpace& space( cacheFreeSpace_[ cacheLocation_ ] );
+        space.keep = megaBytes * 1000000;
+        space.keepPercent = percent;
+        space.checked = 0;
+    }
 
-                fs::path source;
 
-                if ( is_symlink( toCache ) ) {
-                    source = read_link( toCache );
-                } else {
-                    source = toCache;
-                }
+    template< typename Traits >
+    void BasicFileCache< Traits >::compression( const std::string& codec, uintmax_t megaByteThreshold, const std::string& extensions )
+    {
+        WriteGuard guard( mutex_ );
 
-                fs::path result;
+        CompressionPolicy policy;
+        policy.codec = CompressionPolicy::codec_from_name( codec );
+        policy.threshold = megaByteThreshold * 1000000;
+        policy.extensions_from_list( extensions );
 
-                if ( is_remote( source ) ) {
-                    fs::path destination( cached_file_path( source ) );
+        if ( CODEC_NONE == policy.codec ) {
+            if ( !codec.empty() && "none" != codec ) {
+                message( "Compression codec '" + codec + "' is not available" );
+            }
 
-                    // Does the file exist?
-                    if ( fs::exists( destination ) ) {
-                        // Is it used by another process?
-                        if ( is_used( destination ) ) {
-                            // Is it the same as the original?
-                            if ( !is_different( source, destination ) || is_used_by_this_cache( destination ) ) {
-                                // Best case: destination exists, is used but not different -- mark it
-                                DEBUGMSG( "RegisterInCache '" + destination.string() + "' exists in cache and is equal to original or different but already used by this cache instance" );
-                                register_file( destination );
-                                result = destination;
-                            }
+            cacheCompression_.erase( cacheLocation_ );
+        } else {
+            cacheCompression_[ cacheLocation_ ] = policy;
+        }
+    }
 
-                            /* If we ended up here the file
-                             * is outdated but used elsewhere,
-                             * so we can't update the cache :|
-                             */
-                        } else if ( is_different( source, destination ) ) {
-                            // Destination already exists and isn't used but it is different
-                            DEBUGMSG( "Copy2Cache '" + destination.string() + "' exists in cache and is not used but different to original '" + source.string() + "'" );
-                            result = copy_to_cache( source, destination );
-                        } else {
-                            // Best case: destination exists, is not used nor different -- mark it
-                            DEBUGMSG( "RegisterInCache '" + destination.string() + "' exists in cache and is equal to original '" + source.string() + "'" );
-                            register_file( destination );
-                            result = destination;
-                        }
-                    } else {
-                        // Destination doesn't exist
-                        DEBUGMSG( "RegisterInCache '" + destination.string() + "' does not exist in cache" );
-                        result = copy_to_cache( source, destination );
-                    }
-                } else {
-                    // It's a local file
-                    DEBUGMSG( "Ignoring '" + source.string() + "' since it is a local file" );
-                }
 
-                return result;
-            }
-        } catch ( fs::filesystem_error ) {
-            // Anything goes wrong we play it safe and return the unalterted path
-            message( "File '" + toCache.string() + "' was not cached." );
-        }
+    template< typename Traits >
+    void BasicFileCache< Traits >::eviction( const std::string& policy )
+    {
+        WriteGuard guard( mutex_ );
 
-        DEBUGMSG( "CacheDeactivated '" + toCache.string() + "' ignored" );
+        EvictionPolicy parsed;
 
-        return toCache;
+        if ( eviction_policy_from_name( policy, parsed ) ) {
+            cacheEviction_[ cacheLocation_ ] = parsed;
+        } else {
+            message( "Eviction policy '" + policy + "' is not known" );
+        }
     }
 
 
-    std::string FileCache::cacheFile( const std::string& toCache )
+    template< typename Traits >
+    void BasicFileCache< Traits >::admission( const std::string& filter, unsigned maxPercent )
     {
         WriteGuard guard( mutex_ );
-        return cacheFile( fs::path( toCache ) ).string();
-    }
 
+        AdmissionFilter parsed;
 
-    fs::path FileCache::cacheFileForWriting( const fs::path& toCache )
-    {
-        ReadGuard guard( mutex_ );
+        if ( !admission_filter_from_name( filter, parsed ) ) {
+            message( "Admission filter '" + filter + "' is not known" );
+            return;
+        }
 
-        if ( cache_ ) {
-            WriteGuard guard( mutex_, boost::adopt_lock );
+        boost::mutex::scoped_lock lock( statsMutex_ );
 
-            fs::path source;
+        // The sketch keeps what it counted so far
+        AdmissionPolicy& policy( cacheAdmission_[ cacheLocation_ ] );
+        policy.filter = parsed;
+        policy.maxPercent = maxPercent;
+    }
 
-            if ( is_symlink( toCache ) ) {
-                source = read_link( toCache );
-            } else {
-                source = toCache;
-            }
 
-            fs::path result;
+    template< typename Traits >
+    void BasicFileCache< Traits >::bypass( bool adaptive )
+    {
+        boost::scoped_ptr< Prefetcher > previous;
 
-            if ( is_remote( source ) ) {
-                fs::path destination( cached_file_path( source ) );
+        {
+            WriteGuard guard( mutex_ );
 
-                // Does the file exist?
-                if ( fs::exists( destination ) ) {
-                    // Is it used by another process?
-                    if ( is_used( destination ) ) {
-                        // We can't allow writing to a file that is being used
-                        DEBUGMSG( "RegisterInCache '" + destination.string() + "' exists in cache and is being used" );
-                        result = source;
-                    } else {
-                        // Destination exists but is not -- mark it
-                        DEBUGMSG( "RegisterInCache '" + destination.string() + "' exists in cache but is not being used" );
-                        register_file( destination );
-                        result = destination;
-                    }
-                } else {
-                    // Destination doesn't exist
-                    result = destination;
+            {
+                boost::mutex::scoped_lock lock( statsMutex_ );
+
+                if ( !adaptive ) {
+                    cacheBypass_.erase( cacheLocation_ );
+                } else if ( !cacheBypass_.count( cacheLocation_ ) ) {
+                    cacheBypass_[ cacheLocation_ ];
                 }
-            } else {
-                DEBUGMSG( "Ignoring local file '" + source.string() + "'" );
-                result = source;
             }
 
-            return result;
+            copier_.swap( previous );
+
+            if ( adaptive ) {
+                copier_.reset( new Prefetcher( boost::bind( &BasicFileCache::prefetch_file, this, _1, false ) ) );
+            }
         }
 
-        return toCache;
+        // The previous copier is stopped here, without our lock
     }
 
 
-    std::string FileCache::cacheFileForWriting( const std::string& toCache )
+    template< typename Traits >
+    void BasicFileCache< Traits >::deltaRefresh( uintmax_t megaByteThreshold )
     {
         WriteGuard guard( mutex_ );
-        return cacheFileForWriting( fs::path( toCache ) ).string();
+
+        if ( megaByteThreshold ) {
+            cacheDelta_[ cacheLocation_ ] = megaByteThreshold * 1000000;
+        } else {
+            cacheDelta_.erase( cacheLocation_ );
+        }
     }
 
 
-    fs::path FileCache::uncacheFile( const fs::path& fromCache, bool overwrite, bool ifNewer )
+    template< typename Traits >
+    void BasicFileCache< Traits >::revalidate( unsigned interval, unsigned rate )
     {
+        boost::shared_ptr< Revalidator > previous;
 
-        fs::path destination( original_file_path( fromCache ) );
+        {
+            WriteGuard guard( mutex_ );
 
-        ReadGuard guard( mutex_ );
+            start_revalidator( interval, rate, previous );
+        }
 
-        try {
-            if ( cache_ ) {
-                WriteGuard guard( mutex_, boost::adopt_lock );
+        // The previous revalidator is stopped here, without our lock
+    }
 
-                if ( is_used_by_this_cache( fromCache ) ) {
-                    if ( fs::exists( destination ) ) {
-                        // Check if our destination is outdated
-                        if ( !ifNewer ||
-                             ( ifNewer &&
-                               ( fs::last_write_time( destination ) <
-                                       fs::last_write_time( fromCache ) ) ) ) {
-                            // Copy from cache
-                            if ( overwrite ) {
-                                copy_overwrite_file( fromCache, destination );
-                            } else {
-                                fs::copy_file( fromCache, destination );
-                            }
-                        } else {
-                            message( "File has same or older timestamp." );
-                            //throw fs::filesystem_error( std::string( "Original file has same or older timestamp as destination." ), fromCache, destination, boost::system::errc::file_exists  );
-                        }
-                    } else {
-                        copy_overwrite_file( fromCache, destination );
-                    }
-                } else {
-                    message( "File is not registered in this cache instance" );
-                    //throw( fs::filesystem_error() );
-                }
 
-                return destination;
-            }
-        } catch ( fs::filesystem_error ) {
-            // Anything goes wrong we play it safe and return the unalterted path
-            message( "Could not copy file '" + fromCache.string() + "' back to '" + destination.string() + "'" );
-        }
+    template< typename Traits >
+    void BasicFileCache< Traits >::progressive( uintmax_t megaByteThreshold )
+    {
+        WriteGuard guard( mutex_ );
 
-        return fromCache;
+        if ( megaByteThreshold ) {
+            cacheProgressive_[ cacheLocation_ ] = megaByteThreshold * 1000000;
+        } else {
+            cacheProgressive_.erase( cacheLocation_ );
+        }
     }
 
 
-    std::string FileCache::uncacheFile( const std::string& fromCache, bool overwrite, bool ifNewer )
+    template< typename Traits >
+    std::streamsize BasicFileCache< Traits >::readFile( const fs::path& file, uintmax_t offset, char* buffer, std::size_t size )
     {
-        WriteGuard guard( mutex_ );
+        boost::scoped_ptr< SourceFile > reader( openFile( file ) );
+
+        if ( !reader ) {
+            return -1;
+        }
 
-        return uncacheFile( fs::path( fromCache ) ).string();
+        return reader->read( offset, buffer, size );
     }
 
 
-    void FileCache::init_cache( const fs::path& where, bool activate )
+    template< typename Traits >
+    SourceFile* BasicFileCache< Traits >::openFile( const fs::path& file )
     {
-        // Current working directory -- needs to be stored per class instance
-        cwd_ = fs::current_path();
+        SourceFile* reader( 0 );
+        boost::shared_ptr< SourceBackend > backend( local_backend() );
 
-        if ( where.empty() ) {
-            char* env( std::getenv( "FILECACHE_LOCATION" ) );
+        {
+            WriteGuard guard( mutex_ );
 
             try {
-                if ( env ) {
-                    cacheLocation_ = env;
-                }
+                if ( cache_ ) {
+                    fs::path source( resolve_link( file ) );
 
-                if ( cacheLocation_.empty() ) {
-                    //throw( fs::filesystem_error() );
+                    if ( is_remote( source ) ) {
+                        fs::path destination( cached_file_path( source ) );
+
+                        backend = source_for( source );
+
+                        if ( uses_compression( source ) ) {
+                            destination = compressed_file_path( destination );
+                        } else {
+                            // A large miss is read while it is being filled
+                            reader = fill_progressively( *backend, source, destination );
+                        }
+
+                        // Reading ranges doesn't pin the file -- the open descriptor keeps it alive
+                        PathIdSet& thisFileInventory( cacheInventory_[ cacheLocation_ ][ ipd::get_current_process_id() ][ reference_ ] );
+                        std::size_t pinned( thisFileInventory.size() );
+
+                        // The entry, or a version of it
+                        fs::path entry( reader ? fs::path() : cache_entry( source, destination ) );
+
+                        if ( !entry.empty() ) {
+                            if ( is_compressed_file( entry ) ) {
+                                CompressedFile* compressed( new CompressedFile( entry ) );
+
+                                if ( compressed->valid() ) {
+                                    reader = compressed;
+                                } else {
+                                    delete compressed;
+                                }
+                            } else {
+                                reader = local_backend()->open( entry );
+                            }
+
+                            if ( thisFileInventory.size() > pinned ) {
+                                thisFileInventory.erase( paths_.intern( entry.string() ) );
+                            }
+                        }
+                    }
                 }
             } catch ( fs::filesystem_error ) {
-                cacheLocation_ = "/var/tmp/_cache";
+                message( "File '" + file.string() + "' was not cached." );
             }
-        } else {
-            cacheLocation_ = where;
         }
 
-        char* size( getenv( "FILECACHE_SIZE" ) );
+        if ( !reader ) {
+            // Worst case: read the original
+            reader = backend->open( file );
+        }
 
-        if ( size ) {
-            cacheSize_[ cacheLocation_ ] = boost::lexical_cast< intmax_t >( size );
+        return reader;
+    }
+
+
+    template< typename Traits >
+    void BasicFileCache< Traits >::peers( const std::string& peers )
+    {
+        WriteGuard guard( mutex_ );
+
+        boost::shared_ptr< PeerClient > client( new PeerClient( peers ) );
+
+        if ( client->empty() ) {
+            cachePeers_.erase( cacheLocation_ );
         } else {
-            cacheSize_[ cacheLocation_ ] = 0;
+            cachePeers_[ cacheLocation_ ] = client;
         }
+    }
 
-        processName_ = get_process_name();
 
-        if ( create_full_path( cacheLocation_ ) ) {
-            if ( is_remote( cacheLocation_ ) ) {
-                // Caching is useless if the cache itself is remote
-                cache_ = false;
-                log_ = false;
-            } else {
-                cache_ = activate;
-                log_ = true;
-            }
+    template< typename Traits >
+    void BasicFileCache< Traits >::writeBack( const std::string& server, const std::string& codec )
+    {
+        WriteGuard guard( mutex_ );
+
+        boost::shared_ptr< WriteBackClient > client( new WriteBackClient( server, codec ) );
+
+        if ( client->valid() ) {
+            cacheWriteBack_[ cacheLocation_ ] = client;
         } else {
-            message( "Could not create cache location '" + cacheLocation_.string() + "'" );
-            cache_ = false;
-            log_ = true;
+            cacheWriteBack_.erase( cacheLocation_ );
         }
+    }
 
-        // Create a unique reference_ id for this instance under this process
-        ipd::OS_process_id_t id( ipd::get_current_process_id() );
 
-        do {
-            reference_ = random();
-        } while ( instanceCounter_[ id ].end() != instanceCounter_[ id ].find( reference_ ) );
+    template< typename Traits >
+    CacheStats BasicFileCache< Traits >::stats() const
+    {
+        boost::mutex::scoped_lock lock( statsMutex_ );
 
-        // Register this instance
-        instanceCounter_[ id ].insert( reference_ );
-        cacheInventory_[ cacheLocation_ ][ id ][ reference_ ] = std::set< fs::path >();
+        PathStatsMap::const_iterator it( cacheStats_.find( cacheLocation_ ) );
+
+        return cacheStats_.end() == it ? CacheStats() : it->second;
     }
 
 
-    void FileCache::relocate_cache( const fs::path& where )
+    template< typename Traits >
+    CacheStats BasicFileCache< Traits >::processStats()
     {
-        if ( cacheLocation_ != where ) {
-            erase_this_reference();
+        boost::mutex::scoped_lock lock( statsMutex_ );
 
-            cacheLocation_ = where;
+        CacheStats result;
+
+        for ( PathStatsMap::const_iterator it( cacheStats_.begin() ); it != cacheStats_.end(); ++it ) {
+            result += it->second;
+        }
+
+        return result;
+    }
+
+
+    template< typename Traits >
+    void BasicFileCache< Traits >::statsFile( const fs::path& file, unsigned interval )
+    {
+        boost::mutex::scoped_lock lock( statsMutex_ );
+
+        statsFile_ = file.string();
+        statsInterval_ = interval;
+    }
+
+
+    template< typename Traits >
+    void BasicFileCache< Traits >::traceFile( const fs::path& file )
+    {
+        std::string name( file.string() );
+        boost::algorithm::replace_all( name, "%p", boost::lexical_cast< std::string >( getpid() ) );
+
+        if ( !tracer_.open( name ) && !name.empty() ) {
+            std::cerr << "[FileCache] Could not trace to '" << name << "'" << std::endl;
+        }
+    }
+
+
+    template< typename Traits >
+    void BasicFileCache< Traits >::addSource( const boost::shared_ptr< SourceBackend >& backend )
+    {
+        WriteGuard guard( mutex_ );
+
+        cacheSources_[ cacheLocation_ ].push_back( backend );
+    }
+
+
+    template< typename Traits >
+    fs::path BasicFileCache< Traits >::cacheFile( const fs::path& toCache )
+    {
+        FILECACHE_SPAN( "cacheFile" );
+
+        if ( cache_ ) {
+            ScratchArena::Scope scope;
+
+            PathId id;
+            const char* hit( cached_hit( toCache.string().c_str(), toCache.string().size(), id ) );
+
+            if ( hit ) {
+                return fs::path( hit, fs::no_check );
+            }
+        }
+
+        WriteGuard guard( mutex_ );
+
+        return cache_file( toCache );
+    }
+
+
+    template< typename Traits >
+    std::string BasicFileCache< Traits >::cacheFile( const std::string& toCache )
+    {
+        std::string result;
+
+        cacheFile( toCache.c_str(), result );
+
+        return result;
+    }
+
+
+    template< typename Traits >
+    bool BasicFileCache< Traits >::cacheFile( const char* toCache, std::string& result )
+    {
+        FILECACHE_SPAN( "cacheFile" );
+
+        if ( cache_ ) {
+            ScratchArena::Scope scope;
+
+            PathId id;
+            const char* hit( cached_hit( toCache, strlen( toCache ), id ) );
+
+            if ( hit ) {
+                result.assign( hit );
+                return true;
+            }
+        }
+
+        WriteGuard guard( mutex_ );
+
+        result = cache_file( fs::path( toCache ) ).string();
+
+        return result != toCache;
+    }
+
+
+    template< typename Traits >
+    const char* BasicFileCache< Traits >::cacheFileInterned( const char* toCache )
+    {
+        FILECACHE_SPAN( "cacheFile" );
+
+        if ( cache_ ) {
+            ScratchArena::Scope scope;
+
+            PathId id;
+
+            if ( cached_hit( toCache, strlen( toCache ), id ) ) {
+                return paths_.c_str( id );
+            }
+        }
+
+        WriteGuard guard( mutex_ );
+
+        fs::path result( cache_file( fs::path( toCache ) ) );
+
+        if ( result.string() == toCache ) {
+            return toCache;
+        }
+
+        return paths_.c_str( paths_.intern( result.string() ) );
+    }
+
+
+    /**
+     * Cache a file the general way, with our lock held
+     *
+     */
+    template< typename Traits >
+    fs::path BasicFileCache< Traits >::cache_file( const fs::path& toCache )
+    {
+        try {
+            if ( cache_ ) {
+                StopWatch watch;
+                fs::path source( resolve_link( toCache ) );
+
+                fs::path result( toCache );
+
+                outcome_ = TraceRecord::LOCAL;
+
+                if ( is_remote( source ) ) {
+                    fs::path destination( cached_file_path( source ) );
+                    fs::path cached;
+
+                    if ( uses_compression( source ) ) {
+                        // Callers need a plain file -- decompress the stored entry next to it
+                        fs::path stored( cache_entry( source, compressed_file_path( destination ) ) );
+
+                        if ( !stored.empty() ) {
+                            // Next to a version if that is what is stored
+                            cached = materialize_file( stored, fs::change_extension( stored, "" ) );
+                        }
+                    } else {
+                        cached = cache_entry( source, destination );
+                    }
+
+                    if ( !cached.empty() ) {
+                        result = cached;
+                    } else if ( TraceRecord::HIT == outcome_ || TraceRecord::MISS == outcome_ ) {
+                        outcome_ = TraceRecord::FAILED;
+                    }
+
+                    if ( predictor_ ) {
+                        read_ahead( source );
+                    }
+                } else {
+                    // It's a local file
+                    DEBUGMSG( "Ignoring '" + source.string() + "' since it is a local file" );
+                }
+
+                record_latency( &CacheStats::cacheFileLatency, watch );
+                dump_stats( false );
+
+                if ( tracer_.enabled() ) {
+                    double seconds( watch.seconds() );
+                    SourceStats original;
+                    uintmax_t size( 0 );
+
+                    // Stat the cached file if there is one, the original is expensive
+                    if ( result != toCache ) {
+                        size = fs::file_size( result );
+                    } else if ( TraceRecord::LOCAL != outcome_ && source_stats( source, original ) ) {
+                        size = original.size;
+                    }
+
+                    trace( TraceRecord::CACHE, outcome_, cached_file_path( source ), size, seconds );
+                }
+
+                return result;
+            }
+        } catch ( fs::filesystem_error ) {
+            // Anything goes wrong we play it safe and return the unalterted path
+            message( "File '" + toCache.string() + "' was not cached." );
+        }
+
+        DEBUGMSG( "CacheDeactivated '" + toCache.string() + "' ignored" );
+
+        return toCache;
+    }
+
+
+    template< typename Traits >
+    std::size_t BasicFileCache< Traits >::cacheDirectory( const fs::path& directory, bool recursive )
+    {
+        FILECACHE_SPAN( "cacheDirectory" );
+
+        WriteGuard guard( mutex_ );
+
+        try {
+            if ( cache_ ) {
+                std::vector< fs::path > files;
+
+                if ( collect_files( directory.has_root_directory() ? directory : cwd_ / directory, 0, recursive, files ) ) {
+                    std::size_t cached( cache_set( files ) );
+
+                    dump_stats( false );
+
+                    return cached;
+                }
+            }
+        } catch ( fs::filesystem_error ) {
+            message( "Directory '" + directory.string() + "' was not cached." );
+        }
+
+        return 0;
+    }
+
+
+    template< typename Traits >
+    std::size_t BasicFileCache< Traits >::cacheDirectory( const std::string& directory, bool recursive )
+    {
+        return cacheDirectory( fs::path( directory, fs::no_check ), recursive );
+    }
+
+
+    template< typename Traits >
+    fs::path BasicFileCache< Traits >::cachePattern( const fs::path& pattern )
+    {
+        FILECACHE_SPAN( "cachePattern" );
+
+        WriteGuard guard( mutex_ );
+
+        try {
+            if ( cache_ ) {
+                fs::path absolute( pattern.has_root_directory() ? pattern : cwd_ / pattern );
+                FilePattern names( absolute.leaf() );
+                std::vector< fs::path > files;
+
+                if ( collect_files( absolute.branch_path(), &names, false, files ) && !files.empty() ) {
+                    // Linked files are cached under their targets' names, which the pattern doesn't match
+                    bool linked( false );
+
+                    for ( std::vector< fs::path >::const_iterator it( files.begin() ); it != files.end() && !linked; ++it ) {
+                        linked = Traits::RESOLVE_SYMLINKS && is_symlink( *it );
+                    }
+
+                    std::vector< fs::path > used;
+                    bool complete( cache_set( files, &used ) == files.size() );
+
+                    dump_stats( false );
+
+                    if ( complete && !linked ) {
+                        fs::path cached( name_set( cached_file_path( absolute ), used ) );
+
+                        if ( !cached.empty() ) {
+                            return cached;
+                        }
+                    }
+                }
+            }
+        } catch ( fs::filesystem_error ) {
+            message( "Pattern '" + pattern.string() + "' was not cached." );
+        }
+
+        return pattern;
+    }
+
+
+    template< typename Traits >
+    std::string BasicFileCache< Traits >::cachePattern( const std::string& pattern )
+    {
+        return cachePattern( fs::path( pattern, fs::no_check ) ).string();
+    }
+
+
+    /**
+     * Name a set of cached files by one pattern
+     *
+     * The pattern inside the cache only matches entry names. If versions
+     * stand in for some pinned entries, all files of the set are hard
+     * linked under their entry's name with a tag of the versions appended,
+     * so the tagged pattern matches them instead. All instances using the
+     * same versions find the same links; unused links are evicted like
+     * entries.
+     *
+     * @param  pattern  the pattern inside the cache
+     * @param  used     the cached files of the set
+     *
+     * @return  the pattern matching the files, an empty path if there is none
+     */
+    template< typename Traits >
+    fs::path BasicFileCache< Traits >::name_set( const fs::path& pattern, const std::vector< fs::path >& used )
+    {
+        std::vector< std::string > versions;
+
+        for ( std::vector< fs::path >::const_iterator it( used.begin() ); it != used.end(); ++it ) {
+            std::string name( it->leaf() );
+
+            if ( std::string::npos != name.find( "%%" ) ) {
+                versions.push_back( name );
+            }
+        }
+
+        if ( versions.empty() ) {
+            return pattern;
+        }
+
+        std::sort( versions.begin(), versions.end() );
+
+        // Unlike version_path()'s tags, this one doesn't start with a digit
+        std::string tag( "%%set" + boost::lexical_cast< std::string >( boost::hash_range( versions.begin(), versions.end() ) ) );
+
+        for ( std::vector< fs::path >::const_iterator it( used.begin() ); it != used.end(); ++it ) {
+            std::string name( it->leaf() );
+            fs::path link( it->branch_path() / ( name.substr( 0, name.find( "%%" ) ) + tag ) );
+
+            if ( ::link( it->string().c_str(), link.string().c_str() ) ) {
+                if ( EEXIST != errno ) {
+                    return fs::path();
+                }
+
+                // Linked to an entry that was refreshed since
+                if ( !fs::equivalent( *it, link ) ) {
+                    if ( is_used( link ) ) {
+                        return fs::path();
+                    }
+
+                    fs::remove( link );
+
+                    if ( ::link( it->string().c_str(), link.string().c_str() ) ) {
+                        return fs::path();
+                    }
+                }
+            }
+
+            register_file( link );
+        }
+
+        return fs::path( pattern.string() + tag, fs::no_check );
+    }
+
+
+    template< typename Traits >
+    fs::path BasicFileCache< Traits >::cacheFileForWriting( const fs::path& toCache )
+    {
+        WriteGuard guard( mutex_ );
+
+        if ( cache_ ) {
+            fs::path source( resolve_link( toCache ) );
+
+            fs::path result;
+
+            if ( is_remote( source ) ) {
+                fs::path destination( cached_file_path( source ) );
+
+                // Does the file exist?
+                if ( fs::exists( destination ) ) {
+                    // Is it used by another process?
+                    if ( is_used( destination ) ) {
+                        // We can't allow writing to a file that is being used
+                        DEBUGMSG( "RegisterInCache '" + destination.string() + "' exists in cache and is being used" );
+                        result = source;
+                    } else {
+                        // Destination exists but is not -- mark it
+                        DEBUGMSG( "RegisterInCache '" + destination.string() + "' exists in cache but is not being used" );
+                        register_file( destination );
+                        result = destination;
+                    }
+                } else {
+                    // Destination doesn't exist
+                    result = destination;
+                }
+            } else {
+                DEBUGMSG( "Ignoring local file '" + source.string() + "'" );
+                result = source;
+            }
+
+            return result;
+        }
+
+        return toCache;
+    }
+
+
+    template< typename Traits >
+    std::string BasicFileCache< Traits >::cacheFileForWriting( const std::string& toCache )
+    {
+        return cacheFileForWriting( fs::path( toCache ) ).string();
+    }
+
+
+    template< typename Traits >
+    fs::path BasicFileCache< Traits >::uncacheFile( const fs::path& fromCache, bool overwrite, bool ifNewer )
+    {
+        FILECACHE_SPAN( "uncacheFile" );
+
+        fs::path destination( original_file_path( fromCache ) );
+
+        WriteGuard guard( mutex_ );
+
+        try {
+            if ( cache_ ) {
+                if ( is_used_by_this_cache( fromCache ) ) {
+                    if ( fs::exists( destination ) ) {
+                        // Check if our destination is outdated
+                        if ( !ifNewer ||
+                             ( ifNewer &&
+                               ( fs::last_write_time( destination ) <
+                                       fs::last_write_time( fromCache ) ) ) ) {
+                            // Copy from cache
+                            copy_back( fromCache, destination, overwrite );
+                        } else {
+                            message( "File has same or older timestamp." );
+                            //throw fs::filesystem_error( std::string( "Original file has same or older timestamp as destination." ), fromCache, destination, boost::system::errc::file_exists  );
+                        }
+                    } else {
+                        copy_back( fromCache, destination, true );
+                    }
+                } else {
+                    message( "File is not registered in this cache instance" );
+                    //throw( fs::filesystem_error() );
+                }
+
+                return destination;
+            }
+        } catch ( fs::filesystem_error ) {
+            // Anything goes wrong we play it safe and return the unalterted path
+            message( "Could not copy file '" + fromCache.string() + "' back to '" + destination.string() + "'" );
+        }
+
+        return fromCache;
+    }
+
+
+    template< typename Traits >
+    std::string BasicFileCache< Traits >::uncacheFile( const std::string& fromCache, bool overwrite, bool ifNewer )
+    {
+        return uncacheFile( fs::path( fromCache ), overwrite, ifNewer ).string();
+    }
+
+
+    template< typename Traits >
+    void BasicFileCache< Traits >::init_cache( const fs::path& where, bool activate )
+    {
+        // Current working directory -- needs to be stored per class instance
+        cwd_ = fs::current_path();
+
+        if ( where.empty() ) {
+            char* env( std::getenv( "FILECACHE_LOCATION" ) );
+
+            try {
+                if ( env ) {
+                    cacheLocation_ = env;
+                }
+
+                if ( cacheLocation_.empty() ) {
+                    //throw( fs::filesystem_error() );
+                }
+            } catch ( fs::filesystem_error ) {
+                cacheLocation_ = "/var/tmp/_cache";
+            }
+        } else {
+            cacheLocation_ = where;
+        }
+
+        update_prefix();
+
+        char* size( getenv( "FILECACHE_SIZE" ) );
+
+        if ( size ) {
+            cacheSize_[ cacheLocation_ ] = boost::lexical_cast< intmax_t >( size );
+        } else {
+            cacheSize_[ cacheLocation_ ] = 0;
+        }
+
+        char* keepFree( getenv( "FILECACHE_KEEP_FREE" ) );
+        char* keepFreePercent( getenv( "FILECACHE_KEEP_FREE_PERCENT" ) );
+
+        if ( ( keepFree || keepFreePercent ) && !cacheFreeSpace_.count( cacheLocation_ ) ) {
+            FreeSpace& space( cacheFreeSpace_[ cacheLocation_ ] );
+            space.keep = keepFree ? boost::lexical_cast< uintmax_t >( keepFree ) * 1000000 : 0;
+            space.keepPercent = keepFreePercent ? boost::lexical_cast< unsigned >( keepFreePercent ) : 0;
+        }
+
+        char* codec( getenv( "FILECACHE_COMPRESSION" ) );
+
+        if ( codec ) {
+            CompressionPolicy policy;
+            policy.codec = CompressionPolicy::codec_from_name( codec );
+
+            char* threshold( getenv( "FILECACHE_COMPRESSION_SIZE" ) );
+            char* extensions( getenv( "FILECACHE_COMPRESSION_EXTENSIONS" ) );
+
+            if ( threshold ) {
+                policy.threshold = boost::lexical_cast< uintmax_t >( threshold ) * 1000000;
+            }
+
+            if ( extensions ) {
+                policy.extensions_from_list( extensions );
+            }
+
+            if ( CODEC_NONE != policy.codec ) {
+                cacheCompression_[ cacheLocation_ ] = policy;
+            }
+        }
+
+        char* peers( getenv( "FILECACHE_PEERS" ) );
+
+        if ( peers && !cachePeers_.count( cacheLocation_ ) ) {
+            boost::shared_ptr< PeerClient > client( new PeerClient( peers ) );
+
+            if ( !client->empty() ) {
+                cachePeers_[ cacheLocation_ ] = client;
+            }
+        }
+
+        char* remote( getenv( "FILECACHE_REMOTE" ) );
+
+        if ( remote && !cacheSources_.count( cacheLocation_ ) ) {
+            boost::shared_ptr< SourceBackend > backend( new LocalBackend( remote ) );
+
+            char* latency( getenv( "FILECACHE_REMOTE_LATENCY" ) );
+            char* bandwidth( getenv( "FILECACHE_REMOTE_BANDWIDTH" ) );
+
+            if ( latency || bandwidth ) {
+                backend.reset( new ThrottledBackend( backend,
+                                                     latency ? boost::lexical_cast< double >( latency ) / 1000 : 0,
+                                                     bandwidth ? boost::lexical_cast< double >( bandwidth ) * 1000000 : 0 ) );
+            }
+
+            cacheSources_[ cacheLocation_ ].push_back( backend );
+        }
+
+        char* eviction( getenv( "FILECACHE_EVICTION" ) );
+        EvictionPolicy policy;
+
+        if ( eviction && !cacheEviction_.count( cacheLocation_ ) && eviction_policy_from_name( eviction, policy ) ) {
+            cacheEviction_[ cacheLocation_ ] = policy;
+        }
+
+        char* admission( getenv( "FILECACHE_ADMISSION" ) );
+        char* admissionLimit( getenv( "FILECACHE_ADMISSION_LIMIT" ) );
+        AdmissionFilter filter( ADMIT_ALL );
+
+        if ( ( admission || admissionLimit ) && !cacheAdmission_.count( cacheLocation_ ) &&
+             ( !admission || admission_filter_from_name( admission, filter ) ) ) {
+            boost::mutex::scoped_lock lock( statsMutex_ );
+
+            AdmissionPolicy& policy( cacheAdmission_[ cacheLocation_ ] );
+            policy.filter = filter;
+            policy.maxPercent = admissionLimit ? boost::lexical_cast< unsigned >( admissionLimit ) : 0;
+        }
+
+        char* bypass( getenv( "FILECACHE_BYPASS" ) );
+
+        if ( bypass && boost::lexical_cast< unsigned >( bypass ) ) {
+            boost::mutex::scoped_lock lock( statsMutex_ );
+
+            cacheBypass_[ cacheLocation_ ];
+        }
+
+        char* delta( getenv( "FILECACHE_DELTA" ) );
+
+        if ( delta && !cacheDelta_.count( cacheLocation_ ) ) {
+            uintmax_t threshold( boost::lexical_cast< uintmax_t >( delta ) );
+
+            if ( threshold ) {
+                cacheDelta_[ cacheLocation_ ] = threshold * 1000000;
+            }
+        }
+
+        char* progressive( getenv( "FILECACHE_PROGRESSIVE" ) );
+
+        if ( progressive && !cacheProgressive_.count( cacheLocation_ ) ) {
+            uintmax_t threshold( boost::lexical_cast< uintmax_t >( progressive ) );
+
+            if ( threshold ) {
+                cacheProgressive_[ cacheLocation_ ] = threshold * 1000000;
+            }
+        }
+
+        char* writeBack( getenv( "FILECACHE_WRITEBACK" ) );
+
+        if ( writeBack && !cacheWriteBack_.count( cacheLocation_ ) ) {
+            char* writeBackCodec( getenv( "FILECACHE_WRITEBACK_CODEC" ) );
+            boost::shared_ptr< WriteBackClient > client( new WriteBackClient( writeBack, writeBackCodec ? writeBackCodec : "lz4" ) );
+
+            if ( client->valid() ) {
+                cacheWriteBack_[ cacheLocation_ ] = client;
+            }
+        }
+
+        {
+            boost::mutex::scoped_lock lock( statsMutex_ );
+
+            // Locations show up in dumps even before they are used
+            cacheStats_[ cacheLocation_ ];
+
+            char* stats( getenv( "FILECACHE_STATS" ) );
+
+            if ( stats && statsFile_.empty() ) {
+                char* interval( getenv( "FILECACHE_STATS_INTERVAL" ) );
+
+                statsFile_ = stats;
+                statsInterval_ = interval ? boost::lexical_cast< unsigned >( interval ) : 60;
+            }
+        }
+
+        char* trace( getenv( "FILECACHE_TRACE" ) );
+
+        if ( trace && !tracer_.enabled() ) {
+            traceFile( trace );
+        }
+
+        char* readAhead( getenv( "FILECACHE_READAHEAD" ) );
+
+        if ( readAhead && boost::lexical_cast< unsigned >( readAhead ) ) {
+            predictor_.reset( new SequencePredictor( boost::lexical_cast< unsigned >( readAhead ) ) );
+            prefetcher_.reset( new Prefetcher( boost::bind( &BasicFileCache::prefetch_file, this, _1, true ) ) );
+        }
+
+        if ( cacheBypass_.count( cacheLocation_ ) ) {
+            copier_.reset( new Prefetcher( boost::bind( &BasicFileCache::prefetch_file, this, _1, false ) ) );
+        }
+
+        char* spans( getenv( "FILECACHE_TRACE_SPANS" ) );
+
+        if ( spans && !SpanTracer::enabled() ) {
+            SpanTracer::enable( spans );
+        }
+
+        processName_ = get_process_name();
+
+        if ( create_full_path( cacheLocation_ ) ) {
+            if ( is_remote( cacheLocation_ ) ) {
+                // Caching is useless if the cache itself is remote
+                cache_ = false;
+                log_ = false;
+            } else {
+                cache_ = activate;
+                log_ = true;
+            }
+        } else {
+            message( "Could not create cache location '" + cacheLocation_.string() + "'" );
+            cache_ = false;
+            log_ = true;
+        }
+
+        if ( cache_ && !cacheRevalidators_.count( cacheLocation_ ) ) {
+            char* revalidate( getenv( "FILECACHE_REVALIDATE" ) );
+
+            if ( revalidate && !cacheRevalidate_.count( cacheLocation_ ) ) {
+                char* rate( getenv( "FILECACHE_REVALIDATE_RATE" ) );
+
+                cacheRevalidate_[ cacheLocation_ ] = boost::lexical_cast< unsigned >( revalidate );
+                cacheRevalidateRate_[ cacheLocation_ ] = rate ? boost::lexical_cast< unsigned >( rate ) : 0;
+            }
+
+            // Also resumes revalidation paused when the last instance went
+            if ( cacheRevalidate_.count( cacheLocation_ ) ) {
+                boost::shared_ptr< Revalidator > none;
+
+                start_revalidator( cacheRevalidate_[ cacheLocation_ ], cacheRevalidateRate_[ cacheLocation_ ], none );
+            }
+        }
+
+        register_instance();
+    }
+
+
+    template< typename Traits >
+    void BasicFileCache< Traits >::register_instance()
+    {
+        // Create a unique reference_ id for this instance under this process
+        ipd::OS_process_id_t id( ipd::get_current_process_id() );
+
+        do {
+            reference_ = random();
+        } while ( instanceCounter_[ id ].end() != instanceCounter_[ id ].find( reference_ ) );
+
+        outcome_ = TraceRecord::LOCAL;
+
+        // Register this instance
+        instanceCounter_[ id ].insert( reference_ );
+        cacheInventory_[ cacheLocation_ ][ id ][ reference_ ] = PathIdSet();
+    }
+
+
+    template< typename Traits >
+    void BasicFileCache< Traits >::relocate_cache( const fs::path& where )
+    {
+        if ( cacheLocation_ != where ) {
+            erase_this_reference();
+
+            cacheLocation_ = where;
+            update_prefix();
 
             if ( create_full_path( cacheLocation_ ) ) {
                 if ( is_remote( cacheLocation_ ) ) {
@@ -513,333 +1441,2463 @@ namespace Jupiter {
                     cache_ = false;
                 }
             } else {
-                message( "Could not create cache location '" + cacheLocation_.string() + "'" );
-                cache_ = false;
+                message( "Could not create cache location '" + cacheLocation_.string() + "'" );
+                cache_ = false;
+            }
+
+            // Register this instance at the new location
+            ipd::OS_process_id_t id( ipd::get_current_process_id() );
+
+            instanceCounter_[ id ].insert( reference_ );
+            cacheInventory_[ cacheLocation_ ][ id ][ reference_ ] = PathIdSet();
+        }
+    }
+
+
+    template< typename Traits >
+    void BasicFileCache< Traits >::update_prefix()
+    {
+        cachePrefix_ = cacheLocation_.string();
+
+        if ( cachePrefix_.empty() || '/' != cachePrefix_[ cachePrefix_.size() - 1 ] ) {
+            cachePrefix_ += '/';
+        }
+    }
+
+
+    template< typename Traits >
+    void BasicFileCache< Traits >::erase_this_reference()
+    {
+        ipd::OS_process_id_t id( ipd::get_current_process_id() );
+
+        std::set< unsigned >::const_iterator referenceIt( instanceCounter_[ id ].find( reference_ ) );
+
+        if ( instanceCounter_[ id ].end() != referenceIt ) {
+            instanceCounter_[ id ].erase( referenceIt );
+        }
+
+        ReferenceInventory::iterator inventoryIt( cacheInventory_[ cacheLocation_ ][ id ].find( reference_ ) );
+
+        if ( cacheInventory_[ cacheLocation_ ][ id ].end() != inventoryIt ) {
+            cacheInventory_[ cacheLocation_ ][ id ].erase( inventoryIt );
+        }
+    }
+
+
+    template< typename Traits >
+    void BasicFileCache< Traits >::copy_overwrite_file( const fs::path& source, const fs::path& destination ) const
+    {
+        if ( fs::exists( destination ) ) {
+            fs::remove( destination );
+        }
+
+        fs::copy_file( source, destination );
+    }
+
+
+    /**
+     * Copy a file from the cache back to its origin
+     *
+     * Goes through the write-back server if there is one, so the data crosses
+     * the network compressed.
+     */
+    template< typename Traits >
+    void BasicFileCache< Traits >::copy_back( const fs::path& fromCache, const fs::path& destination, bool overwrite ) const
+    {
+        PathWriteBackMap::const_iterator it( cacheWriteBack_.find( cacheLocation_ ) );
+        boost::shared_ptr< WriteBackClient > server( cacheWriteBack_.end() != it ? it->second : boost::shared_ptr< WriteBackClient >() );
+
+        {
+            // The file is ours -- nothing evicts it while the lock is released
+            Unlocked unlocked;
+
+            if ( server && server->store( fromCache, destination, overwrite ) ) {
+                DEBUGMSG( "WroteBack '" + destination.string() + "'" );
+            } else if ( overwrite ) {
+                copy_overwrite_file( fromCache, destination );
+            } else {
+                fs::copy_file( fromCache, destination );
+            }
+        }
+
+        count( &CacheStats::bytesOut, fs::file_size( fromCache ) );
+        dump_stats( false );
+    }
+
+
+    /**
+     * Queue the files predicted to follow a request for prefetching
+     *
+     */
+    template< typename Traits >
+    void BasicFileCache< Traits >::read_ahead( const fs::path& source )
+    {
+        std::vector< fs::path > predicted;
+        predictor_->observe( source, predicted );
+
+        for ( std::vector< fs::path >::const_iterator it( predicted.begin() ); it != predicted.end(); ++it ) {
+            // Skip what is obviously cached already, the prefetcher checks the rest
+            if ( !fs::exists( cached_file_path( *it ) ) ) {
+                prefetcher_->enqueue( *it );
+            }
+        }
+    }
+
+
+    /**
+     * Copy a file to the cache ahead of time, on the prefetcher's thread
+     *
+     * Our lock is only held while the cache is looked at, not during the
+     * copy. The copy goes to a temporary name first: a cacheFile() call for
+     * the same file in the meantime copies it itself and wins.
+     *
+     * @param  prefetch  whether the file was predicted, rather than bypassed
+     *                   and copied for its next request
+     */
+    template< typename Traits >
+    void BasicFileCache< Traits >::prefetch_file( const fs::path& source, bool prefetch )
+    {
+        FILECACHE_SPAN( "prefetch_file" );
+
+        try {
+            boost::shared_ptr< SourceBackend > backend;
+
+            {
+                WriteGuard guard( mutex_ );
+
+                if ( cache_ ) {
+                    backend = source_for( source );
+                }
+            }
+
+            SourceStats stats;
+            StopWatch answer;
+
+            // Frames past the end of the sequence simply don't exist
+            if ( !backend || !backend->stat( source, stats ) || stats.directory ) {
+                return;
+            }
+
+            double statSeconds( answer.seconds() );
+
+            fs::path entry, partial;
+            Codec codec( CODEC_NONE );
+
+            {
+                WriteGuard guard( mutex_ );
+
+                entry = cached_file_path( source );
+
+                PathCompressionMap::const_iterator compression( cacheCompression_.find( cacheLocation_ ) );
+
+                if ( cacheCompression_.end() != compression && compression->second.applies( source, stats.size ) ) {
+                    entry = compressed_file_path( entry );
+                    codec = compression->second.codec;
+                }
+
+                if ( fs::exists( entry ) || is_copying( entry ) || !tidy_up_cache( stats.size ) ) {
+                    return;
+                }
+
+                partial = partial_file_path( entry, "prefetch" );
+            }
+
+            StopWatch watch;
+
+            if ( !transfer( *backend, source, stats, partial, codec ) ) {
+                return;
+            }
+
+            if ( CODEC_NONE == codec ) {
+                record_source( *backend, statSeconds, stats.size, watch.seconds() );
+            }
+
+            WriteGuard guard( mutex_ );
+
+            if ( fs::exists( entry ) || rename( partial.string().c_str(), entry.string().c_str() ) ) {
+                fs::remove( partial );
+                return;
+            }
+
+            record_latency( &CacheStats::copyLatency, watch );
+            count( &CacheStats::bytesIn, stats.size );
+
+            if ( !prefetch ) {
+                return;
+            }
+
+            count( &CacheStats::prefetches );
+
+            boost::mutex::scoped_lock lock( statsMutex_ );
+
+            prefetched_.insert( paths_.intern( entry.string() ) );
+        } catch ( ... ) {
+            message( ( prefetch ? "Prefetching '" : "Copying in the background '" ) + source.string() + "' failed" );
+        }
+    }
+
+
+    template< typename Traits >
+    fs::path BasicFileCache< Traits >::cached_file_path( const fs::path& toCache ) const
+    {
+
+        fs::path tmpPath;
+
+        if ( toCache.has_root_directory() ) {
+            tmpPath = toCache;
+        } else {
+            tmpPath = cwd_ / toCache; // Prepend by current working dir
+        }
+
+        const std::string& name( tmpPath.string() );
+        std::string entry( cachePrefix_.size() + Traits::entry_length( name.size() ), '\0' );
+
+        entry.resize( entry_name( name.data(), name.size(), &entry[ 0 ] ) );
+
+        return fs::path( entry, fs::no_check );
+    }
+
+
+    /**
+     * Write the name of the cache entry of an absolute path
+     *
+     * The entry is named by Traits::entry_name(), in the cache directory.
+     *
+     * @param  entry  receives the name, not terminated; must have room for
+     *                cachePrefix_ and Traits::entry_length() of the source
+     *
+     * @return  the length of the name
+     */
+    template< typename Traits >
+    std::size_t BasicFileCache< Traits >::entry_name( const char* source, std::size_t length, char* entry ) const
+    {
+        memcpy( entry, cachePrefix_.data(), cachePrefix_.size() );
+
+        return cachePrefix_.size() + Traits::entry_name( source, length, entry + cachePrefix_.size() );
+    }
+
+
+    /**
+     * Transform cached locations back to the source.
+     *
+     * @return  the original path name
+     */
+    template< typename Traits >
+    fs::path BasicFileCache< Traits >::original_file_path( const fs::path& fromCache ) const
+    {
+
+        // Strip any path in front of file name (the "leaf").
+        return fs::path( Traits::source_name( fromCache.leaf() ) );
+    }
+
+
+    /**
+     * Get a cached location for write caching.
+     *
+     * @return  the cached path if cache was true, toCache otherwise
+     */
+    template< typename Traits >
+    fs::path BasicFileCache< Traits >::cached_file_name( const fs::path& toCache ) const
+    {
+        if ( cache_ ) {
+            try {
+                return cached_file_path( toCache );
+            } catch ( fs::filesystem_error ) {
+                // Anything goes wrong we play it safe and return the unalterted path.
+                message( "Could not form valid cache file name from '" + toCache.string() + "'" );
+            }
+        }
+
+        return toCache;
+    }
+
+
+    template< typename Traits >
+    bool BasicFileCache< Traits >::is_remote( const fs::path& toCache ) const
+    {
+        FILECACHE_SPAN( "is_remote" );
+
+        return 0 != source_for( resolve_link( toCache ) );
+    }
+
+
+    /**
+     * Find the backend of a (symlink resolved) file
+     *
+     * @return  the backend if the file is to be cached, null otherwise
+     */
+    template< typename Traits >
+    boost::shared_ptr< SourceBackend > BasicFileCache< Traits >::source_for( const fs::path& source ) const
+    {
+        return source_for( source.string().c_str() );
+    }
+
+
+    template< typename Traits >
+    boost::shared_ptr< SourceBackend > BasicFileCache< Traits >::source_for( const char* source ) const
+    {
+        PathSourceMap::const_iterator it( cacheSources_.find( cacheLocation_ ) );
+        boost::shared_ptr< SourceBackend > backend;
+
+        if ( cacheSources_.end() != it ) {
+            for ( std::vector< boost::shared_ptr< SourceBackend > >::const_iterator b( it->second.begin() ); b != it->second.end() && !backend; ++b ) {
+                if ( ( *b )->handles( source ) ) {
+                    backend = *b;
+                }
+            }
+        }
+
+        if ( !backend && nfs_backend()->handles( source ) ) {
+            backend = nfs_backend();
+        }
+
+        if ( !Traits::is_remote( source, 0 != backend ) ) {
+            return boost::shared_ptr< SourceBackend >();
+        }
+
+        return backend ? backend : local_backend();
+    }
+
+
+    /**
+     * Get a file's size and modification time from its backend
+     *
+     * @return  true if the file exists, false otherwise
+     */
+    template< typename Traits >
+    bool BasicFileCache< Traits >::source_stats( const fs::path& source, SourceStats& stats ) const
+    {
+        boost::shared_ptr< SourceBackend > backend( source_for( source ) );
+
+        return ( backend ? backend : local_backend() )->stat( source, stats );
+    }
+
+
+    template< typename Traits >
+    bool BasicFileCache< Traits >::is_different( const fs::path& toCache, const fs::path& destination, const SourceStats* known ) const
+    {
+        FILECACHE_SPAN( "is_different" );
+
+        // Compressed entries know the size of their original
+        uintmax_t size( is_compressed_file( destination ) ? CompressedFile( destination ).size() : fs::file_size( destination ) );
+
+        if ( known ) {
+            return Traits::is_different( size, fs::last_write_time( destination ), *known );
+        }
+
+        SourceStats original;
+        PathId id;
+
+        // Checked in the background recently
+        if ( paths_.find( destination.string(), id ) && revalidated( id, original ) ) {
+            return Traits::is_different( size, fs::last_write_time( destination ), original );
+        }
+
+        // An original we can't ask about is never the same
+        return !source_stats( toCache, original ) || Traits::is_different( size, fs::last_write_time( destination ), original );
+    }
+
+
+    /**
+     * Check if the location stores a file compressed
+     *
+     */
+    template< typename Traits >
+    bool BasicFileCache< Traits >::uses_compression( const fs::path& source ) const
+    {
+        PathCompressionMap::const_iterator it( cacheCompression_.find( cacheLocation_ ) );
+        SourceStats stats;
+
+        return cacheCompression_.end() != it && source_stats( source, stats ) && it->second.applies( source, stats.size );
+    }
+
+
+    /**
+     * Path of the compressed entry of a cached file
+     *
+     */
+    template< typename Traits >
+    fs::path BasicFileCache< Traits >::compressed_file_path( const fs::path& cached ) const
+    {
+        return fs::path( cached.string() + ".jfcz", fs::no_check );
+    }
+
+
+    template< typename Traits >
+    bool BasicFileCache< Traits >::is_compressed_file( const fs::path& path ) const
+    {
+        return ".jfcz" == fs::extension( path );
+    }
+
+
+    /**
+     * Query whether this instance uses an entry, without adding to the inventory
+     *
+     */
+    template< typename Traits >
+    bool BasicFileCache< Traits >::is_used_by_this_cache( PathId id ) const
+    {
+        Inventory::const_iterator location( cacheInventory_.find( cacheLocation_ ) );
+
+        if ( cacheInventory_.end() == location ) {
+            return false;
+        }
+
+        ProcessInventory::const_iterator process( location->second.find( ipd::get_current_process_id() ) );
+
+        if ( location->second.end() == process ) {
+            return false;
+        }
+
+        ReferenceInventory::const_iterator instance( process->second.find( reference_ ) );
+
+        return process->second.end() != instance && instance->second.count( id );
+    }
+
+
+    template< typename Traits >
+    bool BasicFileCache< Traits >::is_used_by_this_cache( const fs::path& path ) const
+    {
+        PathIdSet& thisCache( cacheInventory_[ cacheLocation_ ][ ipd::get_current_process_id() ][ reference_ ] );
+        PathId id;
+
+        return( paths_.find( path.string(), id ) && thisCache.count( id ) );
+    }
+
+
+    template< typename Traits >
+    bool BasicFileCache< Traits >::is_used( const fs::path& path ) const
+    {
+        PathId id;
+
+        // A path that was never interned isn't in any instance's inventory
+        if ( !paths_.find( path.string(), id ) ) {
+            return false;
+        }
+
+        const ProcessInventory& thisProcessInventory( cacheInventory_[ cacheLocation_ ] );
+
+        for ( ProcessInventory::const_iterator it( thisProcessInventory.begin() ); it != thisProcessInventory.end(); ++it ) {
+            const ReferenceInventory& thisReferenceInventory( it->second );
+
+            for ( ReferenceInventory::const_iterator jt( thisReferenceInventory.begin() ); jt != thisReferenceInventory.end(); ++jt ) {
+                if ( jt->second.count( id ) ) {
+                    return true;
+                }
+            }
+        }
+
+        /*for( processInventory::const_iterator it( thisInventory.begin() ); it != thisInventory.end(); ++it ) {
+        	//if( it->second.end() != it->second.find( path ) ) {
+        	if( it->second.count( path ) ) {
+        		return true;
+        	}
+        }*/
+        return false;
+    }
+
+
+    template< typename Traits >
+    void BasicFileCache< Traits >::register_file( const fs::path& path )
+    {
+        register_file( paths_.intern( path.string() ) );
+    }
+
+
+    template< typename Traits >
+    void BasicFileCache< Traits >::register_file( PathId id )
+    {
+        // Register the file for the current process
+        cacheInventory_[ cacheLocation_ ][ ipd::get_current_process_id() ][ reference_ ].insert( id );
+    }
+
+
+    /**
+     * Register a file served from the cache
+     *
+     */
+    template< typename Traits >
+    void BasicFileCache< Traits >::register_hit( const fs::path& entry )
+    {
+        register_hit( paths_.intern( entry.string() ) );
+    }
+
+
+    template< typename Traits >
+    void BasicFileCache< Traits >::register_hit( PathId id )
+    {
+        register_file( id );
+        count( &CacheStats::hits );
+
+        boost::mutex::scoped_lock lock( statsMutex_ );
+
+        record_request( id );
+
+        if ( prefetched_.erase( id ) ) {
+            ++cacheStats_[ cacheLocation_ ].prefetchHits;
+        }
+    }
+
+
+    /**
+     * Serve a cache hit without allocating
+     *
+     * Only handles the common case: an absolute path that isn't a symlink, at
+     * a location that doesn't compress, whose entry is known to the path table
+     * and current. Everything else, and an instance that reads ahead or
+     * traces, is left to cache_file(). Nothing is counted unless the hit is
+     * served.
+     * @par
+     * Takes our lock itself: shared for the lookups, not at all while the
+     * original is asked, and exclusively only to register the hit.
+     *
+     * @param  id  receives the entry's id in paths_
+     *
+     * @return  the entry, in the thread's scratch arena, or 0
+     */
+    template< typename Traits >
+    const char* BasicFileCache< Traits >::cached_hit( const char* source, std::size_t length, PathId& id )
+    {
+        if ( !length || '/' != source[ 0 ] || predictor_ || tracer_.enabled() ) {
+            return 0;
+        }
+
+        StopWatch watch;
+        struct stat link;
+
+        // Symlinks are resolved by cache_file()
+        if ( Traits::RESOLVE_SYMLINKS && ( lstat( source, &link ) || S_ISLNK( link.st_mode ) ) ) {
+            return 0;
+        }
+
+        char* entry( ScratchArena::local().allocate( cachePrefix_.size() + Traits::entry_length( length ) + 1 ) );
+        std::size_t entryLength( entry_name( source, length, entry ) );
+        entry[ entryLength ] = '\0';
+
+        struct stat cached;
+
+        if ( !paths_.find( entry, entryLength, id ) || ::stat( entry, &cached ) ) {
+            return 0;
+        }
+
+        boost::shared_ptr< SourceBackend > backend;
+        SourceStats original;
+        bool used, known;
+
+        {
+            ReadGuard guard( mutex_ );
+
+            if ( cacheCompression_.count( cacheLocation_ ) ) {
+                return 0;
+            }
+
+            backend = source_for( source );
+
+            // As in entry_state(): an entry this instance uses is current, any other is compared to the original
+            used = is_used_by_this_cache( id );
+            known = used || revalidated( id, original );
+        }
+
+        // The original may be behind a slow mount, nobody waits for our lock meanwhile
+        if ( !backend || ( !known && !backend->stat( source, original ) ) ||
+             ( !used && Traits::is_different( cached.st_size, cached.st_mtime, original ) ) ) {
+            return 0;
+        }
+
+        WriteGuard guard( mutex_ );
+
+        struct stat current;
+
+        // Evicted or replaced while we didn't hold the lock
+        if ( ::stat( entry, &current ) || current.st_ino != cached.st_ino || current.st_mtime != cached.st_mtime ||
+             current.st_size != cached.st_size ) {
+            return 0;
+        }
+
+        register_hit( id );
+        outcome_ = TraceRecord::HIT;
+
+        record_latency( &CacheStats::cacheFileLatency, watch );
+        dump_stats( false );
+
+        return entry;
+    }
+
+
+    /**
+     * Check whether a cache entry can be used for a file
+     *
+     * An entry this instance already uses is always current.
+     *
+     * @param  original  the original's stats if they are known already, the
+     *                   source is asked otherwise
+     */
+    template< typename Traits >
+    FileCacheBase::EntryState BasicFileCache< Traits >::entry_state( const fs::path& source, const fs::path& destination, const SourceStats* original ) const
+    {
+        // Does the file exist?
+        if ( fs::exists( destination ) ) {
+            // Is it used by another process?
+            if ( is_used( destination ) ) {
+                // Is it the same as the original?
+                if ( !is_different( source, destination, original ) || is_used_by_this_cache( destination ) ) {
+                    // Best case: destination exists, is used but not different
+                    DEBUGMSG( "RegisterInCache '" + destination.string() + "' exists in cache and is equal to original or different but already used by this cache instance" );
+                    return ENTRY_CURRENT;
+                }
+
+                /* If we ended up here the file
+                 * is outdated but used elsewhere,
+                 * so we can't update the cache :|
+                 */
+                return ENTRY_STALE_PINNED;
+            } else if ( is_different( source, destination, original ) ) {
+                // Destination already exists and isn't used but it is different
+                DEBUGMSG( "Copy2Cache '" + destination.string() + "' exists in cache and is not used but different to original '" + source.string() + "'" );
+            } else {
+                // Best case: destination exists, is not used nor different
+                DEBUGMSG( "RegisterInCache '" + destination.string() + "' exists in cache and is equal to original '" + source.string() + "'" );
+                return ENTRY_CURRENT;
+            }
+        } else {
+            // Destination doesn't exist
+            DEBUGMSG( "RegisterInCache '" + destination.string() + "' does not exist in cache" );
+        }
+
+        return ENTRY_OUTDATED;
+    }
+
+
+    /**
+     * Find or create the cache entry for a file
+     *
+     * Does not replace an outdated entry if it is used by another cache
+     * instance.
+     *
+     * @return  the entry if successful, an empty path otherwise
+     */
+    template< typename Traits >
+    fs::path BasicFileCache< Traits >::cache_entry( const fs::path& source, const fs::path& destination )
+    {
+        switch ( entry_state( source, destination ) ) {
+            case ENTRY_CURRENT:
+                register_hit( destination );
+                outcome_ = TraceRecord::HIT;
+                return destination;
+
+            case ENTRY_STALE_PINNED: {
+                fs::path version( cache_version( source, destination, ENTRY_STALE_PINNED ) );
+
+                if ( version.empty() ) {
+                    count( &CacheStats::stalePinned );
+                    outcome_ = TraceRecord::STALE_PINNED;
+                }
+
+                return version;
+            }
+
+            default: {
+                fs::path version( cache_version( source, destination, ENTRY_OUTDATED ) );
+
+                if ( !version.empty() ) {
+                    return version;
+                }
+
+                break;
+            }
+        }
+
+        // Being filled for a reader already
+        if ( join_fill( destination ) ) {
+            register_hit( destination );
+            outcome_ = TraceRecord::HIT;
+            return destination;
+        }
+
+        count( &CacheStats::misses );
+        outcome_ = TraceRecord::MISS;
+
+        if ( copy_to_cache( source, destination, destination ) == destination ) {
+            return destination;
+        }
+
+        return fs::path();
+    }
+
+
+    /**
+     * Use or create a version of an outdated entry
+     *
+     * Versions are named by the original's modification time and size (see
+     * version_path()), so all instances find the same one without a listing.
+     * While the entry is pinned elsewhere, the version is copied or reused.
+     * Once the entry is free, a current version nobody else uses replaces it;
+     * a pinned version keeps being served until it is released, too.
+     *
+     * @param  state  the entry's state, ENTRY_STALE_PINNED or ENTRY_OUTDATED
+     *
+     * @return  the entry to use if one was found or created, an empty path
+     *          if the caller should fall back
+     */
+    template< typename Traits >
+    fs::path BasicFileCache< Traits >::cache_version( const fs::path& source, const fs::path& destination, EntryState state )
+    {
+        SourceStats original;
+
+        if ( !source_stats( source, original ) ) {
+            return fs::path();
+        }
+
+        fs::path version( version_path( destination, original ) );
+
+        if ( fs::exists( version ) && ENTRY_CURRENT == entry_state( source, version ) ) {
+            if ( ENTRY_STALE_PINNED == state || is_used( version ) ) {
+                register_hit( version );
+                outcome_ = TraceRecord::HIT;
+                return version;
+            }
+
+            // Neither is in use anymore -- the version becomes the entry, replacing the old one
+            fs::rename( version, destination );
+
+            if ( fs::exists( checksum_file_path( version ) ) ) {
+                fs::rename( checksum_file_path( version ), checksum_file_path( destination ) );
+            } else if ( fs::exists( checksum_file_path( destination ) ) ) {
+                fs::remove( checksum_file_path( destination ) );
+            }
+
+            if ( is_compressed_file( version ) ) {
+                // Its decompressed copy is recreated next to the entry
+                fs::path decompressed( fs::change_extension( version, "" ) );
+
+                if ( fs::exists( decompressed ) && !is_used( decompressed ) ) {
+                    fs::remove( decompressed );
+                }
+            }
+
+            register_hit( destination );
+            outcome_ = TraceRecord::HIT;
+            return destination;
+        }
+
+        if ( ENTRY_STALE_PINNED != state ) {
+            // The entry itself can be updated
+            return fs::path();
+        }
+
+        count( &CacheStats::misses );
+        count( &CacheStats::versions );
+        outcome_ = TraceRecord::MISS;
+
+        if ( copy_to_cache( source, version, destination ) == version ) {
+            DEBUGMSG( "CacheVersion '" + version.string() + "' cached next to the pinned '" + destination.string() + "'" );
+            return version;
+        }
+
+        return fs::path();
+    }
+
+
+    /**
+     * The name of an entry's version matching an original
+     *
+     * Entry names never contain "%%" -- a path has no empty elements. A
+     * compressed entry keeps its extension.
+     */
+    template< typename Traits >
+    fs::path BasicFileCache< Traits >::version_path( const fs::path& entry, const SourceStats& original ) const
+    {
+        std::string name( entry.string() );
+        std::string tag( "%%" + boost::lexical_cast< std::string >( original.mtime ) + "-" + boost::lexical_cast< std::string >( original.size ) );
+
+        if ( is_compressed_file( entry ) ) {
+            name.insert( name.size() - fs::extension( entry ).size(), tag );
+        } else {
+            name += tag;
+        }
+
+        return fs::path( name, fs::no_check );
+    }
+
+
+    /**
+     * Decompress a compressed cache entry next to it
+     *
+     * The decompressed file is reused as long as it isn't older than the
+     * entry.
+     *
+     * @return  the decompressed file if successful, an empty path otherwise
+     */
+    template< typename Traits >
+    fs::path BasicFileCache< Traits >::materialize_file( const fs::path& stored, const fs::path& destination )
+    {
+        if ( fs::exists( destination ) ) {
+            if ( fs::last_write_time( destination ) >= fs::last_write_time( stored ) ) {
+                register_file( destination );
+                return destination;
+            }
+
+            if ( is_used( destination ) ) {
+                // An outdated decompressed copy is still in use elsewhere
+                return fs::path();
+            }
+
+            fs::remove( destination );
+        }
+
+        CompressedFile compressed( stored );
+
+        if ( compressed.valid() && tidy_up_cache( compressed.size() ) && compressed.decompress( destination ) ) {
+            DEBUGMSG( "Decompressed '" + stored.string() + "' to '" + destination.string() + "'" );
+            register_file( destination );
+            return destination;
+        }
+
+        message( "Decompressing '" + stored.string() + "' failed" );
+
+        return fs::path();
+    }
+
+
+    /**
+     * Physically copy a file to the cache
+     *
+     * @param  base  an older entry of the file to refresh by blocks from, if any
+     *
+     * @return  the cached path if sucessful, the unaltered original path otherwise
+     */
+    template< typename Traits >
+    fs::path BasicFileCache< Traits >::copy_to_cache( const fs::path& toCache, const fs::path& destination, const fs::path& base )
+    {
+        FILECACHE_SPAN( "copy_to_cache" );
+
+        try {
+            // Another thread copied the file meanwhile
+            if ( wait_for_copy( destination ) && fs::exists( destination ) && !is_different( toCache, destination ) ) {
+                register_file( destination );
+                return destination;
+            }
+
+            boost::shared_ptr< SourceBackend > backend( source_for( toCache ) );
+            SourceStats stats;
+            StopWatch answer;
+
+            if ( !backend || !backend->stat( toCache, stats ) ) {
+                message( "Original '" + toCache.string() + "' is not available" );
+                return toCache;
+            }
+
+            double statSeconds( answer.seconds() );
+            uintmax_t size( stats.size );
+
+            // A miss is a request, too -- the filters then decide whether it's copied
+            bool filtered( false ), adaptive( false );
+            unsigned maxPercent( 0 );
+
+            {
+                boost::mutex::scoped_lock lock( statsMutex_ );
+
+                PathAdmissionMap::const_iterator admission( cacheAdmission_.find( cacheLocation_ ) );
+
+                if ( cacheAdmission_.end() != admission ) {
+                    filtered = true;
+                    maxPercent = admission->second.maxPercent;
+                }
+
+                adaptive = cacheBypass_.count( cacheLocation_ );
+
+                if ( filtered || adaptive ) {
+                    record_request( paths_.intern( destination.string() ) );
+                }
+            }
+
+            uintmax_t capacity;
+
+            if ( maxPercent && effective_size( capacity ) && ( double )size * 100 > ( double )capacity * maxPercent ) {
+                count( &CacheStats::rejected );
+                return toCache;
+            }
+
+            if ( adaptive ) {
+                switch ( bypass_decision( *backend, destination, size ) ) {
+                    case BYPASS_BACKGROUND:
+                        if ( copier_ ) {
+                            copier_->enqueue( toCache );
+                            count( &CacheStats::backgroundCopies );
+                            return toCache;
+                        }
+
+                        // Fall through -- this instance can't copy in the background
+                    case BYPASS_ORIGINAL:
+                        count( &CacheStats::bypassed );
+                        return toCache;
+
+                    default:
+                        break;
+                }
+            }
+
+            // A delta refresh reads the old copy, making room must leave it alone
+            boost::scoped_ptr< Copying > pinned( base.empty() ? 0 : new Copying( paths_.intern( base.string() ) ) );
+
+            if ( tidy_up_cache( size, filtered ? destination : fs::path() ) ) {
+                StopWatch watch;
+
+                if ( filtered ) {
+                    count( &CacheStats::admitted );
+                }
+
+                Codec codec( is_compressed_file( destination ) ? cacheCompression_[ cacheLocation_ ].codec : CODEC_NONE );
+                // Checksums are only worth writing if the source can be asked for its own
+                bool delta( CODEC_NONE == codec && uses_delta( size ) && backend->checksummed() );
+                bool refreshed( false ), copied( false ), summed( false );
+
+                fs::path partial( partial_file_path( destination, "copying" ) );
+                BlockSums checksums;
+
+                {
+                    // Requests for the file wait for us, the others go on meanwhile
+                    Copying copying( paths_.intern( destination.string() ) );
+
+                    {
+                        Unlocked unlocked;
+
+                        refreshed = delta && !base.empty() && delta_transfer( *backend, toCache, stats, base, destination );
+                        copied = refreshed || transfer( *backend, toCache, stats, partial, codec );
+                        summed = copied && !refreshed && delta && LocalBackend().checksums( partial, BlockSums::BLOCK_SIZE, checksums );
+                    }
+
+                    if ( !copied || ( !refreshed && rename( partial.string().c_str(), destination.string().c_str() ) ) ) {
+                        if ( fs::exists( partial ) ) {
+                            fs::remove( partial );
+                        }
+
+                        return toCache;
+                    }
+                }
+
+                record_latency( &CacheStats::copyLatency, watch );
+
+                if ( refreshed ) {
+                    register_file( destination );
+                    return destination;
+                }
+
+                count( &CacheStats::bytesIn, size );
+
+                if ( CODEC_NONE == codec ) {
+                    record_source( *backend, statSeconds, size, watch.seconds() );
+                }
+
+                // Checksums of an earlier copy describe what was overwritten
+                fs::path sums( checksum_file_path( destination ) );
+
+                if ( delta ) {
+                    if ( !summed || !checksums.save( sums ) ) {
+                        message( "Checksumming '" + destination.string() + "' failed" );
+                    }
+                } else if ( fs::exists( sums ) ) {
+                    fs::remove( sums );
+                }
+
+                register_file( destination );
+                return destination;
+            }
+
+            // Cache was full and/or couldn't be tidied up enough...
+        } catch ( ... ) {
+            // Anything goes wrong we play it safe and return the unalterted path
+            message( "Copying '" + toCache.string() + "' to '" + destination.string() + "' failed" );
+        }
+
+        return toCache;
+    }
+
+
+    /**
+     * Refresh an entry by the blocks that changed on the source
+     *
+     * Needs checksums of @c base written after it, and checksums of the
+     * source from its backend. @c base is only read; the new entry is built
+     * next to the destination and renamed over it. Runs without our lock.
+     *
+     * @return  true if successful, false if the caller should copy the whole file
+     */
+    template< typename Traits >
+    bool BasicFileCache< Traits >::delta_transfer( const SourceBackend& backend, const fs::path& toCache, const SourceStats& stats, const fs::path& base, const fs::path& destination )
+    {
+        fs::path baseSumsPath( checksum_file_path( base ) );
+        BlockSums baseSums, sourceSums;
+
+        // Checksums older than the entry belong to a copy that was overwritten since
+        if ( !fs::exists( base ) || !baseSums.load( baseSumsPath ) || baseSums.size != fs::file_size( base ) ||
+             fs::last_write_time( baseSumsPath ) < fs::last_write_time( base ) ||
+             !backend.checksums( toCache, baseSums.blockSize, sourceSums ) || sourceSums.size != stats.size ) {
+            return false;
+        }
+
+        boost::scoped_ptr< SourceFile > source( backend.open( toCache ) );
+
+        if ( !source ) {
+            return false;
+        }
+
+        fs::path target( partial_file_path( destination, "delta" ) );
+        uintmax_t fetched;
+
+        if ( !delta_copy( *source, sourceSums, base, baseSums, target, fetched ) ) {
+            message( "Refreshing '" + destination.string() + "' by blocks failed" );
+            return false;
+        }
+
+        fs::rename( target, destination );
+
+        if ( !sourceSums.save( checksum_file_path( destination ) ) ) {
+            message( "Checksumming '" + destination.string() + "' failed" );
+        }
+
+        DEBUGMSG( "DeltaRefresh '" + destination.string() + "' fetched " + boost::lexical_cast< std::string >( fetched ) + " bytes" );
+
+        count( &CacheStats::bytesIn, fetched );
+        count( &CacheStats::deltaRefreshes );
+        count( &CacheStats::deltaSavedBytes, stats.size - fetched );
+
+        return true;
+    }
+
+
+    /**
+     * Check if the location refreshes files of a size by blocks
+     *
+     */
+    template< typename Traits >
+    bool BasicFileCache< Traits >::uses_delta( uintmax_t size ) const
+    {
+        PathSizeMap::const_iterator it( cacheDelta_.find( cacheLocation_ ) );
+
+        return cacheDelta_.end() != it && size >= it->second;
+    }
+
+
+    /**
+     * Path of the block checksums of a cache entry
+     *
+     */
+    template< typename Traits >
+    fs::path BasicFileCache< Traits >::checksum_file_path( const fs::path& entry ) const
+    {
+        return fs::path( entry.string() + ".jfcs", fs::no_check );
+    }
+
+
+    template< typename Traits >
+    bool BasicFileCache< Traits >::is_checksum_file( const fs::path& path ) const
+    {
+        return ".jfcs" == fs::extension( path );
+    }
+
+
+    /**
+     * Read a missing entry while it is being copied
+     *
+     * Joins the fill of the entry if one is running in this process, or
+     * starts one if the entry is missing and the file is large enough.
+     *
+     * @return  a reader of the fill, to be deleted by the caller, or 0 if the
+     *          entry should be cached as usual
+     */
+    template< typename Traits >
+    SourceFile* BasicFileCache< Traits >::fill_progressively( const SourceBackend& backend, const fs::path& source, const fs::path& destination )
+    {
+        // Held while a fill is started, so only one instance starts it
+        boost::mutex::scoped_lock lock( fillsMutex_ );
+
+        for ( FillMap::iterator it( fills_.begin() ); it != fills_.end(); ) {
+            if ( destination.string() == it->first && !it->second->finished() ) {
+                return ProgressiveFill::reader( it->second );
+            }
+
+            // Finished fills go once nobody reads them any more
+            if ( it->second->finished() ) {
+                fills_.erase( it++ );
+            } else {
+                ++it;
+            }
+        }
+
+        if ( !cacheProgressive_.count( cacheLocation_ ) || fs::exists( destination ) ) {
+            return 0;
+        }
+
+        SourceStats stats;
+
+        if ( !backend.stat( source, stats ) || stats.directory || !uses_progressive( stats.size ) || !tidy_up_cache( stats.size ) ) {
+            return 0;
+        }
+
+        SourceFile* original( backend.open( source ) );
+
+        if ( !original ) {
+            return 0;
+        }
+
+        fs::path partial( partial_file_path( destination, "filling" ) );
+        boost::shared_ptr< ProgressiveFill > fill( new ProgressiveFill( original, stats.size, partial, destination ) );
+
+        fills_[ destination.string() ] = fill;
+
+        DEBUGMSG( "FillProgressively '" + destination.string() + "'" );
+
+        count( &CacheStats::misses );
+        count( &CacheStats::progressiveFills );
+        count( &CacheStats::bytesIn, stats.size );
+        outcome_ = TraceRecord::MISS;
+
+        return ProgressiveFill::reader( fill );
+    }
+
+
+    /**
+     * Wait for the fill of an entry, if one is running in this process
+     *
+     * @return  true if the entry was filled, false if there was no fill or it failed
+     */
+    template< typename Traits >
+    bool BasicFileCache< Traits >::join_fill( const fs::path& destination )
+    {
+        boost::shared_ptr< ProgressiveFill > fill;
+
+        {
+            boost::mutex::scoped_lock lock( fillsMutex_ );
+
+            FillMap::const_iterator it( fills_.find( destination.string() ) );
+
+            if ( fills_.end() == it ) {
+                return false;
+            }
+
+            fill = it->second;
+        }
+
+        return fill->wait() && fs::exists( destination );
+    }
+
+
+    template< typename Traits >
+    bool BasicFileCache< Traits >::uses_progressive( uintmax_t size ) const
+    {
+        PathSizeMap::const_iterator it( cacheProgressive_.find( cacheLocation_ ) );
+
+        return cacheProgressive_.end() != it && size >= it->second;
+    }
+
+
+    /**
+     * Path an entry is written to before it is renamed into place
+     *
+     * Every process and thread gets a name of its own, so nobody ever writes
+     * to another's partial file: the entry, the kind, the process and the
+     * thread id. The writers create it exclusively.
+     *
+     * @param  kind  the extension naming the writer, e.g. "copying"
+     */
+    template< typename Traits >
+    fs::path BasicFileCache< Traits >::partial_file_path( const fs::path& entry, const char* kind ) const
+    {
+        std::ostringstream name;
+        name << entry.string() << '.' << kind << '-' << getpid() << '-' << boost::this_thread::get_id();
+
+        return fs::path( name.str(), fs::no_check );
+    }
+
+
+    /**
+     * Query whether a file in the cache is an entry still being written
+     *
+     * Progressive fills, copies, prefetches and background copies, delta and
+     * revalidation refreshes each write next to the entry under their own
+     * extension, see partial_file_path(), and rename the file when done.
+     */
+    template< typename Traits >
+    bool BasicFileCache< Traits >::is_partial_file( const fs::path& path ) const
+    {
+        static const char* const kinds[] = { ".filling", ".copying", ".prefetch", ".delta", ".refresh" };
+
+        std::string extension( fs::extension( path ) );
+
+        for ( std::size_t i( 0 ); i < sizeof( kinds ) / sizeof( *kinds ); ++i ) {
+            std::size_t length( strlen( kinds[ i ] ) );
+
+            // Plain ones were left by earlier versions
+            if ( !extension.compare( 0, length, kinds[ i ] ) && ( extension.size() == length || '-' == extension[ length ] ) ) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+
+    /**
+     * Query whether nobody writes a partial file any more
+     *
+     * Copies of this process are known, as are its progressive fills unless
+     * one is being started right now. Other processes' partial files are
+     * taken for abandoned once they weren't written for PARTIAL_TIMEOUT
+     * seconds.
+     */
+    template< typename Traits >
+    bool BasicFileCache< Traits >::is_abandoned( const fs::path& partial ) const
+    {
+        if ( std::time( 0 ) - fs::last_write_time( partial ) < PARTIAL_TIMEOUT ) {
+            return false;
+        }
+
+        std::string entry( partial.string() );
+        entry.erase( entry.size() - fs::extension( partial ).size() );
+
+        if ( is_copying( fs::path( entry, fs::no_check ) ) ) {
+            return false;
+        }
+
+        // fill_progressively() makes room with the lock held
+        boost::mutex::scoped_lock lock( fillsMutex_, boost::try_to_lock );
+
+        if ( !lock ) {
+            return false;
+        }
+
+        FillMap::const_iterator fill( fills_.find( entry ) );
+
+        return fills_.end() == fill || fill->second->finished();
+    }
+
+
+    template< typename Traits >
+    bool BasicFileCache< Traits >::is_copying( const fs::path& entry ) const
+    {
+        PathId id;
+
+        return paths_.find( entry.string(), id ) && copying_.count( id );
+    }
+
+
+    /**
+     * Wait while another thread copies an entry, see copy_to_cache()
+     *
+     * Our lock is released while waiting.
+     *
+     * @return  true if there was a copy to wait for, false otherwise
+     */
+    template< typename Traits >
+    bool BasicFileCache< Traits >::wait_for_copy( const fs::path& entry )
+    {
+        if ( !is_copying( entry ) ) {
+            return false;
+        }
+
+        do {
+            copied_.wait( mutex_ );
+        } while ( is_copying( entry ) );
+
+        return true;
+    }
+
+
+    /**
+     * Replace the location's revalidator
+     *
+     * The revalidator works on a worker instance of its own, so it doesn't
+     * depend on this one staying around.
+     *
+     * @param  previous  receives the replaced revalidator, to be destroyed
+     *                   by the caller once our lock is released
+     */
+    template< typename Traits >
+    void BasicFileCache< Traits >::start_revalidator( unsigned interval, unsigned rate, boost::shared_ptr< Revalidator >& previous )
+    {
+        PathRevalidatorMap::iterator it( cacheRevalidators_.find( cacheLocation_ ) );
+
+        if ( cacheRevalidators_.end() != it ) {
+            previous = it->second;
+            cacheRevalidators_.erase( it );
+        }
+
+        if ( !interval ) {
+            cacheRevalidate_.erase( cacheLocation_ );
+            cacheRevalidateRate_.erase( cacheLocation_ );
+            return;
+        }
+
+        cacheRevalidate_[ cacheLocation_ ] = interval;
+        cacheRevalidateRate_[ cacheLocation_ ] = rate;
+
+        boost::shared_ptr< BasicFileCache > worker( new BasicFileCache( *this, WORKER ) );
+
+        cacheRevalidators_[ cacheLocation_ ].reset( new Revalidator( boost::bind( &BasicFileCache::revalidate_entries, worker, rate ), interval ) );
+    }
+
+
+    /**
+     * Check the originals of the entries in use, on the revalidator's thread
+     *
+     * The entries checked longest ago go first; with a rate, the pass stops
+     * after as many as the rate allows per interval.
+     */
+    template< typename Traits >
+    void BasicFileCache< Traits >::revalidate_entries( unsigned rate )
+    {
+        FILECACHE_SPAN( "revalidate_entries" );
+
+        std::vector< std::pair< time_t, PathId > > order;
+        std::vector< PendingCopy > checks;
+        std::vector< PathId > ids;
+
+        {
+            WriteGuard guard( mutex_ );
+
+            PathSizeMap::const_iterator interval( cacheRevalidate_.find( cacheLocation_ ) );
+
+            if ( !cache_ || cacheRevalidate_.end() == interval ) {
+                return;
+            }
+
+            // The entries in use in this process are the hot ones
+            PathIdSet hot;
+            const ProcessInventory& thisProcessInventory( cacheInventory_[ cacheLocation_ ] );
+            ProcessInventory::const_iterator process( thisProcessInventory.find( ipd::get_current_process_id() ) );
+
+            if ( thisProcessInventory.end() != process ) {
+                for ( ReferenceInventory::const_iterator it( process->second.begin() ); it != process->second.end(); ++it ) {
+                    for ( std::size_t i( 0 ); i < it->second.size(); ++i ) {
+                        hot.insert( it->second.ids()[ i ] );
+                    }
+                }
+            }
+
+            {
+                boost::mutex::scoped_lock lock( statsMutex_ );
+
+                for ( std::size_t i( 0 ); i < hot.size(); ++i ) {
+                    ValidationMap::const_iterator it( validated_.find( hot.ids()[ i ] ) );
+
+                    order.push_back( std::make_pair( validated_.end() == it ? 0 : it->second.checked, hot.ids()[ i ] ) );
+                }
+            }
+
+            std::sort( order.begin(), order.end() );
+
+            if ( rate && order.size() > ( std::size_t )rate * interval->second ) {
+                order.resize( ( std::size_t )rate * interval->second );
+            }
+
+            for ( std::vector< std::pair< time_t, PathId > >::const_iterator it( order.begin() ); it != order.end(); ++it ) {
+                PendingCopy check;
+                check.entry = fs::path( paths_.path( it->second ), fs::no_check );
+
+                // Versions and decompressed copies follow their entry
+                if ( std::string::npos != check.entry.string().find( "%%" ) ||
+                     ( cacheCompression_.count( cacheLocation_ ) && !is_compressed_file( check.entry ) ) ) {
+                    continue;
+                }
+
+                check.source = original_file_path( is_compressed_file( check.entry ) ? fs::change_extension( check.entry, "" ) : check.entry );
+                check.destination = check.entry;
+                check.codec = is_compressed_file( check.entry ) ? cacheCompression_[ cacheLocation_ ].codec : CODEC_NONE;
+                check.backend = source_for( check.source );
+                check.done = false;
+
+                if ( check.backend ) {
+                    checks.push_back( check );
+                    ids.push_back( it->second );
+                }
+            }
+        }
+
+        // The sources are asked without holding the lock
+        stat_sources( checks );
+
+        time_t now( std::time( 0 ) );
+
+        for ( std::size_t i( 0 ); i < checks.size(); ++i ) {
+            count( &CacheStats::revalidations );
+
+            {
+                boost::mutex::scoped_lock lock( statsMutex_ );
+
+                // The entry was dropped meanwhile and its id may name another one
+                if ( paths_.path( ids[ i ] ) != checks[ i ].entry.string() ) {
+                    continue;
+                }
+
+                if ( checks[ i ].done ) {
+                    Validation& validation( validated_[ ids[ i ] ] );
+                    validation.stats = checks[ i ].stats;
+                    validation.checked = now;
+                } else {
+                    // Gone from the source -- let the next request find out
+                    validated_.erase( ids[ i ] );
+                }
+            }
+
+            try {
+                if ( checks[ i ].done && fs::exists( checks[ i ].entry ) && is_different( checks[ i ].source, checks[ i ].entry, &checks[ i ].stats ) ) {
+                    refresh_entry( checks[ i ] );
+                }
+            } catch ( ... ) {
+                message( "Refreshing '" + checks[ i ].entry.string() + "' failed" );
+            }
+        }
+    }
+
+
+    /**
+     * Copy an updated original to the cache, on the revalidator's thread
+     *
+     * Like a prefetch, the copy goes to a temporary name first and our lock
+     * isn't held during it. An entry nobody uses is replaced, one in use
+     * gets a version next to it.
+     */
+    template< typename Traits >
+    void BasicFileCache< Traits >::refresh_entry( const PendingCopy& check )
+    {
+        fs::path partial;
+
+        {
+            WriteGuard guard( mutex_ );
+
+            fs::path target( is_used( check.entry ) ? version_path( check.entry, check.stats ) : check.entry );
+
+            if ( ( target != check.entry && fs::exists( target ) ) || is_copying( target ) || !tidy_up_cache( check.stats.size ) ) {
+                return;
+            }
+
+            partial = partial_file_path( target, "refresh" );
+        }
+
+        StopWatch watch;
+
+        if ( !transfer( *check.backend, check.source, check.stats, partial, check.codec ) ) {
+            return;
+        }
+
+        WriteGuard guard( mutex_ );
+
+        // Whoever started using the entry meanwhile keeps it
+        fs::path target( is_used( check.entry ) ? version_path( check.entry, check.stats ) : check.entry );
+
+        if ( ( target != check.entry && fs::exists( target ) ) || rename( partial.string().c_str(), target.string().c_str() ) ) {
+            fs::remove( partial );
+            return;
+        }
+
+        // Checksums of the old copy don't describe the new one
+        if ( target == check.entry && fs::exists( checksum_file_path( target ) ) ) {
+            fs::remove( checksum_file_path( target ) );
+        }
+
+        DEBUGMSG( "Refreshed '" + target.string() + "'" );
+
+        record_latency( &CacheStats::copyLatency, watch );
+        count( &CacheStats::bytesIn, check.stats.size );
+        count( &CacheStats::refreshes );
+    }
+
+
+    /**
+     * Look up a recent background check of an entry's original
+     *
+     * @return  true if revalidation is on and the entry's original was found
+     *          and checked less than two intervals ago, false otherwise
+     */
+    template< typename Traits >
+    bool BasicFileCache< Traits >::revalidated( PathId id, SourceStats& original ) const
+    {
+        PathSizeMap::const_iterator interval( cacheRevalidate_.find( cacheLocation_ ) );
+
+        if ( cacheRevalidate_.end() == interval ) {
+            return false;
+        }
+
+        boost::mutex::scoped_lock lock( statsMutex_ );
+
+        ValidationMap::const_iterator it( validated_.find( id ) );
+
+        // A revalidator falling behind is as good as none
+        if ( validated_.end() == it || std::time( 0 ) - it->second.checked > ( time_t )( 2 * interval->second ) ) {
+            return false;
+        }
+
+        original = it->second.stats;
+        return true;
+    }
+
+
+    /**
+     * Get a file into the cache: compressed, from a peer or copied
+     *
+     * This only touches the destination, so several transfers can run at
+     * once. It must not exist; the transfer creates it.
+     *
+     * @return  true if successful, false otherwise
+     */
+    template< typename Traits >
+    bool BasicFileCache< Traits >::transfer( const SourceBackend& backend, const fs::path& toCache, const SourceStats& stats, const fs::path& destination, Codec codec ) const
+    {
+        if ( CODEC_NONE != codec ) {
+            boost::scoped_ptr< SourceFile > source( backend.open( toCache ) );
+
+            if ( !source || !CompressedFile::compress( *source, stats.size, destination, codec ) ) {
+                message( "Compressing '" + toCache.string() + "' to '" + destination.string() + "' failed" );
+                return false;
+            }
+        } else if ( fetch_from_peers( toCache, stats, destination ) ) {
+            count( &CacheStats::peerFetches );
+        } else if ( !backend.copy( toCache, destination ) ) {
+            message( "Copying '" + toCache.string() + "' to '" + destination.string() + "' failed" );
+            return false;
+        }
+
+        return true;
+    }
+
+
+    /**
+     * Try to get a file from another node's cache instead of the original
+     *
+     * @return  true if a peer delivered the file, false otherwise
+     */
+    template< typename Traits >
+    bool BasicFileCache< Traits >::fetch_from_peers( const fs::path& toCache, const SourceStats& stats, const fs::path& destination ) const
+    {
+        boost::shared_ptr< PeerClient > peers;
+
+        {
+            // Transfers run without our lock
+            ReadGuard guard( mutex_ );
+
+            PathPeerMap::const_iterator it( cachePeers_.find( cacheLocation_ ) );
+
+            if ( cachePeers_.end() == it ) {
+                return false;
+            }
+
+            peers = it->second;
+        }
+
+        if ( fs::exists( destination ) ) {
+            fs::remove( destination );
+        }
+
+        // Peers know the file by its entry's name, the destination may be a temporary one
+        std::string name( cached_file_path( toCache ).leaf() );
+
+        if ( peers->fetch( name, stats.size, stats.mtime, destination ) ) {
+            DEBUGMSG( "FetchedFromPeer '" + destination.string() + "'" );
+            return true;
+        }
+
+        return false;
+    }
+
+
+    /**
+     * List the files of a directory on its source
+     *
+     * Without a pattern, every file is listed and subdirectories are
+     * descended into if @c recursive is set. With a pattern, only the names
+     * matching it are listed, without asking the source about each of them.
+     *
+     * @return  true if the directory is remote and could be listed, false otherwise
+     */
+    template< typename Traits >
+    bool BasicFileCache< Traits >::collect_files( const fs::path& directory, const FilePattern* pattern, bool recursive, std::vector< fs::path >& files ) const
+    {
+        boost::shared_ptr< SourceBackend > backend( source_for( directory ) );
+        std::vector< std::string > names;
+
+        if ( !backend || !backend->list( directory, names ) ) {
+            return false;
+        }
+
+        std::vector< PendingCopy > entries;
+
+        for ( std::vector< std::string >::const_iterator it( names.begin() ); it != names.end(); ++it ) {
+            fs::path path( directory / fs::path( *it, fs::no_check ) );
+
+            if ( pattern ) {
+                if ( pattern->matches( *it ) ) {
+                    files.push_back( path );
+                }
+            } else {
+                PendingCopy entry;
+                entry.source = path;
+                entry.backend = backend;
+                entry.codec = CODEC_NONE;
+                entry.done = false;
+                entry.seconds = 0;
+
+                entries.push_back( entry );
             }
+        }
 
-            // Register this instance at the new location
-            ipd::OS_process_id_t id( ipd::get_current_process_id() );
+        // Telling files from directories takes a stat each -- all at once
+        stat_sources( entries );
+
+        for ( std::vector< PendingCopy >::const_iterator it( entries.begin() ); it != entries.end(); ++it ) {
+            if ( !it->done ) {
+                continue;
+            }
+
+            if ( !it->stats.directory ) {
+                files.push_back( it->source );
+            } else if ( recursive ) {
+                collect_files( it->source, 0, true, files );
+            }
+        }
+
+        return true;
+    }
+
+
+    /**
+     * Cache a set of files, copying the missing ones in parallel
+     *
+     * All originals are asked about at once, for revalidating the existing
+     * entries and for planning the copies. Missing files go through the same
+     * admission and bypass decisions as with cacheFile(). Room is made for
+     * all admitted files at once; if they don't fit, or the admission filter
+     * has to weigh each of them against what it would evict, each file makes
+     * room for itself. The copies then run in parallel without our lock.
+     * Entries pinned elsewhere are served from versions, see cache_version().
+     *
+     * @param  used  receives the cached files to use if not null
+     *
+     * @return  the number of files that are in the cache
+     */
+    template< typename Traits >
+    std::size_t BasicFileCache< Traits >::cache_set( const std::vector< fs::path >& files, std::vector< fs::path >* used )
+    {
+        std::vector< PendingCopy > requests, copies;
+        std::vector< std::pair< fs::path, fs::path > > entries;
+
+        for ( std::vector< fs::path >::const_iterator it( files.begin() ); it != files.end(); ++it ) {
+            fs::path source( resolve_link( *it ) );
+
+            if ( !is_remote( source ) ) {
+                continue;
+            }
+
+            PendingCopy copy;
+            copy.source = source;
+            copy.destination = cached_file_path( source );
+            copy.entry = uses_compression( source ) ? compressed_file_path( copy.destination ) : copy.destination;
+            copy.codec = copy.entry != copy.destination ? cacheCompression_[ cacheLocation_ ].codec : CODEC_NONE;
+            copy.backend = source_for( source );
+            copy.done = false;
+            copy.seconds = 0;
+
+            requests.push_back( copy );
+        }
+
+        StopWatch answer;
+
+        stat_sources( requests );
+
+        // They were asked in parallel, each answer took about as long as all
+        double statSeconds( answer.seconds() );
+
+        bool filtered( false ), adaptive( false );
+        unsigned maxPercent( 0 );
+        uintmax_t capacity( 0 );
+
+        {
+            boost::mutex::scoped_lock lock( statsMutex_ );
+
+            PathAdmissionMap::const_iterator admission( cacheAdmission_.find( cacheLocation_ ) );
+
+            if ( cacheAdmission_.end() != admission ) {
+                filtered = true;
+                maxPercent = admission->second.maxPercent;
+            }
+
+            adaptive = cacheBypass_.count( cacheLocation_ );
+        }
+
+        if ( maxPercent && !effective_size( capacity ) ) {
+            maxPercent = 0;
+        }
+
+        for ( std::vector< PendingCopy >::iterator it( requests.begin() ); it != requests.end(); ++it ) {
+            if ( !it->done ) {
+                count( &CacheStats::misses );
+                message( "Original '" + it->source.string() + "' is not available" );
+                continue;
+            }
+
+            switch ( entry_state( it->source, it->entry, &it->stats ) ) {
+                case ENTRY_CURRENT:
+                    register_hit( it->entry );
+                    entries.push_back( std::make_pair( it->entry, it->destination ) );
+                    continue;
+
+                case ENTRY_STALE_PINNED: {
+                    // Served from a version next to the pinned entry, like by cacheFile()
+                    fs::path version( cache_version( it->source, it->entry, ENTRY_STALE_PINNED ) );
+
+                    if ( version.empty() ) {
+                        count( &CacheStats::stalePinned );
+                    } else {
+                        entries.push_back( std::make_pair( version, it->entry == it->destination ? version : fs::change_extension( version, "" ) ) );
+                    }
+
+                    continue;
+                }
+
+                default:
+                    break;
+            }
+
+            count( &CacheStats::misses );
+            it->done = false;
+
+            // Someone else is copying it -- wait for that like cacheFile() does
+            if ( is_copying( it->entry ) ) {
+                if ( copy_to_cache( it->source, it->entry ) == it->entry ) {
+                    entries.push_back( std::make_pair( it->entry, it->destination ) );
+                }
+
+                continue;
+            }
+
+            if ( filtered || adaptive ) {
+                boost::mutex::scoped_lock lock( statsMutex_ );
+                record_request( paths_.intern( it->entry.string() ) );
+            }
+
+            if ( maxPercent && ( double )it->stats.size * 100 > ( double )capacity * maxPercent ) {
+                count( &CacheStats::rejected );
+                continue;
+            }
+
+            if ( adaptive ) {
+                BypassDecision decision( bypass_decision( *it->backend, it->entry, it->stats.size ) );
+
+                if ( BYPASS_BACKGROUND == decision && copier_ ) {
+                    copier_->enqueue( it->source );
+                    count( &CacheStats::backgroundCopies );
+                    continue;
+                }
+
+                if ( BYPASS_COPY != decision ) {
+                    count( &CacheStats::bypassed );
+                    continue;
+                }
+            }
+
+            copies.push_back( *it );
+        }
+
+        if ( !copies.empty() ) {
+            uintmax_t incoming( 0 );
+
+            for ( std::vector< PendingCopy >::const_iterator it( copies.begin() ); it != copies.end(); ++it ) {
+                incoming += it->stats.size;
+            }
+
+            if ( filtered || !tidy_up_cache( incoming ) ) {
+                std::vector< PendingCopy > admitted;
+                incoming = 0;
+
+                // Each one makes room next to the ones before it
+                for ( std::vector< PendingCopy >::const_iterator it( copies.begin() ); it != copies.end(); ++it ) {
+                    if ( tidy_up_cache( incoming + it->stats.size, filtered ? it->entry : fs::path() ) ) {
+                        incoming += it->stats.size;
+                        admitted.push_back( *it );
+
+                        if ( filtered ) {
+                            count( &CacheStats::admitted );
+                        }
+                    }
+                }
+
+                copies.swap( admitted );
+            }
+
+            // Transfer to temporary names, marked as being copied
+            std::vector< fs::path > targets;
+
+            for ( std::vector< PendingCopy >::iterator it( copies.begin() ); it != copies.end(); ++it ) {
+                targets.push_back( it->entry );
+                it->entry = partial_file_path( it->entry, "copying" );
+                copying_.insert( paths_.intern( targets.back().string() ) );
+            }
+
+            try {
+                Unlocked unlocked;
+
+                transfer_sources( copies );
+            } catch ( ... ) {
+                for ( std::size_t i( 0 ); i < copies.size(); ++i ) {
+                    copies[ i ].done = false;
+                }
+            }
+
+            for ( std::size_t i( 0 ); i < copies.size(); ++i ) {
+                PendingCopy& copy( copies[ i ] );
+
+                copying_.erase( copying_.find( paths_.intern( targets[ i ].string() ) ) );
+
+                if ( copy.done && rename( copy.entry.string().c_str(), targets[ i ].string().c_str() ) ) {
+                    copy.done = false;
+                }
+
+                if ( !copy.done ) {
+                    if ( fs::exists( copy.entry ) ) {
+                        fs::remove( copy.entry );
+                    }
+
+                    continue;
+                }
+
+                if ( CODEC_NONE == copy.codec ) {
+                    record_source( *copy.backend, statSeconds, copy.stats.size, copy.seconds );
+                }
+
+                register_file( targets[ i ] );
+                entries.push_back( std::make_pair( targets[ i ], copy.destination ) );
+            }
+
+            copied_.notify_all();
+        }
+
+        std::size_t cached( 0 );
+
+        for ( std::vector< std::pair< fs::path, fs::path > >::const_iterator it( entries.begin() ); it != entries.end(); ++it ) {
+            // Compressed entries are handed out decompressed, like by cacheFile()
+            if ( it->first == it->second || !materialize_file( it->first, it->second ).empty() ) {
+                ++cached;
+
+                if ( used ) {
+                    used->push_back( it->second );
+                }
+            }
+        }
+
+        return cached;
+    }
+
+
+    /**
+     * Stat the originals of a set of files
+     *
+     * Originals of direct() backends are batched on an IoEngine, the others
+     * are asked through their backends on several threads. Sets
+     * PendingCopy::done for each original that exists.
+     */
+    template< typename Traits >
+    void BasicFileCache< Traits >::stat_sources( std::vector< PendingCopy >& copies ) const
+    {
+        std::vector< StatRequest > batch;
+        std::vector< std::size_t > batched, other;
+        std::vector< PendingCopy > others;
+
+        for ( std::size_t i( 0 ); i < copies.size(); ++i ) {
+            if ( copies[ i ].backend && copies[ i ].backend->direct() ) {
+                StatRequest request;
+                request.path = copies[ i ].source.string();
+
+                batch.push_back( request );
+                batched.push_back( i );
+            } else {
+                others.push_back( copies[ i ] );
+                other.push_back( i );
+            }
+        }
+
+        if ( !batch.empty() ) {
+            boost::scoped_ptr< IoEngine > engine( IoEngine::create() );
+            engine->stat( batch );
+
+            for ( std::size_t i( 0 ); i < batch.size(); ++i ) {
+                copies[ batched[ i ] ].done = batch[ i ].done;
+                copies[ batched[ i ] ].stats = batch[ i ].stats;
+            }
+        }
+
+        if ( !others.empty() ) {
+            run_copies( others, true );
+
+            for ( std::size_t i( 0 ); i < others.size(); ++i ) {
+                copies[ other[ i ] ].done = others[ i ].done;
+                copies[ other[ i ] ].stats = others[ i ].stats;
+            }
+        }
+    }
+
+
+    /**
+     * Transfer a set of files to the cache
+     *
+     * Plain copies from direct() backends are batched on an IoEngine; those
+     * to compress, to fetch from peers or to read through their backend are
+     * transferred on several threads. Sets PendingCopy::done for each file
+     * that succeeded.
+     */
+    template< typename Traits >
+    void BasicFileCache< Traits >::transfer_sources( std::vector< PendingCopy >& copies ) const
+    {
+        std::vector< CopyRequest > batch;
+        std::vector< std::size_t > batched, other;
+        std::vector< PendingCopy > others;
+
+        bool peers;
+
+        {
+            // Called without our lock
+            ReadGuard guard( mutex_ );
+            peers = cachePeers_.count( cacheLocation_ );
+        }
+
+        for ( std::size_t i( 0 ); i < copies.size(); ++i ) {
+            if ( CODEC_NONE == copies[ i ].codec && !peers && copies[ i ].backend->direct() ) {
+                CopyRequest request;
+                request.source = copies[ i ].source.string();
+                request.destination = copies[ i ].entry.string();
+
+                batch.push_back( request );
+                batched.push_back( i );
+            } else {
+                others.push_back( copies[ i ] );
+                other.push_back( i );
+            }
+        }
+
+        if ( !batch.empty() ) {
+            boost::scoped_ptr< IoEngine > engine( IoEngine::create() );
+            engine->copy( batch );
+
+            for ( std::size_t i( 0 ); i < batch.size(); ++i ) {
+                PendingCopy& copy( copies[ batched[ i ] ] );
+                copy.done = batch[ i ].done;
+
+                if ( copy.done ) {
+                    copy.seconds = batch[ i ].seconds;
+                    record_latency( &CacheStats::copyLatency, batch[ i ].seconds );
+                    count( &CacheStats::bytesIn, copy.stats.size );
+                } else {
+                    message( "Copying '" + copy.source.string() + "' to '" + copy.entry.string() + "' failed" );
+                }
+            }
+        }
+
+        if ( !others.empty() ) {
+            run_copies( others, false );
+
+            for ( std::size_t i( 0 ); i < others.size(); ++i ) {
+                copies[ other[ i ] ].done = others[ i ].done;
+                copies[ other[ i ] ].seconds = others[ i ].seconds;
+            }
+        }
+    }
+
+
+    /**
+     * Stat (when planning) or transfer a set of files on several threads
+     *
+     * Sets PendingCopy::done for each file that succeeded.
+     */
+    template< typename Traits >
+    void BasicFileCache< Traits >::run_copies( std::vector< PendingCopy >& copies, bool planning ) const
+    {
+        std::size_t next( 0 );
+        boost::mutex nextMutex;
+        boost::thread_group threads;
+
+        for ( std::size_t i( 0 ); i < copies.size() && i < COPY_THREADS; ++i ) {
+            threads.create_thread( boost::bind( &BasicFileCache::copy_worker, this, &copies, &next, &nextMutex, planning ) );
+        }
+
+        threads.join_all();
+    }
+
+
+    /**
+     * Work on planned copies until there are none left
+     */
+    template< typename Traits >
+    void BasicFileCache< Traits >::copy_worker( std::vector< PendingCopy >* copies, std::size_t* next, boost::mutex* nextMutex, bool planning ) const
+    {
+        for ( ;; ) {
+            std::size_t i;
+
+            {
+                boost::mutex::scoped_lock lock( *nextMutex );
+                i = ( *next )++;
+            }
+
+            if ( i >= copies->size() ) {
+                return;
+            }
+
+            PendingCopy& copy( ( *copies )[ i ] );
+
+            if ( planning ) {
+                copy.done = copy.backend && copy.backend->stat( copy.source, copy.stats );
+                continue;
+            }
+
+            StopWatch watch;
+
+            try {
+                copy.done = transfer( *copy.backend, copy.source, copy.stats, copy.entry, copy.codec );
+            } catch ( ... ) {
+                message( "Copying '" + copy.source.string() + "' to '" + copy.entry.string() + "' failed" );
+            }
+
+            if ( copy.done ) {
+                copy.seconds = watch.seconds();
+                record_latency( &CacheStats::copyLatency, copy.seconds );
+                count( &CacheStats::bytesIn, copy.stats.size );
+            }
+        }
+    }
+
+
+    /**
+     * Createas a full path.
+     *
+     * Iteratoes over the path and consecutively creates each directory, if
+     * nonexistant.
+     *
+     * @return  true if successfull, false otherwise
+     */
+    template< typename Traits >
+    bool BasicFileCache< Traits >::create_full_path( const fs::path& createPath ) const
+    {
+        fs::path create;
+
+        try {
+            for ( fs::path::iterator it( createPath.begin() ); it != createPath.end(); ++it ) {
+                create /= *it;
+
+                if ( !fs::exists( create ) )
+                    { fs::create_directory( create ); }
+            }
+
+            return true;
+        } catch ( ... ) {
+            message( "Creating directory '" + createPath.string() + "' failed" );
+        }
+
+        return false;
+    }
+
+
+    /**
+     * Get the last access time of the given file
+     *
+     * @return  the access time if successfull, 0 otherwise
+     */
+    template< typename Traits >
+    time_t BasicFileCache< Traits >::last_access_time( const fs::path& createPath ) const
+    {
+        struct stat fstats;
 
-            instanceCounter_[ id ].insert( reference_ );
-            cacheInventory_[ cacheLocation_ ][ id ][ reference_ ] = std::set< fs::path >();
+        if ( !stat( createPath.string().c_str(), &fstats ) ) {
+            return fstats.st_atime;
         }
+
+        return 0; // January 1, 1970 :)
     }
 
 
-    void FileCache::erase_this_reference()
+    /**
+     * Tidies up the cache inventory by purging all inventory lists whose
+     * processes don't exist anymore
+     *
+     */
+    template< typename Traits >
+    void BasicFileCache< Traits >::tidy_up_inventory()
     {
+        ProcessInventory& thisInventory( cacheInventory_[ cacheLocation_ ] );
         ipd::OS_process_id_t id( ipd::get_current_process_id() );
 
-        std::set< unsigned >::const_iterator referenceIt( instanceCounter_[ id ].find( reference_ ) );
-
-        if ( instanceCounter_[ id ].end() != referenceIt ) {
-            instanceCounter_[ id ].erase( referenceIt );
+        for ( ProcessInventory::iterator it( thisInventory.begin() ); it != thisInventory.end(); ++it ) {
+            if ( ( id != it->first ) && !( !kill( it->first, 0 ) || ( ESRCH != errno ) ) ) {
+                thisInventory.erase( it );
+            }
         }
+    }
 
-        ReferenceInventory::iterator inventoryIt( cacheInventory_[ cacheLocation_ ][ id ].find( reference_ ) );
 
-        if ( cacheInventory_[ cacheLocation_ ][ id ].end() != inventoryIt ) {
-            cacheInventory_[ cacheLocation_ ][ id ].erase( inventoryIt );
+    /**
+     * Drop the interned paths nothing refers to any more
+     *
+     * Every miss interns its entry's path, so a long running process would
+     * keep each path it ever saw. Once the table has doubled since the last
+     * time (and holds at least RECLAIM_PATHS), only the paths in an
+     * inventory, being copied or prefetched, the entry being admitted and
+     * those handed out as C strings are kept. Background checks of the
+     * others go with them; request counts of their ids fade like any other
+     * in the sketches. The caller holds our lock exclusively.
+     */
+    template< typename Traits >
+    void BasicFileCache< Traits >::reclaim_paths( const fs::path& admitting )
+    {
+        std::size_t size( paths_.size() );
+
+        if ( size < RECLAIM_PATHS || size < 2 * pathsKept_ ) {
+            return;
         }
-    }
 
+        std::vector< PathId > live( copying_.begin(), copying_.end() );
+        PathId id;
 
-    void FileCache::copy_overwrite_file( const fs::path& source, const fs::path& destination ) const
-    {
-        if ( fs::exists( destination ) ) {
-            fs::remove( destination );
+        if ( !admitting.empty() && paths_.find( admitting.string(), id ) ) {
+            live.push_back( id );
         }
 
-        fs::copy_file( source, destination );
-    }
+        for ( Inventory::const_iterator location( cacheInventory_.begin() ); location != cacheInventory_.end(); ++location ) {
+            for ( ProcessInventory::const_iterator process( location->second.begin() ); process != location->second.end(); ++process ) {
+                for ( ReferenceInventory::const_iterator it( process->second.begin() ); it != process->second.end(); ++it ) {
+                    live.insert( live.end(), it->second.ids().begin(), it->second.ids().end() );
+                }
+            }
+        }
 
+        // Held throughout, so background checks can't record an id that is being reused
+        boost::mutex::scoped_lock lock( statsMutex_ );
 
-    fs::path FileCache::cached_file_path( const fs::path& toCache ) const
-    {
+        live.insert( live.end(), prefetched_.ids().begin(), prefetched_.ids().end() );
 
-        fs::path tmpPath;
+        std::sort( live.begin(), live.end() );
+        live.erase( std::unique( live.begin(), live.end() ), live.end() );
 
-        if ( toCache.has_root_directory() ) {
-            tmpPath = toCache;
-        } else {
-            tmpPath = cwd_ / toCache; // Prepend by current working dir
+        paths_.retain( live );
+
+        for ( ValidationMap::iterator it( validated_.begin() ); it != validated_.end(); ) {
+            if ( std::binary_search( live.begin(), live.end(), it->first ) ) {
+                ++it;
+            } else {
+                validated_.erase( it++ );
+            }
         }
 
-        std::string newPathString( tmpPath.string() );
-        // The following works on any platform since string() returns the internal
-        // representation of a path which always uses '/' as the separator char.
-        boost::algorithm::replace_all( newPathString, "/", "%" );
+        pathsKept_ = paths_.size();
 
-        return cacheLocation_ / fs::path( newPathString, fs::no_check );
+        DEBUGMSG( "ReclaimedPaths, kept " + boost::lexical_cast< std::string >( pathsKept_ ) );
     }
 
 
     /**
-     * Transform cached locations back to the source.
+     * Tidies up the cache
      *
-     * @return  the original path name
      */
-    fs::path FileCache::original_file_path( const fs::path& fromCache ) const
+    template< typename Traits >
+    bool BasicFileCache< Traits >::tidy_up_cache( uintmax_t incoming, const fs::path& admitting )
     {
+        FILECACHE_SPAN( "tidy_up_cache" );
 
-        // Strip any path in front of file name (the "leaf").
-        std::string newPathString( fromCache.leaf() );
-        boost::algorithm::replace_all( newPathString, "%", "/" );
+        StopWatch watch;
+
+        bool result( make_room( incoming, admitting ) );
 
-        return fs::path( newPathString );
+        record_latency( &CacheStats::tidyLatency, watch );
+
+        return result;
     }
 
 
     /**
-     * Get a cached location for write caching.
+     * Evicts unused files until there is room for @c incoming bytes
      *
-     * @return  the cached path if cache was true, toCache otherwise
+     * @param  admitting  the entry the room is for, if the admission filter
+     *                    is to decide whether it's worth the evictions
+     *
+     * @return  true if there is enough room, false otherwise
      */
-    fs::path FileCache::cached_file_name( const fs::path& toCache ) const
+    template< typename Traits >
+    bool BasicFileCache< Traits >::make_room( uintmax_t incoming, const fs::path& admitting )
     {
-        if ( cache_ ) {
-            try {
-                return cached_file_path( toCache );
-            } catch ( fs::filesystem_error ) {
-                // Anything goes wrong we play it safe and return the unalterted path.
-                message( "Could not form valid cache file name from '" + toCache.string() + "'" );
-            }
-        }
 
-        return toCache;
-    }
+        if ( cacheSize_[ cacheLocation_ ] || cacheFreeSpace_.count( cacheLocation_ ) ) {
+            std::vector< fs::path > files;
+            std::vector< EvictionCandidate > candidates;
 
+            uintmax_t totalSize( incoming );
 
-    bool FileCache::is_remote( const fs::path& toCache ) const
-    {
-        fs::path tmpPath( toCache );
+            bool compression( cacheCompression_.count( cacheLocation_ ) );
 
-        // Resolve symlinks prior to caching
-        if ( fs::is_symlink( tmpPath ) ) {
-            tmpPath = read_link( tmpPath );
-        }
+            // Find all files and their sizes -- compressed entries count with their compressed size
+            fs::directory_iterator end;
 
-        std::string pathStr( tmpPath.remove_leaf().string() );
+            for ( fs::directory_iterator it( cacheLocation_ ); it != end; ++it ) {
+                if ( is_partial_file( *it ) && is_abandoned( *it ) ) {
+                    // Left behind by a process that died while writing it
+                    DEBUGMSG( "RemoveAbandoned '" + it->string() + "'" );
+                    fs::remove( *it );
+                } else if ( is_checksum_file( *it ) || is_partial_file( *it ) ) {
+                    // Block checksums go with their entry, entries being filled can't go yet
+                    totalSize += fs::file_size( *it );
+                } else if ( !is_directory( *it ) ) {
+                    EvictionCandidate candidate;
+                    candidate.size = fs::file_size( *it );
+                    candidate.lastAccess = last_access_time( *it );
+
+                    // Decompressed copies of compressed entries can be recreated without touching the original
+                    candidate.preferred = compression && !is_compressed_file( *it ) && fs::exists( compressed_file_path( *it ) );
+
+                    files.push_back( *it );
+                    candidates.push_back( candidate );
+
+                    totalSize += candidate.size;
+                }
+            }
 
-        // Check if the file is on a mounted location
-        struct statvfs stats;
+            // Tidy up our inventory so we don't keep files of other cache-using processes that got killed
+            tidy_up_inventory();
+            reclaim_paths( admitting );
 
-        if ( !statvfs( pathStr.c_str(), &stats ) ) {
-            return NFS_SUPER_MAGIC == stats.f_fsid; // || ( SMB_SUPER_MAGIC == stats.f_type );
-        }
+            check_free_space( totalSize - incoming );
 
-        return false;
-    }
+            uintmax_t capacity;
 
+            if ( !effective_size( capacity ) || totalSize <= capacity ) {
+                // The cache is big enough
+                return true;
+            }
 
-    bool FileCache::is_different( const fs::path& toCache, const fs::path& destination ) const
-    {
-        if ( // check if the remote file is newer than the (possibly) existing file in the cache
-            ( fs::last_write_time( destination ) < fs::last_write_time( toCache ) ) ||
-            // Also check if the size is different
-            ( fs::file_size( destination ) != fs::file_size( toCache ) ) ) {
-            return true;
-        }
+            // We need to tidy up the cache
+            for ( std::size_t i( 0 ); i < files.size(); ++i ) {
+                candidates[ i ].pinned = is_used( files[ i ] ) || is_copying( files[ i ] );
+            }
 
-        return false;
-    }
+            PathEvictionMap::const_iterator policy( cacheEviction_.find( cacheLocation_ ) );
+            std::vector< std::size_t > victims;
 
+            bool room( Traits::plan_eviction( candidates, totalSize, capacity,
+                                              cacheEviction_.end() == policy ? EVICT_LRU : policy->second, victims ) );
 
-    bool FileCache::is_used_by_this_cache( const fs::path& path ) const
-    {
-        std::set< fs::path >& thisCache( cacheInventory_[ cacheLocation_ ][ ipd::get_current_process_id() ][ reference_ ] );
+            if ( !admitting.empty() && !victims.empty() && !admits( admitting, files, victims ) ) {
+                count( &CacheStats::rejected );
+                return false;
+            }
 
-        return( thisCache.count( path ) );
-    }
+            for ( std::vector< std::size_t >::const_iterator it( victims.begin() ); it != victims.end(); ++it ) {
+                fs::remove( files[ *it ] );
 
+                if ( fs::exists( checksum_file_path( files[ *it ] ) ) ) {
+                    fs::remove( checksum_file_path( files[ *it ] ) );
+                }
 
-    bool FileCache::is_used( const fs::path& path ) const
-    {
-        const ProcessInventory& thisProcessInventory( cacheInventory_[ cacheLocation_ ] );
+                count( &CacheStats::evictions );
+                count( &CacheStats::evictedBytes, candidates[ *it ].size );
 
-        for ( ProcessInventory::const_iterator it( thisProcessInventory.begin() ); it != thisProcessInventory.end(); ++it ) {
-            const ReferenceInventory& thisReferenceInventory( it->second );
+                boost::mutex::scoped_lock lock( statsMutex_ );
+                PathId id;
 
-            for ( ReferenceInventory::const_iterator jt( thisReferenceInventory.begin() ); jt != thisReferenceInventory.end(); ++jt ) {
-                if ( jt->second.count( path ) ) {
-                    return true;
+                if ( paths_.find( files[ *it ].string(), id ) && prefetched_.erase( id ) ) {
+                    ++cacheStats_[ cacheLocation_ ].prefetchWasted;
                 }
             }
-        }
-
-        /*for( processInventory::const_iterator it( thisInventory.begin() ); it != thisInventory.end(); ++it ) {
-        	//if( it->second.end() != it->second.find( path ) ) {
-        	if( it->second.count( path ) ) {
-        		return true;
-        	}
-        }*/
-        return false;
-    }
 
+            return room;
 
-    void FileCache::register_file( const fs::path& path )
-    {
-        // Register the file for the current process
-        cacheInventory_[ cacheLocation_ ][ ipd::get_current_process_id() ][ reference_ ].insert( path );
+        } else {
+            // A zero size cache is unlimited, return success
+            return true;
+        }
     }
 
 
     /**
-     * Physically copy a file to the cache
+     * Work out how much the cache may use without eating into the free space
+     * it has to leave, if it's time to look at the filesystem again
      *
-     * @return  the cached path if sucessful, the unaltered original path otherwise
+     * Our own copies move bytes from the free space to the cache, so the
+     * budget stays right between looks; only other jobs change it.
+     *
+     * @param  used  the bytes in the cache now
      */
-    fs::path FileCache::copy_to_cache( const fs::path& toCache, const fs::path& destination )
+    template< typename Traits >
+    void BasicFileCache< Traits >::check_free_space( uintmax_t used )
     {
-        try {
-            if ( tidy_up_cache( toCache ) ) {
-                copy_overwrite_file( toCache, destination );
-                register_file( destination );
-                return destination;
-            }
+        PathFreeSpaceMap::iterator it( cacheFreeSpace_.find( cacheLocation_ ) );
+        time_t now( std::time( 0 ) );
 
-            // Cache was full and/or couldn't be tidied up enough...
-        } catch ( ... ) {
-            // Anything goes wrong we play it safe and return the unalterted path
-            message( "Copying '" + toCache.string() + "' to '" + destination.string() + "' failed" );
+        if ( cacheFreeSpace_.end() == it || ( it->second.checked && now - it->second.checked < FREE_SPACE_INTERVAL ) ) {
+            return;
         }
 
-        return toCache;
+        uintmax_t available, size;
+
+        if ( !filesystem_space( cacheLocation_, available, size ) ) {
+            message( "Could not query the free space at '" + cacheLocation_.string() + "'" );
+            return;
+        }
+
+        FreeSpace& space( it->second );
+        uintmax_t keep( std::max( space.keep, size / 100 * space.keepPercent ) );
+
+        space.budget = used + available > keep ? used + available - keep : 0;
+        space.checked = now;
+
+        DEBUGMSG( "Cache size is " + boost::lexical_cast< std::string >( space.budget ) + " bytes" );
     }
 
 
     /**
-     * Createas a full path.
+     * Query the bytes the cache may use
      *
-     * Iteratoes over the path and consecutively creates each directory, if
-     * nonexistant.
-     *
-     * @return  true if successfull, false otherwise
+     * @return  true if the cache is limited, false otherwise
      */
-    bool FileCache::create_full_path( const fs::path& createPath ) const
+    template< typename Traits >
+    bool BasicFileCache< Traits >::effective_size( uintmax_t& size ) const
     {
-        fs::path create;
-
-        try {
-            for ( fs::path::iterator it( createPath.begin() ); it != createPath.end(); ++it ) {
-                create /= *it;
+        PathSizeMap::const_iterator configured( cacheSize_.find( cacheLocation_ ) );
+        PathFreeSpaceMap::const_iterator space( cacheFreeSpace_.find( cacheLocation_ ) );
 
-                if ( !fs::exists( create ) )
-                    { fs::create_directory( create ); }
-            }
+        bool sized( cacheSize_.end() != configured && configured->second );
+        bool budgeted( cacheFreeSpace_.end() != space && space->second.checked );
 
-            return true;
-        } catch ( ... ) {
-            message( "Creating directory '" + createPath.string() + "' failed" );
+        if ( !sized && !budgeted ) {
+            // A zero size cache is unlimited
+            return false;
         }
 
-        return false;
+        size = !budgeted ? configured->second : !sized ? space->second.budget : std::min( configured->second, space->second.budget );
+
+        return true;
     }
 
 
     /**
-     * Get the last access time of the given file
+     * Ask the admission filter whether a file is worth evicting others for
      *
-     * @return  the access time if successfull, 0 otherwise
+     * @param  victims  the indices of the entries in @c files it would evict
      */
-    time_t FileCache::last_access_time( const fs::path& createPath ) const
+    template< typename Traits >
+    bool BasicFileCache< Traits >::admits( const fs::path& candidate, const std::vector< fs::path >& files, const std::vector< std::size_t >& victims ) const
     {
-        struct stat fstats;
+        boost::mutex::scoped_lock lock( statsMutex_ );
 
-        if ( !stat( createPath.string().c_str(), &fstats ) ) {
-            return fstats.st_atime;
+        PathAdmissionMap::const_iterator admission( cacheAdmission_.find( cacheLocation_ ) );
+
+        if ( cacheAdmission_.end() == admission || ADMIT_TINYLFU != admission->second.filter ) {
+            return true;
         }
 
-        return 0; // January 1, 1970 :)
+        const FrequencySketch& sketch( admission->second.sketch );
+        PathId id;
+
+        unsigned frequency( paths_.find( candidate.string(), id ) ? sketch.estimate( id ) : 0 );
+        std::vector< unsigned > frequencies;
+
+        for ( std::vector< std::size_t >::const_iterator it( victims.begin() ); it != victims.end(); ++it ) {
+            // Entries this process never asked for count as never requested
+            frequencies.push_back( paths_.find( files[ *it ].string(), id ) ? sketch.estimate( id ) : 0 );
+        }
+
+        return Traits::admit( frequency, frequencies );
     }
 
 
     /**
-     * Tidies up the cache inventory by purging all inventory lists whose
-     * processes don't exist anymore
+     * Count a request of an entry for the admission filter
      *
+     * The caller holds statsMutex_.
      */
-    void FileCache::tidy_up_inventory()
+    template< typename Traits >
+    void BasicFileCache< Traits >::record_request( PathId id ) const
     {
-        ProcessInventory& thisInventory( cacheInventory_[ cacheLocation_ ] );
-        ipd::OS_process_id_t id( ipd::get_current_process_id() );
+        PathAdmissionMap::iterator admission( cacheAdmission_.find( cacheLocation_ ) );
 
-        for ( ProcessInventory::iterator it( thisInventory.begin() ); it != thisInventory.end(); ++it ) {
-            if ( ( id != it->first ) && !( !kill( it->first, 0 ) || ( ESRCH != errno ) ) ) {
-                thisInventory.erase( it );
-            }
+        if ( cacheAdmission_.end() != admission && ADMIT_TINYLFU == admission->second.filter ) {
+            admission->second.sketch.record( id );
+        }
+
+        PathBypassMap::iterator bypass( cacheBypass_.find( cacheLocation_ ) );
+
+        if ( cacheBypass_.end() != bypass ) {
+            bypass->second.requests.record( id );
         }
     }
 
 
     /**
-     * Tidies up the cache
+     * Decide whether a missing file is copied, see plan_bypass()
      *
+     * Measures the cache disk first if its last measurement is too old.
      */
-    bool FileCache::tidy_up_cache( const fs::path& toCache )
+    template< typename Traits >
+    BypassDecision BasicFileCache< Traits >::bypass_decision( const SourceBackend& backend, const fs::path& entry, uintmax_t size ) const
     {
+        bool probe( false );
 
-        if ( cacheSize_[ cacheLocation_ ] ) {
-            std::multimap< time_t, fs::path > files;
-            std::multimap< time_t, intmax_t > sizes;
+        {
+            boost::mutex::scoped_lock lock( statsMutex_ );
 
-            uintmax_t totalSize;
+            PathBypassMap::iterator bypass( cacheBypass_.find( cacheLocation_ ) );
 
-            if ( !toCache.empty() ) {
-                totalSize = fs::file_size( toCache );
-            } else {
-                totalSize = 0;
+            if ( cacheBypass_.end() == bypass ) {
+                return BYPASS_COPY;
             }
 
-            // Find all files and their sizes
-            fs::directory_iterator end;
+            if ( std::time( 0 ) - bypass->second.probed >= BypassPolicy::PROBE_INTERVAL ) {
+                // Whoever gets here first measures, the others go by the last measurement
+                bypass->second.probed = std::time( 0 );
+                probe = true;
+            }
+        }
 
-            for ( fs::directory_iterator it( cacheLocation_ ); it != end; ++it ) {
-                if ( !is_directory( *it ) ) {
-                    time_t t( last_access_time( *it ) );
-                    files.insert( std::pair< time_t, fs::path >( t, *it ) );
+        double seconds;
 
-                    intmax_t s( fs::file_size( *it ) );
-                    sizes.insert( std::pair< time_t, intmax_t >( t, s ) );
+        if ( probe && probe_write( cachePrefix_ + ".probe" + boost::lexical_cast< std::string >( getpid() ), BypassPolicy::PROBE_SIZE, seconds ) ) {
+            boost::mutex::scoped_lock lock( statsMutex_ );
 
-                    totalSize += s;
-                }
+            PathBypassMap::iterator bypass( cacheBypass_.find( cacheLocation_ ) );
+
+            if ( cacheBypass_.end() != bypass ) {
+                bypass->second.cache.recordTransfer( BypassPolicy::PROBE_SIZE, seconds );
             }
+        }
 
-            // Tidy up our inventory so we don't keep files of other cache-using processes that got killed
-            tidy_up_inventory();
+        boost::mutex::scoped_lock lock( statsMutex_ );
 
-            // We need to tidy up the cache
-            if ( totalSize > cacheSize_[ cacheLocation_ ] ) {
-                std::multimap< time_t, fs::path >::const_iterator f( files.begin() );
-                std::multimap< time_t, intmax_t >::const_iterator s( sizes.begin() );
-
-                // Delete oldest files first
-                while ( files.end() != f ) {
-                    if ( !is_used( f->second ) ) {
-                        fs::remove( f->second );
-                        totalSize -= s->second;
-
-                        if ( totalSize < cacheSize_[ cacheLocation_ ] ) {
-                            // We made enough room
-                            return true;
-                        }
-                    }
+        PathBypassMap::const_iterator bypass( cacheBypass_.find( cacheLocation_ ) );
 
-                    ++f;
-                    ++s;
-                }
+        if ( cacheBypass_.end() == bypass ) {
+            return BYPASS_COPY;
+        }
 
-                // We couldn't make enough room
-                return false;
-            }
+        std::map< const SourceBackend*, RateEstimate >::const_iterator source( bypass->second.sources.find( &backend ) );
+        PathId id;
 
-            // The cache is big enough
-            return true;
+        if ( bypass->second.sources.end() == source ) {
+            return BYPASS_COPY;
+        }
 
-        } else {
-            // A zero size cache is unlimited, return success
-            return true;
+        return Traits::plan_bypass( size, paths_.find( entry.string(), id ) ? bypass->second.requests.estimate( id ) : 1,
+                                    source->second, bypass->second.cache );
+    }
+
+
+    /**
+     * Note how fast a copy from a source backend was, for bypass_decision()
+     *
+     */
+    template< typename Traits >
+    void BasicFileCache< Traits >::record_source( const SourceBackend& backend, double statSeconds, uintmax_t bytes, double copySeconds ) const
+    {
+        boost::mutex::scoped_lock lock( statsMutex_ );
+
+        PathBypassMap::iterator bypass( cacheBypass_.find( cacheLocation_ ) );
+
+        if ( cacheBypass_.end() != bypass ) {
+            RateEstimate& source( bypass->second.sources[ &backend ] );
+            source.recordLatency( statSeconds );
+            source.recordTransfer( bytes, copySeconds );
         }
     }
 
@@ -852,7 +3910,8 @@ namespace Jupiter {
      *
      * @return  the dereferenced link if successful, the original otherwise
      */
-    fs::path FileCache::read_link( const fs::path& link ) const
+    template< typename Traits >
+    fs::path BasicFileCache< Traits >::read_link( const fs::path& link ) const
     {
         enum { GROWBY = 256 }; // How large we will grow strings by
 
@@ -874,6 +3933,17 @@ namespace Jupiter {
     }
 
 
+    /**
+     * The file to cache for a path: a link's target unless Traits keep links
+     *
+     */
+    template< typename Traits >
+    fs::path BasicFileCache< Traits >::resolve_link( const fs::path& path ) const
+    {
+        return Traits::RESOLVE_SYMLINKS && is_symlink( path ) ? read_link( path ) : path;
+    }
+
+
     /* Fixed old implementation. The original was leaking memory
      * Needs testing that this is really fixed. In the meantime,
      * above implementation uses boost::shared_array -- possibly
@@ -906,7 +3976,95 @@ namespace Jupiter {
     }*/
 
 
-    inline void FileCache::message( const std::string& message ) const
+    template< typename Traits >
+    void BasicFileCache< Traits >::count( boost::uint64_t CacheStats::* counter, boost::uint64_t amount ) const
+    {
+        boost::mutex::scoped_lock lock( statsMutex_ );
+
+        cacheStats_[ cacheLocation_ ].*counter += amount;
+    }
+
+
+    template< typename Traits >
+    void BasicFileCache< Traits >::record_latency( LatencyHistogram CacheStats::* histogram, const StopWatch& watch ) const
+    {
+        record_latency( histogram, watch.seconds() );
+    }
+
+
+    template< typename Traits >
+    void BasicFileCache< Traits >::record_latency( LatencyHistogram CacheStats::* histogram, double seconds ) const
+    {
+        boost::mutex::scoped_lock lock( statsMutex_ );
+
+        ( cacheStats_[ cacheLocation_ ].*histogram ).record( seconds );
+    }
+
+
+    /**
+     * Write the statistics of all cache locations to the stats file
+     *
+     * Unless forced, this only happens if the last dump is older than the
+     * stats interval.
+     */
+    template< typename Traits >
+    void BasicFileCache< Traits >::dump_stats( bool force ) const
+    {
+        boost::mutex::scoped_lock lock( statsMutex_ );
+
+        time_t now( time( NULL ) );
+
+        if ( statsFile_.empty() || ( !force && now - lastStatsDump_ < ( time_t )statsInterval_ ) ) {
+            return;
+        }
+
+        lastStatsDump_ = now;
+
+        std::string pid( boost::lexical_cast< std::string >( getpid() ) );
+        std::string file( statsFile_ );
+        boost::algorithm::replace_all( file, "%p", pid );
+
+        std::string process( label_value( processName_ ) );
+
+        CacheStats::LabeledStats labeled;
+
+        for ( PathStatsMap::const_iterator it( cacheStats_.begin() ); it != cacheStats_.end(); ++it ) {
+            labeled[ "location=\"" + label_value( it->first.string() ) + "\",process=\"" + process + "\",pid=\"" + pid + "\"" ] = it->second;
+        }
+
+        // Write next to the file and rename so a scraper never reads half a dump
+        std::string partial( file + ".partial" );
+        std::ofstream out( partial.c_str() );
+
+        CacheStats::writePrometheus( out, labeled );
+        out.close();
+
+        if ( !out || rename( partial.c_str(), file.c_str() ) ) {
+            unlink( partial.c_str() );
+            message( "Could not write statistics to '" + file + "'" );
+        }
+    }
+
+
+    template< typename Traits >
+    void BasicFileCache< Traits >::trace( TraceRecord::Operation operation, TraceRecord::Outcome outcome, const fs::path& entry, uintmax_t size, double seconds ) const
+    {
+        TraceRecord record;
+        record.time = trace_time();
+        record.path = entry.empty() ? 0 : hash_path( entry.leaf() );
+        record.size = size;
+        record.latency = seconds * 1000000;
+        record.pid = getpid();
+        record.instance = reference_;
+        record.operation = operation;
+        record.outcome = outcome;
+
+        tracer_.record( record );
+    }
+
+
+    template< typename Traits >
+    inline void BasicFileCache< Traits >::message( const std::string& message ) const
     {
         if ( log_ ) {
             WriteGuard guard( messageMutex_ );
@@ -927,7 +4085,8 @@ namespace Jupiter {
      * Only works on Linux, if /proc is mounted.
      *
      */
-    std::string FileCache::get_process_name() const
+    template< typename Traits >
+    std::string BasicFileCache< Traits >::get_process_name() const
     {
         pid_t pid( getpid() );
         PROCTAB* procTp( openproc( PROC_FILLBUG ) );
@@ -945,12 +4104,16 @@ namespace Jupiter {
         return std::string();
     }
 #else
-    std::string FileCache::get_process_name() const
+    template< typename Traits >
+    std::string BasicFileCache< Traits >::get_process_name() const
     {
         return std::string();
     }
 #endif
 
 
-} // namespace Jupiter
+    // The engines built into the library, see DefaultCacheTraits for adding one
+    template class BasicFileCache< DefaultCacheTraits >;
 
+
+} // namespace Jupiter
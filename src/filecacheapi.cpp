@@ -0,0 +1,296 @@
+/**@file
+ *
+ * C interface to FileCache, for renderer plugins and foreign function interfaces.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010  Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+// Own headers
+#include <filecacheapi.h>
+#include <filecache.hpp>
+#include <sharedcache.hpp>
+
+// Standard headers
+#include <cstring> // memcpy(), strlen()
+#include <new> // bad_alloc, nothrow
+
+// Boost headers
+#include <boost/scoped_ptr.hpp>
+
+
+/**
+ * Either an instance of its own (filecache_open()) or an attachment to the
+ * process's engine for the location (filecache_attach())
+ */
+struct FileCacheHandle {
+    boost::scoped_ptr< Jupiter::FileCache > cache;
+    boost::scoped_ptr< Jupiter::SharedCache > shared;
+
+    Jupiter::FileCache& engine() { return shared ? shared->engine() : *cache; }
+};
+
+
+namespace {
+
+    /**
+     * Copy a path into a caller's buffer
+     */
+    int copy_result( const char* path, std::size_t pathLength, char* buffer, size_t size, size_t* length )
+    {
+        if ( length ) {
+            *length = pathLength;
+        }
+
+        if ( !buffer || size <= pathLength ) {
+            return FILECACHE_ERROR_BUFFER;
+        }
+
+        memcpy( buffer, path, pathLength + 1 );
+
+        return FILECACHE_OK;
+    }
+
+
+    int copy_result( const std::string& path, char* buffer, size_t size, size_t* length )
+    {
+        return copy_result( path.c_str(), path.size(), buffer, size, length );
+    }
+
+} // anonymous namespace
+
+
+extern "C" {
+
+
+FileCacheHandle* filecache_open( const char* location, int* status )
+{
+    FileCacheHandle* cache( 0 );
+    int result( FILECACHE_OK );
+
+    try {
+        cache = new FileCacheHandle;
+        cache->cache.reset( new Jupiter::FileCache( std::string( location ? location : "" ) ) );
+    } catch ( const std::bad_alloc& ) {
+        result = FILECACHE_ERROR_MEMORY;
+    } catch ( ... ) {
+        result = FILECACHE_ERROR_INTERNAL;
+    }
+
+    if ( FILECACHE_OK != result ) {
+        delete cache;
+        cache = 0;
+    }
+
+    if ( status ) {
+        *status = result;
+    }
+
+    return cache;
+}
+
+
+FileCacheHandle* filecache_attach( const char* location, int* status )
+{
+    FileCacheHandle* cache( 0 );
+    int result( FILECACHE_OK );
+
+    try {
+        cache = new FileCacheHandle;
+        cache->shared.reset( new Jupiter::SharedCache( std::string( location ? location : "" ) ) );
+    } catch ( const std::bad_alloc& ) {
+        result = FILECACHE_ERROR_MEMORY;
+    } catch ( ... ) {
+        result = FILECACHE_ERROR_INTERNAL;
+    }
+
+    if ( FILECACHE_OK != result ) {
+        delete cache;
+        cache = 0;
+    }
+
+    if ( status ) {
+        *status = result;
+    }
+
+    return cache;
+}
+
+
+void filecache_close( FileCacheHandle* cache )
+{
+    try {
+        delete cache;
+    } catch ( ... ) {
+    }
+}
+
+
+int filecache_cache_file( FileCacheHandle* cache, const char* path, char* buffer, size_t size, size_t* length )
+{
+    const char* result;
+    int status( filecache_cache_file_interned( cache, path, &result ) );
+
+    if ( 0 > status ) {
+        return status;
+    }
+
+    int copied( copy_result( result, strlen( result ), buffer, size, length ) );
+
+    return FILECACHE_OK == copied ? status : copied;
+}
+
+
+int filecache_cache_file_interned( FileCacheHandle* cache, const char* path, const char** result )
+{
+    if ( !cache || !path || !result ) {
+        return FILECACHE_ERROR_ARGUMENT;
+    }
+
+    try {
+        *result = cache->shared ? cache->shared->cacheFile( path ) : cache->cache->cacheFileInterned( path );
+
+        return path == *result ? FILECACHE_NOT_CACHED : FILECACHE_OK;
+    } catch ( const std::bad_alloc& ) {
+        return FILECACHE_ERROR_MEMORY;
+    } catch ( ... ) {
+        return FILECACHE_ERROR_INTERNAL;
+    }
+}
+
+
+int filecache_release_file( FileCacheHandle* cache, const char* path )
+{
+    if ( !cache || !path ) {
+        return FILECACHE_ERROR_ARGUMENT;
+    }
+
+    try {
+        if ( cache->shared ) {
+            cache->shared->releaseFile( path );
+        } else {
+            cache->cache->releaseFile( std::string( path ) );
+        }
+
+        return FILECACHE_OK;
+    } catch ( const std::bad_alloc& ) {
+        return FILECACHE_ERROR_MEMORY;
+    } catch ( ... ) {
+        return FILECACHE_ERROR_INTERNAL;
+    }
+}
+
+
+int filecache_cache_file_for_writing( FileCacheHandle* cache, const char* path, char* buffer, size_t size, size_t* length )
+{
+    if ( !cache || !path ) {
+        return FILECACHE_ERROR_ARGUMENT;
+    }
+
+    try {
+        std::string result( cache->engine().cacheFileForWriting( std::string( path ) ) );
+        int status( result == path ? FILECACHE_NOT_CACHED : FILECACHE_OK );
+        int copied( copy_result( result, buffer, size, length ) );
+
+        return FILECACHE_OK == copied ? status : copied;
+    } catch ( const std::bad_alloc& ) {
+        return FILECACHE_ERROR_MEMORY;
+    } catch ( ... ) {
+        return FILECACHE_ERROR_INTERNAL;
+    }
+}
+
+
+int filecache_uncache_file( FileCacheHandle* cache, const char* path, int overwrite, int ifNewer, char* buffer, size_t size, size_t* length )
+{
+    if ( !cache || !path ) {
+        return FILECACHE_ERROR_ARGUMENT;
+    }
+
+    try {
+        std::string result( cache->engine().uncacheFile( std::string( path ), overwrite, ifNewer ) );
+        int status( result == path ? FILECACHE_NOT_CACHED : FILECACHE_OK );
+        int copied( copy_result( result, buffer, size, length ) );
+
+        return FILECACHE_OK == copied ? status : copied;
+    } catch ( const std::bad_alloc& ) {
+        return FILECACHE_ERROR_MEMORY;
+    } catch ( ... ) {
+        return FILECACHE_ERROR_INTERNAL;
+    }
+}
+
+
+int filecache_relocate( FileCacheHandle* cache, const char* location )
+{
+    if ( !cache || !location ) {
+        return FILECACHE_ERROR_ARGUMENT;
+    }
+
+    try {
+        if ( cache->shared ) {
+            // Moves to the other location's engine, dropping this handle's pins
+            cache->shared.reset( new Jupiter::SharedCache( std::string( location ) ) );
+        } else {
+            cache->cache->relocate( std::string( location ) );
+        }
+
+        return FILECACHE_OK;
+    } catch ( const std::bad_alloc& ) {
+        return FILECACHE_ERROR_MEMORY;
+    } catch ( ... ) {
+        return FILECACHE_ERROR_INTERNAL;
+    }
+}
+
+
+int filecache_resize( FileCacheHandle* cache, unsigned long megabytes )
+{
+    if ( !cache ) {
+        return FILECACHE_ERROR_ARGUMENT;
+    }
+
+    try {
+        cache->engine().resize( megabytes );
+
+        return FILECACHE_OK;
+    } catch ( ... ) {
+        return FILECACHE_ERROR_INTERNAL;
+    }
+}
+
+
+const char* filecache_status_string( int status )
+{
+    switch ( status ) {
+        case FILECACHE_OK: return "cached";
+        case FILECACHE_NOT_CACHED: return "not cached";
+        case FILECACHE_ERROR_ARGUMENT: return "missing argument";
+        case FILECACHE_ERROR_BUFFER: return "buffer too small";
+        case FILECACHE_ERROR_MEMORY: return "out of memory";
+        case FILECACHE_ERROR_INTERNAL: return "internal error";
+        default: return "unknown status";
+    }
+}
+
+
+} // extern "C"
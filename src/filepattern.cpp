@@ -0,0 +1,242 @@
+/**@file
+ *
+ * File name patterns for texture sets and frame sequences.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010  Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+// Own headers
+#include <filepattern.hpp>
+
+// Standard headers
+#include <cctype> // isdigit(), tolower()
+
+
+namespace Jupiter {
+
+
+    FilePattern::FilePattern( const std::string& pattern )
+        : pattern_( pattern )
+    {
+    }
+
+
+    bool FilePattern::literal() const
+    {
+        for ( std::string::size_type p( 0 ); p < pattern_.size(); ++p ) {
+            std::string::size_type length, digits;
+            bool udim, matched;
+
+            if ( '*' == pattern_[ p ] || '?' == pattern_[ p ] ||
+                 number( p, length, digits, udim ) ||
+                 ( '[' == pattern_[ p ] && character_class( p, 'x', length, matched ) ) ) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+
+    bool FilePattern::matches( const std::string& name ) const
+    {
+        return match( 0, name, 0 );
+    }
+
+
+    bool FilePattern::match( std::string::size_type p, const std::string& name, std::string::size_type n ) const
+    {
+        while ( p < pattern_.size() ) {
+            std::string::size_type length, digits;
+            bool udim, matched;
+
+            if ( '*' == pattern_[ p ] ) {
+                for ( std::string::size_type i( n ); i <= name.size(); ++i ) {
+                    if ( match( p + 1, name, i ) ) {
+                        return true;
+                    }
+                }
+
+                return false;
+            }
+
+            if ( number( p, length, digits, udim ) ) {
+                if ( udim ) {
+                    if ( name.size() < n + 4 || '0' == name[ n ] ) {
+                        return false;
+                    }
+
+                    for ( int i( 0 ); i < 4; ++i ) {
+                        if ( !isdigit( ( unsigned char )name[ n + i ] ) ) {
+                            return false;
+                        }
+                    }
+
+                    p += length;
+                    n += 4;
+                    continue;
+                }
+
+                std::string::size_type start( n < name.size() && '-' == name[ n ] ? n + 1 : n );
+                std::string::size_type end( start );
+
+                while ( end < name.size() && isdigit( ( unsigned char )name[ end ] ) ) {
+                    ++end;
+                }
+
+                // Take as many digits as possible, give some back if the rest needs them
+                for ( std::string::size_type e( end ); e >= start + digits; --e ) {
+                    if ( match( p + length, name, e ) ) {
+                        return true;
+                    }
+
+                    if ( e == start + digits ) {
+                        break;
+                    }
+                }
+
+                return false;
+            }
+
+            if ( n >= name.size() ) {
+                return false;
+            }
+
+            if ( '?' == pattern_[ p ] ) {
+                ++p;
+                ++n;
+            } else if ( '[' == pattern_[ p ] && character_class( p, name[ n ], length, matched ) ) {
+                if ( !matched ) {
+                    return false;
+                }
+
+                p += length;
+                ++n;
+            } else if ( pattern_[ p ] == name[ n ] ) {
+                ++p;
+                ++n;
+            } else {
+                return false;
+            }
+        }
+
+        return n == name.size();
+    }
+
+
+    /**
+     * Parse a frame number or UDIM token at @c p
+     *
+     * @return  true if there is one, false otherwise
+     */
+    bool FilePattern::number( std::string::size_type p, std::string::size_type& length, std::string::size_type& digits, bool& udim ) const
+    {
+        udim = false;
+
+        if ( '#' == pattern_[ p ] ) {
+            length = pattern_.find_first_not_of( '#', p );
+            length = ( std::string::npos == length ? pattern_.size() : length ) - p;
+            digits = length;
+            return true;
+        }
+
+        if ( '%' == pattern_[ p ] ) {
+            std::string::size_type i( p + 1 );
+            digits = 0;
+
+            if ( i < pattern_.size() && '0' == pattern_[ i ] ) {
+                ++i;
+            }
+
+            while ( i < pattern_.size() && isdigit( ( unsigned char )pattern_[ i ] ) ) {
+                digits = digits * 10 + pattern_[ i ] - '0';
+                ++i;
+            }
+
+            if ( i < pattern_.size() && 'd' == pattern_[ i ] ) {
+                length = i + 1 - p;
+                digits = digits ? digits : 1;
+                return true;
+            }
+
+            return false;
+        }
+
+        if ( '<' == pattern_[ p ] && pattern_.size() >= p + 6 ) {
+            const char* token( "<udim>" );
+
+            for ( int i( 0 ); i < 6; ++i ) {
+                if ( tolower( ( unsigned char )pattern_[ p + i ] ) != token[ i ] ) {
+                    return false;
+                }
+            }
+
+            length = 6;
+            digits = 4;
+            udim = true;
+            return true;
+        }
+
+        return false;
+    }
+
+
+    /**
+     * Match @c c against the character class starting at @c p
+     *
+     * @return  true if there is a complete class at @c p, false otherwise
+     */
+    bool FilePattern::character_class( std::string::size_type p, char c, std::string::size_type& length, bool& matched ) const
+    {
+        std::string::size_type i( p + 1 );
+        bool negate( i < pattern_.size() && ( '!' == pattern_[ i ] || '^' == pattern_[ i ] ) );
+
+        if ( negate ) {
+            ++i;
+        }
+
+        matched = false;
+
+        // A ']' right at the start is part of the class
+        for ( std::string::size_type first( i ); i < pattern_.size() && ( ']' != pattern_[ i ] || i == first ); ++i ) {
+            if ( i + 2 < pattern_.size() && '-' == pattern_[ i + 1 ] && ']' != pattern_[ i + 2 ] ) {
+                matched = matched || ( pattern_[ i ] <= c && c <= pattern_[ i + 2 ] );
+                i += 2;
+            } else {
+                matched = matched || pattern_[ i ] == c;
+            }
+        }
+
+        if ( i >= pattern_.size() ) {
+            // No closing bracket -- it's a literal '['
+            return false;
+        }
+
+        length = i + 1 - p;
+        matched = matched != negate;
+
+        return true;
+    }
+
+
+} // namespace Jupiter
@@ -0,0 +1,758 @@
+/**@file
+ *
+ * Batched stats and copies of local files, on io_uring or threads.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010  Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+// Own headers
+#include <ioengine.hpp>
+#include <cachestats.hpp>
+
+// Standard headers
+#include <algorithm> // min(), max()
+#include <cstring> // memset()
+
+// System headers
+#include <errno.h> // errno
+#include <fcntl.h> // open()
+#include <sys/stat.h> // stat(), statx
+#include <unistd.h> // read(), write(), close(), unlink()
+#if defined( FILECACHE_URING )
+# include <linux/io_uring.h>
+# include <sys/mman.h> // mmap()
+# include <sys/syscall.h> // syscall()
+#endif
+
+// Boost headers
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+
+namespace Jupiter {
+
+
+    namespace {
+
+        bool write_all( int fd, const char* buffer, size_t size )
+        {
+            while ( size ) {
+                ssize_t n( write( fd, buffer, size ) );
+
+                if ( -1 == n && EINTR == errno ) {
+                    continue;
+                }
+
+                if ( n <= 0 ) {
+                    return false;
+                }
+
+                buffer += n;
+                size -= n;
+            }
+
+            return true;
+        }
+
+
+        bool copy_file( const std::string& source, const std::string& destination )
+        {
+            int in( open( source.c_str(), O_RDONLY ) );
+
+            if ( -1 == in ) {
+                return false;
+            }
+
+            int out( open( destination.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644 ) );
+
+            if ( -1 == out ) {
+                close( in );
+                return false;
+            }
+
+            std::vector< char > block( IoEngine::COPY_BLOCK_SIZE );
+            ssize_t n;
+            bool success( true );
+
+            while ( success && 0 != ( n = read( in, &block[ 0 ], block.size() ) ) ) {
+                if ( -1 == n && EINTR == errno ) {
+                    continue;
+                }
+
+                success = 0 < n && write_all( out, &block[ 0 ], n );
+            }
+
+            close( in );
+
+            if ( close( out ) || !success ) {
+                unlink( destination.c_str() );
+                return false;
+            }
+
+            return true;
+        }
+
+
+        /**
+         * Blocking calls on a pool of threads.
+         *
+         */
+        class ThreadEngine : public IoEngine {
+            public:
+                virtual const char* name() const {
+                    return "threads";
+                }
+
+                virtual void stat( std::vector< StatRequest >& requests ) {
+                    run( requests );
+                }
+
+                virtual void copy( std::vector< CopyRequest >& requests ) {
+                    run( requests );
+                }
+
+            private:
+                template< typename Request >
+                void run( std::vector< Request >& requests ) {
+                    std::size_t next( 0 );
+                    boost::mutex nextMutex;
+                    boost::thread_group threads;
+
+                    for ( std::size_t i( 0 ); i < requests.size() && i < THREADS; ++i ) {
+                        threads.create_thread( boost::bind( &ThreadEngine::work< Request >, &requests, &next, &nextMutex ) );
+                    }
+
+                    threads.join_all();
+                }
+
+                template< typename Request >
+                static void work( std::vector< Request >* requests, std::size_t* next, boost::mutex* nextMutex ) {
+                    for ( ;; ) {
+                        std::size_t i;
+
+                        {
+                            boost::mutex::scoped_lock lock( *nextMutex );
+                            i = ( *next )++;
+                        }
+
+                        if ( i >= requests->size() ) {
+                            return;
+                        }
+
+                        perform( ( *requests )[ i ] );
+                    }
+                }
+
+                static void perform( StatRequest& request ) {
+                    struct stat buffer;
+
+                    request.done = !::stat( request.path.c_str(), &buffer );
+
+                    if ( request.done ) {
+                        request.stats.size = buffer.st_size;
+                        request.stats.mtime = buffer.st_mtime;
+                        request.stats.directory = S_ISDIR( buffer.st_mode );
+                    }
+                }
+
+                static void perform( CopyRequest& request ) {
+                    StopWatch watch;
+
+                    request.done = copy_file( request.source, request.destination );
+                    request.seconds = watch.seconds();
+                }
+        };
+
+
+#if defined( FILECACHE_URING )
+        /**
+         * A submission and a completion queue shared with the kernel.
+         *
+         * Only the calling thread uses a ring, so the queues need no locks --
+         * just barriers where the kernel reads or writes the indices.
+         *
+         */
+        class Ring {
+            public:
+                Ring() : fd_( -1 ), sqRing_( MAP_FAILED ), cqRing_( MAP_FAILED ), sqes_( ( io_uring_sqe* )MAP_FAILED ), queued_( 0 ) {}
+
+                ~Ring() {
+                    if ( MAP_FAILED != ( void* )sqes_ ) {
+                        munmap( sqes_, sqesSize_ );
+                    }
+
+                    if ( MAP_FAILED != cqRing_ && cqRing_ != sqRing_ ) {
+                        munmap( cqRing_, cqSize_ );
+                    }
+
+                    if ( MAP_FAILED != sqRing_ ) {
+                        munmap( sqRing_, sqSize_ );
+                    }
+
+                    if ( -1 != fd_ ) {
+                        close( fd_ );
+                    }
+                }
+
+                /**
+                 * Set up the ring
+                 *
+                 * @return  true if the kernel has io_uring with the operations used here (5.6), false otherwise
+                 */
+                bool setup( unsigned entries ) {
+                    io_uring_params params;
+                    memset( &params, 0, sizeof( params ) );
+
+                    fd_ = syscall( __NR_io_uring_setup, entries, &params );
+
+                    if ( -1 == fd_ || !( params.features & IORING_FEAT_RW_CUR_POS ) ) {
+                        return false;
+                    }
+
+                    sqSize_ = params.sq_off.array + params.sq_entries * sizeof( unsigned );
+                    cqSize_ = params.cq_off.cqes + params.cq_entries * sizeof( io_uring_cqe );
+
+                    if ( params.features & IORING_FEAT_SINGLE_MMAP ) {
+                        sqSize_ = cqSize_ = std::max( sqSize_, cqSize_ );
+                    }
+
+                    sqRing_ = mmap( 0, sqSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING );
+
+                    if ( MAP_FAILED == sqRing_ ) {
+                        return false;
+                    }
+
+                    cqRing_ = params.features & IORING_FEAT_SINGLE_MMAP ? sqRing_ :
+                              mmap( 0, cqSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING );
+
+                    if ( MAP_FAILED == cqRing_ ) {
+                        return false;
+                    }
+
+                    sqesSize_ = params.sq_entries * sizeof( io_uring_sqe );
+                    sqes_ = ( io_uring_sqe* )mmap( 0, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES );
+
+                    if ( MAP_FAILED == ( void* )sqes_ ) {
+                        return false;
+                    }
+
+                    char* sq( ( char* )sqRing_ );
+                    char* cq( ( char* )cqRing_ );
+
+                    sqHead_ = ( unsigned* )( sq + params.sq_off.head );
+                    sqTail_ = ( unsigned* )( sq + params.sq_off.tail );
+                    sqMask_ = *( unsigned* )( sq + params.sq_off.ring_mask );
+                    sqArray_ = ( unsigned* )( sq + params.sq_off.array );
+                    cqHead_ = ( unsigned* )( cq + params.cq_off.head );
+                    cqTail_ = ( unsigned* )( cq + params.cq_off.tail );
+                    cqMask_ = *( unsigned* )( cq + params.cq_off.ring_mask );
+                    cqes_ = ( io_uring_cqe* )( cq + params.cq_off.cqes );
+
+                    return true;
+                }
+
+                /**
+                 * Queue an operation -- the caller keeps no more in flight than the ring has entries
+                 */
+                io_uring_sqe* queue( unsigned char opcode, int fd, const void* address, unsigned length, boost::uint64_t offset, boost::uint64_t data ) {
+                    unsigned tail( *sqTail_ + queued_ );
+                    io_uring_sqe* sqe( &sqes_[ tail & sqMask_ ] );
+
+                    memset( sqe, 0, sizeof( *sqe ) );
+                    sqe->opcode = opcode;
+                    sqe->fd = fd;
+                    sqe->addr = ( unsigned long )address;
+                    sqe->len = length;
+                    sqe->off = offset;
+                    sqe->user_data = data;
+
+                    sqArray_[ tail & sqMask_ ] = tail & sqMask_;
+                    ++queued_;
+
+                    return sqe;
+                }
+
+                /**
+                 * Submit what was queued and wait for at least one completion
+                 *
+                 * @return  true if successful, false otherwise
+                 */
+                bool submit_and_wait() {
+                    // The entries must be visible before the new tail
+                    __sync_synchronize();
+                    *sqTail_ += queued_;
+                    __sync_synchronize();
+
+                    unsigned submit( queued_ );
+                    queued_ = 0;
+
+                    for ( ;; ) {
+                        int n( syscall( __NR_io_uring_enter, fd_, submit, 1, IORING_ENTER_GETEVENTS, 0, 0 ) );
+
+                        if ( 0 <= n ) {
+                            return true;
+                        }
+
+                        if ( EINTR != errno ) {
+                            return false;
+                        }
+
+                        // Interrupted after submitting -- only wait
+                        submit = 0;
+                    }
+                }
+
+                /**
+                 * Take back what the kernel didn't consume of a failed submission
+                 *
+                 * Only io_uring_enter() consumes entries, so they can be
+                 * dropped once it returned.
+                 *
+                 * @param  data  receives the data of the dropped operations
+                 */
+                void retract( std::vector< boost::uint64_t >& data ) {
+                    __sync_synchronize();
+
+                    unsigned head( *sqHead_ );
+
+                    for ( unsigned i( head ); i != *sqTail_; ++i ) {
+                        data.push_back( sqes_[ sqArray_[ i & sqMask_ ] ].user_data );
+                    }
+
+                    *sqTail_ = head;
+                    __sync_synchronize();
+                }
+
+                /**
+                 * Wait for at least one completion without submitting
+                 *
+                 * @return  true if successful, false otherwise
+                 */
+                bool wait() {
+                    for ( ;; ) {
+                        if ( 0 <= syscall( __NR_io_uring_enter, fd_, 0, 1, IORING_ENTER_GETEVENTS, 0, 0 ) ) {
+                            return true;
+                        }
+
+                        if ( EINTR != errno ) {
+                            return false;
+                        }
+                    }
+                }
+
+                /**
+                 * Take the next completion
+                 *
+                 * @return  true if there was one, false otherwise
+                 */
+                bool complete( boost::uint64_t& data, int& result ) {
+                    unsigned head( *cqHead_ );
+
+                    __sync_synchronize();
+
+                    if ( head == *cqTail_ ) {
+                        return false;
+                    }
+
+                    data = cqes_[ head & cqMask_ ].user_data;
+                    result = cqes_[ head & cqMask_ ].res;
+
+                    __sync_synchronize();
+                    *cqHead_ = head + 1;
+
+                    return true;
+                }
+
+            private:
+                int fd_;
+                void* sqRing_;
+                void* cqRing_;
+                io_uring_sqe* sqes_;
+                io_uring_cqe* cqes_;
+                std::size_t sqSize_, cqSize_, sqesSize_;
+                unsigned* sqHead_;
+                unsigned* sqTail_;
+                unsigned* sqArray_;
+                unsigned* cqHead_;
+                unsigned* cqTail_;
+                unsigned sqMask_, cqMask_;
+                unsigned queued_;
+        };
+
+
+        /**
+         * All operations of a batch on one ring.
+         *
+         */
+        class UringEngine : public IoEngine {
+            public:
+                UringEngine() : failed_( false ) {}
+
+                bool setup() {
+                    return ring_.setup( QUEUE_DEPTH );
+                }
+
+                virtual const char* name() const {
+                    return "io_uring";
+                }
+
+                virtual void stat( std::vector< StatRequest >& requests ) {
+                    if ( failed_ ) {
+                        ThreadEngine().stat( requests );
+                        return;
+                    }
+
+                    std::vector< struct statx > buffers( std::min< std::size_t >( requests.size(), QUEUE_DEPTH ) );
+                    std::vector< std::size_t > slots( buffers.size() );
+                    std::vector< std::size_t > free;
+
+                    for ( std::size_t i( buffers.size() ); i--; ) {
+                        free.push_back( i );
+                    }
+
+                    std::size_t next( 0 ), inFlight( 0 );
+
+                    while ( next < requests.size() || inFlight ) {
+                        for ( ; next < requests.size() && !free.empty(); ++next, ++inFlight ) {
+                            std::size_t slot( free.back() );
+                            free.pop_back();
+                            slots[ slot ] = next;
+
+                            ring_.queue( IORING_OP_STATX, AT_FDCWD, requests[ next ].path.c_str(),
+                                         STATX_TYPE | STATX_SIZE | STATX_MTIME, ( unsigned long )&buffers[ slot ], slot );
+                        }
+
+                        bool submitted( ring_.submit_and_wait() );
+                        std::vector< boost::uint64_t > dropped;
+
+                        if ( !submitted ) {
+                            failed_ = true;
+                            ring_.retract( dropped );
+                            inFlight -= dropped.size();
+                        }
+
+                        // After a failure, the kernel may only write to the buffers until the last completion
+                        do {
+                            boost::uint64_t slot;
+                            int result;
+
+                            while ( ring_.complete( slot, result ) ) {
+                                StatRequest& request( requests[ slots[ slot ] ] );
+                                const struct statx& buffer( buffers[ slot ] );
+
+                                request.done = 0 == result;
+
+                                if ( request.done ) {
+                                    request.stats.size = buffer.stx_size;
+                                    request.stats.mtime = buffer.stx_mtime.tv_sec;
+                                    request.stats.directory = S_ISDIR( buffer.stx_mode );
+                                }
+
+                                free.push_back( slot );
+                                --inFlight;
+                            }
+                        } while ( !submitted && inFlight && ring_.wait() );
+
+                        if ( !submitted ) {
+                            if ( inFlight ) {
+                                // Still in the kernel's hands -- never free them
+                                buffers.swap( *new std::vector< struct statx > );
+                            }
+
+                            // The rest on threads
+                            std::vector< StatRequest > rest;
+                            std::vector< std::size_t > indices;
+
+                            for ( std::size_t i( 0 ); i < dropped.size(); ++i ) {
+                                indices.push_back( slots[ dropped[ i ] ] );
+                            }
+
+                            for ( ; next < requests.size(); ++next ) {
+                                indices.push_back( next );
+                            }
+
+                            for ( std::size_t i( 0 ); i < indices.size(); ++i ) {
+                                rest.push_back( requests[ indices[ i ] ] );
+                            }
+
+                            ThreadEngine().stat( rest );
+
+                            for ( std::size_t i( 0 ); i < indices.size(); ++i ) {
+                                requests[ indices[ i ] ] = rest[ i ];
+                            }
+
+                            return;
+                        }
+                    }
+                }
+
+                virtual void copy( std::vector< CopyRequest >& requests ) {
+                    if ( failed_ ) {
+                        ThreadEngine().copy( requests );
+                        return;
+                    }
+
+                    // A copy has one operation in flight at a time
+                    std::vector< Stream > streams( std::min< std::size_t >( requests.size(), QUEUE_DEPTH ) );
+                    std::vector< std::size_t > free;
+
+                    for ( std::size_t i( streams.size() ); i--; ) {
+                        free.push_back( i );
+                    }
+
+                    std::size_t next( 0 ), inFlight( 0 );
+
+                    while ( next < requests.size() || inFlight ) {
+                        for ( ; next < requests.size() && !free.empty(); ++next, ++inFlight ) {
+                            std::size_t slot( free.back() );
+                            free.pop_back();
+
+                            start( streams[ slot ], requests[ next ], slot );
+                        }
+
+                        if ( !ring_.submit_and_wait() ) {
+                            failed_ = true;
+                            drain( requests, streams, inFlight, next );
+                            return;
+                        }
+
+                        boost::uint64_t slot;
+                        int result;
+
+                        while ( ring_.complete( slot, result ) ) {
+                            if ( !advance( streams[ slot ], result, slot ) ) {
+                                free.push_back( slot );
+                                --inFlight;
+                            }
+                        }
+                    }
+                }
+
+            private:
+                enum Phase {
+                    OPEN_SOURCE,
+                    OPEN_DESTINATION,
+                    READ,
+                    WRITE
+                };
+
+                struct Stream {
+                    CopyRequest* request;
+                    Phase phase;
+                    int in, out;
+                    boost::uint64_t offset;
+                    unsigned length, written;
+                    std::vector< char > buffer;
+                    StopWatch watch;
+                };
+
+                Ring ring_;
+                bool failed_;
+
+                /**
+                 * Give up on the ring after a failed submission
+                 *
+                 * Drops what the kernel didn't take, waits for what it did and
+                 * copies the unfinished requests on threads instead.
+                 */
+                void drain( std::vector< CopyRequest >& requests, std::vector< Stream >& streams, std::size_t inFlight, std::size_t next ) {
+                    std::vector< boost::uint64_t > dropped;
+                    std::vector< std::size_t > indices;
+
+                    ring_.retract( dropped );
+                    inFlight -= dropped.size();
+
+                    for ( std::size_t i( 0 ); i < dropped.size(); ++i ) {
+                        Stream& stream( streams[ dropped[ i ] ] );
+
+                        finish( stream, false );
+                        indices.push_back( stream.request - &requests[ 0 ] );
+                    }
+
+                    // The kernel may only use the buffers until the last completion
+                    do {
+                        boost::uint64_t slot;
+                        int result;
+
+                        while ( ring_.complete( slot, result ) ) {
+                            Stream& stream( streams[ slot ] );
+
+                            if ( 0 <= result && OPEN_SOURCE == stream.phase ) {
+                                stream.in = result;
+                            }
+                            else if ( 0 <= result && OPEN_DESTINATION == stream.phase ) {
+                                stream.out = result;
+                            }
+
+                            finish( stream, false );
+                            indices.push_back( stream.request - &requests[ 0 ] );
+                            --inFlight;
+                        }
+                    } while ( inFlight && ring_.wait() );
+
+                    if ( inFlight ) {
+                        // Still in the kernel's hands -- never free them
+                        streams.swap( *new std::vector< Stream > );
+                    }
+
+                    for ( ; next < requests.size(); ++next ) {
+                        indices.push_back( next );
+                    }
+
+                    std::vector< CopyRequest > rest;
+
+                    for ( std::size_t i( 0 ); i < indices.size(); ++i ) {
+                        rest.push_back( requests[ indices[ i ] ] );
+                    }
+
+                    ThreadEngine().copy( rest );
+
+                    for ( std::size_t i( 0 ); i < indices.size(); ++i ) {
+                        requests[ indices[ i ] ] = rest[ i ];
+                    }
+                }
+
+                void start( Stream& stream, CopyRequest& request, std::size_t slot ) {
+                    stream.request = &request;
+                    stream.phase = OPEN_SOURCE;
+                    stream.in = stream.out = -1;
+                    stream.offset = 0;
+                    stream.buffer.resize( COPY_BLOCK_SIZE );
+                    stream.watch = StopWatch();
+
+                    io_uring_sqe* sqe( ring_.queue( IORING_OP_OPENAT, AT_FDCWD, request.source.c_str(), 0, 0, slot ) );
+                    sqe->open_flags = O_RDONLY;
+                }
+
+                /**
+                 * Take a stream's completed operation and queue its next one
+                 *
+                 * @return  true if the stream goes on, false if it is finished
+                 */
+                bool advance( Stream& stream, int result, std::size_t slot ) {
+                    if ( result < 0 ) {
+                        return finish( stream, false );
+                    }
+
+                    switch ( stream.phase ) {
+                        case OPEN_SOURCE: {
+                            stream.in = result;
+                            stream.phase = OPEN_DESTINATION;
+
+                            // A new file, never one somebody else writes or reads
+                            io_uring_sqe* sqe( ring_.queue( IORING_OP_OPENAT, AT_FDCWD, stream.request->destination.c_str(), 0644, 0, slot ) );
+                            sqe->open_flags = O_WRONLY | O_CREAT | O_EXCL;
+                            return true;
+                        }
+
+                        case OPEN_DESTINATION:
+                            stream.out = result;
+                            break;
+
+                        case READ:
+                            if ( !result ) {
+                                return finish( stream, true );
+                            }
+
+                            stream.length = result;
+                            stream.written = 0;
+                            break;
+
+                        case WRITE:
+                            if ( !result ) {
+                                return finish( stream, false );
+                            }
+
+                            stream.written += result;
+                            break;
+                    }
+
+                    if ( READ == stream.phase || ( WRITE == stream.phase && stream.written < stream.length ) ) {
+                        stream.phase = WRITE;
+                        ring_.queue( IORING_OP_WRITE, stream.out, &stream.buffer[ stream.written ], stream.length - stream.written,
+                                     stream.offset + stream.written, slot );
+                        return true;
+                    }
+
+                    if ( WRITE == stream.phase ) {
+                        stream.offset += stream.length;
+                    }
+
+                    stream.phase = READ;
+                    ring_.queue( IORING_OP_READ, stream.in, &stream.buffer[ 0 ], stream.buffer.size(), stream.offset, slot );
+                    return true;
+                }
+
+                bool finish( Stream& stream, bool success ) {
+                    if ( -1 != stream.in ) {
+                        close( stream.in );
+                    }
+
+                    if ( -1 != stream.out && close( stream.out ) ) {
+                        success = false;
+                    }
+
+                    if ( !success && -1 != stream.out ) {
+                        unlink( stream.request->destination.c_str() );
+                    }
+
+                    stream.request->done = success;
+                    stream.request->seconds = stream.watch.seconds();
+
+                    // The buffer isn't needed until the slot starts another copy
+                    std::vector< char >().swap( stream.buffer );
+
+                    return false;
+                }
+        };
+#endif
+
+    } // anonymous namespace
+
+
+    IoEngine::~IoEngine()
+    {
+    }
+
+
+    IoEngine* IoEngine::create( bool uring )
+    {
+#if defined( FILECACHE_URING )
+        if ( uring ) {
+            UringEngine* engine( new UringEngine );
+
+            if ( engine->setup() ) {
+                return engine;
+            }
+
+            // Kernel too old, or io_uring switched off
+            delete engine;
+        }
+#endif
+
+        return new ThreadEngine;
+    }
+
+
+} // namespace Jupiter
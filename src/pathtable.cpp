@@ -0,0 +1,327 @@
+/**@file
+ *
+ * Interned paths and sets of them, for the cache inventory.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010  Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+// Own headers
+#include <pathtable.hpp>
+
+// Standard headers
+#include <algorithm> // lower_bound(), binary_search()
+#include <cstring> // memcmp(), memcpy()
+
+
+namespace Jupiter {
+
+
+    namespace {
+
+        // FNV-1a
+        boost::uint32_t hash_string( const char* data, std::size_t length )
+        {
+            boost::uint32_t hash( 2166136261u );
+
+            for ( std::size_t i( 0 ); i < length; ++i ) {
+                hash = ( hash ^ ( unsigned char )data[ i ] ) * 16777619u;
+            }
+
+            return hash;
+        }
+
+    } // anonymous namespace
+
+
+    PathTable::PathTable()
+        : blockUsed_( BLOCK_SIZE ), slots_( 1024, ( PathId )EMPTY )
+    {
+    }
+
+
+    PathTable::~PathTable()
+    {
+        for ( std::vector< char* >::iterator it( blocks_.begin() ); it != blocks_.end(); ++it ) {
+            delete[] *it;
+        }
+    }
+
+
+    PathId PathTable::intern( const std::string& path )
+    {
+        return intern( path.data(), path.size() );
+    }
+
+
+    PathId PathTable::intern( const char* path, std::size_t length )
+    {
+        boost::uint32_t hash( hash_string( path, length ) );
+
+        boost::mutex::scoped_lock lock( mutex_ );
+
+        std::size_t index( slot( path, length, hash ) );
+
+        if ( EMPTY != slots_[ index ] ) {
+            return slots_[ index ];
+        }
+
+        Entry entry;
+        store( entry, path, length );
+        entry.length = length;
+        entry.hash = hash;
+        entry.exposed = false;
+
+        PathId id;
+
+        if ( free_.empty() ) {
+            id = entries_.size();
+            entries_.push_back( entry );
+        } else {
+            id = free_.back();
+            free_.pop_back();
+            entries_[ id ] = entry;
+        }
+
+        slots_[ index ] = id;
+
+        // Keep the table at most half full
+        if ( ( entries_.size() - free_.size() ) * 2 > slots_.size() ) {
+            rehash( slots_.size() * 2 );
+        }
+
+        return id;
+    }
+
+
+    bool PathTable::find( const std::string& path, PathId& id ) const
+    {
+        return find( path.data(), path.size(), id );
+    }
+
+
+    bool PathTable::find( const char* path, std::size_t length, PathId& id ) const
+    {
+        boost::uint32_t hash( hash_string( path, length ) );
+
+        boost::mutex::scoped_lock lock( mutex_ );
+
+        id = slots_[ slot( path, length, hash ) ];
+
+        return EMPTY != id;
+    }
+
+
+    std::string PathTable::path( PathId id ) const
+    {
+        boost::mutex::scoped_lock lock( mutex_ );
+
+        if ( id >= entries_.size() || !entries_[ id ].data ) {
+            return std::string();
+        }
+
+        return std::string( entries_[ id ].data, entries_[ id ].length );
+    }
+
+
+    const char* PathTable::c_str( PathId id )
+    {
+        boost::mutex::scoped_lock lock( mutex_ );
+
+        if ( id >= entries_.size() ) {
+            return 0;
+        }
+
+        // The caller may keep the string for good
+        entries_[ id ].exposed = true;
+
+        return entries_[ id ].data;
+    }
+
+
+    std::size_t PathTable::retain( const std::vector< PathId >& live )
+    {
+        boost::mutex::scoped_lock lock( mutex_ );
+
+        std::size_t removed( 0 );
+
+        for ( PathId id( 0 ); id < entries_.size(); ++id ) {
+            Entry& entry( entries_[ id ] );
+
+            if ( !entry.data || entry.exposed || std::binary_search( live.begin(), live.end(), id ) ) {
+                continue;
+            }
+
+            blockLive_[ entry.block ] -= entry.length + 1;
+
+            // The block being filled stays, store() frees it once it's full
+            if ( !blockLive_[ entry.block ] && entry.block + 1 != blocks_.size() ) {
+                delete[] blocks_[ entry.block ];
+                blocks_[ entry.block ] = 0;
+            }
+
+            entry.data = 0;
+            free_.push_back( id );
+            ++removed;
+        }
+
+        if ( removed ) {
+            rehash( slots_.size() );
+        }
+
+        return removed;
+    }
+
+
+    std::size_t PathTable::size() const
+    {
+        boost::mutex::scoped_lock lock( mutex_ );
+
+        return entries_.size() - free_.size();
+    }
+
+
+    /**
+     * The slot holding a path, or the empty slot it would go to
+     *
+     */
+    std::size_t PathTable::slot( const char* data, std::size_t length, boost::uint32_t hash ) const
+    {
+        std::size_t mask( slots_.size() - 1 );
+
+        for ( std::size_t index( hash & mask ); ; index = ( index + 1 ) & mask ) {
+            PathId id( slots_[ index ] );
+
+            if ( EMPTY == id ) {
+                return index;
+            }
+
+            const Entry& entry( entries_[ id ] );
+
+            if ( entry.hash == hash && entry.length == length && !memcmp( entry.data, data, length ) ) {
+                return index;
+            }
+        }
+    }
+
+
+    void PathTable::store( Entry& entry, const char* data, std::size_t length )
+    {
+        // Terminated, so c_str() can hand out the stored string
+        if ( blockUsed_ + length + 1 > BLOCK_SIZE ) {
+            // A full block whose paths were all removed meanwhile
+            if ( !blocks_.empty() && !blockLive_.back() ) {
+                delete[] blocks_.back();
+                blocks_.back() = 0;
+            }
+
+            // Paths longer than a block get one of their own
+            blocks_.push_back( new char[ std::max< std::size_t >( BLOCK_SIZE, length + 1 ) ] );
+            blockLive_.push_back( 0 );
+            blockUsed_ = 0;
+        }
+
+        char* result( blocks_.back() + blockUsed_ );
+        memcpy( result, data, length );
+        result[ length ] = '\0';
+        blockUsed_ += length + 1;
+        blockLive_.back() += length + 1;
+
+        entry.data = result;
+        entry.block = blocks_.size() - 1;
+    }
+
+
+    void PathTable::rehash( std::size_t size )
+    {
+        std::vector< PathId > slots( size, ( PathId )EMPTY );
+        std::size_t mask( slots.size() - 1 );
+
+        for ( PathId id( 0 ); id < entries_.size(); ++id ) {
+            if ( !entries_[ id ].data ) {
+                continue;
+            }
+
+            std::size_t index( entries_[ id ].hash & mask );
+
+            while ( EMPTY != slots[ index ] ) {
+                index = ( index + 1 ) & mask;
+            }
+
+            slots[ index ] = id;
+        }
+
+        slots_.swap( slots );
+    }
+
+
+    bool PathIdSet::insert( PathId id )
+    {
+        std::vector< PathId >::iterator it( std::lower_bound( ids_.begin(), ids_.end(), id ) );
+
+        if ( ids_.end() != it && id == *it ) {
+            return false;
+        }
+
+        ids_.insert( it, id );
+        return true;
+    }
+
+
+    bool PathIdSet::erase( PathId id )
+    {
+        std::vector< PathId >::iterator it( std::lower_bound( ids_.begin(), ids_.end(), id ) );
+
+        if ( ids_.end() == it || id != *it ) {
+            return false;
+        }
+
+        ids_.erase( it );
+        return true;
+    }
+
+
+    bool PathIdSet::count( PathId id ) const
+    {
+        return std::binary_search( ids_.begin(), ids_.end(), id );
+    }
+
+
+    bool PathIdSet::empty() const
+    {
+        return ids_.empty();
+    }
+
+
+    std::size_t PathIdSet::size() const
+    {
+        return ids_.size();
+    }
+
+
+    const std::vector< PathId >& PathIdSet::ids() const
+    {
+        return ids_;
+    }
+
+
+} // namespace Jupiter
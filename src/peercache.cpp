@@ -0,0 +1,930 @@
+/**@file
+ *
+ * Peer-to-peer fetching of cached files between render nodes.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010  Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+// Own headers
+#include <peercache.hpp>
+
+// Standard headers
+#include <cstring> // memcpy()
+#include <sstream> // istringstream, ostringstream
+
+// System headers
+#include <errno.h> // errno
+#include <fcntl.h> // open(), fcntl()
+#include <netdb.h> // getaddrinfo()
+#include <arpa/inet.h> // htonl(), ntohl()
+#include <netinet/in.h> // sockaddr_in
+#include <sys/select.h> // select()
+#include <sys/socket.h> // socket()
+#include <sys/stat.h> // fstat(), lstat(), fchmod()
+#include <limits.h> // PATH_MAX
+#include <stdio.h> // rename()
+#include <stdlib.h> // realpath(), mkstemp()
+#include <unistd.h> // read(), write(), close()
+#if defined( LINUX )
+# include <sys/sendfile.h> // sendfile()
+#endif
+#ifndef MSG_NOSIGNAL
+# define MSG_NOSIGNAL 0
+#endif
+
+// Boost headers
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/tokenizer.hpp>
+
+
+namespace Jupiter {
+
+
+    namespace {
+
+        enum {
+            CONNECT_TIMEOUT = 2,  // Seconds to wait for a peer to accept a connection
+            IO_TIMEOUT = 30,      // Seconds a stalled transfer is allowed to hang
+            BUFFER_SIZE = 65536
+        };
+
+        /**
+         * Buffered reading of protocol lines from a socket.
+         *
+         * Any bytes read past the end of a line are kept and handed out by
+         * read() before the socket is read again.
+         */
+        class LineReader {
+            public:
+                LineReader( int fd ) : fd_( fd ), begin_( 0 ), end_( 0 ) {}
+
+                bool line( std::string& result ) {
+                    result.clear();
+
+                    for ( ;; ) {
+                        for ( ; begin_ < end_; ++begin_ ) {
+                            if ( '\n' == buffer_[ begin_ ] ) {
+                                ++begin_;
+                                return true;
+                            }
+
+                            result += buffer_[ begin_ ];
+                        }
+
+                        if ( !fill() ) {
+                            return false;
+                        }
+                    }
+                }
+
+                ssize_t read( char* data, size_t size ) {
+                    if ( begin_ == end_ && !fill() ) {
+                        return 0;
+                    }
+
+                    size_t n( std::min( size, end_ - begin_ ) );
+                    memcpy( data, buffer_ + begin_, n );
+                    begin_ += n;
+
+                    return n;
+                }
+
+            private:
+                int fd_;
+                char buffer_[ BUFFER_SIZE ];
+                size_t begin_, end_;
+
+                bool fill() {
+                    ssize_t n;
+
+                    do {
+                        n = ::read( fd_, buffer_, BUFFER_SIZE );
+                    } while ( -1 == n && EINTR == errno );
+
+                    begin_ = 0;
+                    end_ = n > 0 ? n : 0;
+
+                    return n > 0;
+                }
+        };
+
+
+        bool read_all( LineReader& reader, char* data, size_t size )
+        {
+            while ( size ) {
+                ssize_t n( reader.read( data, size ) );
+
+                if ( n <= 0 ) {
+                    return false;
+                }
+
+                data += n;
+                size -= n;
+            }
+
+            return true;
+        }
+
+
+        bool write_all( int fd, const char* data, size_t size )
+        {
+            while ( size ) {
+                ssize_t n( ::write( fd, data, size ) );
+
+                if ( -1 == n ) {
+                    if ( EINTR == errno ) {
+                        continue;
+                    }
+
+                    return false;
+                }
+
+                data += n;
+                size -= n;
+            }
+
+            return true;
+        }
+
+
+        /**
+         * Send a string to a peer.
+         *
+         * A peer that went away must not kill the sending process with SIGPIPE.
+         */
+        bool send_all( int fd, const char* data, size_t size )
+        {
+            while ( size ) {
+                ssize_t n( send( fd, data, size, MSG_NOSIGNAL ) );
+
+                if ( -1 == n ) {
+                    if ( EINTR == errno ) {
+                        continue;
+                    }
+
+                    return false;
+                }
+
+                data += n;
+                size -= n;
+            }
+
+            return true;
+        }
+
+
+        bool send_all( int fd, const std::string& data )
+        {
+            return send_all( fd, data.data(), data.size() );
+        }
+
+
+        void set_timeouts( int fd )
+        {
+            struct timeval timeout;
+            timeout.tv_sec = IO_TIMEOUT;
+            timeout.tv_usec = 0;
+
+            setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof( timeout ) );
+            setsockopt( fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof( timeout ) );
+        }
+
+
+        /**
+         * Connect to a peer without blocking for longer than CONNECT_TIMEOUT.
+         *
+         * A dead node on the farm must not stall a render for the duration of
+         * the TCP connect timeout.
+         *
+         * @return  the connected socket, -1 on failure
+         */
+        int connect_to( const std::string& host, const std::string& port )
+        {
+            struct addrinfo hints;
+            memset( &hints, 0, sizeof( hints ) );
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+
+            struct addrinfo* addresses;
+
+            if ( getaddrinfo( host.c_str(), port.c_str(), &hints, &addresses ) ) {
+                return -1;
+            }
+
+            int fd( -1 );
+
+            for ( struct addrinfo* a( addresses ); a && -1 == fd; a = a->ai_next ) {
+                fd = socket( a->ai_family, a->ai_socktype, a->ai_protocol );
+
+                if ( -1 == fd ) {
+                    continue;
+                }
+
+                int flags( fcntl( fd, F_GETFL, 0 ) );
+                fcntl( fd, F_SETFL, flags | O_NONBLOCK );
+
+                bool connected( !connect( fd, a->ai_addr, a->ai_addrlen ) );
+
+                if ( !connected && EINPROGRESS == errno ) {
+                    fd_set writable;
+                    FD_ZERO( &writable );
+                    FD_SET( fd, &writable );
+
+                    struct timeval timeout;
+                    timeout.tv_sec = CONNECT_TIMEOUT;
+                    timeout.tv_usec = 0;
+
+                    if ( 0 < select( fd + 1, NULL, &writable, NULL, &timeout ) ) {
+                        int error( 0 );
+                        socklen_t length( sizeof( error ) );
+
+                        connected = !getsockopt( fd, SOL_SOCKET, SO_ERROR, &error, &length ) && !error;
+                    }
+                }
+
+                if ( connected ) {
+                    fcntl( fd, F_SETFL, flags );
+                    set_timeouts( fd );
+                } else {
+                    close( fd );
+                    fd = -1;
+                }
+            }
+
+            freeaddrinfo( addresses );
+
+            return fd;
+        }
+
+    } // anonymous namespace
+
+
+    PeerServer::PeerServer( const fs::path& location, unsigned short port, const std::string& address )
+        : location_( location ), port_( port ), address_( address ), socket_( -1 ), running_( false ), thread_( 0 ), connections_( 0 )
+    {
+    }
+
+
+    PeerServer::~PeerServer()
+    {
+        stop();
+    }
+
+
+    bool PeerServer::start()
+    {
+        if ( running_ ) {
+            return true;
+        }
+
+        struct addrinfo hints;
+        memset( &hints, 0, sizeof( hints ) );
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+
+        struct addrinfo* addresses;
+
+        // An empty address means all interfaces
+        if ( getaddrinfo( address_.empty() ? NULL : address_.c_str(),
+                          boost::lexical_cast< std::string >( port_ ).c_str(), &hints, &addresses ) ) {
+            return false;
+        }
+
+        socket_ = socket( addresses->ai_family, addresses->ai_socktype, addresses->ai_protocol );
+
+        if ( -1 == socket_ ) {
+            freeaddrinfo( addresses );
+            return false;
+        }
+
+        int on( 1 );
+        setsockopt( socket_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof( on ) );
+
+        bool listening( !bind( socket_, addresses->ai_addr, addresses->ai_addrlen ) && !listen( socket_, SOMAXCONN ) );
+
+        freeaddrinfo( addresses );
+
+        if ( !listening ) {
+            close( socket_ );
+            socket_ = -1;
+            return false;
+        }
+
+        running_ = true;
+        thread_ = new boost::thread( boost::bind( &PeerServer::run, this ) );
+
+        return true;
+    }
+
+
+    void PeerServer::stop()
+    {
+        running_ = false;
+
+        if ( thread_ ) {
+            thread_->join();
+            delete thread_;
+            thread_ = 0;
+        }
+
+        if ( -1 != socket_ ) {
+            close( socket_ );
+            socket_ = -1;
+        }
+
+        // Connections reference this instance -- wait for them to finish
+        boost::mutex::scoped_lock lock( connectionMutex_ );
+
+        while ( connections_ ) {
+            idle_.wait( lock );
+        }
+    }
+
+
+    void PeerServer::run()
+    {
+        while ( running_ ) {
+            // Wake up regularly to notice stop()
+            fd_set readable;
+            FD_ZERO( &readable );
+            FD_SET( socket_, &readable );
+
+            struct timeval timeout;
+            timeout.tv_sec = 1;
+            timeout.tv_usec = 0;
+
+            if ( 0 < select( socket_ + 1, &readable, NULL, NULL, &timeout ) ) {
+                int connection( accept( socket_, NULL, NULL ) );
+
+                if ( -1 != connection ) {
+                    set_timeouts( connection );
+
+                    boost::mutex::scoped_lock lock( connectionMutex_ );
+                    ++connections_;
+
+                    boost::thread( boost::bind( &PeerServer::serve_connection, this, connection ) );
+                }
+            }
+        }
+    }
+
+
+    void PeerServer::writable( const fs::path& root )
+    {
+        std::string path( root.string() );
+        char resolved[ PATH_MAX ];
+
+        // Destinations are checked with their links resolved, so the roots are too
+        if ( realpath( path.c_str(), resolved ) ) {
+            path = resolved;
+        }
+
+        while ( 1 < path.size() && '/' == path[ path.size() - 1 ] ) {
+            path.erase( path.size() - 1 );
+        }
+
+        writable_.push_back( path );
+    }
+
+
+    void PeerServer::serve_connection( int connection )
+    {
+        LineReader reader( connection );
+        std::string request;
+
+        // Peers may send any number of requests over one connection
+        while ( reader.line( request ) ) {
+            if ( "LIST" == request ) {
+                serve_list( connection );
+            } else if ( 0 == request.compare( 0, 6, "FETCH " ) ) {
+                serve_fetch( connection, request );
+            } else if ( 0 == request.compare( 0, 6, "STORE " ) ) {
+                serve_store( connection, request );
+            } else {
+                break;
+            }
+        }
+
+        close( connection );
+
+        boost::mutex::scoped_lock lock( connectionMutex_ );
+
+        if ( !--connections_ ) {
+            idle_.notify_all();
+        }
+    }
+
+
+    void PeerServer::serve_list( int connection ) const
+    {
+        std::ostringstream reply;
+
+        try {
+            fs::directory_iterator end;
+
+            for ( fs::directory_iterator it( location_ ); it != end; ++it ) {
+                std::string name( it->path().leaf() );
+                struct stat stats;
+
+                if ( std::string::npos == name.find( '\n' ) &&
+                     !stat( it->path().string().c_str(), &stats ) && S_ISREG( stats.st_mode ) ) {
+                    reply << stats.st_size << ' ' << stats.st_mtime << ' ' << name << '\n';
+                }
+            }
+        } catch ( fs::filesystem_error ) {
+            // An unreadable cache simply advertises nothing
+        }
+
+        reply << ".\n";
+
+        send_all( connection, reply.str() );
+    }
+
+
+    void PeerServer::serve_fetch( int connection, const std::string& request ) const
+    {
+        std::istringstream parser( request.substr( 6 ) );
+        uintmax_t size;
+        time_t mtime;
+
+        parser >> size >> mtime;
+        parser.get(); // Skip the separator
+
+        std::string name;
+        std::getline( parser, name );
+
+        int fd( -1 );
+
+        // Never serve anything outside the cache location
+        if ( !parser.fail() && !name.empty() && std::string::npos == name.find( '/' ) && "." != name && ".." != name ) {
+            fd = open( ( location_ / name ).string().c_str(), O_RDONLY );
+        }
+
+        struct stat stats;
+
+        // Same rules as FileCache::is_different(): same size and not older
+        if ( -1 == fd || fstat( fd, &stats ) ||
+             ( uintmax_t )stats.st_size != size || stats.st_mtime < mtime ) {
+            send_all( connection, "NO\n" );
+
+            if ( -1 != fd ) {
+                close( fd );
+            }
+
+            return;
+        }
+
+        if ( send_all( connection, "OK " + boost::lexical_cast< std::string >( size ) + "\n" ) ) {
+            off_t offset( 0 );
+
+#if defined( LINUX )
+            while ( ( uintmax_t )offset < size ) {
+                ssize_t n( sendfile( connection, fd, &offset, size - offset ) );
+
+                // Zero means the file shrank under us, errno is only set on -1
+                if ( !n || ( -1 == n && EINTR != errno ) ) {
+                    break;
+                }
+            }
+#else
+            char buffer[ BUFFER_SIZE ];
+            ssize_t n;
+
+            while ( ( uintmax_t )offset < size && 0 < ( n = read( fd, buffer, BUFFER_SIZE ) ) ) {
+                if ( !send_all( connection, buffer, n ) ) {
+                    break;
+                }
+
+                offset += n;
+            }
+#endif
+        }
+
+        close( fd );
+    }
+
+
+    void PeerServer::serve_store( int connection, const std::string& request ) const
+    {
+        std::istringstream parser( request.substr( 6 ) );
+        std::string codecName;
+        uintmax_t size;
+        bool overwrite;
+
+        parser >> codecName >> size >> overwrite;
+        parser.get(); // Skip the separator
+
+        std::string path;
+        std::getline( parser, path );
+
+        Codec codec( CompressionPolicy::codec_from_name( codecName ) );
+        std::string destination( parser.fail() ? std::string() : store_path( path ) );
+        struct stat stats;
+
+        if ( CODEC_NONE == codec || destination.empty() ||
+             ( !overwrite && !lstat( destination.c_str(), &stats ) ) ) {
+            send_all( connection, "NO\n" );
+            return;
+        }
+
+        // Readers of the destination must never see a partial file. The name is
+        // new and created exclusively, so nothing planted there is followed
+        std::string partial( destination + ".filecache-partial.XXXXXX" );
+        std::vector< char > name( partial.begin(), partial.end() );
+        name.push_back( '\0' );
+
+        int out( mkstemp( &name[ 0 ] ) );
+
+        if ( -1 == out ) {
+            send_all( connection, "NO\n" );
+            return;
+        }
+
+        partial = &name[ 0 ];
+        fchmod( out, 0644 );
+
+        // The client waits for this before sending anything, so a fresh reader loses no data
+        bool success( send_all( connection, "GO\n" ) );
+
+        LineReader reader( connection );
+        std::vector< char > stored( WriteBackClient::BLOCK_SIZE );
+        std::vector< char > block( WriteBackClient::BLOCK_SIZE );
+        uintmax_t received( 0 );
+
+        while ( success ) {
+            boost::uint32_t lengths[ 2 ];
+
+            success = read_all( reader, ( char* )lengths, sizeof( lengths ) );
+
+            boost::uint32_t length( ntohl( lengths[ 0 ] ) );
+            boost::uint32_t storedLength( ntohl( lengths[ 1 ] ) );
+
+            if ( !success || !length ) {
+                break;
+            }
+
+            success = length <= WriteBackClient::BLOCK_SIZE && storedLength <= length &&
+                      read_all( reader, &stored[ 0 ], storedLength );
+
+            if ( success && storedLength == length ) {
+                success = write_all( out, &stored[ 0 ], length );
+            } else if ( success ) {
+                success = decompress_block( codec, &stored[ 0 ], storedLength, &block[ 0 ], length ) &&
+                          write_all( out, &block[ 0 ], length );
+            }
+
+            received += length;
+        }
+
+        success = !close( out ) && success && received == size &&
+                  !rename( partial.c_str(), destination.c_str() );
+
+        if ( !success ) {
+            unlink( partial.c_str() );
+        }
+
+        send_all( connection, success ? "OK\n" : "NO\n" );
+    }
+
+
+    /**
+     * Resolve where a STORE writes to
+     *
+     * The destination's directory is resolved, so a link inside a writable
+     * root can't lead out of it. The destination itself is replaced, not
+     * followed.
+     *
+     * @return  the destination in its resolved directory, empty if it isn't
+     *          below a writable root
+     */
+    std::string PeerServer::store_path( const std::string& path ) const
+    {
+        std::string::size_type slash( path.rfind( '/' ) );
+
+        if ( !is_writable( path ) || std::string::npos == slash ) {
+            return std::string();
+        }
+
+        std::string leaf( path.substr( slash + 1 ) );
+        char resolved[ PATH_MAX ];
+
+        if ( leaf.empty() || "." == leaf || !realpath( slash ? path.substr( 0, slash ).c_str() : "/", resolved ) ) {
+            return std::string();
+        }
+
+        std::string directory( resolved );
+        std::string destination( ( "/" == directory ? directory : directory + "/" ) + leaf );
+
+        return is_writable( destination ) ? destination : std::string();
+    }
+
+
+    /**
+     * Check if a path lies below one of the writable roots
+     *
+     * Relative paths and paths containing ".." components are never writable.
+     */
+    bool PeerServer::is_writable( const std::string& path ) const
+    {
+        if ( path.empty() || '/' != path[ 0 ] ||
+             std::string::npos != path.find( '\n' ) ||
+             std::string::npos != ( "/" + path + "/" ).find( "/../" ) ) {
+            return false;
+        }
+
+        for ( std::vector< std::string >::const_iterator it( writable_.begin() ); it != writable_.end(); ++it ) {
+            if ( path.size() > it->size() && 0 == path.compare( 0, it->size(), *it ) &&
+                 ( '/' == path[ it->size() ] || "/" == *it ) ) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+
+    PeerClient::PeerClient( const std::string& peers )
+        : lastRefresh_( 0 ), refresh_( 30 )
+    {
+        typedef boost::tokenizer< boost::char_separator< char > > Tokenizer;
+
+        boost::char_separator< char > separators( " ,\t\n" );
+        Tokenizer tokens( peers, separators );
+
+        for ( Tokenizer::iterator it( tokens.begin() ); it != tokens.end(); ++it ) {
+            std::string::size_type colon( it->rfind( ':' ) );
+
+            if ( std::string::npos != colon ) {
+                Peer peer;
+                peer.host = it->substr( 0, colon );
+                peer.port = it->substr( colon + 1 );
+                peer.reachable = false;
+
+                peers_.push_back( peer );
+            }
+        }
+    }
+
+
+    bool PeerClient::empty() const
+    {
+        boost::mutex::scoped_lock lock( mutex_ );
+
+        return peers_.empty();
+    }
+
+
+    void PeerClient::refresh( unsigned seconds )
+    {
+        boost::mutex::scoped_lock lock( mutex_ );
+
+        refresh_ = seconds;
+    }
+
+
+    bool PeerClient::fetch( const std::string& name, uintmax_t size, time_t mtime, const fs::path& destination )
+    {
+        std::vector< Peer > candidates;
+        std::vector< Peer > advertised;
+
+        {
+            boost::mutex::scoped_lock lock( mutex_ );
+
+            // Claim the refresh so no other thread queries the peers meanwhile
+            if ( time( NULL ) - lastRefresh_ >= ( time_t )refresh_ ) {
+                lastRefresh_ = time( NULL );
+                advertised = peers_;
+            }
+        }
+
+        // Querying peers may take up to CONNECT_TIMEOUT each, so it runs unlocked
+        if ( !advertised.empty() ) {
+            query_advertisements( advertised );
+        }
+
+        {
+            boost::mutex::scoped_lock lock( mutex_ );
+
+            if ( !advertised.empty() ) {
+                peers_.swap( advertised );
+            }
+
+            for ( std::vector< Peer >::const_iterator it( peers_.begin() ); it != peers_.end(); ++it ) {
+                if ( it->reachable && it->holds.count( name ) ) {
+                    Peer candidate;
+                    candidate.host = it->host;
+                    candidate.port = it->port;
+
+                    candidates.push_back( candidate );
+                }
+            }
+        }
+
+        // Transfers run unlocked so a large file doesn't hold up other fetches
+        for ( std::vector< Peer >::const_iterator it( candidates.begin() ); it != candidates.end(); ++it ) {
+            if ( fetch_from( *it, name, size, mtime, destination ) ) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+
+    void PeerClient::query_advertisements( std::vector< Peer >& peers )
+    {
+        for ( std::vector< Peer >::iterator it( peers.begin() ); it != peers.end(); ++it ) {
+            it->holds.clear();
+            it->reachable = false;
+
+            int fd( connect_to( it->host, it->port ) );
+
+            if ( -1 == fd ) {
+                continue;
+            }
+
+            if ( send_all( fd, "LIST\n" ) ) {
+                LineReader reader( fd );
+                std::string line;
+
+                while ( reader.line( line ) ) {
+                    if ( "." == line ) {
+                        it->reachable = true;
+                        break;
+                    }
+
+                    // size mtime name
+                    std::string::size_type first( line.find( ' ' ) );
+                    std::string::size_type second( std::string::npos == first ? first : line.find( ' ', first + 1 ) );
+
+                    if ( std::string::npos != second ) {
+                        it->holds.insert( line.substr( second + 1 ) );
+                    }
+                }
+            }
+
+            close( fd );
+        }
+
+    }
+
+
+    bool PeerClient::fetch_from( const Peer& peer, const std::string& name, uintmax_t size, time_t mtime, const fs::path& destination ) const
+    {
+        int fd( connect_to( peer.host, peer.port ) );
+
+        if ( -1 == fd ) {
+            return false;
+        }
+
+        std::ostringstream request;
+        request << "FETCH " << size << ' ' << mtime << ' ' << name << '\n';
+
+        LineReader reader( fd );
+        std::string reply;
+        bool success( false );
+
+        if ( send_all( fd, request.str() ) && reader.line( reply ) &&
+             "OK " + boost::lexical_cast< std::string >( size ) == reply ) {
+            int out( open( destination.string().c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644 ) );
+
+            if ( -1 != out ) {
+                char buffer[ BUFFER_SIZE ];
+                uintmax_t received( 0 );
+                ssize_t n;
+
+                while ( received < size && 0 < ( n = reader.read( buffer, std::min< uintmax_t >( size - received, BUFFER_SIZE ) ) ) ) {
+                    if ( !write_all( out, buffer, n ) ) {
+                        break;
+                    }
+
+                    received += n;
+                }
+
+                success = !close( out ) && received == size;
+
+                if ( !success ) {
+                    // Never leave a truncated file behind in the cache
+                    unlink( destination.string().c_str() );
+                }
+            }
+        }
+
+        close( fd );
+
+        return success;
+    }
+
+
+    WriteBackClient::WriteBackClient( const std::string& server, const std::string& codec )
+        : codecName_( codec ), codec_( CompressionPolicy::codec_from_name( codec ) )
+    {
+        std::string::size_type colon( server.rfind( ':' ) );
+
+        if ( std::string::npos != colon ) {
+            host_ = server.substr( 0, colon );
+            port_ = server.substr( colon + 1 );
+        }
+    }
+
+
+    bool WriteBackClient::valid() const
+    {
+        return !host_.empty() && !port_.empty() && CODEC_NONE != codec_;
+    }
+
+
+    bool WriteBackClient::store( const fs::path& source, const fs::path& destination, bool overwrite ) const
+    {
+        if ( !valid() ) {
+            return false;
+        }
+
+        int in( open( source.string().c_str(), O_RDONLY ) );
+
+        if ( -1 == in ) {
+            return false;
+        }
+
+        struct stat stats;
+        int fd( fstat( in, &stats ) ? -1 : connect_to( host_, port_ ) );
+
+        if ( -1 == fd ) {
+            close( in );
+            return false;
+        }
+
+        std::ostringstream request;
+        request << "STORE " << codecName_ << ' ' << stats.st_size << ' ' << overwrite << ' ' << destination.string() << '\n';
+
+        LineReader reader( fd );
+        std::string reply;
+
+        bool success( send_all( fd, request.str() ) && reader.line( reply ) && "GO" == reply );
+
+        std::vector< char > block( BLOCK_SIZE );
+        std::string compressed;
+
+        while ( success ) {
+            ssize_t n;
+
+            do {
+                n = read( in, &block[ 0 ], BLOCK_SIZE );
+            } while ( -1 == n && EINTR == errno );
+
+            if ( -1 == n ) {
+                success = false;
+                break;
+            }
+
+            boost::uint32_t lengths[ 2 ] = { htonl( n ), htonl( n ) };
+            const char* data( &block[ 0 ] );
+
+            // Already compressed data (e.g. zip compressed EXRs) goes over the wire as it is
+            if ( n && compress_block( codec_, &block[ 0 ], n, compressed ) && compressed.size() < ( size_t )n ) {
+                lengths[ 1 ] = htonl( compressed.size() );
+                data = compressed.data();
+            }
+
+            success = send_all( fd, ( const char* )lengths, sizeof( lengths ) ) &&
+                      send_all( fd, data, ntohl( lengths[ 1 ] ) );
+
+            // The empty block ends the stream
+            if ( !n ) {
+                break;
+            }
+        }
+
+        success = success && reader.line( reply ) && "OK" == reply;
+
+        close( fd );
+        close( in );
+
+        return success;
+    }
+
+
+} // namespace Jupiter
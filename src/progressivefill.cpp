@@ -0,0 +1,295 @@
+/**@file
+ *
+ * Cache entries readable while they are being filled.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010  Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+// Own headers
+#include <progressivefill.hpp>
+
+// Standard headers
+#include <algorithm> // min()
+#include <cstdio> // rename()
+
+// System headers
+#include <errno.h> // errno
+#include <fcntl.h> // open()
+#include <unistd.h> // pread(), pwrite(), close(), unlink()
+
+// Boost headers
+#include <boost/bind.hpp>
+
+
+namespace Jupiter {
+
+
+    namespace {
+
+        bool pread_all( int fd, char* buffer, size_t size, off_t offset )
+        {
+            while ( size ) {
+                ssize_t n( pread( fd, buffer, size, offset ) );
+
+                if ( -1 == n && EINTR == errno ) {
+                    continue;
+                }
+
+                if ( n <= 0 ) {
+                    return false;
+                }
+
+                buffer += n;
+                size -= n;
+                offset += n;
+            }
+
+            return true;
+        }
+
+
+        bool pwrite_all( int fd, const char* buffer, size_t size, off_t offset )
+        {
+            while ( size ) {
+                ssize_t n( pwrite( fd, buffer, size, offset ) );
+
+                if ( -1 == n && EINTR == errno ) {
+                    continue;
+                }
+
+                if ( n <= 0 ) {
+                    return false;
+                }
+
+                buffer += n;
+                size -= n;
+                offset += n;
+            }
+
+            return true;
+        }
+
+
+        /**
+         * Reads a fill, keeping it alive.
+         *
+         */
+        class FillReader : public SourceFile {
+            public:
+                FillReader( const boost::shared_ptr< ProgressiveFill >& fill ) : fill_( fill ) {}
+
+                virtual std::streamsize read( uintmax_t offset, char* buffer, std::size_t size ) {
+                    return fill_->read( offset, buffer, size );
+                }
+
+            private:
+                boost::shared_ptr< ProgressiveFill > fill_;
+        };
+
+    } // anonymous namespace
+
+
+    ProgressiveFill::ProgressiveFill( SourceFile* source, uintmax_t size, const fs::path& partial, const fs::path& destination )
+        : source_( source ), size_( size ), partial_( partial ), destination_( destination ),
+          fd_( open( partial.string().c_str(), O_RDWR | O_CREAT | O_EXCL, 0644 ) ),
+          present_( ( size + BLOCK_SIZE - 1 ) / BLOCK_SIZE, false ), missing_( present_.size() ), next_( 0 ),
+          finished_( false ), complete_( false ), stop_( false ),
+          thread_( boost::bind( &ProgressiveFill::run, this ) )
+    {
+    }
+
+
+    ProgressiveFill::~ProgressiveFill()
+    {
+        {
+            boost::mutex::scoped_lock lock( mutex_ );
+
+            stop_ = true;
+        }
+
+        thread_.join();
+
+        if ( -1 != fd_ ) {
+            close( fd_ );
+        }
+    }
+
+
+    std::streamsize ProgressiveFill::read( uintmax_t offset, char* buffer, std::size_t size )
+    {
+        if ( offset >= size_ ) {
+            return 0;
+        }
+
+        std::size_t length( std::min< uintmax_t >( size, size_ - offset ) );
+
+        if ( !length ) {
+            return 0;
+        }
+
+        boost::uint32_t first( offset / BLOCK_SIZE ), last( ( offset + length - 1 ) / BLOCK_SIZE );
+
+        {
+            boost::mutex::scoped_lock lock( mutex_ );
+
+            if ( !is_present( first, last ) ) {
+                // Ahead of whatever was wanted before, first block first
+                for ( boost::uint32_t block( last + 1 ); block-- > first; ) {
+                    if ( !present_[ block ] ) {
+                        wanted_.push_front( block );
+                    }
+                }
+
+                while ( !finished_ && !is_present( first, last ) ) {
+                    filled_.wait( lock );
+                }
+
+                if ( !is_present( first, last ) ) {
+                    return -1;
+                }
+            }
+        }
+
+        return pread_all( fd_, buffer, length, offset ) ? ( std::streamsize )length : -1;
+    }
+
+
+    bool ProgressiveFill::wait()
+    {
+        boost::mutex::scoped_lock lock( mutex_ );
+
+        while ( !finished_ ) {
+            filled_.wait( lock );
+        }
+
+        return complete_;
+    }
+
+
+    bool ProgressiveFill::finished() const
+    {
+        boost::mutex::scoped_lock lock( mutex_ );
+
+        return finished_;
+    }
+
+
+    SourceFile* ProgressiveFill::reader( const boost::shared_ptr< ProgressiveFill >& fill )
+    {
+        return new FillReader( fill );
+    }
+
+
+    /**
+     * Choose the block to copy next: one a reader waits for, else the next missing one
+     *
+     */
+    bool ProgressiveFill::next_block( boost::uint32_t& block )
+    {
+        while ( !wanted_.empty() ) {
+            block = wanted_.front();
+            wanted_.pop_front();
+
+            if ( !present_[ block ] ) {
+                next_ = block + 1;
+                return true;
+            }
+        }
+
+        for ( std::size_t i( 0 ); i < present_.size(); ++i ) {
+            block = ( next_ + i ) % present_.size();
+
+            if ( !present_[ block ] ) {
+                next_ = block + 1;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+
+    bool ProgressiveFill::is_present( boost::uint32_t first, boost::uint32_t last ) const
+    {
+        for ( boost::uint32_t block( first ); block <= last; ++block ) {
+            if ( !present_[ block ] ) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+
+    void ProgressiveFill::run()
+    {
+        std::vector< char > buffer( BLOCK_SIZE );
+        bool success( -1 != fd_ );
+
+        while ( success ) {
+            boost::uint32_t block;
+
+            {
+                boost::mutex::scoped_lock lock( mutex_ );
+
+                if ( stop_ || !next_block( block ) ) {
+                    break;
+                }
+            }
+
+            uintmax_t offset( ( uintmax_t )block * BLOCK_SIZE );
+            std::size_t length( std::min< uintmax_t >( BLOCK_SIZE, size_ - offset ) );
+
+            success = ( std::streamsize )length == source_->read( offset, &buffer[ 0 ], length ) &&
+                      pwrite_all( fd_, &buffer[ 0 ], length, offset );
+
+            if ( success ) {
+                {
+                    boost::mutex::scoped_lock lock( mutex_ );
+
+                    present_[ block ] = true;
+                    --missing_;
+                }
+
+                filled_.notify_all();
+            }
+        }
+
+        // The original isn't needed any more, readers keep using the descriptor
+        source_.reset();
+
+        boost::mutex::scoped_lock lock( mutex_ );
+
+        complete_ = success && !missing_ && !rename( partial_.string().c_str(), destination_.string().c_str() );
+
+        // A partial file that couldn't be created isn't ours
+        if ( !complete_ && -1 != fd_ ) {
+            unlink( partial_.string().c_str() );
+        }
+
+        finished_ = true;
+        filled_.notify_all();
+    }
+
+
+} // namespace Jupiter
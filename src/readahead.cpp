@@ -0,0 +1,200 @@
+/**@file
+ *
+ * Predicting and prefetching the next files of a sequence.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010  Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+// Own headers
+#include <readahead.hpp>
+
+// Standard headers
+#include <cctype> // isdigit()
+#include <cstdlib> // strtol(), labs()
+#include <cstdio> // snprintf()
+
+// Boost headers
+#include <boost/bind.hpp>
+
+
+namespace Jupiter {
+
+
+    SequencePredictor::SequencePredictor( unsigned depth )
+        : depth_( depth ), requests_( 0 )
+    {
+    }
+
+
+    void SequencePredictor::observe( const fs::path& file, std::vector< fs::path >& predicted )
+    {
+        predicted.clear();
+
+        std::string name( file.leaf() );
+        std::string::size_type end( name.size() );
+
+        while ( end && !isdigit( ( unsigned char )name[ end - 1 ] ) ) {
+            --end;
+        }
+
+        std::string::size_type start( end );
+
+        while ( start && isdigit( ( unsigned char )name[ start - 1 ] ) ) {
+            --start;
+        }
+
+        // No number, or too long to be a frame
+        if ( start == end || end - start > 9 ) {
+            return;
+        }
+
+        long frame( strtol( name.substr( start, end - start ).c_str(), 0, 10 ) );
+        int width( '0' == name[ start ] ? end - start : 0 );
+
+        std::string prefix( file.branch_path().string() + "/" + name.substr( 0, start ) );
+        std::string suffix( name.substr( end ) );
+        std::string key( prefix + '\0' + suffix );
+
+        ++requests_;
+
+        Sequences::iterator it( sequences_.find( key ) );
+
+        if ( sequences_.end() == it ) {
+            if ( sequences_.size() >= MAX_SEQUENCES ) {
+                forget_oldest();
+            }
+
+            Sequence sequence;
+            sequence.frame = frame;
+            sequence.stride = 0;
+            sequence.age = requests_;
+
+            sequences_[ key ] = sequence;
+            return;
+        }
+
+        Sequence& sequence( it->second );
+        long stride( frame - sequence.frame );
+        bool confirmed( stride && ( stride == sequence.stride || ( !sequence.stride && 1 == labs( stride ) ) ) );
+
+        sequence.frame = frame;
+        sequence.stride = stride;
+        sequence.age = requests_;
+
+        if ( !confirmed ) {
+            return;
+        }
+
+        for ( unsigned i( 1 ); i <= depth_; ++i ) {
+            long next( frame + stride * ( long )i );
+
+            if ( next < 0 ) {
+                break;
+            }
+
+            char number[ 32 ];
+            snprintf( number, sizeof( number ), "%0*ld", width, next );
+
+            predicted.push_back( fs::path( prefix + number + suffix ) );
+        }
+    }
+
+
+    void SequencePredictor::forget_oldest()
+    {
+        Sequences::iterator oldest( sequences_.begin() );
+
+        for ( Sequences::iterator it( sequences_.begin() ); it != sequences_.end(); ++it ) {
+            if ( it->second.age < oldest->second.age ) {
+                oldest = it;
+            }
+        }
+
+        if ( sequences_.end() != oldest ) {
+            sequences_.erase( oldest );
+        }
+    }
+
+
+    Prefetcher::Prefetcher( const Job& job )
+        : job_( job ), stop_( false ), thread_( boost::bind( &Prefetcher::run, this ) )
+    {
+    }
+
+
+    Prefetcher::~Prefetcher()
+    {
+        {
+            boost::mutex::scoped_lock lock( mutex_ );
+
+            stop_ = true;
+        }
+
+        wakeUp_.notify_one();
+        thread_.join();
+    }
+
+
+    void Prefetcher::enqueue( const fs::path& file )
+    {
+        {
+            boost::mutex::scoped_lock lock( mutex_ );
+
+            if ( queue_.size() >= MAX_QUEUED || !queued_.insert( file ).second ) {
+                return;
+            }
+
+            queue_.push_back( file );
+        }
+
+        wakeUp_.notify_one();
+    }
+
+
+    void Prefetcher::run()
+    {
+        for ( ;; ) {
+            fs::path file;
+
+            {
+                boost::mutex::scoped_lock lock( mutex_ );
+
+                while ( !stop_ && queue_.empty() ) {
+                    wakeUp_.wait( lock );
+                }
+
+                if ( stop_ ) {
+                    return;
+                }
+
+                file = queue_.front();
+                queue_.pop_front();
+                queued_.erase( file );
+            }
+
+            job_( file );
+        }
+    }
+
+
+} // namespace Jupiter
@@ -0,0 +1,79 @@
+/**@file
+ *
+ * Periodic background checks of cache entries against their originals.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010  Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+// Own headers
+#include <revalidator.hpp>
+
+// Boost headers
+#include <boost/bind.hpp>
+#include <boost/thread/thread_time.hpp> // get_system_time()
+
+
+namespace Jupiter {
+
+
+    Revalidator::Revalidator( const Job& job, unsigned interval )
+        : job_( job ), interval_( interval ), stop_( false ), thread_( boost::bind( &Revalidator::run, this ) )
+    {
+    }
+
+
+    Revalidator::~Revalidator()
+    {
+        {
+            boost::mutex::scoped_lock lock( mutex_ );
+
+            stop_ = true;
+        }
+
+        wakeUp_.notify_one();
+        thread_.join();
+    }
+
+
+    void Revalidator::run()
+    {
+        for ( ;; ) {
+            {
+                boost::mutex::scoped_lock lock( mutex_ );
+
+                boost::system_time due( boost::get_system_time() + boost::posix_time::seconds( interval_ ) );
+
+                while ( !stop_ && wakeUp_.timed_wait( lock, due ) ) {
+                }
+
+                if ( stop_ ) {
+                    return;
+                }
+            }
+
+            job_();
+        }
+    }
+
+
+} // namespace Jupiter
@@ -0,0 +1,130 @@
+/**@file
+ *
+ * Per-thread scratch memory for the temporaries of a request.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010  Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+// Own headers
+#include <scratcharena.hpp>
+
+// Standard headers
+#include <algorithm> // max()
+
+// System headers
+#include <pthread.h> // pthread_key_create(), pthread_once()
+
+
+namespace Jupiter {
+
+
+    namespace {
+
+        __thread ScratchArena* ownArena( 0 );
+
+        pthread_key_t arenaKey;
+        pthread_once_t arenaKeyOnce = PTHREAD_ONCE_INIT;
+
+
+        void delete_arena( void* arena )
+        {
+            delete static_cast< ScratchArena* >( arena );
+        }
+
+
+        void create_arena_key()
+        {
+            pthread_key_create( &arenaKey, delete_arena );
+        }
+
+    } // anonymous namespace
+
+
+    ScratchArena::Scope::Scope()
+        : arena_( ScratchArena::local() ), block_( arena_.block_ ), used_( arena_.used_ )
+    {
+    }
+
+
+    ScratchArena::Scope::~Scope()
+    {
+        arena_.block_ = block_;
+        arena_.used_ = used_;
+    }
+
+
+    ScratchArena& ScratchArena::local()
+    {
+        if ( !ownArena ) {
+            ownArena = new ScratchArena;
+
+            // Freed when the thread exits
+            pthread_once( &arenaKeyOnce, create_arena_key );
+            pthread_setspecific( arenaKey, ownArena );
+        }
+
+        return *ownArena;
+    }
+
+
+    char* ScratchArena::allocate( std::size_t size )
+    {
+        // Keep allocations aligned for anything
+        size = ( size + sizeof( double ) - 1 ) & ~( sizeof( double ) - 1 );
+
+        while ( block_ < blocks_.size() && used_ + size > blocks_[ block_ ].size ) {
+            ++block_;
+            used_ = 0;
+        }
+
+        if ( block_ == blocks_.size() ) {
+            Block block;
+            block.size = std::max< std::size_t >( BLOCK_SIZE, size );
+            block.data = new char[ block.size ];
+
+            blocks_.push_back( block );
+            used_ = 0;
+        }
+
+        char* result( blocks_[ block_ ].data + used_ );
+        used_ += size;
+
+        return result;
+    }
+
+
+    ScratchArena::ScratchArena()
+        : block_( 0 ), used_( 0 )
+    {
+    }
+
+
+    ScratchArena::~ScratchArena()
+    {
+        for ( std::vector< Block >::iterator it( blocks_.begin() ); it != blocks_.end(); ++it ) {
+            delete[] it->data;
+        }
+    }
+
+
+} // namespace Jupiter
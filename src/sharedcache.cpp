@@ -0,0 +1,259 @@
+/**@file
+ *
+ * A process-wide cache engine per location that plugins attach to.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010  Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+// Own headers
+#include <sharedcache.hpp>
+
+// Standard headers
+#include <algorithm> // lower_bound()
+#include <cstring> // strcmp()
+#include <functional> // less
+#include <map>
+
+// Boost headers
+#include <boost/thread/mutex.hpp>
+#include <boost/weak_ptr.hpp>
+
+
+namespace Jupiter {
+
+
+    /**
+     * A location's cache and the pins of all its attachments
+     *
+     */
+    struct SharedCache::Engine {
+        FileCache cache;
+
+        // Guards everything below; caching runs without it
+        boost::mutex mutex;
+
+        // Attachments pinning each interned path
+        std::map< const char*, unsigned > pins;
+
+        // Counts releases. A cacheFile() call that overlapped the release
+        // of the file it is about to pin caches it again, since the
+        // release may have dropped it from the inventory after the call
+        // put it there
+        unsigned long releases;
+        std::map< const char*, unsigned long > released;    ///< The last release of each path, while calls run
+        std::multiset< unsigned long > calls;               ///< The releases when each running call started
+
+        Engine( const std::string& location ) : cache( location ), releases( 0 ) {}
+    };
+
+
+    namespace {
+
+        typedef std::less< const char* > AddressLess;
+
+        struct Registry {
+            boost::mutex mutex;
+            std::map< std::string, boost::weak_ptr< SharedCache::Engine > > engines;
+        };
+
+        /**
+         * The process's engines, by location.
+         *
+         * Never destroyed: attachments living in other static objects may
+         * detach after this translation unit's statics are gone.
+         */
+        Registry& registry()
+        {
+            static Registry* registry( new Registry );
+
+            return *registry;
+        }
+
+    } // anonymous namespace
+
+
+    SharedCache::SharedCache( const std::string& location )
+    {
+        Registry& shared( registry() );
+        boost::mutex::scoped_lock lock( shared.mutex );
+
+        boost::weak_ptr< Engine >& engine( shared.engines[ location ] );
+        engine_ = engine.lock();
+
+        if ( !engine_ ) {
+            engine_.reset( new Engine( location ) );
+            engine = engine_;
+        }
+    }
+
+
+    SharedCache::~SharedCache()
+    {
+        boost::mutex::scoped_lock lock( engine_->mutex );
+
+        for ( std::vector< const char* >::const_iterator it( pins_.begin() ); it != pins_.end(); ++it ) {
+            unpin( *it );
+        }
+    }
+
+
+    const char* SharedCache::cacheFile( const char* toCache )
+    {
+        boost::mutex::scoped_lock lock( engine_->mutex );
+
+        const char* cached;
+
+        for ( ; ; ) {
+            std::multiset< unsigned long >::iterator call( engine_->calls.insert( engine_->releases ) );
+
+            // Copies must not hold up the other attachments
+            lock.unlock();
+
+            try {
+                cached = engine_->cache.cacheFileInterned( toCache );
+            } catch ( ... ) {
+                lock.lock();
+                finish( call );
+                throw;
+            }
+
+            lock.lock();
+
+            unsigned long started( *call );
+            finish( call );
+
+            if ( cached == toCache ) {
+                return toCache;
+            }
+
+            // Pinned files stay in the inventory; others may have been released while we cached them
+            std::map< const char*, unsigned long >::const_iterator released( engine_->released.find( cached ) );
+
+            if ( engine_->pins.count( cached ) || engine_->released.end() == released || released->second <= started ) {
+                break;
+            }
+        }
+
+        std::vector< const char* >::iterator it( std::lower_bound( pins_.begin(), pins_.end(), cached, AddressLess() ) );
+
+        if ( pins_.end() == it || *it != cached ) {
+            pins_.insert( it, cached );
+            ++engine_->pins[ cached ];
+        }
+
+        return cached;
+    }
+
+
+    void SharedCache::releaseFile( const char* path )
+    {
+        std::vector< const char* >::iterator it( std::lower_bound( pins_.begin(), pins_.end(), path, AddressLess() ) );
+
+        if ( pins_.end() == it || *it != path ) {
+            // Not the interned pointer -- a copy of it
+            for ( it = pins_.begin(); it != pins_.end() && strcmp( *it, path ); ++it ) {
+            }
+
+            if ( pins_.end() == it ) {
+                return;
+            }
+        }
+
+        boost::mutex::scoped_lock lock( engine_->mutex );
+
+        unpin( *it );
+        pins_.erase( it );
+    }
+
+
+    std::size_t SharedCache::pinned() const
+    {
+        return pins_.size();
+    }
+
+
+    FileCache& SharedCache::engine() const
+    {
+        return engine_->cache;
+    }
+
+
+    std::size_t SharedCache::engines()
+    {
+        Registry& shared( registry() );
+        boost::mutex::scoped_lock lock( shared.mutex );
+
+        std::size_t count( 0 );
+
+        for ( std::map< std::string, boost::weak_ptr< Engine > >::const_iterator it( shared.engines.begin() ); it != shared.engines.end(); ++it ) {
+            if ( !it->second.expired() ) {
+                ++count;
+            }
+        }
+
+        return count;
+    }
+
+
+    /**
+     * Drop one pin on a path, with the engine's lock held
+     *
+     * A path nobody pins anymore is released right away.
+     *
+     */
+    void SharedCache::unpin( const char* path )
+    {
+        std::map< const char*, unsigned >::iterator it( engine_->pins.find( path ) );
+
+        if ( engine_->pins.end() == it || --it->second ) {
+            return;
+        }
+
+        engine_->pins.erase( it );
+        engine_->cache.releaseFile( std::string( path ) );
+
+        ++engine_->releases;
+
+        // Only calls running now can have cached the file before this
+        if ( !engine_->calls.empty() ) {
+            engine_->released[ path ] = engine_->releases;
+        }
+    }
+
+
+    /**
+     * End a cacheFile() call, with the engine's lock held
+     *
+     */
+    void SharedCache::finish( std::multiset< unsigned long >::iterator call )
+    {
+        engine_->calls.erase( call );
+
+        // Releases older than every running call can't race any of them
+        if ( engine_->calls.empty() ) {
+            engine_->released.clear();
+        }
+    }
+
+
+} // namespace Jupiter
@@ -0,0 +1,479 @@
+/**@file
+ *
+ * Where the cache gets the originals of cached files from.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010  Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+// Own headers
+#include <sourcebackend.hpp>
+#include <blockdelta.hpp>
+
+// Standard headers
+#include <algorithm> // max()
+#include <cstring> // memcpy(), strncmp(), strrchr()
+
+// System headers
+#include <errno.h> // errno
+#include <fcntl.h> // open()
+#include <limits.h> // PATH_MAX
+#include <sys/stat.h> // stat()
+#include <sys/statvfs.h> // statvfs()
+#include <unistd.h> // pread(), close(), usleep()
+
+// Boost headers
+#include <boost/filesystem.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/tokenizer.hpp>
+
+// superblock magic number for NFS -- see filecache.cpp
+#ifndef NFS_SUPER_MAGIC
+#define NFS_SUPER_MAGIC       0x00006969
+#endif
+
+
+namespace Jupiter {
+
+
+    namespace {
+
+        enum {
+            COPY_BLOCK_SIZE = 1048576
+        };
+
+        class LocalFile : public SourceFile {
+            public:
+                LocalFile( int fd ) : fd_( fd ) {}
+
+                virtual ~LocalFile() {
+                    close( fd_ );
+                }
+
+                virtual std::streamsize read( uintmax_t offset, char* buffer, std::size_t size ) {
+                    std::streamsize done( 0 );
+
+                    while ( done < ( std::streamsize )size ) {
+                        ssize_t n( pread( fd_, buffer + done, size - done, offset + done ) );
+
+                        if ( -1 == n && EINTR == errno ) {
+                            continue;
+                        }
+
+                        if ( -1 == n ) {
+                            return -1;
+                        }
+
+                        if ( !n ) {
+                            break;
+                        }
+
+                        done += n;
+                    }
+
+                    return done;
+                }
+
+            private:
+                int fd_;
+        };
+
+    } // anonymous namespace
+
+
+    SourceFile::~SourceFile()
+    {
+    }
+
+
+    SourceBackend::~SourceBackend()
+    {
+    }
+
+
+    bool SourceBackend::handles( const char* path ) const
+    {
+        return handles( fs::path( path, fs::no_check ) );
+    }
+
+
+    bool SourceBackend::stat( const char* path, SourceStats& stats ) const
+    {
+        return stat( fs::path( path, fs::no_check ), stats );
+    }
+
+
+    bool SourceBackend::copy( const fs::path& path, const fs::path& destination ) const
+    {
+        boost::scoped_ptr< SourceFile > file( open( path ) );
+
+        if ( !file ) {
+            return false;
+        }
+
+        int out( ::open( destination.string().c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644 ) );
+
+        if ( -1 == out ) {
+            return false;
+        }
+
+        std::vector< char > block( COPY_BLOCK_SIZE );
+        uintmax_t offset( 0 );
+        std::streamsize n;
+        bool success( true );
+
+        while ( success && 0 < ( n = file->read( offset, &block[ 0 ], block.size() ) ) ) {
+            for ( std::streamsize written( 0 ); success && written < n; ) {
+                ssize_t w( write( out, &block[ written ], n - written ) );
+
+                if ( -1 == w && EINTR == errno ) {
+                    continue;
+                }
+
+                success = 0 < w;
+                written += w;
+            }
+
+            offset += n;
+        }
+
+        if ( close( out ) || !success || n < 0 ) {
+            unlink( destination.string().c_str() );
+            return false;
+        }
+
+        return true;
+    }
+
+
+    bool SourceBackend::checksums( const fs::path& path, boost::uint32_t blockSize, BlockSums& sums ) const
+    {
+        return false;
+    }
+
+
+    bool SourceBackend::checksummed() const
+    {
+        return false;
+    }
+
+
+    bool SourceBackend::direct() const
+    {
+        return false;
+    }
+
+
+    LocalBackend::LocalBackend( const std::string& directories )
+    {
+        typedef boost::tokenizer< boost::char_separator< char > > Tokenizer;
+
+        boost::char_separator< char > separators( ":" );
+        Tokenizer tokens( directories, separators );
+
+        for ( Tokenizer::iterator it( tokens.begin() ); it != tokens.end(); ++it ) {
+            std::string directory( *it );
+
+            if ( '/' != directory[ directory.size() - 1 ] ) {
+                directory += '/';
+            }
+
+            directories_.push_back( directory );
+        }
+    }
+
+
+    bool LocalBackend::handles( const fs::path& path ) const
+    {
+        return handles( path.string().c_str() );
+    }
+
+
+    bool LocalBackend::handles( const char* path ) const
+    {
+        for ( std::vector< std::string >::const_iterator it( directories_.begin() ); it != directories_.end(); ++it ) {
+            // The directory itself counts too, so it can be listed
+            if ( 0 == strncmp( path, it->c_str(), it->size() ) || 0 == it->compare( 0, it->size() - 1, path ) ) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+
+    bool LocalBackend::stat( const fs::path& path, SourceStats& stats ) const
+    {
+        return stat( path.string().c_str(), stats );
+    }
+
+
+    bool LocalBackend::stat( const char* path, SourceStats& stats ) const
+    {
+        struct stat s;
+
+        if ( ::stat( path, &s ) ) {
+            return false;
+        }
+
+        stats.size = s.st_size;
+        stats.mtime = s.st_mtime;
+        stats.directory = S_ISDIR( s.st_mode );
+
+        return true;
+    }
+
+
+    SourceFile* LocalBackend::open( const fs::path& path ) const
+    {
+        int fd( ::open( path.string().c_str(), O_RDONLY ) );
+
+        return -1 == fd ? 0 : new LocalFile( fd );
+    }
+
+
+    bool LocalBackend::list( const fs::path& directory, std::vector< std::string >& names ) const
+    {
+        try {
+            fs::directory_iterator end;
+
+            for ( fs::directory_iterator it( directory ); it != end; ++it ) {
+                std::string name( it->path().leaf() );
+                names.push_back( name );
+            }
+        } catch ( fs::filesystem_error ) {
+            return false;
+        }
+
+        return true;
+    }
+
+
+    bool LocalBackend::copy( const fs::path& path, const fs::path& destination ) const
+    {
+        try {
+            // Fails if the destination exists
+            fs::copy_file( path, destination );
+        } catch ( fs::filesystem_error ) {
+            return false;
+        }
+
+        return true;
+    }
+
+
+    bool LocalBackend::checksums( const fs::path& path, boost::uint32_t blockSize, BlockSums& sums ) const
+    {
+        SourceStats stats;
+
+        if ( !stat( path, stats ) ) {
+            return false;
+        }
+
+        boost::scoped_ptr< SourceFile > file( open( path ) );
+
+        return file && sums.compute( *file, stats.size, blockSize );
+    }
+
+
+    bool LocalBackend::checksummed() const
+    {
+        return true;
+    }
+
+
+    bool LocalBackend::direct() const
+    {
+        return true;
+    }
+
+
+    bool NfsBackend::handles( const fs::path& path ) const
+    {
+        return handles( path.string().c_str() );
+    }
+
+
+    bool NfsBackend::handles( const char* path ) const
+    {
+        // The directory the file is in, without building a path
+        const char* slash( strrchr( path, '/' ) );
+        char directory[ PATH_MAX ];
+
+        if ( !slash || slash - path >= PATH_MAX ) {
+            return false;
+        }
+
+        memcpy( directory, path, slash - path );
+        directory[ slash - path ] = '\0';
+
+        // Check if the file is on a mounted location
+        struct statvfs stats;
+
+        if ( !statvfs( slash == path ? "/" : directory, &stats ) ) {
+            return NFS_SUPER_MAGIC == stats.f_fsid; // || ( SMB_SUPER_MAGIC == stats.f_type );
+        }
+
+        return false;
+    }
+
+
+    bool NfsBackend::checksums( const fs::path& path, boost::uint32_t blockSize, BlockSums& sums ) const
+    {
+        return false;
+    }
+
+
+    bool NfsBackend::checksummed() const
+    {
+        // Summing on the client would read the whole file over the mount
+        return false;
+    }
+
+
+    class ThrottledBackend::File : public SourceFile {
+        public:
+            File( const ThrottledBackend& backend, SourceFile* file ) : backend_( backend ), file_( file ) {}
+
+            virtual std::streamsize read( uintmax_t offset, char* buffer, std::size_t size ) {
+                backend_.wait();
+
+                std::streamsize n( file_->read( offset, buffer, size ) );
+
+                if ( 0 < n ) {
+                    backend_.transfer( n );
+                }
+
+                return n;
+            }
+
+        private:
+            const ThrottledBackend& backend_;
+            boost::scoped_ptr< SourceFile > file_;
+    };
+
+
+    ThrottledBackend::ThrottledBackend( const boost::shared_ptr< SourceBackend >& backend, double latency, double bandwidth )
+        : backend_( backend ), latency_( latency ), bandwidth_( bandwidth ), linkBusyUntil_( 0 )
+    {
+    }
+
+
+    bool ThrottledBackend::handles( const fs::path& path ) const
+    {
+        return backend_->handles( path );
+    }
+
+
+    bool ThrottledBackend::handles( const char* path ) const
+    {
+        return backend_->handles( path );
+    }
+
+
+    bool ThrottledBackend::stat( const fs::path& path, SourceStats& stats ) const
+    {
+        wait();
+
+        return backend_->stat( path, stats );
+    }
+
+
+    bool ThrottledBackend::stat( const char* path, SourceStats& stats ) const
+    {
+        wait();
+
+        return backend_->stat( path, stats );
+    }
+
+
+    SourceFile* ThrottledBackend::open( const fs::path& path ) const
+    {
+        wait();
+
+        SourceFile* file( backend_->open( path ) );
+
+        return file ? new File( *this, file ) : 0;
+    }
+
+
+    bool ThrottledBackend::list( const fs::path& directory, std::vector< std::string >& names ) const
+    {
+        wait();
+
+        return backend_->list( directory, names );
+    }
+
+
+    bool ThrottledBackend::checksums( const fs::path& path, boost::uint32_t blockSize, BlockSums& sums ) const
+    {
+        wait();
+
+        // Computed on the far side, only the checksums cross the link
+        if ( !backend_->checksums( path, blockSize, sums ) ) {
+            return false;
+        }
+
+        transfer( sums.sums.size() * sizeof( boost::uint64_t ) );
+
+        return true;
+    }
+
+
+    bool ThrottledBackend::checksummed() const
+    {
+        return backend_->checksummed();
+    }
+
+
+    void ThrottledBackend::wait() const
+    {
+        if ( 0 < latency_ ) {
+            usleep( ( useconds_t )( latency_ * 1e6 ) );
+        }
+    }
+
+
+    void ThrottledBackend::transfer( uintmax_t bytes ) const
+    {
+        if ( 0 >= bandwidth_ ) {
+            return;
+        }
+
+        double done;
+
+        {
+            boost::mutex::scoped_lock lock( mutex_ );
+
+            linkBusyUntil_ = std::max( linkBusyUntil_, clock_.seconds() ) + bytes / bandwidth_;
+            done = linkBusyUntil_;
+        }
+
+        double remaining( done - clock_.seconds() );
+
+        if ( 0 < remaining ) {
+            usleep( ( useconds_t )( remaining * 1e6 ) );
+        }
+    }
+
+
+} // namespace Jupiter
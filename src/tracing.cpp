@@ -0,0 +1,269 @@
+/**@file
+ *
+ * Low overhead tracing spans for the cache's internal steps.
+ *
+ * @par License:
+ * Copyright (C) 2007, 2010  Moritz Moeller
+ * @par
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later
+ * version.
+ * @par
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * @par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA or point your web browser to
+ * http://www.gnu.org/licenses/lgpl.txt
+ *
+ * @author Moritz Moeller (realritz@virtualritz.com)
+ *
+ */
+// Own headers
+#include <tracing.hpp>
+
+// Standard headers
+#include <fstream> // ofstream
+#include <vector>
+
+// System headers
+#include <pthread.h> // pthread_key_create(), pthread_once()
+#include <stdio.h> // rename()
+#include <sys/syscall.h> // SYS_gettid
+#include <sys/time.h> // gettimeofday()
+#include <time.h> // clock_gettime()
+#include <unistd.h> // syscall(), getpid(), unlink()
+
+// Boost headers
+#include <boost/algorithm/string/replace.hpp> // replace_all()
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/mutex.hpp>
+
+
+namespace Jupiter {
+
+
+    namespace {
+
+        struct Event {
+            const char* name;
+            boost::uint64_t start;
+            boost::uint64_t duration;
+            volatile boost::uint64_t sequence;  ///< Index of the span plus one, 0 while it is written
+        };
+
+        /**
+         * The spans of one thread. Only the owning thread writes to it.
+         */
+        struct Ring {
+            Ring* next;
+            volatile int owned;
+            long thread;
+            volatile boost::uint64_t head;  ///< Spans recorded so far
+            Event events[ SpanTracer::RING_SIZE ];
+        };
+
+        Ring* volatile rings( 0 );
+        __thread Ring* ownRing( 0 );
+
+        pthread_key_t ringKey;
+        pthread_once_t ringKeyOnce = PTHREAD_ONCE_INIT;
+
+        boost::mutex fileMutex;
+        std::string spanFile;
+
+
+        void release_ring( void* ring )
+        {
+            // The thread is gone, its spans stay until a new thread takes the ring over
+            __sync_lock_release( &static_cast< Ring* >( ring )->owned );
+        }
+
+
+        void create_ring_key()
+        {
+            pthread_key_create( &ringKey, release_ring );
+        }
+
+
+        Ring* this_thread_ring()
+        {
+            if ( ownRing ) {
+                return ownRing;
+            }
+
+            Ring* ring( rings );
+
+            while ( ring && __sync_lock_test_and_set( &ring->owned, 1 ) ) {
+                ring = ring->next;
+            }
+
+            if ( !ring ) {
+                ring = new Ring;
+                ring->owned = 1;
+                ring->head = 0;
+
+                for ( int i( 0 ); i < SpanTracer::RING_SIZE; ++i ) {
+                    ring->events[ i ].sequence = 0;
+                }
+
+                do {
+                    ring->next = rings;
+                } while ( !__sync_bool_compare_and_swap( &rings, ring->next, ring ) );
+            }
+
+            ring->thread = syscall( SYS_gettid );
+
+            pthread_once( &ringKeyOnce, create_ring_key );
+            pthread_setspecific( ringKey, ring );
+
+            ownRing = ring;
+
+            return ring;
+        }
+
+
+        /**
+         * Escape a string for JSON
+         */
+        std::string json_string( const char* value )
+        {
+            std::string result;
+
+            for ( ; *value; ++value ) {
+                if ( '"' == *value || '\\' == *value ) {
+                    result += '\\';
+                }
+
+                result += *value;
+            }
+
+            return result;
+        }
+
+    } // anonymous namespace
+
+
+    volatile bool SpanTracer::enabled_( false );
+
+
+    void SpanTracer::enable( const std::string& file )
+    {
+        boost::mutex::scoped_lock lock( fileMutex );
+
+        spanFile = file;
+        boost::algorithm::replace_all( spanFile, "%p", boost::lexical_cast< std::string >( getpid() ) );
+
+        enabled_ = !spanFile.empty();
+    }
+
+
+    void SpanTracer::record( const char* name, boost::uint64_t start, boost::uint64_t duration )
+    {
+        Ring* ring( this_thread_ring() );
+        boost::uint64_t index( ring->head );
+        Event& event( ring->events[ index % RING_SIZE ] );
+
+        // Readers skip the slot while it is rewritten
+        event.sequence = 0;
+        __sync_synchronize();
+
+        event.name = name;
+        event.start = start;
+        event.duration = duration;
+        __sync_synchronize();
+
+        event.sequence = index + 1;
+        ring->head = index + 1;
+    }
+
+
+    void SpanTracer::write( std::ostream& out )
+    {
+        long pid( getpid() );
+        bool first( true );
+
+        out << "{\"traceEvents\":[";
+
+        for ( Ring* ring( rings ); ring; ring = ring->next ) {
+            boost::uint64_t head( ring->head );
+            boost::uint64_t tail( head > RING_SIZE ? head - RING_SIZE : 0 );
+
+            for ( boost::uint64_t i( tail ); i < head; ++i ) {
+                const Event& slot( ring->events[ i % RING_SIZE ] );
+
+                boost::uint64_t sequence( slot.sequence );
+                __sync_synchronize();
+
+                Event event;
+                event.name = slot.name;
+                event.start = slot.start;
+                event.duration = slot.duration;
+                __sync_synchronize();
+
+                if ( sequence != i + 1 || slot.sequence != sequence ) {
+                    // Overwritten while we read it
+                    continue;
+                }
+
+                out << ( first ? "\n" : ",\n" )
+                    << "{\"name\":\"" << json_string( event.name ) << "\",\"cat\":\"filecache\",\"ph\":\"X\""
+                    << ",\"ts\":" << event.start << ",\"dur\":" << event.duration
+                    << ",\"pid\":" << pid << ",\"tid\":" << ring->thread << "}";
+
+                first = false;
+            }
+        }
+
+        out << "\n]}\n";
+    }
+
+
+    bool SpanTracer::dump()
+    {
+        boost::mutex::scoped_lock lock( fileMutex );
+
+        if ( spanFile.empty() ) {
+            return true;
+        }
+
+        // Write next to the file and rename so a viewer never loads half a dump
+        std::string partial( spanFile + ".partial" );
+        std::ofstream out( partial.c_str() );
+
+        write( out );
+        out.close();
+
+        if ( !out || rename( partial.c_str(), spanFile.c_str() ) ) {
+            unlink( partial.c_str() );
+            return false;
+        }
+
+        return true;
+    }
+
+
+    boost::uint64_t SpanTracer::now()
+    {
+#if defined( CLOCK_MONOTONIC )
+        struct timespec monotonic;
+
+        if ( !clock_gettime( CLOCK_MONOTONIC, &monotonic ) ) {
+            return ( boost::uint64_t )monotonic.tv_sec * 1000000 + monotonic.tv_nsec / 1000;
+        }
+#endif
+
+        struct timeval wall;
+        gettimeofday( &wall, 0 );
+
+        return ( boost::uint64_t )wall.tv_sec * 1000000 + wall.tv_usec;
+    }
+
+
+} // namespace Jupiter
@@ -5,24 +5,89 @@
 %module filecache
 %include "std_string.i"
 
-namespace filecache {
-class filecache {
+%{
+#include <filecache.hpp>
+#include <cacheclient.hpp>
+#include <cachestats.hpp>
+%}
+
+namespace Jupiter {
+struct LatencyHistogram {
+	unsigned long long count;
+	double        sum;
+
+	double        quantile( double ) const;
+};
+
+struct CacheStats {
+	unsigned long long hits;
+	unsigned long long misses;
+	unsigned long long stalePinned;
+	unsigned long long versions;
+	unsigned long long deltaRefreshes;
+	unsigned long long deltaSavedBytes;
+	unsigned long long progressiveFills;
+	unsigned long long revalidations;
+	unsigned long long refreshes;
+	unsigned long long admitted;
+	unsigned long long rejected;
+	unsigned long long bypassed;
+	unsigned long long backgroundCopies;
+	unsigned long long peerFetches;
+	unsigned long long bytesIn;
+	unsigned long long bytesOut;
+	unsigned long long evictions;
+	unsigned long long evictedBytes;
+	unsigned long long prefetches;
+	unsigned long long prefetchHits;
+	unsigned long long prefetchWasted;
+
+	LatencyHistogram cacheFileLatency;
+	LatencyHistogram copyLatency;
+	LatencyHistogram tidyLatency;
+
+	double        copyThroughput() const;
+};
+}
+
+// The default traits' instantiation, still called filecache in Python
+%rename(filecache) Jupiter::FileCache;
+
+namespace Jupiter {
+class FileCache {
 	public:
-		              filecache( bool = true );
-		              filecache( const char*, bool = true );
-		bool          operator==( const filecache& fc ) const;
-		             ~filecache();
+		              FileCache( bool = true );
+		              FileCache( const std::string&, bool = true );
+		bool          operator==( const FileCache& fc ) const;
+		             ~FileCache();
 
-		std::string   cacheFile( const char* toCache );
-		std::string   uncacheFile( const char*, bool = true, bool = false );
-		std::string   cacheFileForWriting( const char* toCache );
-		void          releaseFile( const char* );
+		std::string   cacheFile( const std::string& toCache );
+		std::string   uncacheFile( const std::string&, bool = true, bool = true );
+		std::string   cacheFileForWriting( const std::string& toCache );
+		void          releaseFile( const std::string& );
 
 		void          babble( bool );
-		void          relocate( const char* );
+		void          relocate( const std::string& );
 		void          resize( unsigned long );
 
 		unsigned long size() const;
 		std::string   location() const;
+
+		CacheStats    stats() const;
+};
+}
+
+namespace Jupiter {
+class CacheClient {
+	public:
+		              CacheClient( const std::string& = std::string() );
+		             ~CacheClient();
+
+		std::string   cacheFile( const std::string& toCache );
+		std::string   uncacheFile( const std::string&, bool = true, bool = true );
+		std::string   cacheFileForWriting( const std::string& toCache );
+		void          releaseFile( const std::string& );
+
+		bool          connected() const;
 };
 }